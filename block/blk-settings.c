@@ -507,6 +507,31 @@ void blk_queue_io_opt(struct request_queue *q, unsigned int opt)
 }
 EXPORT_SYMBOL(blk_queue_io_opt);
 
+/**
+ * blk_queue_writeback_hints - set writeback policy for a latency sensitive queue
+ * @q:          the request queue for the device
+ * @latency_us: target time for one background writeback chunk, 0 for none
+ * @defer_ms:   window to defer small, frequently rewritten inodes, 0 for none
+ *
+ * Description:
+ *   Devices on which large writes noticeably delay reads, or which wear
+ *   out with every write (flash), may ask the flusher to keep background
+ *   writeback chunks short enough to complete within @latency_us, and to
+ *   leave small files which are rewritten soon after every writeback
+ *   dirty for up to @defer_ms.  Both are also tunable in sysfs as
+ *   writeback_latency_us and writeback_defer_ms, and are capped at
+ *   WB_MAX_LATENCY_US and WB_MAX_DEFER_MS.
+ */
+void blk_queue_writeback_hints(struct request_queue *q,
+			       unsigned int latency_us, unsigned int defer_ms)
+{
+	q->backing_dev_info.wb_max_latency = min(latency_us,
+						 WB_MAX_LATENCY_US);
+	q->backing_dev_info.wb_defer_ms = min(defer_ms, WB_MAX_DEFER_MS);
+	q->backing_dev_info.wb_chunk = 0;
+}
+EXPORT_SYMBOL(blk_queue_writeback_hints);
+
 /**
  * blk_queue_stack_limits - inherit underlying queue limits for stacked drivers
  * @t:	the stacking driver (top)
@@ -94,6 +94,47 @@ queue_ra_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_wb_latency_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->backing_dev_info.wb_max_latency, page);
+}
+
+static ssize_t
+queue_wb_latency_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long latency_us;
+	ssize_t ret = queue_var_store(&latency_us, page, count);
+
+	if (ret < 0)
+		return ret;
+	if (latency_us > WB_MAX_LATENCY_US)
+		return -EINVAL;
+
+	blk_queue_writeback_hints(q, latency_us,
+				  q->backing_dev_info.wb_defer_ms);
+	return ret;
+}
+
+static ssize_t queue_wb_defer_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->backing_dev_info.wb_defer_ms, page);
+}
+
+static ssize_t
+queue_wb_defer_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long defer_ms;
+	ssize_t ret = queue_var_store(&defer_ms, page, count);
+
+	if (ret < 0)
+		return ret;
+	if (defer_ms > WB_MAX_DEFER_MS)
+		return -EINVAL;
+
+	q->backing_dev_info.wb_defer_ms = defer_ms;
+	return ret;
+}
+
 static ssize_t queue_max_sectors_show(struct request_queue *q, char *page)
 {
 	int max_sectors_kb = queue_max_sectors(q) >> 1;
@@ -297,6 +338,18 @@ static struct queue_sysfs_entry queue_ra_entry = {
 	.store = queue_ra_store,
 };
 
+static struct queue_sysfs_entry queue_wb_latency_entry = {
+	.attr = {.name = "writeback_latency_us", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_latency_show,
+	.store = queue_wb_latency_store,
+};
+
+static struct queue_sysfs_entry queue_wb_defer_entry = {
+	.attr = {.name = "writeback_defer_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_defer_show,
+	.store = queue_wb_defer_store,
+};
+
 static struct queue_sysfs_entry queue_max_sectors_entry = {
 	.attr = {.name = "max_sectors_kb", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_max_sectors_show,
@@ -407,6 +460,8 @@ static struct queue_sysfs_entry queue_random_entry = {
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
+	&queue_wb_latency_entry.attr,
+	&queue_wb_defer_entry.attr,
 	&queue_max_hw_sectors_entry.attr,
 	&queue_max_sectors_entry.attr,
 	&queue_max_segments_entry.attr,
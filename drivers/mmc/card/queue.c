@@ -32,6 +32,13 @@
  */
 #define DEFAULT_NUM_REQS_TO_START_PACK 17
 
+/*
+ * Keep background writeback from holding up reads for long, and avoid
+ * wearing the flash with repeated writeback of small rewritten files.
+ */
+#define MMC_WB_LATENCY_US	100000
+#define MMC_WB_DEFER_MS		5000
+
 /*
  * Prepare a MMC request. This just filters out odd stuff.
  */
@@ -295,6 +302,7 @@ void mmc_cmdq_setup_queue(struct mmc_queue *mq, struct mmc_card *card)
 		limit = *mmc_dev(host)->dma_mask;
 
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
+	blk_queue_writeback_hints(mq->queue, MMC_WB_LATENCY_US, MMC_WB_DEFER_MS);
 	if (mmc_can_erase(card))
 		mmc_queue_setup_discard(mq->queue, card);
 
@@ -371,6 +379,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
+	blk_queue_writeback_hints(mq->queue, MMC_WB_LATENCY_US, MMC_WB_DEFER_MS);
 	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, mq->queue);
 	if (mmc_can_erase(card))
 		mmc_queue_setup_discard(mq->queue, card);
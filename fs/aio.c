@@ -15,6 +15,7 @@
 #include <linux/errno.h>
 #include <linux/time.h>
 #include <linux/aio_abi.h>
+#include <linux/aio_ring.h>
 #include <linux/export.h>
 #include <linux/syscalls.h>
 #include <linux/backing-dev.h>
@@ -31,6 +32,8 @@
 #include <linux/timer.h>
 #include <linux/aio.h>
 #include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/poll.h>
 #include <linux/workqueue.h>
 #include <linux/security.h>
 #include <linux/eventfd.h>
@@ -40,6 +43,9 @@
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
 #include <linux/mount.h>
+#include <linux/kthread.h>
+#include <linux/vmalloc.h>
+#include <linux/sizes.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -67,6 +73,18 @@ struct aio_ring {
 
 #define AIO_RING_PAGES	8
 
+#define AIO_MAX_SQ_ENTRIES	4096
+#define AIO_MAX_FIXED_FILES	1024
+#define AIO_MAX_FIXED_BUFS	1024
+
+/* A buffer registered with io_setup2(), pinned for the context lifetime */
+struct aio_mapped_ubuf {
+	u64		ubuf;
+	size_t		len;
+	struct bio_vec	*bvec;
+	unsigned int	nr_bvecs;
+};
+
 struct kioctx_table {
 	struct rcu_head	rcu;
 	unsigned	nr;
@@ -149,6 +167,28 @@ struct kioctx {
 	struct file		*aio_ring_file;
 
 	unsigned		id;
+
+	/*
+	 * Submission ring, see io_setup2().  The SQ pages follow the
+	 * completion ring pages in aio_ring_file and are vmapped so the
+	 * submission path can read iocbs without copy_from_user().
+	 */
+	struct aio_sq_ring	*sq_ring;
+	unsigned		sq_entries;
+	unsigned		sq_first_page;
+	unsigned		sq_head;	/* private copy of sq_ring->head */
+	struct mutex		sq_lock;	/* serializes SQ consumers */
+	struct task_struct	*sq_thread;
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_thread_idle;	/* in jiffies */
+
+	/* Files and buffers registered with io_setup2() */
+	struct mm_struct	*mm;
+	struct file		**user_files;
+	unsigned		nr_user_files;
+	struct aio_mapped_ubuf	*user_bufs;
+	unsigned		nr_user_bufs;
+	unsigned long		nr_pinned;
 };
 
 /*------ sysctl variables----*/
@@ -160,6 +200,9 @@ unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio request
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
+/* Runs the parts of requests that would block the submitter */
+static struct workqueue_struct *aio_wq;
+
 static struct vfsmount *aio_mnt;
 
 static const struct file_operations aio_ring_fops;
@@ -237,6 +280,10 @@ static int __init aio_setup(void)
 	kiocb_cachep = KMEM_CACHE(kiocb, SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
+	aio_wq = alloc_workqueue("aio", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!aio_wq)
+		panic("Failed to create aio workqueue.");
+
 	pr_debug("sizeof(struct page) = %zu\n", sizeof(struct page));
 
 	return 0;
@@ -268,6 +315,11 @@ static void aio_free_ring(struct kioctx *ctx)
 	 */
 	put_aio_ring_file(ctx);
 
+	if (ctx->sq_ring) {
+		vunmap(ctx->sq_ring);
+		ctx->sq_ring = NULL;
+	}
+
 	for (i = 0; i < ctx->nr_pages; i++) {
 		struct page *page;
 		pr_debug("pid(%d) [%d] page->count=%d\n", current->pid, i,
@@ -325,8 +377,11 @@ static int aio_migratepage(struct address_space *mapping, struct page *new,
 
 	idx = old->index;
 	if (idx < (pgoff_t)ctx->nr_pages) {
+		/* The SQ pages are vmapped, leave them where they are */
+		if (ctx->sq_ring && idx >= ctx->sq_first_page)
+			rc = -EBUSY;
 		/* Make sure the old page hasn't already been changed */
-		if (ctx->ring_pages[idx] != old)
+		else if (ctx->ring_pages[idx] != old)
 			rc = -EAGAIN;
 	} else
 		rc = -EINVAL;
@@ -372,13 +427,13 @@ static const struct address_space_operations aio_ctx_aops = {
 #endif
 };
 
-static int aio_setup_ring(struct kioctx *ctx)
+static int aio_setup_ring(struct kioctx *ctx, unsigned sq_entries)
 {
 	struct aio_ring *ring;
 	unsigned nr_events = ctx->max_reqs;
 	struct mm_struct *mm = current->mm;
 	unsigned long size, unused;
-	int nr_pages;
+	int nr_pages, sq_pages = 0;
 	int i;
 	struct file *file;
 
@@ -392,6 +447,12 @@ static int aio_setup_ring(struct kioctx *ctx)
 	if (nr_pages < 0)
 		return -EINVAL;
 
+	if (sq_entries)
+		sq_pages = PFN_UP(sizeof(struct aio_sq_ring) +
+				  sizeof(struct iocb) * sq_entries);
+	ctx->sq_first_page = nr_pages;
+	nr_pages += sq_pages;
+
 	file = aio_private_file(ctx, nr_pages);
 	if (IS_ERR(file)) {
 		ctx->aio_ring_file = NULL;
@@ -399,7 +460,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 	}
 
 	ctx->aio_ring_file = file;
-	nr_events = (PAGE_SIZE * nr_pages - sizeof(struct aio_ring))
+	nr_events = (PAGE_SIZE * ctx->sq_first_page - sizeof(struct aio_ring))
 			/ sizeof(struct io_event);
 
 	ctx->ring_pages = ctx->internal_pages;
@@ -432,6 +493,17 @@ static int aio_setup_ring(struct kioctx *ctx)
 		return -ENOMEM;
 	}
 
+	if (sq_pages) {
+		ctx->sq_ring = vmap(ctx->ring_pages + ctx->sq_first_page,
+				    sq_pages, VM_MAP, PAGE_KERNEL);
+		if (!ctx->sq_ring) {
+			aio_free_ring(ctx);
+			return -ENOMEM;
+		}
+		ctx->sq_entries = sq_entries;
+		ctx->sq_ring->nr = sq_entries;
+	}
+
 	ctx->mmap_size = nr_pages * PAGE_SIZE;
 	pr_debug("attempting mmap of %lu bytes\n", ctx->mmap_size);
 
@@ -506,12 +578,40 @@ static int kiocb_cancel(struct kiocb *kiocb)
 	return cancel(kiocb);
 }
 
+static void aio_unregister(struct kioctx *ctx)
+{
+	unsigned i, j;
+
+	for (i = 0; i < ctx->nr_user_files; i++)
+		fput(ctx->user_files[i]);
+	kfree(ctx->user_files);
+
+	for (i = 0; i < ctx->nr_user_bufs; i++) {
+		struct aio_mapped_ubuf *imu = &ctx->user_bufs[i];
+
+		for (j = 0; j < imu->nr_bvecs; j++) {
+			set_page_dirty_lock(imu->bvec[j].bv_page);
+			put_page(imu->bvec[j].bv_page);
+		}
+		kfree(imu->bvec);
+	}
+	kfree(ctx->user_bufs);
+
+	if (ctx->mm) {
+		down_write(&ctx->mm->mmap_sem);
+		ctx->mm->pinned_vm -= ctx->nr_pinned;
+		up_write(&ctx->mm->mmap_sem);
+		mmdrop(ctx->mm);
+	}
+}
+
 static void free_ioctx(struct work_struct *work)
 {
 	struct kioctx *ctx = container_of(work, struct kioctx, free_work);
 
 	pr_debug("freeing %p\n", ctx);
 
+	aio_unregister(ctx);
 	aio_free_ring(ctx);
 	free_percpu(ctx->cpu);
 	percpu_ref_exit(&ctx->reqs);
@@ -625,7 +725,7 @@ static void aio_nr_sub(unsigned nr)
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned sq_entries)
 {
 	struct mm_struct *mm = current->mm;
 	struct kioctx *ctx;
@@ -666,6 +766,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	 * the ring_lock mutex held until setup is complete. */
 	mutex_lock(&ctx->ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_lock);
+	init_waitqueue_head(&ctx->sq_wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 
@@ -679,7 +781,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (!ctx->cpu)
 		goto err;
 
-	err = aio_setup_ring(ctx);
+	err = aio_setup_ring(ctx, sq_entries);
 	if (err < 0)
 		goto err;
 
@@ -753,6 +855,12 @@ static int kill_ioctx(struct mm_struct *mm, struct kioctx *ctx,
 	/* percpu_ref_kill() will do the necessary call_rcu() */
 	wake_up_all(&ctx->wait);
 
+	/* No more submissions from the ring once we return */
+	if (ctx->sq_thread) {
+		kthread_stop(ctx->sq_thread);
+		ctx->sq_thread = NULL;
+	}
+
 	/*
 	 * It'd be more correct to do this in free_ioctx(), after all
 	 * the outstanding kiocbs have finished - but by then io_destroy
@@ -1271,7 +1379,7 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, 0);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1369,12 +1477,438 @@ static ssize_t aio_setup_single_vector(struct kiocb *kiocb,
 	return 0;
 }
 
+/*
+ * Point @iter at the pinned pages backing @buf in a registered buffer,
+ * io_submit_one() has checked that the range lies within @imu.
+ */
+static ssize_t aio_setup_fixed_buf(struct kiocb *kiocb, int rw,
+				   char __user *buf,
+				   struct aio_mapped_ubuf *imu,
+				   struct iov_iter *iter)
+{
+	size_t offset = (unsigned long)buf - imu->ubuf;
+	unsigned long seg = 0;
+
+	/* Only the first bvec can start in the middle of a page */
+	if (offset >= imu->bvec[0].bv_len) {
+		offset -= imu->bvec[0].bv_len;
+		seg = 1 + (offset >> PAGE_SHIFT);
+		offset &= ~PAGE_MASK;
+	}
+
+	iter->type = ITER_BVEC | rw;
+	iter->bvec = imu->bvec + seg;
+	iter->nr_segs = imu->nr_bvecs - seg;
+	iter->iov_offset = offset;
+	iter->count = kiocb->ki_nbytes;
+	return 0;
+}
+
+/*
+ * Buffered reads.  Submitting a buffered read used to run ->read_iter()
+ * in io_submit(), blocking the submitter on every page cache miss.  Now
+ * the submitter only reads data that is already cached; on a miss it
+ * starts readahead and hands the request to aio_wq, which waits for the
+ * page being read in to be unlocked before finishing the read in the
+ * submitter's mm.
+ */
+struct aio_buffered_read {
+	struct kiocb		*req;
+	rw_iter_op		*iter_op;
+	struct iov_iter		iter;
+	struct iovec		*iovec;		/* taken over from aio_run_iocb() */
+	struct iovec		fast_iov[UIO_FASTIOV];
+	struct mm_struct	*mm;
+	wait_queue_t		wait;
+	struct work_struct	work;
+};
+
+static bool aio_read_may_block(struct file *file)
+{
+	return !(file->f_flags & O_DIRECT) &&
+	       S_ISREG(file_inode(file)->i_mode) &&
+	       file->f_mapping->a_ops->readpage;
+}
+
+/*
+ * aio_read_prepare:
+ *	Check whether [pos, pos + count) of @file is uptodate in the page
+ *	cache, starting readahead for the pages that are not.  Returns 0
+ *	if a read of the range won't block, -EAGAIN if it has to be done
+ *	synchronously, or -EIOCBQUEUED if a page is being read in.  In
+ *	the last case a non-NULL @wait is queued on that page and its wake
+ *	function is guaranteed to run once.
+ */
+static int aio_read_prepare(struct file *file, loff_t pos, size_t count,
+			    wait_queue_t *wait)
+{
+	struct address_space *mapping = file->f_mapping;
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t index, last;
+
+	if (!count || pos >= isize)
+		return 0;
+	if (count > isize - pos)
+		count = isize - pos;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	last = (pos + count - 1) >> PAGE_CACHE_SHIFT;
+	for (; index <= last; index++) {
+		struct page *page;
+
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &file->f_ra, file,
+						  index, last + 1 - index);
+			page = find_get_page(mapping, index);
+			if (unlikely(!page))
+				return -EAGAIN;
+		}
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &file->f_ra, file,
+						   page, index,
+						   last + 1 - index);
+
+		if (PageUptodate(page)) {
+			page_cache_release(page);
+			continue;
+		}
+
+		if (!PageLocked(page)) {
+			/* Read error or truncation, let ->read_iter() sort it */
+			page_cache_release(page);
+			return -EAGAIN;
+		}
+
+		if (wait) {
+			wait->private = page;
+			add_page_wait_queue(page, wait);
+			/*
+			 * The read may have completed before we were queued.
+			 * Cycling the page lock makes sure the wakeup comes:
+			 * if someone else has it, their unlock wakes us.
+			 */
+			if (!PageLocked(page) && trylock_page(page))
+				unlock_page(page);
+		}
+		page_cache_release(page);
+		return -EIOCBQUEUED;
+	}
+	return 0;
+}
+
+static int aio_read_wake(wait_queue_t *wait, unsigned mode, int sync,
+			 void *arg)
+{
+	struct aio_buffered_read *r =
+		container_of(wait, struct aio_buffered_read, wait);
+	struct wait_bit_key *key = arg;
+	struct page *page = wait->private;
+
+	if (key->flags != &page->flags || key->bit_nr != PG_locked)
+		return 0;
+
+	list_del_init(&wait->task_list);
+	queue_work(aio_wq, &r->work);
+	return 0;
+}
+
+static void aio_buffered_read_work(struct work_struct *work)
+{
+	struct aio_buffered_read *r =
+		container_of(work, struct aio_buffered_read, work);
+	struct kiocb *req = r->req;
+	mm_segment_t old_fs;
+	ssize_t ret;
+
+	ret = aio_read_prepare(req->ki_filp, req->ki_pos,
+			       iov_iter_count(&r->iter), &r->wait);
+	if (ret == -EIOCBQUEUED)
+		return;
+
+	/* The destination may be gone if the submitter has exited */
+	if (!atomic_inc_not_zero(&r->mm->mm_users)) {
+		ret = -EINTR;
+	} else {
+		use_mm(r->mm);
+		old_fs = get_fs();
+		set_fs(USER_DS);
+		ret = r->iter_op(req, &r->iter);
+		set_fs(old_fs);
+		unuse_mm(r->mm);
+		mmput(r->mm);
+	}
+
+	mmdrop(r->mm);
+	kfree(r->iovec);
+	kfree(r);
+	aio_complete(req, ret, 0);
+}
+
+static ssize_t aio_buffered_read(struct kiocb *req, rw_iter_op *iter_op,
+				 struct iov_iter *iter, struct iovec **iovec,
+				 struct iovec *inline_vecs)
+{
+	struct aio_buffered_read *r;
+
+	if (!aio_read_prepare(req->ki_filp, req->ki_pos, iov_iter_count(iter),
+			      NULL))
+		return iter_op(req, iter);
+
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (unlikely(!r))
+		return iter_op(req, iter);
+
+	r->req = req;
+	r->iter_op = iter_op;
+	r->iter = *iter;
+	r->iovec = NULL;
+	if (!(iter->type & ITER_BVEC)) {
+		if (*iovec != inline_vecs) {
+			r->iovec = *iovec;
+			*iovec = inline_vecs;
+		} else {
+			memcpy(r->fast_iov, inline_vecs,
+			       iter->nr_segs * sizeof(struct iovec));
+			r->iter.iov = r->fast_iov;
+		}
+	}
+	r->mm = current->mm;
+	atomic_inc(&r->mm->mm_count);
+	init_waitqueue_func_entry(&r->wait, aio_read_wake);
+	INIT_WORK(&r->work, aio_buffered_read_work);
+
+	queue_work(aio_wq, &r->work);
+	return -EIOCBQUEUED;
+}
+
+/*
+ * fsync/fdatasync for files without ->aio_fsync(), run from aio_wq.
+ */
+struct aio_fsync_work {
+	struct work_struct	work;
+	struct kiocb		*req;
+	int			datasync;
+};
+
+static void aio_fsync_work(struct work_struct *work)
+{
+	struct aio_fsync_work *fw =
+		container_of(work, struct aio_fsync_work, work);
+	struct kiocb *req = fw->req;
+	int ret;
+
+	ret = vfs_fsync(req->ki_filp, fw->datasync);
+	kfree(fw);
+	aio_complete(req, ret, 0);
+}
+
+static ssize_t aio_fsync(struct kiocb *req, int datasync)
+{
+	struct file *file = req->ki_filp;
+	struct aio_fsync_work *fw;
+
+	if (file->f_op->aio_fsync)
+		return file->f_op->aio_fsync(req, datasync);
+	if (!file->f_op->fsync)
+		return -EINVAL;
+
+	fw = kmalloc(sizeof(*fw), GFP_KERNEL);
+	if (unlikely(!fw))
+		return -ENOMEM;
+
+	INIT_WORK(&fw->work, aio_fsync_work);
+	fw->req = req;
+	fw->datasync = datasync;
+	queue_work(aio_wq, &fw->work);
+	return -EIOCBQUEUED;
+}
+
+/*
+ * One-shot poll.  The request sits on the file's wait queue until one of
+ * the requested events fires, then aio_wq checks the file and completes
+ * it with the mask of ready events, or re-queues it on a spurious wakeup.
+ * Once armed the request is cancellable; a cancelled poll completes
+ * with 0.
+ *
+ * p->head->lock protects woken, armed, cancelled and the wait entry.
+ */
+struct aio_poll {
+	struct kiocb		*req;
+	wait_queue_head_t	*head;
+	wait_queue_t		wait;
+	unsigned		events;
+	bool			woken;
+	bool			armed;
+	bool			cancelled;
+	struct work_struct	work;
+};
+
+struct aio_poll_table {
+	poll_table		pt;
+	struct aio_poll		*poll;
+	int			error;
+};
+
+static void aio_poll_complete(struct aio_poll *p, unsigned mask)
+{
+	struct kiocb *req = p->req;
+	struct kioctx *ctx = req->ki_ctx;
+
+	/* Past this point io_cancel() can't find us and look at p */
+	spin_lock_irq(&ctx->ctx_lock);
+	list_del_init(&req->ki_list);
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	kfree(p);
+	aio_complete(req, mask, 0);
+}
+
+static void aio_poll_work(struct work_struct *work)
+{
+	struct aio_poll *p = container_of(work, struct aio_poll, work);
+	struct file *file = p->req->ki_filp;
+	unsigned mask;
+
+	/* Requeue before polling, so an event in between isn't lost */
+	spin_lock_irq(&p->head->lock);
+	if (p->cancelled) {
+		spin_unlock_irq(&p->head->lock);
+		aio_poll_complete(p, 0);
+		return;
+	}
+	p->woken = false;
+	__add_wait_queue(p->head, &p->wait);
+	spin_unlock_irq(&p->head->lock);
+
+	mask = file->f_op->poll(file, NULL) & p->events;
+	if (!mask)
+		return;
+
+	spin_lock_irq(&p->head->lock);
+	if (list_empty(&p->wait.task_list)) {
+		/* Woken or cancelled meanwhile, the work is queued again */
+		spin_unlock_irq(&p->head->lock);
+		return;
+	}
+	list_del_init(&p->wait.task_list);
+	spin_unlock_irq(&p->head->lock);
+
+	aio_poll_complete(p, mask);
+}
+
+static int aio_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			 void *key)
+{
+	struct aio_poll *p = container_of(wait, struct aio_poll, wait);
+	unsigned long mask = (unsigned long)key;
+
+	if (mask && !(mask & p->events))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	p->woken = true;
+	if (p->armed)
+		queue_work(aio_wq, &p->work);
+	return 1;
+}
+
+/* Called with ctx->ctx_lock held */
+static int aio_poll_cancel(struct kiocb *req)
+{
+	struct aio_poll *p = req->private;
+
+	spin_lock(&p->head->lock);
+	p->cancelled = true;
+	if (!list_empty(&p->wait.task_list)) {
+		list_del_init(&p->wait.task_list);
+		queue_work(aio_wq, &p->work);
+	}
+	spin_unlock(&p->head->lock);
+	return 0;
+}
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct aio_poll_table *apt = container_of(pt, struct aio_poll_table, pt);
+
+	/* A single wait entry can only be on one queue */
+	if (unlikely(apt->poll->head)) {
+		apt->error = -EINVAL;
+		return;
+	}
+	apt->poll->head = head;
+	add_wait_queue(head, &apt->poll->wait);
+}
+
+static ssize_t aio_poll(struct kiocb *req, unsigned events)
+{
+	struct kioctx *ctx = req->ki_ctx;
+	struct file *file = req->ki_filp;
+	struct aio_poll_table apt;
+	struct aio_poll *p;
+	unsigned mask;
+	bool done;
+
+	if (!file->f_op->poll)
+		return -EINVAL;
+	if (req->ki_pos || req->ki_nbytes)
+		return -EINVAL;
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (unlikely(!p))
+		return -ENOMEM;
+
+	p->req = req;
+	p->events = events | POLLERR | POLLHUP;
+	init_waitqueue_func_entry(&p->wait, aio_poll_wake);
+	INIT_WORK(&p->work, aio_poll_work);
+	req->private = p;
+
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	apt.poll = p;
+	apt.error = 0;
+	mask = file->f_op->poll(file, &apt.pt) & p->events;
+
+	if (unlikely(!p->head)) {
+		/* Nothing to wait on, report what is ready now */
+		kfree(p);
+		return apt.error ?: mask;
+	}
+
+	spin_lock_irq(&ctx->ctx_lock);
+	spin_lock(&p->head->lock);
+	done = mask || apt.error;
+	if (done) {
+		if (!list_empty(&p->wait.task_list))
+			list_del_init(&p->wait.task_list);
+	} else {
+		p->armed = true;
+		if (!req->ki_list.next)
+			list_add(&req->ki_list, &ctx->active_reqs);
+		req->ki_cancel = aio_poll_cancel;
+		/* A wakeup before we were armed didn't queue the work */
+		if (p->woken)
+			queue_work(aio_wq, &p->work);
+	}
+	spin_unlock(&p->head->lock);
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	if (!done)
+		return -EIOCBQUEUED;
+
+	kfree(p);
+	return apt.error ?: mask;
+}
+
 /*
  * aio_run_iocb:
  *	Performs the initial checks and io submission.
  */
 static ssize_t aio_run_iocb(struct kiocb *req, unsigned opcode,
-			    char __user *buf, bool compat)
+			    char __user *buf, struct aio_mapped_ubuf *imu,
+			    bool compat)
 {
 	struct file *file = req->ki_filp;
 	ssize_t ret;
@@ -1409,12 +1943,18 @@ rw_common:
 		if (!rw_op && !iter_op)
 			return -EINVAL;
 
-		ret = (opcode == IOCB_CMD_PREADV ||
-		       opcode == IOCB_CMD_PWRITEV)
-			? aio_setup_vectored_rw(req, rw, buf, &nr_segs,
-						&iovec, compat)
-			: aio_setup_single_vector(req, rw, buf, &nr_segs,
-						  iovec);
+		if (imu) {
+			/* Registered buffers are pages, not user iovecs */
+			if (!iter_op)
+				return -EINVAL;
+			ret = aio_setup_fixed_buf(req, rw, buf, imu, &iter);
+		} else
+			ret = (opcode == IOCB_CMD_PREADV ||
+			       opcode == IOCB_CMD_PWRITEV)
+				? aio_setup_vectored_rw(req, rw, buf, &nr_segs,
+							&iovec, compat)
+				: aio_setup_single_vector(req, rw, buf,
+							  &nr_segs, iovec);
 		if (!ret)
 			ret = rw_verify_area(rw, file, &req->ki_pos, req->ki_nbytes);
 		if (ret < 0) {
@@ -1436,8 +1976,18 @@ rw_common:
 			file_start_write(file);
 
 		if (iter_op) {
-			iov_iter_init(&iter, rw, iovec, nr_segs, req->ki_nbytes);
-			ret = iter_op(req, &iter);
+			if (imu)
+				/* rw_verify_area() may have trimmed ki_nbytes */
+				iter.count = req->ki_nbytes;
+			else
+				iov_iter_init(&iter, rw, iovec, nr_segs,
+					      req->ki_nbytes);
+
+			if (rw == READ && aio_read_may_block(file))
+				ret = aio_buffered_read(req, iter_op, &iter,
+							&iovec, inline_vecs);
+			else
+				ret = iter_op(req, &iter);
 		} else {
 			ret = rw_op(req, iovec, nr_segs, req->ki_pos);
 		}
@@ -1447,17 +1997,19 @@ rw_common:
 		break;
 
 	case IOCB_CMD_FDSYNC:
-		if (!file->f_op->aio_fsync)
-			return -EINVAL;
-
-		ret = file->f_op->aio_fsync(req, 1);
+		ret = aio_fsync(req, 1);
 		break;
 
 	case IOCB_CMD_FSYNC:
-		if (!file->f_op->aio_fsync)
-			return -EINVAL;
+		ret = aio_fsync(req, 0);
+		break;
+
+	case IOCB_CMD_POLL:
+		if (unlikely(!(file->f_mode & FMODE_READ) &&
+			     !(file->f_mode & FMODE_WRITE)))
+			return -EBADF;
 
-		ret = file->f_op->aio_fsync(req, 0);
+		ret = aio_poll(req, (unsigned long)buf);
 		break;
 
 	default:
@@ -1483,14 +2035,54 @@ rw_common:
 	return 0;
 }
 
+/*
+ * Look up the registered buffer an IOCB_FLAG_FIXED_BUF iocb refers to.
+ * The registration is published before nr_user_bufs, see
+ * aio_register_buffers().
+ */
+static struct aio_mapped_ubuf *aio_fixed_buf(struct kioctx *ctx,
+					     struct iocb *iocb)
+{
+	unsigned nr = ACCESS_ONCE(ctx->nr_user_bufs);
+	struct aio_mapped_ubuf *imu;
+	u64 idx = iocb->aio_reserved2;
+
+	smp_rmb();
+	if (idx >= nr)
+		return NULL;
+	if (iocb->aio_lio_opcode != IOCB_CMD_PREAD &&
+	    iocb->aio_lio_opcode != IOCB_CMD_PWRITE)
+		return NULL;
+
+	imu = &ctx->user_bufs[idx];
+	if (iocb->aio_buf < imu->ubuf ||
+	    iocb->aio_buf + iocb->aio_nbytes < iocb->aio_buf ||
+	    iocb->aio_buf + iocb->aio_nbytes > imu->ubuf + imu->len)
+		return NULL;
+	return imu;
+}
+
+static struct file *aio_fixed_file(struct kioctx *ctx, u32 idx)
+{
+	unsigned nr = ACCESS_ONCE(ctx->nr_user_files);
+
+	smp_rmb();
+	if (idx >= nr)
+		return NULL;
+	return get_file(ctx->user_files[idx]);
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb, bool compat)
 {
+	struct aio_mapped_ubuf *imu = NULL;
 	struct kiocb *req;
 	ssize_t ret;
 
 	/* enforce forwards compatibility on users */
-	if (unlikely(iocb->aio_reserved1 || iocb->aio_reserved2)) {
+	if (unlikely(iocb->aio_reserved1 ||
+		     (iocb->aio_reserved2 &&
+		      !(iocb->aio_flags & IOCB_FLAG_FIXED_BUF)))) {
 		pr_debug("EINVAL: reserve field set\n");
 		return -EINVAL;
 	}
@@ -1505,11 +2097,20 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		return -EINVAL;
 	}
 
+	if (iocb->aio_flags & IOCB_FLAG_FIXED_BUF) {
+		imu = aio_fixed_buf(ctx, iocb);
+		if (unlikely(!imu))
+			return -EFAULT;
+	}
+
 	req = aio_get_req(ctx);
 	if (unlikely(!req))
 		return -EAGAIN;
 
-	req->ki_filp = fget(iocb->aio_fildes);
+	if (iocb->aio_flags & IOCB_FLAG_FIXED_FILE)
+		req->ki_filp = aio_fixed_file(ctx, iocb->aio_fildes);
+	else
+		req->ki_filp = fget(iocb->aio_fildes);
 	if (unlikely(!req->ki_filp)) {
 		ret = -EBADF;
 		goto out_put_req;
@@ -1543,7 +2144,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 
 	ret = aio_run_iocb(req, iocb->aio_lio_opcode,
 			   (char __user *)(unsigned long)iocb->aio_buf,
-			   compat);
+			   imu, compat);
 	if (ret)
 		goto out_put_req;
 
@@ -1626,6 +2227,449 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	return do_io_submit(ctx_id, nr, iocbpp, 0);
 }
 
+/*
+ * User address of SQ slot @idx, reported back in io_event->obj the same
+ * way io_submit() reports the iocb pointer.
+ */
+static struct iocb __user *aio_sq_user_iocb(struct kioctx *ctx, unsigned idx)
+{
+	unsigned long off = PAGE_SIZE * ctx->sq_first_page +
+			    offsetof(struct aio_sq_ring, iocbs) +
+			    idx * sizeof(struct iocb);
+
+	return (struct iocb __user *)(ctx->mmap_base + off);
+}
+
+static bool aio_sq_pending(struct kioctx *ctx)
+{
+	return ACCESS_ONCE(ctx->sq_ring->tail) != ctx->sq_head;
+}
+
+/*
+ * aio_submit_sq:
+ *	Submit up to @nr iocbs queued in the submission ring.  An entry that
+ *	fails to submit is consumed and counted in sq_ring->dropped; the
+ *	system call path stops there and reports the error if nothing was
+ *	submitted before it.  Returns the number of iocbs submitted.
+ */
+static long aio_submit_sq(struct kioctx *ctx, unsigned nr, bool sq_thread)
+{
+	struct aio_sq_ring *ring = ctx->sq_ring;
+	unsigned mask = ctx->sq_entries - 1;
+	unsigned head, tail;
+	struct blk_plug plug;
+	long submitted = 0;
+	int ret = 0;
+
+	mutex_lock(&ctx->sq_lock);
+	head = ctx->sq_head;
+	tail = ACCESS_ONCE(ring->tail);
+	/* Read the iocbs only after the tail that publishes them */
+	smp_rmb();
+
+	blk_start_plug(&plug);
+	while (head != tail && submitted < nr) {
+		struct iocb tmp;
+		unsigned idx = head & mask;
+
+		/* Take a stable copy, userspace may scribble on the slot */
+		memcpy(&tmp, &ring->iocbs[idx], sizeof(tmp));
+
+		/* The poll thread has no file table to resolve fds with */
+		if (sq_thread &&
+		    (!(tmp.aio_flags & IOCB_FLAG_FIXED_FILE) ||
+		     (tmp.aio_flags & IOCB_FLAG_RESFD)))
+			ret = -EBADF;
+		else
+			ret = io_submit_one(ctx, aio_sq_user_iocb(ctx, idx),
+					    &tmp, false);
+		if (ret == -EAGAIN)
+			break;
+
+		head++;
+		if (unlikely(ret)) {
+			ring->dropped++;
+			if (!sq_thread)
+				break;
+			continue;
+		}
+		submitted++;
+	}
+	blk_finish_plug(&plug);
+
+	ctx->sq_head = head;
+	/* Finish reading the slots before handing them back */
+	smp_mb();
+	ring->head = head;
+	mutex_unlock(&ctx->sq_lock);
+
+	return submitted ? submitted : ret;
+}
+
+/*
+ * Kernel side polling of the submission ring.  The thread spins for
+ * sq_thread_idle after the last submission, then sets AIO_SQ_NEED_WAKEUP
+ * and sleeps until io_ring_enter(IORING_ENTER_SQ_WAKEUP).
+ */
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	struct aio_sq_ring *ring = ctx->sq_ring;
+	unsigned long timeout = jiffies + ctx->sq_thread_idle;
+	mm_segment_t old_fs;
+	DEFINE_WAIT(wait);
+
+	use_mm(ctx->mm);
+	old_fs = get_fs();
+	set_fs(USER_DS);
+
+	while (!kthread_should_stop()) {
+		if (aio_sq_pending(ctx)) {
+			aio_submit_sq(ctx, ctx->sq_entries, true);
+			timeout = jiffies + ctx->sq_thread_idle;
+			cond_resched();
+			continue;
+		}
+
+		if (time_before(jiffies, timeout)) {
+			cpu_relax();
+			cond_resched();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		ACCESS_ONCE(ring->flags) |= AIO_SQ_NEED_WAKEUP;
+		/* Pairs with the tail store / flags load in userspace */
+		smp_mb();
+		if (!aio_sq_pending(ctx) && !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+
+		ACCESS_ONCE(ring->flags) &= ~AIO_SQ_NEED_WAKEUP;
+		timeout = jiffies + ctx->sq_thread_idle;
+	}
+
+	set_fs(old_fs);
+	unuse_mm(ctx->mm);
+	return 0;
+}
+
+static int aio_register_files(struct kioctx *ctx, struct aio_setup_params *p)
+{
+	__s32 __user *fds = (__s32 __user *)(unsigned long)p->files;
+	struct file **files;
+	unsigned i;
+	int ret;
+
+	if (!p->nr_files)
+		return 0;
+	if (p->nr_files > AIO_MAX_FIXED_FILES)
+		return -EINVAL;
+
+	files = kcalloc(p->nr_files, sizeof(*files), GFP_KERNEL);
+	if (!files)
+		return -ENOMEM;
+
+	for (i = 0; i < p->nr_files; i++) {
+		__s32 fd;
+
+		ret = -EFAULT;
+		if (get_user(fd, &fds[i]))
+			goto err;
+		ret = -EBADF;
+		files[i] = fget(fd);
+		if (!files[i])
+			goto err;
+	}
+
+	ctx->user_files = files;
+	/* Publish the table before its size, see aio_fixed_file() */
+	smp_wmb();
+	ctx->nr_user_files = p->nr_files;
+	return 0;
+err:
+	while (i--)
+		fput(files[i]);
+	kfree(files);
+	return ret;
+}
+
+static int aio_pin_buffer(struct aio_mapped_ubuf *imu, struct iovec *iov)
+{
+	unsigned long ubuf = (unsigned long)iov->iov_base;
+	unsigned long start = ubuf >> PAGE_SHIFT;
+	unsigned long end = (ubuf + iov->iov_len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	unsigned long nr_pages = end - start;
+	size_t off = ubuf & ~PAGE_MASK, size = iov->iov_len;
+	struct page **pages;
+	long pret;
+	unsigned i;
+
+	pages = kmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+	imu->bvec = kmalloc_array(nr_pages, sizeof(*imu->bvec), GFP_KERNEL);
+	if (!pages || !imu->bvec) {
+		kfree(pages);
+		kfree(imu->bvec);
+		imu->bvec = NULL;
+		return -ENOMEM;
+	}
+
+	down_read(&current->mm->mmap_sem);
+	pret = get_user_pages(current, current->mm, ubuf & PAGE_MASK,
+			      nr_pages, 1, 0, pages, NULL);
+	up_read(&current->mm->mmap_sem);
+
+	if (pret != nr_pages) {
+		for (i = 0; pret > 0 && i < pret; i++)
+			put_page(pages[i]);
+		kfree(pages);
+		kfree(imu->bvec);
+		imu->bvec = NULL;
+		return pret < 0 ? pret : -EFAULT;
+	}
+
+	for (i = 0; i < nr_pages; i++) {
+		size_t len = min_t(size_t, size, PAGE_SIZE - off);
+
+		imu->bvec[i].bv_page = pages[i];
+		imu->bvec[i].bv_len = len;
+		imu->bvec[i].bv_offset = off;
+		off = 0;
+		size -= len;
+	}
+	kfree(pages);
+
+	imu->ubuf = ubuf;
+	imu->len = iov->iov_len;
+	imu->nr_bvecs = nr_pages;
+	return 0;
+}
+
+static int aio_register_buffers(struct kioctx *ctx,
+				struct aio_setup_params *p)
+{
+	struct iovec __user *uiov = (struct iovec __user *)(unsigned long)
+				    p->iovecs;
+	struct mm_struct *mm = current->mm;
+	unsigned long lock_limit, nr_pinned = 0;
+	struct aio_mapped_ubuf *bufs;
+	unsigned i;
+	int ret;
+
+	if (!p->nr_iovecs)
+		return 0;
+	if (p->nr_iovecs > AIO_MAX_FIXED_BUFS)
+		return -EINVAL;
+
+	bufs = kcalloc(p->nr_iovecs, sizeof(*bufs), GFP_KERNEL);
+	if (!bufs)
+		return -ENOMEM;
+
+	lock_limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+	for (i = 0; i < p->nr_iovecs; i++) {
+		struct iovec iov;
+
+		ret = -EFAULT;
+		if (copy_from_user(&iov, &uiov[i], sizeof(iov)))
+			goto err;
+		ret = -EINVAL;
+		if (!iov.iov_base || !iov.iov_len || iov.iov_len > SZ_1G)
+			goto err;
+
+		nr_pinned += PFN_UP((unsigned long)iov.iov_base +
+				    iov.iov_len) -
+			     ((unsigned long)iov.iov_base >> PAGE_SHIFT);
+		ret = -ENOMEM;
+		if (mm->pinned_vm + nr_pinned > lock_limit &&
+		    !capable(CAP_IPC_LOCK))
+			goto err;
+
+		ret = aio_pin_buffer(&bufs[i], &iov);
+		if (ret)
+			goto err;
+	}
+
+	down_write(&mm->mmap_sem);
+	mm->pinned_vm += nr_pinned;
+	up_write(&mm->mmap_sem);
+	ctx->nr_pinned = nr_pinned;
+
+	ctx->user_bufs = bufs;
+	/* Publish the table before its size, see aio_fixed_buf() */
+	smp_wmb();
+	ctx->nr_user_bufs = p->nr_iovecs;
+	return 0;
+err:
+	while (i--) {
+		unsigned j;
+
+		for (j = 0; j < bufs[i].nr_bvecs; j++)
+			put_page(bufs[i].bvec[j].bv_page);
+		kfree(bufs[i].bvec);
+	}
+	kfree(bufs);
+	return ret;
+}
+
+static int aio_start_sq_thread(struct kioctx *ctx, struct aio_setup_params *p)
+{
+	struct task_struct *t;
+	int cpu = p->sq_thread_cpu;
+
+	if (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu)))
+		return -EINVAL;
+
+	ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle ?: 1000);
+	t = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+			   task_pid_nr(current));
+	if (IS_ERR(t))
+		return PTR_ERR(t);
+	if (cpu >= 0)
+		kthread_bind(t, cpu);
+
+	ctx->sq_thread = t;
+	wake_up_process(t);
+	return 0;
+}
+
+/* sys_io_setup2:
+ *	Like io_setup(), with the options in *params: a submission ring
+ *	mapped after the completion ring (IOCTX_FLAG_SQRING), a kernel
+ *	thread polling it (IOCTX_FLAG_SQPOLL, needs CAP_SYS_ADMIN), and
+ *	files and buffers registered for the lifetime of the context.  On
+ *	success params->sq_off is set to the offset of the submission ring
+ *	from the returned context id.
+ */
+SYSCALL_DEFINE3(io_setup2, unsigned, nr_events,
+		struct aio_setup_params __user *, params,
+		aio_context_t __user *, ctxp)
+{
+	struct aio_setup_params p;
+	struct kioctx *ioctx;
+	unsigned long ctx;
+	long ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+
+	if (p.flags & ~(IOCTX_FLAG_SQRING | IOCTX_FLAG_SQPOLL) ||
+	    p.resv[0] || p.resv[1])
+		return -EINVAL;
+
+	if (p.flags & IOCTX_FLAG_SQPOLL) {
+		if (!(p.flags & IOCTX_FLAG_SQRING))
+			return -EINVAL;
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+	}
+
+	if (p.flags & IOCTX_FLAG_SQRING) {
+		if (!p.sq_entries || p.sq_entries > AIO_MAX_SQ_ENTRIES)
+			return -EINVAL;
+		p.sq_entries = roundup_pow_of_two(p.sq_entries);
+	} else {
+		p.sq_entries = 0;
+	}
+
+	ret = get_user(ctx, ctxp);
+	if (unlikely(ret))
+		return ret;
+	if (unlikely(ctx || nr_events == 0))
+		return -EINVAL;
+
+	ioctx = ioctx_alloc(nr_events, p.sq_entries);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+
+	ioctx->mm = current->mm;
+	atomic_inc(&ioctx->mm->mm_count);
+
+	ret = aio_register_files(ioctx, &p);
+	if (!ret)
+		ret = aio_register_buffers(ioctx, &p);
+	if (!ret && (p.flags & IOCTX_FLAG_SQPOLL))
+		ret = aio_start_sq_thread(ioctx, &p);
+
+	if (!ret) {
+		p.sq_off = p.sq_entries ? PAGE_SIZE * ioctx->sq_first_page : 0;
+		if (copy_to_user(params, &p, sizeof(p)))
+			ret = -EFAULT;
+	}
+	if (!ret)
+		ret = put_user(ioctx->user_id, ctxp);
+	if (ret)
+		kill_ioctx(current->mm, ioctx, NULL);
+	percpu_ref_put(&ioctx->users);
+
+	return ret;
+}
+
+/* Number of events sitting in the completion ring */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring *ring;
+	unsigned head, tail;
+
+	/* completion_lock keeps ring_pages[0] stable against migration */
+	spin_lock_irq(&ctx->completion_lock);
+	ring = kmap_atomic(ctx->ring_pages[0]);
+	head = ring->head % ctx->nr_events;
+	kunmap_atomic(ring);
+	tail = ctx->tail;
+	spin_unlock_irq(&ctx->completion_lock);
+
+	return head <= tail ? tail - head : ctx->nr_events - (head - tail);
+}
+
+/* sys_io_ring_enter:
+ *	Submit up to to_submit iocbs from the submission ring of a context
+ *	created with IOCTX_FLAG_SQRING, then with IORING_ENTER_GETEVENTS
+ *	wait until at least min_complete events are in the completion ring.
+ *	With a polling thread, iocbs are picked up without this call and
+ *	IORING_ENTER_SQ_WAKEUP wakes the thread once it has gone to sleep.
+ *	Returns the number of iocbs submitted by this call, which is always
+ *	0 when the polling thread does the submission.
+ */
+SYSCALL_DEFINE4(io_ring_enter, aio_context_t, ctx_id, unsigned, to_submit,
+		unsigned, min_complete, unsigned, flags)
+{
+	struct kioctx *ctx;
+	long ret = 0;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx))
+		return -EINVAL;
+
+	if (!ctx->sq_ring) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (ctx->sq_thread) {
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sq_wait);
+	} else if (to_submit) {
+		ret = aio_submit_sq(ctx, to_submit, false);
+	}
+
+	if (ret >= 0 && (flags & IORING_ENTER_GETEVENTS) && min_complete) {
+		int err;
+
+		min_complete = min(min_complete, ctx->nr_events - 1);
+		err = wait_event_interruptible(ctx->wait,
+				aio_ring_events(ctx) >= min_complete ||
+				atomic_read(&ctx->dead));
+		if (err && !ret)
+			ret = err;
+	}
+out:
+	percpu_ref_put(&ctx->users);
+	return ret;
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
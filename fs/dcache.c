@@ -39,6 +39,8 @@
 #include <linux/ratelimit.h>
 #include <linux/list_lru.h>
 #include <linux/kasan.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include "internal.h"
 #include "mount.h"
@@ -118,6 +120,21 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
+static DEFINE_PER_CPU(long, nr_dentry_negative);
+
+/* Hashing and LRU churn, reported in /proc/fs/dentry-stats */
+static DEFINE_PER_CPU(long, nr_dentry_hashed);
+static DEFINE_PER_CPU(unsigned long, nr_dentry_lru_added);
+static DEFINE_PER_CPU(unsigned long, nr_dentry_lru_removed);
+static DEFINE_PER_CPU(unsigned long, nr_dentry_negative_pruned);
+
+/*
+ * Unused negative dentries may make up at most this percentage of a
+ * superblock's dentry LRU (0 for no limit) before the oldest ones are
+ * reclaimed.  Below DENTRY_NEGATIVE_MIN of them they are always kept.
+ */
+static int sysctl_dentry_negative_ratio __read_mostly = 50;
+#define DENTRY_NEGATIVE_MIN	1024
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
@@ -151,11 +168,21 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -326,6 +353,24 @@ static void dentry_iput(struct dentry * dentry)
 	}
 }
 
+/*
+ * Negative dentries are counted, per superblock and globally, while they
+ * have DCACHE_LRU_LIST set.  Since dentries are taken off the LRU lazily,
+ * one may still be in use there and change type: __d_instantiate() and
+ * dentry_unlink_inode() adjust the counts in that case.
+ */
+static inline void d_negative_inc(struct dentry *dentry)
+{
+	this_cpu_inc(nr_dentry_negative);
+	atomic_long_inc(&dentry->d_sb->s_nr_dentry_negative);
+}
+
+static inline void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	atomic_long_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 /*
  * Release the dentry's inode, using the filesystem
  * d_iput() operation if defined. dentry remains in-use.
@@ -335,6 +380,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
 	__releases(dentry->d_inode->i_lock)
 {
 	struct inode *inode = dentry->d_inode;
+	if (dentry->d_flags & DCACHE_LRU_LIST)
+		d_negative_inc(dentry);
 	__d_clear_type(dentry);
 	dentry->d_inode = NULL;
 	hlist_del_init(&dentry->d_u.d_alias);
@@ -364,12 +411,40 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * rules. d_lock must be held by the caller.
  */
 #define D_FLAG_VERIFY(dentry,x) WARN_ON_ONCE(((dentry)->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) != (x))
+
+/*
+ * How many unused negative dentries @sb has over its limit: they may make
+ * up sysctl_dentry_negative_ratio percent of the LRU, that is, their
+ * number may be ratio / (100 - ratio) times that of the other unused
+ * dentries.
+ */
+static long d_negative_excess(struct super_block *sb)
+{
+	long neg = atomic_long_read(&sb->s_nr_dentry_negative);
+	int ratio = ACCESS_ONCE(sysctl_dentry_negative_ratio);
+	long others, limit;
+
+	if (!ratio || ratio >= 100 || neg <= DENTRY_NEGATIVE_MIN)
+		return 0;
+
+	others = (long)list_lru_count(&sb->s_dentry_lru) - neg;
+	limit = max_t(long, others * ratio / (100 - ratio),
+		      DENTRY_NEGATIVE_MIN);
+	return neg > limit ? neg - limit : 0;
+}
+
 static void d_lru_add(struct dentry *dentry)
 {
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	this_cpu_inc(nr_dentry_lru_added);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+	if (d_is_negative(dentry)) {
+		d_negative_inc(dentry);
+		if (unlikely(d_negative_excess(dentry->d_sb)))
+			schedule_work(&dentry->d_sb->s_dentry_prune_work);
+	}
 }
 
 static void d_lru_del(struct dentry *dentry)
@@ -377,6 +452,9 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	this_cpu_inc(nr_dentry_lru_removed);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -386,6 +464,8 @@ static void d_shrink_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 }
 
 static void d_shrink_add(struct dentry *dentry, struct list_head *list)
@@ -394,6 +474,8 @@ static void d_shrink_add(struct dentry *dentry, struct list_head *list)
 	list_add(&dentry->d_lru, list);
 	dentry->d_flags |= DCACHE_SHRINK_LIST | DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_inc(dentry);
 }
 
 /*
@@ -407,6 +489,9 @@ static void d_lru_isolate(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	this_cpu_inc(nr_dentry_lru_removed);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	list_del_init(&dentry->d_lru);
 }
 
@@ -414,6 +499,7 @@ static void d_lru_shrink_move(struct dentry *dentry, struct list_head *list)
 {
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	this_cpu_inc(nr_dentry_lru_removed);
 	list_move_tail(&dentry->d_lru, list);
 }
 
@@ -450,10 +536,12 @@ void __d_drop(struct dentry *dentry)
 		 * with the exception of those newly allocated by
 		 * d_obtain_alias, which are always IS_ROOT:
 		 */
-		if (unlikely(IS_ROOT(dentry)))
+		if (unlikely(IS_ROOT(dentry))) {
 			b = &dentry->d_sb->s_anon;
-		else
+		} else {
 			b = d_hash(dentry->d_parent, dentry->d_name.hash);
+			this_cpu_dec(nr_dentry_hashed);
+		}
 
 		hlist_bl_lock(b);
 		__hlist_bl_del(&dentry->d_hash);
@@ -957,6 +1045,68 @@ long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
 	return freed;
 }
 
+static enum lru_status
+dentry_lru_isolate_negative(struct list_head *item, spinlock_t *lru_lock,
+			    void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_SKIP;
+	}
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/* Recently looked up ones get another pass, as in prune_dcache_sb() */
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(dentry, freeable);
+	this_cpu_inc(nr_dentry_negative_pruned);
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+/*
+ * Reclaim the oldest unused negative dentries of a superblock which has
+ * gone over its limit, queued from d_lru_add().  Lookups of paths that do
+ * not exist would otherwise fill the hash table with negative entries and
+ * lengthen the chains __d_lookup_rcu() walks long before memory pressure
+ * gets rid of them.
+ */
+void d_prune_negative_workfn(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_dentry_prune_work);
+	LIST_HEAD(dispose);
+	long excess;
+
+	if (!grab_super_passive(sb))
+		return;
+
+	excess = d_negative_excess(sb);
+	if (excess) {
+		/* Positive and referenced entries on the way count, too */
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_negative,
+			      &dispose, 2 * excess);
+		shrink_dentry_list(&dispose);
+	}
+	drop_super(sb);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 						spinlock_t *lru_lock, void *arg)
 {
@@ -1588,6 +1738,9 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	unsigned add_flags = d_flags_for_inode(inode);
 
 	spin_lock(&dentry->d_lock);
+	if (inode && (dentry->d_flags & DCACHE_LRU_LIST) &&
+	    d_is_negative(dentry))
+		d_negative_dec(dentry);
 	__d_set_type(dentry, add_flags);
 	if (inode)
 		hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
@@ -2321,6 +2474,7 @@ static void __d_rehash(struct dentry * entry, struct hlist_bl_head *b)
 	entry->d_flags |= DCACHE_RCUACCESS;
 	hlist_bl_add_head_rcu(&entry->d_hash, b);
 	hlist_bl_unlock(b);
+	this_cpu_inc(nr_dentry_hashed);
 }
 
 static void _d_rehash(struct dentry * entry)
@@ -3335,6 +3489,96 @@ static void __init dcache_init(void)
 		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
 }
 
+#ifdef CONFIG_SYSCTL
+static int zero;
+static int one_hundred = 100;
+
+static struct ctl_table dcache_sysctls[] = {
+	{
+		.procname	= "dentry-negative-ratio",
+		.data		= &sysctl_dentry_negative_ratio,
+		.maxlen		= sizeof(sysctl_dentry_negative_ratio),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one_hundred,
+	},
+	{ }
+};
+#endif
+
+#ifdef CONFIG_PROC_FS
+static void dentry_stats_sb(struct super_block *sb, void *arg)
+{
+	struct seq_file *m = arg;
+	long unused = list_lru_count(&sb->s_dentry_lru);
+	long negative = atomic_long_read(&sb->s_nr_dentry_negative);
+
+	if (unused)
+		seq_printf(m, "%-16s %-12s %10ld %10ld\n", sb->s_id,
+			   sb->s_type->name, max(unused - negative, 0L),
+			   negative);
+}
+
+/*
+ * /proc/fs/dentry-stats: hash table load, LRU churn and the unused
+ * positive and negative dentries of each superblock.  Everything comes
+ * from counters, reading it does not walk the hash table.
+ */
+static int dentry_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long added = 0, removed = 0, pruned = 0;
+	unsigned long buckets = 1UL << d_hash_shift;
+	long hashed = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		hashed += per_cpu(nr_dentry_hashed, cpu);
+		added += per_cpu(nr_dentry_lru_added, cpu);
+		removed += per_cpu(nr_dentry_lru_removed, cpu);
+		pruned += per_cpu(nr_dentry_negative_pruned, cpu);
+	}
+	hashed = max(hashed, 0L);
+
+	seq_printf(m, "hash buckets:      %lu\n", buckets);
+	seq_printf(m, "hashed dentries:   %ld\n", hashed);
+	seq_printf(m, "average chain:     %lu.%02lu\n", hashed / buckets,
+		   (hashed % buckets) * 100 / buckets);
+	seq_printf(m, "lru added:         %lu\n", added);
+	seq_printf(m, "lru removed:       %lu\n", removed);
+	seq_printf(m, "negative pruned:   %lu\n", pruned);
+
+	seq_printf(m, "\n%-16s %-12s %10s %10s\n", "device", "type",
+		   "positive", "negative");
+	iterate_supers(dentry_stats_sb, m);
+	return 0;
+}
+
+static int dentry_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dentry_stats_show, NULL);
+}
+
+static const struct file_operations dentry_stats_fops = {
+	.open		= dentry_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
+static int __init dcache_stats_init(void)
+{
+#ifdef CONFIG_SYSCTL
+	register_sysctl("fs", dcache_sysctls);
+#endif
+#ifdef CONFIG_PROC_FS
+	proc_create("fs/dentry-stats", 0444, NULL, &dentry_stats_fops);
+#endif
+	return 0;
+}
+fs_initcall(dcache_stats_init);
+
 /* SLAB cache for __getname() consumers */
 struct kmem_cache *names_cachep __read_mostly;
 EXPORT_SYMBOL(names_cachep);
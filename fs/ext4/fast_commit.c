@@ -0,0 +1,194 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits for fsync.
+ *
+ * An fsync normally has to commit the whole running transaction, which
+ * writes every metadata block touched by anyone since the last commit.
+ * When the only change an inode needs on disk is to its own inode table
+ * entry (timestamps, size within already allocated blocks, extent state
+ * in the inode), we instead log a copy of the on-disk inode into the
+ * jbd2 fast commit area with a single flush.  Recovery copies the logged
+ * inodes back into the inode tables after the regular log replay.
+ *
+ * Anything that makes an inode depend on other metadata in the running
+ * transaction (block allocation, directory, xattr or orphan list changes,
+ * ...) marks it ineligible through ext4_fc_mark_ineligible(), and fsync
+ * then falls back to a full commit.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include <linux/buffer_head.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+/*
+ * A fast commit block is a jbd2 block header followed by inode records,
+ * up to a record with a zero inode number or the end of the block.  Each
+ * record is followed by fc_len bytes of on-disk inode.
+ */
+struct ext4_fc_inode {
+	__le32	fc_ino;		/* Inode number */
+	__le16	fc_len;		/* Size of the inode copy */
+	__le16	fc_reserved;
+	__le32	fc_crc;		/* crc32 of fc_ino, fc_len and the copy */
+};
+
+static __u32 ext4_fc_inode_csum(struct ext4_fc_inode *fc, void *raw, int len)
+{
+	__u32 crc;
+
+	crc = crc32_le(~0, (void *)fc, offsetof(struct ext4_fc_inode, fc_crc));
+	return crc32_le(crc, raw, len);
+}
+
+static int ext4_fc_eligible(struct inode *inode, tid_t commit_tid)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	return S_ISREG(inode->i_mode) && inode->i_nlink &&
+		!ext4_has_inline_data(inode) &&
+		list_empty(&ei->i_orphan) &&
+		ei->i_fc_ineligible_tid != commit_tid;
+}
+
+/*
+ * Fast commit @inode as of transaction @commit_tid.  Returns 0 when the
+ * inode is on disk, or -EAGAIN if the caller has to wait for a full
+ * commit of @commit_tid instead.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int len = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode *fc;
+	struct buffer_head *bh;
+	struct ext4_iloc iloc;
+	int ineligible, err;
+
+	if (!ext4_fc_eligible(inode, commit_tid) ||
+	    sizeof(journal_header_t) + sizeof(*fc) + len > sb->s_blocksize)
+		return -EAGAIN;
+
+	/* Read the inode table block before the fast commit starts */
+	if (ext4_get_inode_loc(inode, &iloc))
+		return -EAGAIN;
+
+	if (jbd2_fc_begin_commit(journal, commit_tid)) {
+		brelse(iloc.bh);
+		return -EAGAIN;
+	}
+
+	err = jbd2_fc_get_buf(journal, &bh);
+	if (err) {
+		brelse(iloc.bh);
+		goto fallback;
+	}
+
+	/*
+	 * ext4_do_update_inode() fills the on-disk inode under i_raw_lock
+	 * after any change which makes the inode ineligible has been
+	 * recorded, so a copy taken under the same lock is only usable if
+	 * the inode is still eligible afterwards.
+	 */
+	fc = (struct ext4_fc_inode *)(bh->b_data + sizeof(journal_header_t));
+	spin_lock(&ei->i_raw_lock);
+	memcpy(fc + 1, ext4_raw_inode(&iloc), len);
+	ineligible = ei->i_fc_ineligible_tid == commit_tid;
+	spin_unlock(&ei->i_raw_lock);
+	brelse(iloc.bh);
+	if (ineligible)
+		goto fallback;
+
+	fc->fc_ino = cpu_to_le32(inode->i_ino);
+	fc->fc_len = cpu_to_le16(len);
+	fc->fc_crc = cpu_to_le32(ext4_fc_inode_csum(fc, fc + 1, len));
+
+	err = jbd2_fc_end_commit(journal);
+	if (err) {
+		ext4_warning(sb, "fast commit of inode %lu failed (%d)",
+			     inode->i_ino, err);
+		return -EAGAIN;
+	}
+	return 0;
+
+fallback:
+	jbd2_fc_end_commit_fallback(journal);
+	return -EAGAIN;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb, unsigned long ino,
+				void *raw, int len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_group_t group;
+	ext4_fsblk_t block;
+	unsigned long index;
+
+	if (!ext4_valid_inum(sb, ino))
+		return -EIO;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	index = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EIO;
+
+	block = ext4_inode_table(sb, gdp) + index / sbi->s_inodes_per_block;
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+
+	lock_buffer(bh);
+	memcpy(bh->b_data + (index % sbi->s_inodes_per_block) * len, raw, len);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return 0;
+}
+
+/*
+ * jbd2 recovery callback: copy the inodes logged in one fast commit block
+ * back into the inode tables.  A record that fails its checksum was torn
+ * by the crash and ends the replay.
+ */
+int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+		   int off, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	char *p = bh->b_data + sizeof(journal_header_t);
+	char *end = bh->b_data + journal->j_blocksize;
+	struct ext4_fc_inode *fc;
+	unsigned long ino;
+	int len, err;
+
+	while (p + sizeof(*fc) <= end) {
+		fc = (struct ext4_fc_inode *)p;
+		ino = le32_to_cpu(fc->fc_ino);
+		if (!ino)
+			break;
+
+		len = le16_to_cpu(fc->fc_len);
+		if (len != EXT4_INODE_SIZE(sb) ||
+		    p + sizeof(*fc) + len > end ||
+		    le32_to_cpu(fc->fc_crc) !=
+		    ext4_fc_inode_csum(fc, fc + 1, len)) {
+			ext4_msg(sb, KERN_WARNING, "fast commit block %d "
+				 "of transaction %u is corrupt", off, tid);
+			return 1;
+		}
+
+		err = ext4_fc_replay_inode(sb, ino, fc + 1, len);
+		if (err)
+			return err;
+		p += sizeof(*fc) + len;
+	}
+	return 0;
+}
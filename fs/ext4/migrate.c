@@ -525,6 +525,7 @@ int ext4_ext_migrate(struct inode *inode)
 		goto out;
 	}
 
+	ext4_fc_mark_ineligible(handle, inode);
 	ei = EXT4_I(inode);
 	i_data = ei->i_data;
 	memset(&lb, 0, sizeof(lb));
@@ -646,6 +647,7 @@ int ext4_ind_migrate(struct inode *inode)
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
 
+	ext4_fc_mark_ineligible(handle, inode);
 	down_write(&EXT4_I(inode)->i_data_sem);
 	ret = ext4_ext_check_inode(inode);
 	if (ret)
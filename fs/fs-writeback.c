@@ -34,6 +34,19 @@
  */
 #define MIN_WRITEBACK_PAGES	(4096UL >> (PAGE_CACHE_SHIFT - 10))
 
+/*
+ * 128KB minimal write chunk size for devices with a chunk latency target
+ */
+#define MIN_LATENCY_WRITEBACK_PAGES	(128UL >> (PAGE_CACHE_SHIFT - 10))
+
+/*
+ * Inodes of at most WB_DEFER_MAX_PAGES pages which were redirtied shortly
+ * after writeback cleaned them WB_DEFER_REDIRTIES times in a row are left
+ * dirty by periodic and background writeback, see inode_defer_writeback().
+ */
+#define WB_DEFER_MAX_PAGES	16
+#define WB_DEFER_REDIRTIES	2
+
 /*
  * Passed into wb_writeback(), essentially a subset of writeback_control
  */
@@ -574,6 +587,53 @@ out:
 	return ret;
 }
 
+/*
+ * Small files which are rewritten over and over (logs, database journals,
+ * settings files, ...) get written back after every redirtying, which on
+ * flash mostly costs erase cycles.  On devices which ask for it, periodic
+ * and background writeback leave such an inode dirty until wb_defer_ms
+ * have passed since writeback last cleaned it.  Data integrity writeback
+ * and sync(2) are never deferred.
+ */
+static bool inode_defer_writeback(struct inode *inode,
+				  struct backing_dev_info *bdi,
+				  struct wb_writeback_work *work)
+{
+	if (!bdi->wb_defer_ms || !(work->for_kupdate || work->for_background))
+		return false;
+	if (inode->i_wb_redirtied < WB_DEFER_REDIRTIES ||
+	    inode->i_mapping->nrpages > WB_DEFER_MAX_PAGES)
+		return false;
+	return time_before(jiffies, inode->i_wb_cleaned +
+			   msecs_to_jiffies(bdi->wb_defer_ms));
+}
+
+/*
+ * Adapt the background chunk size of a bdi with a latency target to the
+ * time the last chunk took.  Once the device is busy, submission blocks
+ * on the request queue until earlier requests complete, so this follows
+ * the completion time of a chunk - and thus how long a read issued
+ * meanwhile may queue behind it.
+ */
+static void wb_update_chunk(struct backing_dev_info *bdi, long written,
+			    s64 elapsed)
+{
+	unsigned long chunk = bdi->wb_chunk;
+
+	/* Chunks cut short by small inodes say nothing about the device */
+	if (written < chunk / 2)
+		return;
+
+	if (elapsed > bdi->wb_max_latency)
+		chunk = div64_u64((u64)chunk * bdi->wb_max_latency, elapsed);
+	else if (elapsed < bdi->wb_max_latency / 2)
+		chunk += chunk / 8;
+
+	bdi->wb_chunk = clamp(chunk, MIN_LATENCY_WRITEBACK_PAGES,
+			      bdi->avg_write_bandwidth / 2 +
+			      MIN_WRITEBACK_PAGES);
+}
+
 static long writeback_chunk_size(struct backing_dev_info *bdi,
 				 struct wb_writeback_work *work)
 {
@@ -600,6 +660,16 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
 		pages = min(pages, work->nr_pages);
 		pages = round_down(pages + MIN_WRITEBACK_PAGES,
 				   MIN_WRITEBACK_PAGES);
+
+		if (bdi->wb_max_latency) {
+			/* Start from what the bandwidth allows */
+			if (!bdi->wb_chunk)
+				bdi->wb_chunk = max_t(unsigned long,
+					(u64)bdi->avg_write_bandwidth *
+					bdi->wb_max_latency / USEC_PER_SEC,
+					MIN_LATENCY_WRITEBACK_PAGES);
+			pages = min_t(long, pages, bdi->wb_chunk);
+		}
 	}
 
 	return pages;
@@ -627,6 +697,8 @@ static long writeback_sb_inodes(struct super_block *sb,
 	unsigned long start_time = jiffies;
 	long write_chunk;
 	long wrote = 0;  /* count both pages and inodes */
+	bool adapt_chunk;
+	ktime_t chunk_start;
 
 	while (!list_empty(&wb->b_io)) {
 		struct inode *inode = wb_inode(wb->b_io.prev);
@@ -676,6 +748,11 @@ static long writeback_sb_inodes(struct super_block *sb,
 			trace_writeback_sb_inodes_requeue(inode);
 			continue;
 		}
+		if (inode_defer_writeback(inode, wb->bdi, work)) {
+			spin_unlock(&inode->i_lock);
+			redirty_tail(inode, wb);
+			continue;
+		}
 		spin_unlock(&wb->list_lock);
 
 		/*
@@ -697,12 +774,20 @@ static long writeback_sb_inodes(struct super_block *sb,
 		wbc.nr_to_write = write_chunk;
 		wbc.pages_skipped = 0;
 
+		adapt_chunk = wb->bdi->wb_max_latency && write_chunk != LONG_MAX;
+		if (adapt_chunk)
+			chunk_start = ktime_get();
+
 		/*
 		 * We use I_SYNC to pin the inode in memory. While it is set
 		 * evict_inode() will wait so the inode cannot be freed.
 		 */
 		__writeback_single_inode(inode, &wbc);
 
+		if (adapt_chunk)
+			wb_update_chunk(wb->bdi, write_chunk - wbc.nr_to_write,
+					ktime_us_delta(ktime_get(), chunk_start));
+
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
 		wrote += write_chunk - wbc.nr_to_write;
 
@@ -722,8 +807,10 @@ static long writeback_sb_inodes(struct super_block *sb,
 
 		spin_lock(&wb->list_lock);
 		spin_lock(&inode->i_lock);
-		if (!(inode->i_state & I_DIRTY))
+		if (!(inode->i_state & I_DIRTY)) {
+			inode->i_wb_cleaned = jiffies;
 			wrote++;
+		}
 		requeue_inode(inode, wb, &wbc);
 		inode_sync_complete(inode);
 		spin_unlock(&inode->i_lock);
@@ -1239,6 +1326,18 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 					wakeup_bdi = true;
 			}
 
+			/*
+			 * Count how often in a row the inode is redirtied
+			 * soon after writeback cleaned it, for
+			 * inode_defer_writeback().
+			 */
+			if (bdi->wb_defer_ms && inode->i_wb_cleaned &&
+			    time_before(jiffies, inode->i_wb_cleaned +
+					msecs_to_jiffies(bdi->wb_defer_ms)))
+				inode->i_wb_redirtied++;
+			else
+				inode->i_wb_redirtied = 0;
+
 			inode->dirtied_when = jiffies;
 			list_move(&inode->i_wb_list, &bdi->wb.b_dirty);
 			spin_unlock(&bdi->wb.list_lock);
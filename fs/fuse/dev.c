@@ -1951,6 +1951,7 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 			ibuf->ops = NULL;
 			pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
 			pipe->nrbufs--;
+			pipe_buf_consumed(pipe);
 		} else {
 			ibuf->ops->get(pipe, ibuf);
 			*obuf = *ibuf;
@@ -151,6 +151,8 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	inode->i_cdev = NULL;
 	inode->i_rdev = 0;
 	inode->dirtied_when = 0;
+	inode->i_wb_cleaned = 0;
+	inode->i_wb_redirtied = 0;
 
 	if (security_inode_alloc(inode))
 		goto out;
@@ -134,6 +134,7 @@ extern struct dentry *__d_alloc(struct super_block *, const struct qstr *);
 extern int d_set_mounted(struct dentry *dentry);
 extern long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
 			    int nid);
+extern void d_prune_negative_workfn(struct work_struct *work);
 
 /*
  * read_write.c
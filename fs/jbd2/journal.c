@@ -43,6 +43,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
+#include <linux/blkdev.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -754,6 +755,231 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits.
+ *
+ * A fast commit writes filesystem-defined records describing changes of
+ * the running transaction into a small area at the end of the journal,
+ * without locking down the transaction.  Every fast commit block is
+ * tagged with the tid of the running transaction; recovery only accepts
+ * blocks tagged with the first transaction that is missing from the log,
+ * and the area is reused from the start once that transaction has been
+ * committed normally.  Only one fast commit is in flight at a time, and
+ * fast commits never overlap with a full commit.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction whose changes are about to be fast committed.
+ *
+ * Returns 0 if the caller may go on with the fast commit, in which case it
+ * must finish with jbd2_fc_end_commit() or jbd2_fc_end_commit_fallback().
+ * Returns -EALREADY if @tid has been committed in the meantime, and
+ * another negative error if the caller has to do a full commit instead.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	DEFINE_WAIT(wait);
+	int ret = 0;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_INODE_FC) ||
+	    !journal->j_fc_wbuf)
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	while (1) {
+		if (is_journal_aborted(journal)) {
+			ret = -EIO;
+			break;
+		}
+		if (tid_geq(journal->j_commit_sequence, tid)) {
+			ret = -EALREADY;
+			break;
+		}
+		if (!(journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+					  JBD2_FULL_COMMIT_ONGOING)))
+			break;
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+
+	/*
+	 * Until the first full commit after mount or flush the on-disk
+	 * superblock says the log is empty and recovery would not look at
+	 * fast commit blocks at all.
+	 */
+	if (!ret && ((journal->j_flags & JBD2_FLUSHED) ||
+		     !journal->j_running_transaction ||
+		     journal->j_running_transaction->t_tid != tid))
+		ret = -EINVAL;
+
+	if (!ret) {
+		journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+		journal->j_fc_tid = tid;
+		journal->j_fc_nbufs = 0;
+	}
+	write_unlock(&journal->j_state_lock);
+	return ret;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * int jbd2_fc_get_buf() - get the next fast commit block
+ * @journal: Journal to act on.
+ * @bh_out: Return location for the buffer.
+ *
+ * The buffer comes zeroed apart from the block header; the caller fills in
+ * the rest and the buffer is written out by jbd2_fc_end_commit().  Returns
+ * -ENOSPC once the fast commit area is exhausted.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	journal_header_t *header;
+	struct buffer_head *bh;
+	unsigned long long pblock;
+	int err;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal,
+				journal->j_fc_first + journal->j_fc_off,
+				&pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	header = (journal_header_t *)bh->b_data;
+	header->h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	header->h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	header->h_sequence = cpu_to_be32(journal->j_fc_tid);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_wbuf[journal->j_fc_nbufs++] = bh;
+	journal->j_fc_off++;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+static void jbd2_fc_submit_buf(struct buffer_head *bh, int write_op)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(write_op, bh);
+}
+
+static void jbd2_fc_finish(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	journal->j_fc_nbufs = 0;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_end_commit() - write out a fast commit
+ * @journal: Journal to act on.
+ *
+ * Writes all buffers handed out by jbd2_fc_get_buf() and waits for them.
+ * The last block is written with a cache flush and FUA so that data the
+ * caller wrote before starting the fast commit is stable as well.
+ * Returns 0 when the fast commit is on disk; on error the caller has to
+ * fall back to a full commit.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	int nbufs = journal->j_fc_nbufs;
+	int write_op = WRITE_SYNC;
+	struct buffer_head *bh;
+	int i, err = 0;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	if (nbufs && (journal->j_flags & JBD2_BARRIER)) {
+		/* Data for an external journal lives on another device */
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		write_op = WRITE_FLUSH_FUA;
+	}
+
+	/*
+	 * The flush only covers writes which have already completed, so the
+	 * last block goes out after all the others are done.
+	 */
+	for (i = 0; i < nbufs - 1; i++)
+		jbd2_fc_submit_buf(journal->j_fc_wbuf[i], WRITE_SYNC);
+	for (i = 0; i < nbufs - 1; i++) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+	}
+	if (nbufs) {
+		bh = journal->j_fc_wbuf[nbufs - 1];
+		jbd2_fc_submit_buf(bh, write_op);
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+	}
+
+	for (i = 0; i < nbufs; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	if (!err && nbufs) {
+		spin_lock(&journal->j_history_lock);
+		journal->j_stats.ts_fc_commits++;
+		journal->j_stats.ts_fc_blocks += nbufs;
+		spin_unlock(&journal->j_history_lock);
+	}
+
+	jbd2_fc_finish(journal);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * void jbd2_fc_end_commit_fallback() - abandon a fast commit
+ * @journal: Journal to act on.
+ *
+ * Drops the buffers handed out so far without writing them.  The caller
+ * is expected to do a full commit instead.
+ */
+void jbd2_fc_end_commit_fallback(journal_t *journal)
+{
+	int i;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	for (i = 0; i < journal->j_fc_nbufs; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+	journal->j_fc_off -= journal->j_fc_nbufs;
+	jbd2_fc_finish(journal);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
 /*
  * Log buffer allocation routines:
  */
@@ -986,6 +1212,10 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	if (JBD2_HAS_INCOMPAT_FEATURE(s->journal,
+				      JBD2_FEATURE_INCOMPAT_INODE_FC))
+		seq_printf(seq, "%lu fast commits (%lu blocks)\n",
+			   s->stats->ts_fc_commits, s->stats->ts_fc_blocks);
 	return 0;
 }
 
@@ -1089,6 +1319,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1274,6 +1505,75 @@ static void journal_fail_superblock (journal_t *journal)
 	journal->j_sb_buffer = NULL;
 }
 
+/*
+ * Carve the fast commit area out of the end of the journal.  Only
+ * called while the log is not in use, so that moving j_last cannot
+ * strand any live log blocks.
+ */
+static int jbd2_journal_setup_fast_commit(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long first = be32_to_cpu(sb->s_first);
+	unsigned long maxlen = be32_to_cpu(sb->s_maxlen);
+	unsigned long num_fc_blks = be32_to_cpu(sb->s_inode_fc_blks);
+
+	if (!num_fc_blks)
+		num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+
+	if (first + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks > maxlen + 1) {
+		printk(KERN_ERR "JBD2: Journal too short for %lu fast commit "
+		       "blocks (blocks %lu-%lu).\n", num_fc_blks, first, maxlen);
+		return -EINVAL;
+	}
+
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kcalloc(num_fc_blks,
+					     sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+
+	journal->j_fc_last = maxlen;
+	journal->j_fc_first = maxlen - num_fc_blks;
+	journal->j_last = journal->j_fc_first;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
+/*
+ * Turn on fast commits for a journal which has just been loaded and is
+ * still empty.
+ */
+static int jbd2_journal_init_fast_commit(journal_t *journal)
+{
+	int busy, err;
+
+	read_lock(&journal->j_state_lock);
+	busy = journal->j_running_transaction ||
+	       journal->j_committing_transaction ||
+	       journal->j_head != journal->j_first ||
+	       journal->j_tail != journal->j_first;
+	read_unlock(&journal->j_state_lock);
+	if (busy)
+		return -EBUSY;
+
+	err = jbd2_journal_setup_fast_commit(journal);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	journal->j_free = journal->j_last - journal->j_first;
+	/*
+	 * Fast commits must not be written before the superblock carrying
+	 * the feature flag is on disk, or recovery would never look for
+	 * them.  Make the next full commit write it out.
+	 */
+	journal->j_flags |= JBD2_FLUSHED;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
 /*
  * Given a journal_t structure, initialise the various fields for
  * startup of a new journaling session.  We use this both when creating
@@ -1298,9 +1598,16 @@ static int journal_reset(journal_t *journal)
 	journal->j_first = first;
 	journal->j_last = last;
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_INODE_FC) &&
+	    jbd2_journal_setup_fast_commit(journal)) {
+		journal_fail_superblock(journal);
+		return -EINVAL;
+	}
+
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
@@ -1613,6 +1920,11 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	/* Recovery must wrap the log before the fast commit area */
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_INODE_FC))
+		return jbd2_journal_setup_fast_commit(journal);
+
 	return 0;
 }
 
@@ -1753,6 +2065,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1893,6 +2206,12 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 		}
 	}
 
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_INODE_FC) &&
+	    jbd2_journal_init_fast_commit(journal)) {
+		printk(KERN_ERR "JBD2: Cannot enable fast commits.\n");
+		return 0;
+	}
+
 	/* If enabling v1 checksums, downgrade superblock */
 	if (COMPAT_FEATURE_ON(JBD2_FEATURE_COMPAT_CHECKSUM))
 		sb->s_feature_incompat &=
@@ -36,6 +36,7 @@ struct recovery_info
 	int		nr_replays;
 	int		nr_revokes;
 	int		nr_revoke_hits;
+	int		nr_fc_replays;
 };
 
 enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
@@ -43,6 +44,7 @@ static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
 				tid_t, struct recovery_info *);
+static int fc_do_one_pass(journal_t *journal, struct recovery_info *info);
 
 #ifdef __KERNEL__
 
@@ -243,7 +245,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  Fast commit blocks which follow the last transaction in
+ * the log are then handed to the filesystem.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -273,12 +276,16 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_one_pass(journal, &info);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
 		  err, info.start_transaction, info.end_transaction);
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
+	jbd_debug(1, "JBD2: Replayed %d fast commit blocks\n",
+		  info.nr_fc_replays);
 
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
@@ -338,6 +345,58 @@ int jbd2_journal_skip_recovery(journal_t *journal)
 	return err;
 }
 
+/*
+ * Hand the fast commit blocks of the first transaction missing from the
+ * log to the filesystem.  The area is filled from its start, so the first
+ * block with a stale or foreign header ends it.
+ */
+static int fc_do_one_pass(journal_t *journal, struct recovery_info *info)
+{
+	unsigned int expected_tid = info->end_transaction;
+	unsigned long next_fc_block;
+	journal_header_t *tmp;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_INODE_FC) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	for (next_fc_block = journal->j_fc_first;
+	     next_fc_block < journal->j_fc_last; next_fc_block++) {
+		cond_resched();
+
+		err = jread(&bh, journal, next_fc_block);
+		if (err)
+			break;
+
+		tmp = (journal_header_t *)bh->b_data;
+		if (tmp->h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    be32_to_cpu(tmp->h_blocktype) != JBD2_FC_BLOCK ||
+		    be32_to_cpu(tmp->h_sequence) != expected_tid) {
+			brelse(bh);
+			break;
+		}
+
+		err = journal->j_fc_replay_callback(journal, bh,
+				next_fc_block - journal->j_fc_first,
+				expected_tid);
+		brelse(bh);
+		if (err) {
+			if (err > 0)
+				err = 0;
+			break;
+		}
+		info->nr_fc_replays++;
+	}
+
+	if (err)
+		printk(KERN_ERR "JBD2: error %d replaying fast commit block "
+		       "%lu\n", err, next_fc_block);
+	return err;
+}
+
 static inline unsigned long long read_tag_block(journal_t *journal,
 						journal_block_tag_t *tag)
 {
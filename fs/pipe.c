@@ -22,6 +22,8 @@
 #include <linux/syscalls.h>
 #include <linux/fcntl.h>
 #include <linux/aio.h>
+#include <linux/sched.h>
+#include <linux/sysctl.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -39,6 +41,24 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * Maximum allocatable pages per user.  Once a user goes over the soft
+ * limit new pipes start small and no pipe of theirs grows on its own;
+ * over either limit F_SETPIPE_SZ can't grow their pipes without
+ * CAP_SYS_RESOURCE.  0 means no limit.  Can be set by root in
+ * /proc/sys/fs/pipe-user-pages-{soft,hard}.
+ */
+unsigned long pipe_user_pages_hard;
+unsigned long pipe_user_pages_soft = PIPE_DEF_BUFFERS * INR_OPEN_CUR;
+
+/*
+ * Pipes grow by doubling, up to pipe_max_size, when writers keep filling
+ * them while the reader keeps up; see pipe_auto_grow().  A grown pipe is
+ * halved again when, over PIPE_SHRINK_INTERVAL times it was emptied, it
+ * never held more than a quarter of its buffers.
+ */
+#define PIPE_SHRINK_INTERVAL	64
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -226,6 +246,99 @@ static const struct pipe_buf_operations packet_pipe_buf_ops = {
 	.get = generic_pipe_buf_get,
 };
 
+static void account_pipe_buffers(struct pipe_inode_info *pipe,
+				 unsigned long old, unsigned long new)
+{
+	atomic_long_add(new - old, &pipe->user->pipe_bufs);
+}
+
+static bool too_many_pipe_buffers_soft(struct user_struct *user)
+{
+	return pipe_user_pages_soft &&
+	       atomic_long_read(&user->pipe_bufs) >= pipe_user_pages_soft;
+}
+
+static bool too_many_pipe_buffers_hard(struct user_struct *user)
+{
+	return pipe_user_pages_hard &&
+	       atomic_long_read(&user->pipe_bufs) >= pipe_user_pages_hard;
+}
+
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages);
+
+/*
+ * Called by a writer that found the pipe full.  If the reader has
+ * consumed at least a pipe's worth of buffers since the last time that
+ * happened, the pipe is too small for the throughput and is doubled.
+ * Returns true if there is room now.
+ */
+static bool pipe_auto_grow(struct pipe_inode_info *pipe)
+{
+	bool keeping_up;
+
+	keeping_up = pipe->consumed - pipe->consumed_at_full >= pipe->buffers;
+	pipe->consumed_at_full = pipe->consumed;
+
+	if (!keeping_up || pipe->buffers >= pipe->auto_max ||
+	    too_many_pipe_buffers_soft(pipe->user))
+		return false;
+
+	if (pipe_set_size(pipe, pipe->buffers * 2) < 0)
+		return false;
+	pipe->peak = pipe->nrbufs;
+	pipe->drains = 0;
+	return true;
+}
+
+/* Called by a reader that emptied the pipe */
+static void pipe_auto_shrink(struct pipe_inode_info *pipe)
+{
+	if (++pipe->drains < PIPE_SHRINK_INTERVAL)
+		return;
+
+	if (pipe->auto_max && pipe->buffers > PIPE_DEF_BUFFERS &&
+	    pipe->peak <= pipe->buffers / 4)
+		pipe_set_size(pipe, pipe->buffers / 2);
+	pipe->peak = 0;
+	pipe->drains = 0;
+}
+
+/*
+ * Called by readers, through read(2) or splice, once they have taken a
+ * buffer out of the pipe, so that pipes grow and shrink with the pace of
+ * any kind of reader.
+ */
+void pipe_buf_consumed(struct pipe_inode_info *pipe)
+{
+	pipe->consumed++;
+	if (!pipe->nrbufs)
+		pipe_auto_shrink(pipe);
+}
+EXPORT_SYMBOL(pipe_buf_consumed);
+
+/*
+ * Take a reference to the user page at the start of @from if the write
+ * can pass it on to the reader instead of copying it: a whole, page
+ * aligned user page.
+ */
+static struct page *pipe_gift_page(struct iov_iter *from)
+{
+	struct iovec iov;
+	struct page *page;
+
+	if (from->type & (ITER_KVEC | ITER_BVEC))
+		return NULL;
+
+	iov = iov_iter_iovec(from);
+	if (((unsigned long)iov.iov_base & ~PAGE_MASK) ||
+	    iov.iov_len < PAGE_SIZE)
+		return NULL;
+
+	if (get_user_pages_fast((unsigned long)iov.iov_base, 1, 0, &page) != 1)
+		return NULL;
+	return page;
+}
+
 static ssize_t
 pipe_read(struct kiocb *iocb, struct iov_iter *to)
 {
@@ -284,6 +397,7 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 				curbuf = (curbuf + 1) & (pipe->buffers - 1);
 				pipe->curbuf = curbuf;
 				pipe->nrbufs = --bufs;
+				pipe_buf_consumed(pipe);
 				do_wakeup = 1;
 			}
 			total_len -= chars;
@@ -357,9 +471,13 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		goto out;
 	}
 
-	/* We try to merge small writes */
+	/*
+	 * We try to merge small writes, but not in front of pages that
+	 * might be passed on as they are.
+	 */
 	chars = total_len & (PAGE_SIZE-1); /* size of the last buffer */
-	if (pipe->nrbufs && chars != 0) {
+	if (pipe->nrbufs && chars != 0 &&
+	    !(pipe->gift_file == filp && total_len >= PAGE_SIZE)) {
 		int lastbuf = (pipe->curbuf + pipe->nrbufs - 1) &
 							(pipe->buffers - 1);
 		struct pipe_buffer *buf = pipe->bufs + lastbuf;
@@ -397,9 +515,30 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			int copied;
 
+			if (pipe->gift_file == filp && !is_packetized(filp) &&
+			    (page = pipe_gift_page(from))) {
+				iov_iter_advance(from, PAGE_SIZE);
+				do_wakeup = 1;
+				ret += PAGE_SIZE;
+
+				buf->page = page;
+				buf->ops = &nosteal_pipe_buf_ops;
+				buf->offset = 0;
+				buf->len = PAGE_SIZE;
+				buf->flags = 0;
+				pipe->nrbufs = ++bufs;
+				if (bufs > pipe->peak)
+					pipe->peak = bufs;
+
+				if (!iov_iter_count(from))
+					break;
+				continue;
+			}
+			page = pipe->tmp_page;
+
 			if (!page) {
 				page = alloc_page(GFP_HIGHUSER);
 				if (unlikely(!page)) {
@@ -434,12 +573,16 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			}
 			pipe->nrbufs = ++bufs;
 			pipe->tmp_page = NULL;
+			if (bufs > pipe->peak)
+				pipe->peak = bufs;
 
 			if (!iov_iter_count(from))
 				break;
 		}
 		if (bufs < pipe->buffers)
 			continue;
+		if (pipe_auto_grow(pipe))
+			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
 				ret = -EAGAIN;
@@ -554,6 +697,8 @@ pipe_release(struct inode *inode, struct file *file)
 		pipe->readers--;
 	if (file->f_mode & FMODE_WRITE)
 		pipe->writers--;
+	if (pipe->gift_file == file)
+		pipe->gift_file = NULL;
 
 	if (pipe->readers || pipe->writers) {
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM | POLLERR | POLLHUP);
@@ -588,20 +733,30 @@ pipe_fasync(int fd, struct file *filp, int on)
 struct pipe_inode_info *alloc_pipe_info(void)
 {
 	struct pipe_inode_info *pipe;
+	unsigned long pipe_bufs = PIPE_DEF_BUFFERS;
+	struct user_struct *user = get_current_user();
+
+	if (too_many_pipe_buffers_soft(user))
+		pipe_bufs = PIPE_MIN_DEF_BUFFERS;
 
 	pipe = kzalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
 	if (pipe) {
-		pipe->bufs = kzalloc(sizeof(struct pipe_buffer) * PIPE_DEF_BUFFERS, GFP_KERNEL);
+		pipe->bufs = kcalloc(pipe_bufs, sizeof(struct pipe_buffer),
+				     GFP_KERNEL);
 		if (pipe->bufs) {
 			init_waitqueue_head(&pipe->wait);
 			pipe->r_counter = pipe->w_counter = 1;
-			pipe->buffers = PIPE_DEF_BUFFERS;
+			pipe->buffers = pipe_bufs;
+			pipe->auto_max = pipe_max_size >> PAGE_SHIFT;
+			pipe->user = user;
+			account_pipe_buffers(pipe, 0, pipe_bufs);
 			mutex_init(&pipe->mutex);
 			return pipe;
 		}
 		kfree(pipe);
 	}
 
+	free_uid(user);
 	return NULL;
 }
 
@@ -616,6 +771,8 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 	}
 	if (pipe->tmp_page)
 		__free_page(pipe->tmp_page);
+	account_pipe_buffers(pipe, pipe->buffers, 0);
+	free_uid(pipe->user);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -999,6 +1156,7 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 			memcpy(bufs + head, pipe->bufs, tail * sizeof(struct pipe_buffer));
 	}
 
+	account_pipe_buffers(pipe, pipe->buffers, nr_pages);
 	pipe->curbuf = 0;
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
@@ -1070,13 +1228,37 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 		if (!capable(CAP_SYS_RESOURCE) && size > pipe_max_size) {
 			ret = -EPERM;
 			goto out;
+		} else if (nr_pages > pipe->buffers &&
+			   (too_many_pipe_buffers_hard(pipe->user) ||
+			    too_many_pipe_buffers_soft(pipe->user)) &&
+			   !capable(CAP_SYS_RESOURCE) &&
+			   !capable(CAP_SYS_ADMIN)) {
+			ret = -EPERM;
+			goto out;
 		}
 		ret = pipe_set_size(pipe, nr_pages);
+		/* An explicit size is kept */
+		if (ret >= 0)
+			pipe->auto_max = 0;
 		break;
 		}
 	case F_GETPIPE_SZ:
 		ret = pipe->buffers * PAGE_SIZE;
 		break;
+	case F_SETPIPE_GIFT:
+		/* only the writer can give its own pages away */
+		ret = -EBADF;
+		if (!(file->f_mode & FMODE_WRITE))
+			goto out;
+		ret = -EBUSY;
+		if (pipe->gift_file && pipe->gift_file != file)
+			goto out;
+		pipe->gift_file = arg ? file : NULL;
+		ret = 0;
+		break;
+	case F_GETPIPE_GIFT:
+		ret = pipe->gift_file == file;
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -1111,10 +1293,34 @@ static struct file_system_type pipe_fs_type = {
 	.kill_sb	= kill_anon_super,
 };
 
+#ifdef CONFIG_SYSCTL
+static struct ctl_table pipe_sysctls[] = {
+	{
+		.procname	= "pipe-user-pages-hard",
+		.data		= &pipe_user_pages_hard,
+		.maxlen		= sizeof(pipe_user_pages_hard),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
+	{
+		.procname	= "pipe-user-pages-soft",
+		.data		= &pipe_user_pages_soft,
+		.maxlen		= sizeof(pipe_user_pages_soft),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
+	{ }
+};
+#endif
+
 static int __init init_pipe_fs(void)
 {
 	int err = register_filesystem(&pipe_fs_type);
 
+#ifdef CONFIG_SYSCTL
+	register_sysctl("fs", pipe_sysctls);
+#endif
+
 	if (!err) {
 		pipe_mnt = kern_mount(&pipe_fs_type);
 		if (IS_ERR(pipe_mnt)) {
@@ -28,7 +28,12 @@
 #include <linux/console.h>
 #include <linux/module.h>
 #include <linux/pstore.h>
+#ifdef CONFIG_PSTORE_ZLIB_COMPRESS
 #include <linux/zlib.h>
+#endif
+#ifdef CONFIG_PSTORE_LZ4_COMPRESS
+#include <linux/lz4.h>
+#endif
 #include <linux/string.h>
 #include <linux/timer.h>
 #include <linux/slab.h>
@@ -68,12 +73,6 @@ struct pstore_info *psinfo;
 
 static char *backend;
 
-/* Compression parameters */
-#define COMPR_LEVEL 6
-#define WINDOW_BITS 12
-#define MEM_LEVEL 4
-static struct z_stream_s stream;
-
 static char *big_oops_buf;
 static size_t big_oops_buf_sz;
 
@@ -129,6 +128,13 @@ bool pstore_cannot_block_path(enum kmsg_dump_reason reason)
 }
 EXPORT_SYMBOL_GPL(pstore_cannot_block_path);
 
+#ifdef CONFIG_PSTORE_ZLIB_COMPRESS
+/* Compression parameters */
+#define COMPR_LEVEL 6
+#define WINDOW_BITS 12
+#define MEM_LEVEL 4
+static struct z_stream_s stream;
+
 /* Derived from logfs_compress() */
 static int pstore_compress(const void *in, void *out, size_t inlen,
 							size_t outlen)
@@ -236,6 +242,74 @@ static void allocate_buf_for_compression(void)
 	}
 
 }
+#endif
+
+#ifdef CONFIG_PSTORE_LZ4_COMPRESS
+static unsigned char *workspace;
+static unsigned char *lz4_cbuf;
+
+/*
+ * lz4_compress() may write up to lz4_compressbound() bytes, so compress
+ * into a scratch buffer and only copy out results that fit.
+ */
+static int pstore_compress(const void *in, void *out, size_t inlen,
+							size_t outlen)
+{
+	size_t out_len;
+	int ret;
+
+	ret = lz4_compress(in, inlen, lz4_cbuf, &out_len, workspace);
+	if (ret) {
+		pr_err("lz4_compress error, ret = %d!\n", ret);
+		return -EIO;
+	}
+
+	if (out_len >= inlen || out_len > outlen)
+		return -EIO;
+
+	memcpy(out, lz4_cbuf, out_len);
+	return out_len;
+}
+
+static int pstore_decompress(void *in, void *out, size_t inlen, size_t outlen)
+{
+	int ret;
+
+	ret = lz4_decompress_unknownoutputsize(in, inlen, out, &outlen);
+	if (ret) {
+		pr_err("lz4_decompress error, ret = %d!\n", ret);
+		return -EIO;
+	}
+
+	return outlen;
+}
+
+static void allocate_buf_for_compression(void)
+{
+	/*
+	 * Console logs usually compress at least 2:1 with lz4; records
+	 * that don't are stored uncompressed.
+	 */
+	big_oops_buf_sz = psinfo->bufsize * 2;
+	big_oops_buf = kmalloc(big_oops_buf_sz, GFP_KERNEL);
+	if (!big_oops_buf) {
+		pr_err("No memory for uncompressed data; skipping compression\n");
+		return;
+	}
+
+	workspace = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	lz4_cbuf = kmalloc(lz4_compressbound(big_oops_buf_sz), GFP_KERNEL);
+	if (!workspace || !lz4_cbuf) {
+		pr_err("No memory for compression workspace; skipping compression\n");
+		kfree(workspace);
+		kfree(lz4_cbuf);
+		workspace = NULL;
+		lz4_cbuf = NULL;
+		kfree(big_oops_buf);
+		big_oops_buf = NULL;
+	}
+}
+#endif
 
 /*
  * Called when compression fails, since the printk buffer
@@ -37,6 +37,7 @@
 
 #define RAMOOPS_KERNMSG_HDR "===="
 #define MIN_MEM_SIZE 4096UL
+#define MIN_FTRACE_ZONE_SIZE 128UL
 
 static ulong record_size = MIN_MEM_SIZE;
 module_param(record_size, ulong, 0400);
@@ -51,6 +52,11 @@ static ulong ramoops_ftrace_size = MIN_MEM_SIZE;
 module_param_named(ftrace_size, ramoops_ftrace_size, ulong, 0400);
 MODULE_PARM_DESC(ftrace_size, "size of ftrace log");
 
+static int ramoops_ftrace_per_cpu;
+module_param_named(ftrace_per_cpu, ramoops_ftrace_per_cpu, int, 0400);
+MODULE_PARM_DESC(ftrace_per_cpu,
+		"set to 1 to split the ftrace log into per-CPU zones (default 0)");
+
 static ulong ramoops_pmsg_size = MIN_MEM_SIZE;
 module_param_named(pmsg_size, ramoops_pmsg_size, ulong, 0400);
 MODULE_PARM_DESC(pmsg_size, "size of user space message log");
@@ -85,7 +91,7 @@ MODULE_PARM_DESC(ramoops_ecc,
 struct ramoops_context {
 	struct persistent_ram_zone **przs;
 	struct persistent_ram_zone *cprz;
-	struct persistent_ram_zone *fprz;
+	struct persistent_ram_zone **fprzs;
 	struct persistent_ram_zone *mprz;
 	phys_addr_t phys_addr;
 	unsigned long size;
@@ -95,8 +101,10 @@ struct ramoops_context {
 	size_t ftrace_size;
 	size_t pmsg_size;
 	int dump_oops;
+	u32 flags;
 	struct persistent_ram_ecc_info ecc_info;
 	unsigned int max_dump_cnt;
+	unsigned int max_ftrace_cnt;
 	unsigned int dump_write_cnt;
 	/* _read_cnt need clear on ramoops_pstore_open */
 	unsigned int dump_read_cnt;
@@ -176,6 +184,45 @@ static bool prz_ok(struct persistent_ram_zone *prz)
 			   persistent_ram_ecc_string(prz, NULL, 0));
 }
 
+/*
+ * With per-CPU ftrace zones, hand all of them back as a single record;
+ * every entry carries its CPU number, so nothing is lost by
+ * concatenating them.
+ */
+static ssize_t ramoops_read_ftrace_percpu(struct ramoops_context *cxt,
+					  u64 *id, enum pstore_type_id *type,
+					  char **buf)
+{
+	struct persistent_ram_zone *prz;
+	size_t size = 0;
+	char *p;
+	int i;
+
+	if (cxt->ftrace_read_cnt)
+		return 0;
+	cxt->ftrace_read_cnt = cxt->max_ftrace_cnt;
+
+	for (i = 0; i < cxt->max_ftrace_cnt; i++)
+		size += persistent_ram_old_size(cxt->fprzs[i]);
+	if (!size)
+		return 0;
+
+	*buf = kmalloc(size, GFP_KERNEL);
+	if (*buf == NULL)
+		return -ENOMEM;
+
+	p = *buf;
+	for (i = 0; i < cxt->max_ftrace_cnt; i++) {
+		prz = cxt->fprzs[i];
+		memcpy(p, persistent_ram_old(prz), persistent_ram_old_size(prz));
+		p += persistent_ram_old_size(prz);
+	}
+
+	*type = PSTORE_TYPE_FTRACE;
+	*id = 0;
+	return size;
+}
+
 static ssize_t ramoops_pstore_read(u64 *id, enum pstore_type_id *type,
 				   int *count, struct timespec *time,
 				   char **buf, bool *compressed,
@@ -192,9 +239,20 @@ static ssize_t ramoops_pstore_read(u64 *id, enum pstore_type_id *type,
 	if (!prz_ok(prz))
 		prz = ramoops_get_next_prz(&cxt->cprz, &cxt->console_read_cnt,
 					   1, id, type, PSTORE_TYPE_CONSOLE, 0);
+	if (!prz_ok(prz) && cxt->max_ftrace_cnt > 1) {
+		size = ramoops_read_ftrace_percpu(cxt, id, type, buf);
+		if (size) {
+			/* ftrace records carry no kmsg header */
+			time->tv_sec = 0;
+			time->tv_nsec = 0;
+			*compressed = false;
+			return size;
+		}
+	}
 	if (!prz_ok(prz))
-		prz = ramoops_get_next_prz(&cxt->fprz, &cxt->ftrace_read_cnt,
-					   1, id, type, PSTORE_TYPE_FTRACE, 0);
+		prz = ramoops_get_next_prz(cxt->fprzs, &cxt->ftrace_read_cnt,
+					   cxt->max_ftrace_cnt, id, type,
+					   PSTORE_TYPE_FTRACE, 0);
 	if (!prz_ok(prz))
 		prz = ramoops_get_next_prz(&cxt->mprz, &cxt->pmsg_read_cnt,
 					   1, id, type, PSTORE_TYPE_PMSG, 0);
@@ -257,9 +315,17 @@ static int notrace ramoops_pstore_write_buf(enum pstore_type_id type,
 		persistent_ram_write(cxt->cprz, buf, size);
 		return 0;
 	} else if (type == PSTORE_TYPE_FTRACE) {
-		if (!cxt->fprz)
+		int zonenum = 0;
+
+		if (!cxt->fprzs)
 			return -ENOMEM;
-		persistent_ram_write(cxt->fprz, buf, size);
+		/*
+		 * The ftrace callback runs with interrupts disabled, so the
+		 * current CPU is the only writer of its zone.
+		 */
+		if (cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU)
+			zonenum = raw_smp_processor_id();
+		persistent_ram_write(cxt->fprzs[zonenum], buf, size);
 		return 0;
 	} else if (type == PSTORE_TYPE_PMSG) {
 		if (!cxt->mprz)
@@ -310,6 +376,7 @@ static int ramoops_pstore_erase(enum pstore_type_id type, u64 id, int count,
 {
 	struct ramoops_context *cxt = psi->data;
 	struct persistent_ram_zone *prz;
+	int i;
 
 	switch (type) {
 	case PSTORE_TYPE_DMESG:
@@ -321,7 +388,14 @@ static int ramoops_pstore_erase(enum pstore_type_id type, u64 id, int count,
 		prz = cxt->cprz;
 		break;
 	case PSTORE_TYPE_FTRACE:
-		prz = cxt->fprz;
+		if (!cxt->fprzs)
+			return -EINVAL;
+		/* Per-CPU zones are read back as one record */
+		for (i = 1; i < cxt->max_ftrace_cnt; i++) {
+			persistent_ram_free_old(cxt->fprzs[i]);
+			persistent_ram_zap(cxt->fprzs[i]);
+		}
+		prz = cxt->fprzs[0];
 		break;
 	case PSTORE_TYPE_PMSG:
 		prz = cxt->mprz;
@@ -408,7 +482,7 @@ fail_prz:
 
 static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 			    struct persistent_ram_zone **prz,
-			    phys_addr_t *paddr, size_t sz, u32 sig)
+			    phys_addr_t *paddr, size_t sz, u32 sig, u32 flags)
 {
 	if (!sz)
 		return 0;
@@ -421,7 +495,7 @@ static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 	}
 
 	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info,
-				  cxt->memtype, 0);
+				  cxt->memtype, flags);
 	if (IS_ERR(*prz)) {
 		int err = PTR_ERR(*prz);
 
@@ -437,6 +511,62 @@ static int ramoops_init_prz(struct device *dev, struct ramoops_context *cxt,
 	return 0;
 }
 
+static void ramoops_free_fprzs(struct ramoops_context *cxt)
+{
+	int i;
+
+	if (!cxt->fprzs)
+		return;
+
+	for (i = 0; i < cxt->max_ftrace_cnt; i++)
+		persistent_ram_free(cxt->fprzs[i]);
+	kfree(cxt->fprzs);
+	cxt->fprzs = NULL;
+	cxt->max_ftrace_cnt = 0;
+}
+
+static int ramoops_init_fprzs(struct device *dev, struct ramoops_context *cxt,
+			      phys_addr_t *paddr)
+{
+	size_t sz = cxt->ftrace_size;
+	unsigned int cnt = 1;
+	int err, i;
+
+	if (!sz)
+		return 0;
+
+	if (cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU) {
+		cnt = nr_cpu_ids;
+		sz /= cnt;
+		if (sz < MIN_FTRACE_ZONE_SIZE) {
+			dev_err(dev, "ftrace size 0x%zx too small for %u CPUs\n",
+				cxt->ftrace_size, cnt);
+			return -EINVAL;
+		}
+	}
+
+	cxt->fprzs = kcalloc(cnt, sizeof(*cxt->fprzs), GFP_KERNEL);
+	if (!cxt->fprzs)
+		return -ENOMEM;
+	cxt->max_ftrace_cnt = cnt;
+
+	for (i = 0; i < cnt; i++) {
+		err = ramoops_init_prz(dev, cxt, &cxt->fprzs[i], paddr, sz,
+				       LINUX_VERSION_CODE,
+				       cnt > 1 ? PRZ_FLAG_NO_LOCK : 0);
+		if (err) {
+			cxt->fprzs[i] = NULL;
+			ramoops_free_fprzs(cxt);
+			return err;
+		}
+	}
+
+	/* Leave the tail of an uneven split unused */
+	*paddr += cxt->ftrace_size - sz * cnt;
+
+	return 0;
+}
+
 void notrace ramoops_console_write_buf(const char *buf, size_t size)
 {
 	struct ramoops_context *cxt = &oops_cxt;
@@ -482,6 +612,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	cxt->ftrace_size = pdata->ftrace_size;
 	cxt->pmsg_size = pdata->pmsg_size;
 	cxt->dump_oops = pdata->dump_oops;
+	cxt->flags = pdata->flags;
 	cxt->ecc_info = pdata->ecc_info;
 
 	paddr = cxt->phys_addr;
@@ -493,16 +624,16 @@ static int ramoops_probe(struct platform_device *pdev)
 		goto fail_out;
 
 	err = ramoops_init_prz(dev, cxt, &cxt->cprz, &paddr,
-			       cxt->console_size, 0);
+			       cxt->console_size, 0, 0);
 	if (err)
 		goto fail_init_cprz;
 
-	err = ramoops_init_prz(dev, cxt, &cxt->fprz, &paddr, cxt->ftrace_size,
-			       LINUX_VERSION_CODE);
+	err = ramoops_init_fprzs(dev, cxt, &paddr);
 	if (err)
 		goto fail_init_fprz;
 
-	err = ramoops_init_prz(dev, cxt, &cxt->mprz, &paddr, cxt->pmsg_size, 0);
+	err = ramoops_init_prz(dev, cxt, &cxt->mprz, &paddr, cxt->pmsg_size,
+			       0, 0);
 	if (err)
 		goto fail_init_mprz;
 
@@ -552,7 +683,7 @@ fail_clear:
 	cxt->max_dump_cnt = 0;
 	kfree(cxt->mprz);
 fail_init_mprz:
-	kfree(cxt->fprz);
+	ramoops_free_fprzs(cxt);
 fail_init_fprz:
 	kfree(cxt->cprz);
 fail_init_cprz:
@@ -612,6 +743,8 @@ static void ramoops_register_dummy(void)
 	dummy_data->ftrace_size = ramoops_ftrace_size;
 	dummy_data->pmsg_size = ramoops_pmsg_size;
 	dummy_data->dump_oops = dump_oops;
+	if (ramoops_ftrace_per_cpu)
+		dummy_data->flags |= RAMOOPS_FLAG_FTRACE_PER_CPU;
 	/*
 	 * For backwards compatibility ramoops.ecc=1 means 16 bytes ECC
 	 * (using 1 byte for ECC isn't much of use anyway).
@@ -786,6 +786,7 @@ static int splice_from_pipe_feed(struct pipe_inode_info *pipe, struct splice_des
 			ops->release(pipe, buf);
 			pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
 			pipe->nrbufs--;
+			pipe_buf_consumed(pipe);
 			if (pipe->files)
 				sd->need_wakeup = true;
 		}
@@ -1043,6 +1044,7 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 				ops->release(pipe, buf);
 				pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
 				pipe->nrbufs--;
+				pipe_buf_consumed(pipe);
 				if (pipe->files)
 					sd.need_wakeup = true;
 			} else {
@@ -1868,6 +1870,7 @@ retry:
 			opipe->nrbufs++;
 			ipipe->curbuf = (ipipe->curbuf + 1) & (ipipe->buffers - 1);
 			ipipe->nrbufs--;
+			pipe_buf_consumed(ipipe);
 			input_wakeup = true;
 		} else {
 			/*
@@ -190,6 +190,7 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 	INIT_HLIST_NODE(&s->s_instances);
 	INIT_HLIST_BL_HEAD(&s->s_anon);
 	INIT_LIST_HEAD(&s->s_inodes);
+	INIT_WORK(&s->s_dentry_prune_work, d_prune_negative_workfn);
 
 	if (list_lru_init(&s->s_dentry_lru))
 		goto fail;
@@ -283,6 +284,8 @@ void deactivate_locked_super(struct super_block *s)
 		cleancache_invalidate_fs(s);
 		unregister_shrinker(&s->s_shrink);
 		fs->kill_sb(s);
+		/* All dentries are gone, nothing can queue it again */
+		cancel_work_sync(&s->s_dentry_prune_work);
 
 		put_filesystem(fs);
 		put_super(s);
@@ -58,6 +58,13 @@ struct bdi_writeback {
 	spinlock_t list_lock;		/* protects the b_* lists */
 };
 
+/*
+ * Upper bounds of the writeback hints.  Deferral must stay well within
+ * the range time_before() can compare in jiffies.
+ */
+#define WB_MAX_LATENCY_US	10000000U	/* 10s */
+#define WB_MAX_DEFER_MS		3600000U	/* 1h */
+
 struct backing_dev_info {
 	struct list_head bdi_list;
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
@@ -91,6 +98,15 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	/*
+	 * Writeback hints for latency sensitive devices, see
+	 * blk_queue_writeback_hints().  @wb_chunk is the background chunk
+	 * size the flusher has adapted to @wb_max_latency.
+	 */
+	unsigned int wb_max_latency;	/* chunk latency target, us */
+	unsigned int wb_defer_ms;	/* defer rewritten small inodes, ms */
+	unsigned long wb_chunk;
+
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list & wb.dwork scheduling */
 
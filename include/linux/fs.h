@@ -596,6 +596,8 @@ struct inode {
 	struct mutex		i_mutex;
 
 	unsigned long		dirtied_when;	/* jiffies of first dirtying */
+	unsigned long		i_wb_cleaned;	/* jiffies flusher last cleaned it */
+	unsigned int		i_wb_redirtied;	/* redirtied soon after cleaning */
 
 	struct hlist_node	i_hash;
 	struct list_head	i_wb_list;	/* backing dev IO list */
@@ -1294,6 +1296,10 @@ struct super_block {
 	struct workqueue_struct *s_dio_done_wq;
 	struct hlist_head s_pins;
 
+	/* Negative dentries on s_dentry_lru, and the work trimming them */
+	atomic_long_t		s_nr_dentry_negative;
+	struct work_struct	s_dentry_prune_work;
+
 	/*
 	 * Keep the lru lists last in the structure so they always sit on their
 	 * own individual cachelines.
@@ -18,6 +18,18 @@
 
 #define MAX_MSG_SIZE 255
 
+/*
+ * Flags for ipc_log_context_create_flags()
+ *
+ * IPC_LOG_DEFERRED_FMT: ipc_log_string() stores the format pointer and the
+ *                       binary arguments in per-CPU pages without taking
+ *                       any lock, and formats them only when the log is
+ *                       extracted.  The format strings must stay valid for
+ *                       the life of the context, so a module must destroy
+ *                       its contexts before it is unloaded.
+ */
+#define IPC_LOG_DEFERRED_FMT	0x1
+
 enum {
 	TSV_TYPE_MSG_START = 1,
 	TSV_TYPE_SKB = TSV_TYPE_MSG_START,
@@ -56,6 +68,20 @@ struct decode_context {
 void *ipc_log_context_create(int max_num_pages, const char *modname,
 		uint16_t user_version);
 
+/*
+ * ipc_log_context_create_flags: Create a debug log context with flags
+ *                               Should not be called from atomic context
+ *
+ * @max_num_pages: Number of pages of logging space required (max. 10)
+ * @mod_name     : Name of the directory entry under DEBUGFS
+ * @user_version : Version number of user-defined message formats
+ * @flags        : IPC_LOG_* creation flags
+ *
+ * returns context id on success, NULL on failure
+ */
+void *ipc_log_context_create_flags(int max_num_pages, const char *modname,
+		uint16_t user_version, unsigned int flags);
+
 /*
  * msg_encode_start: Start encoding a log message
  *
@@ -231,6 +257,10 @@ static inline void *ipc_log_context_create(int max_num_pages,
 	const char *modname, uint16_t user_version)
 { return NULL; }
 
+static inline void *ipc_log_context_create_flags(int max_num_pages,
+	const char *modname, uint16_t user_version, unsigned int flags)
+{ return NULL; }
+
 static inline void msg_encode_start(struct encode_context *ectxt,
 	uint32_t type) { }
 
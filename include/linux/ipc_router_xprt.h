@@ -27,6 +27,7 @@
 #define IPC_ROUTER_XPRT_EVENT_CLOSE 3
 
 #define FRAG_PKT_WRITE_ENABLE 0x1
+#define PKT_HANDOFF_ENABLE 0x2
 
 /**
  * rr_header_v1 - IPC Router header version 1
@@ -145,6 +146,18 @@ struct msm_ipc_router_xprt {
 	void (*sft_close_done)(struct msm_ipc_router_xprt *xprt);
 };
 
+/**
+ * msm_ipc_router_xprt_notify() - Notify IPC Router of an XPRT event
+ * @xprt: XPRT on which the event occurred.
+ * @event: IPC_ROUTER_XPRT_EVENT_* type of the event.
+ * @data: Packet received by the XPRT for IPC_ROUTER_XPRT_EVENT_DATA.
+ *
+ * By default IPC Router clones the packet and the XPRT keeps ownership of
+ * @data. If the XPRT's get_option() reports PKT_HANDOFF_ENABLE, IPC Router
+ * takes a reference to @data instead. Such an XPRT must allocate the packet
+ * with create_pkt(), must not modify the packet or its SKBs after this
+ * function returns, and only drops its own reference with release_pkt().
+ */
 void msm_ipc_router_xprt_notify(struct msm_ipc_router_xprt *xprt,
 				unsigned event,
 				void *data);
@@ -69,6 +69,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -125,6 +126,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -269,7 +271,14 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+	__u32	s_padding[41];
+/* 0x00F8 */
+	/*
+	 * Not mainline's s_inode_fc_blks: the inode fast commit area has its
+	 * own format, so it uses the last padding word, away from the
+	 * fields mainline adds after s_checksum_type.
+	 */
+	__be32	s_inode_fc_blks;	/* Number of fast commit blocks */
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -294,6 +303,8 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+/* Inode fast commits; 0x20 is mainline's incompatible fast commit format */
+#define JBD2_FEATURE_INCOMPAT_INODE_FC		0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
@@ -302,7 +313,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_INODE_FC)
 
 #ifdef __KERNEL__
 
@@ -669,6 +681,8 @@ struct transaction_run_stats_s {
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	unsigned long		ts_requested;
+	unsigned long		ts_fc_commits;
+	unsigned long		ts_fc_blocks;
 	struct transaction_run_stats_s run;
 };
 
@@ -751,6 +765,15 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
  * @j_private: An opaque pointer to fs-private information.
+ * @j_fc_first: The block number of the first fast commit block
+ * @j_fc_last: The block number one beyond the last fast commit block
+ * @j_fc_off: Number of fast commit blocks used since the last full commit
+ * @j_fc_tid: Transaction the in-flight fast commit is tagged with
+ * @j_fc_wbuf: array of buffer_heads for the in-flight fast commit
+ * @j_fc_nbufs: Number of buffers in j_fc_wbuf
+ * @j_fc_wait: Wait queue for fast and full commits to exclude each other
+ * @j_fc_replay_callback: Called during recovery for each valid fast commit
+ *	block
  */
 
 struct journal_s
@@ -993,6 +1016,42 @@ struct journal_s
 
 	/* Precomputed journal UUID checksum for seeding other checksums */
 	__u32 j_csum_seed;
+
+	/*
+	 * Fast commit area: the block numbers of the first block and one
+	 * beyond the last block reserved for fast commits at the end of the
+	 * journal.  j_last stops at j_fc_first when the area exists.
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+
+	/*
+	 * Fast commit blocks used since the last full commit.
+	 * [JBD2_FAST_COMMIT_ONGOING]
+	 */
+	unsigned long		j_fc_off;
+
+	/* Tid the in-flight fast commit is tagged with [j_state_lock] */
+	tid_t			j_fc_tid;
+
+	/*
+	 * array of bhs for the in-flight fast commit
+	 * [JBD2_FAST_COMMIT_ONGOING]
+	 */
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_nbufs;
+
+	/* Wait queue for fast and full commits to exclude each other */
+	wait_queue_head_t	j_fc_wait;
+
+	/*
+	 * Called during recovery for each fast commit block tagged with the
+	 * first transaction missing from the log, in on-disk order.  Returns
+	 * 0 to continue, 1 to stop at this block or a negative error.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							int off, tid_t tid);
 };
 
 /*
@@ -1008,6 +1067,8 @@ struct journal_s
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* A fast commit is in flight */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* A full commit is in flight */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1249,6 +1310,12 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commit support */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_end_commit_fallback(journal_t *journal);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
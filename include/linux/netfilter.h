@@ -196,6 +196,30 @@ NF_HOOK(uint8_t pf, unsigned int hook, struct sk_buff *skb,
 	return NF_HOOK_THRESH(pf, hook, skb, in, out, okfn, INT_MIN);
 }
 
+/* Run a hook over a list of packets. Packets the hook let pass stay on
+ * @list, in order, and the caller must invoke okfn on them; all others
+ * were consumed. Whether the hook is in use is only checked once.
+ */
+static inline void
+NF_HOOK_LIST(uint8_t pf, unsigned int hook, struct sk_buff_head *list,
+	     struct net_device *in, struct net_device *out,
+	     int (*okfn)(struct sk_buff *))
+{
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	if (!nf_hooks_active(pf, hook))
+		return;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		if (nf_hook_slow(pf, hook, skb, in, out, okfn, INT_MIN) == 1)
+			__skb_queue_tail(&sublist, skb);
+	}
+	/* Put passed packets back on the list */
+	skb_queue_splice(&sublist, list);
+}
+
 /* Call setsockopt() */
 int nf_setsockopt(struct sock *sk, u_int8_t pf, int optval, char __user *opt,
 		  unsigned int len);
@@ -295,6 +319,12 @@ nf_nat_decode_session(struct sk_buff *skb, struct flowi *fl, u_int8_t family)
 #else /* !CONFIG_NETFILTER */
 #define NF_HOOK(pf, hook, skb, indev, outdev, okfn) (okfn)(skb)
 #define NF_HOOK_COND(pf, hook, skb, indev, outdev, okfn, cond) (okfn)(skb)
+static inline void
+NF_HOOK_LIST(uint8_t pf, unsigned int hook, struct sk_buff_head *list,
+	     struct net_device *in, struct net_device *out,
+	     int (*okfn)(struct sk_buff *))
+{
+}
 static inline int nf_hook_thresh(u_int8_t pf, unsigned int hook,
 				 struct sk_buff *skb,
 				 struct net_device *indev,
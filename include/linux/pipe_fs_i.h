@@ -1,7 +1,11 @@
 #ifndef _LINUX_PIPE_FS_I_H
 #define _LINUX_PIPE_FS_I_H
 
+#include <linux/fcntl.h>
+
 #define PIPE_DEF_BUFFERS	16
+/* Initial size of new pipes once the user is over pipe_user_pages_soft */
+#define PIPE_MIN_DEF_BUFFERS	2
 
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
@@ -33,6 +37,14 @@ struct pipe_buffer {
  *	@buffers: total number of buffers (should be a power of 2)
  *	@curbuf: the current pipe buffer entry
  *	@tmp_page: cached released page
+ *	@auto_max: buffers the pipe may grow to on its own, 0 once sized by
+ *		F_SETPIPE_SZ
+ *	@peak: highest @nrbufs since the last shrink check
+ *	@drains: times the pipe was emptied since the last shrink check
+ *	@consumed: buffers released by readers
+ *	@consumed_at_full: @consumed when a writer last found the pipe full
+ *	@gift_file: writes of whole pages through this file pass the writer's
+ *		pages (F_SETPIPE_GIFT)
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
  *	@files: number of struct file referring this pipe (protected by ->i_lock)
@@ -42,6 +54,7 @@ struct pipe_buffer {
  *	@fasync_readers: reader side fasync
  *	@fasync_writers: writer side fasync
  *	@bufs: the circular array of pipe buffers
+ *	@user: the user who created this pipe
  **/
 struct pipe_inode_info {
 	struct mutex mutex;
@@ -54,9 +67,16 @@ struct pipe_inode_info {
 	unsigned int r_counter;
 	unsigned int w_counter;
 	struct page *tmp_page;
+	unsigned int auto_max;
+	unsigned int peak;
+	unsigned int drains;
+	struct file *gift_file;
+	unsigned long consumed;
+	unsigned long consumed_at_full;
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
 	struct pipe_buffer *bufs;
+	struct user_struct *user;
 };
 
 /*
@@ -123,6 +143,8 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
+extern unsigned long pipe_user_pages_hard;
+extern unsigned long pipe_user_pages_soft;
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
 
 
@@ -131,6 +153,7 @@ void pipe_wait(struct pipe_inode_info *pipe);
 
 struct pipe_inode_info *alloc_pipe_info(void);
 void free_pipe_info(struct pipe_inode_info *);
+void pipe_buf_consumed(struct pipe_inode_info *);
 
 /* Generic pipe buffer ops functions */
 void generic_pipe_buf_get(struct pipe_inode_info *, struct pipe_buffer *);
@@ -140,7 +163,20 @@ void generic_pipe_buf_release(struct pipe_inode_info *, struct pipe_buffer *);
 
 extern const struct pipe_buf_operations nosteal_pipe_buf_ops;
 
-/* for F_SETPIPE_SZ and F_GETPIPE_SZ */
+/*
+ * F_SETPIPE_GIFT: with a non-zero argument, write()s of whole, page
+ * aligned pages through this file pass a reference to the writer's pages
+ * to the pipe instead of copying them, as vmsplice() with SPLICE_F_GIFT
+ * does.  The writer must not change those pages until they have been read
+ * out of the pipe.  Only a file open for writing can opt in, and only one
+ * per pipe; writes through other files are always copied.
+ */
+#ifndef F_SETPIPE_GIFT
+#define F_SETPIPE_GIFT	(F_LINUX_SPECIFIC_BASE + 16)
+#define F_GETPIPE_GIFT	(F_LINUX_SPECIFIC_BASE + 17)
+#endif
+
+/* for F_SETPIPE_SZ, F_GETPIPE_SZ, F_SETPIPE_GIFT and F_GETPIPE_GIFT */
 long pipe_fcntl(struct file *, unsigned int, unsigned long arg);
 struct pipe_inode_info *get_pipe_info(struct file *file);
 
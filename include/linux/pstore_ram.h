@@ -25,8 +25,9 @@
 
 /*
  * Choose whether access to the RAM zone requires locking or not.  If a zone
- * can be written to from different CPUs like with ftrace for example, then
- * PRZ_FLAG_NO_LOCK is used. For all other cases, locking is required.
+ * is only ever written by one CPU with interrupts disabled, like the per-CPU
+ * ftrace zones, then PRZ_FLAG_NO_LOCK is used. For all other cases, locking
+ * is required.
  */
 #define PRZ_FLAG_NO_LOCK	BIT(0)
 
@@ -83,8 +84,15 @@ void ramoops_console_write_buf(const char *buf, size_t size);
  * Ramoops platform data
  * @mem_size	memory size for ramoops
  * @mem_address	physical memory address to contain ramoops
+ * @flags	RAMOOPS_FLAG_* below
  */
 
+/*
+ * Split the ftrace area into one zone per possible CPU, so that tracing
+ * CPUs never share a zone and can append without any locking.
+ */
+#define RAMOOPS_FLAG_FTRACE_PER_CPU	BIT(0)
+
 struct ramoops_platform_data {
 	unsigned long	mem_size;
 	unsigned long	mem_address;
@@ -94,6 +102,7 @@ struct ramoops_platform_data {
 	unsigned long	ftrace_size;
 	unsigned long	pmsg_size;
 	int		dump_oops;
+	u32		flags;
 	struct persistent_ram_ecc_info ecc_info;
 };
 
@@ -81,17 +81,21 @@ struct elem_info {
 	struct elem_info *ei_array;
 };
 
+struct qmi_msg_plan;
+
 /**
  * @msg_desc - Describe about the main/outer structure to be
  *		  encoded/decoded.
  *
  * @max_msg_len: Maximum possible length of the QMI message.
  * @ei_array: Array to provide information about a data structure.
+ * @plan: Flat encode/decode plan compiled from @ei_array, if any.
  */
 struct msg_desc {
 	uint16_t msg_id;
 	int max_msg_len;
 	struct elem_info *ei_array;
+	struct qmi_msg_plan *plan;
 };
 
 struct qmi_header {
@@ -160,6 +164,27 @@ int qmi_kernel_decode(struct msg_desc *desc, void *out_c_struct,
  */
 bool qmi_verify_max_msg_len(struct msg_desc *desc);
 
+/**
+ * qmi_kernel_compile_desc() - Compile a structure descriptor into a plan
+ * @desc: Pointer to structure descriptor.
+ *
+ * Once compiled, qmi_kernel_encode() and qmi_kernel_decode() run the flat
+ * plan cached in @desc instead of walking the element info array for every
+ * message. The descriptor must not be in use while it is being compiled.
+ *
+ * @return: 0 on success, -EOPNOTSUPP if the descriptor layout has no plan
+ *          form and is left to the interpreter, < 0 on other errors.
+ */
+int qmi_kernel_compile_desc(struct msg_desc *desc);
+
+/**
+ * qmi_kernel_free_desc_plan() - Free the plan compiled for a descriptor
+ * @desc: Pointer to structure descriptor.
+ *
+ * The descriptor must not be in use while its plan is freed.
+ */
+void qmi_kernel_free_desc_plan(struct msg_desc *desc);
+
 #else
 static inline int qmi_kernel_encode(struct msg_desc *desc,
 				    void *out_buf, uint32_t out_buf_len,
@@ -179,6 +204,15 @@ static inline bool qmi_verify_max_msg_len(struct msg_desc *desc)
 {
 	return false;
 }
+
+static inline int qmi_kernel_compile_desc(struct msg_desc *desc)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void qmi_kernel_free_desc_plan(struct msg_desc *desc)
+{
+}
 #endif
 
 #endif
@@ -14,6 +14,7 @@
 struct epoll_event;
 struct iattr;
 struct inode;
+struct aio_setup_params;
 struct iocb;
 struct io_event;
 struct iovec;
@@ -503,6 +504,11 @@ asmlinkage long sys_io_submit(aio_context_t, long,
 				struct iocb __user * __user *);
 asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb __user *iocb,
 			      struct io_event __user *result);
+asmlinkage long sys_io_setup2(unsigned nr_events,
+			      struct aio_setup_params __user *params,
+			      aio_context_t __user *ctx);
+asmlinkage long sys_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+				  unsigned min_complete, unsigned flags);
 asmlinkage long sys_sendfile(int out_fd, int in_fd,
 			     off_t __user *offset, size_t count);
 asmlinkage long sys_sendfile64(int out_fd, int in_fd,
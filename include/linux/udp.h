@@ -32,6 +32,9 @@ static inline struct udphdr *inner_udp_hdr(const struct sk_buff *skb)
 	return (struct udphdr *)skb_inner_transport_header(skb);
 }
 
+/* Upper bound on the number of datagrams one UDP GSO send may carry */
+#define UDP_MAX_SEGMENTS		(1 << 6UL)
+
 #define UDP_HTABLE_SIZE_MIN		(CONFIG_BASE_SMALL ? 128 : 256)
 
 static inline u32 udp_hashfn(const struct net *net, u32 num, u32 mask)
@@ -50,15 +53,17 @@ struct udp_sock {
 	__u8		 encap_type;	/* Is this an Encapsulation socket? */
 	unsigned char	 no_check6_tx:1,/* Send zero UDP6 checksums on TX? */
 			 no_check6_rx:1,/* Allow zero UDP6 checksums on RX? */
-			 convert_csum:1;/* On receive, convert checksum
+			 convert_csum:1,/* On receive, convert checksum
 					 * unnecessary to checksum complete
 					 * if possible.
 					 */
+			 gro_enabled:1;	/* Coalesce datagrams with GRO? */
 	/*
 	 * Following member retains the information to create a UDP header
 	 * when the socket is uncorked.
 	 */
 	__u16		 len;		/* total length of pending frames */
+	__u16		 gso_size;	/* UDP_SEGMENT segment size, 0 if off */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
@@ -0,0 +1,36 @@
+/*
+ * Windowed min/max tracker, see lib/win_minmax.c.
+ */
+#ifndef _LINUX_WIN_MINMAX_H
+#define _LINUX_WIN_MINMAX_H
+
+#include <linux/types.h>
+
+/* A single data point for the min/max tracker */
+struct minmax_sample {
+	u32	t;	/* time the measurement was taken */
+	u32	v;	/* value measured */
+};
+
+/* The best, 2nd best and 3rd best samples in the window */
+struct minmax {
+	struct minmax_sample s[3];
+};
+
+static inline u32 minmax_get(const struct minmax *m)
+{
+	return m->s[0].v;
+}
+
+static inline u32 minmax_reset(struct minmax *m, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+	return m->s[0].v;
+}
+
+u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas);
+u32 minmax_running_min(struct minmax *m, u32 win, u32 t, u32 meas);
+
+#endif /* _LINUX_WIN_MINMAX_H */
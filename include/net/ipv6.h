@@ -786,6 +786,8 @@ static inline u8 ip6_tclass(__be32 flowinfo)
 
 int ipv6_rcv(struct sk_buff *skb, struct net_device *dev,
 	     struct packet_type *pt, struct net_device *orig_dev);
+void ipv6_list_rcv(struct sk_buff_head *list, struct packet_type *pt,
+		   struct net_device *orig_dev);
 
 int ip6_rcv_finish(struct sk_buff *skb);
 
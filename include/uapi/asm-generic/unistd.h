@@ -707,9 +707,13 @@ __SYSCALL(__NR_getrandom, sys_getrandom)
 __SYSCALL(__NR_memfd_create, sys_memfd_create)
 #define __NR_bpf 280
 __SYSCALL(__NR_bpf, sys_bpf)
+#define __NR_io_setup2 281
+__SYSCALL(__NR_io_setup2, sys_io_setup2)
+#define __NR_io_ring_enter 282
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
 
 #undef __NR_syscalls
-#define __NR_syscalls 281
+#define __NR_syscalls 283
 
 /*
  * All syscalls below here should go away really,
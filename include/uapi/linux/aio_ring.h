@@ -0,0 +1,72 @@
+/*
+ * Submission ring interface for Linux native AIO.
+ *
+ * A context created by io_setup2() with IOCTX_FLAG_SQRING has a ring of
+ * struct iocb mapped right after its completion ring, at sq_off bytes
+ * from the context id.  The application fills iocbs[tail & (nr - 1)],
+ * advances tail and calls io_ring_enter() - or, with IOCTX_FLAG_SQPOLL,
+ * lets a kernel thread pick the iocbs up without any system call.
+ * Completions are read from the regular aio_ring, also without a system
+ * call, by advancing its head.
+ */
+#ifndef _UAPI_LINUX_AIO_RING_H
+#define _UAPI_LINUX_AIO_RING_H
+
+#include <linux/types.h>
+#include <linux/aio_abi.h>
+
+/*
+ * One-shot poll, usable with io_submit() as well: aio_buf holds the POLL*
+ * events to wait for and res the events that fired, or 0 if the request
+ * was cancelled.  aio_offset and aio_nbytes must be 0.  Numbered to match
+ * the slot reserved in aio_abi.h.
+ */
+#define IOCB_CMD_POLL		5
+
+/* io_setup2() flags */
+#define IOCTX_FLAG_SQRING	(1 << 0)	/* map a submission ring */
+#define IOCTX_FLAG_SQPOLL	(1 << 1)	/* kernel thread polls the ring */
+
+/*
+ * Extra iocb->aio_flags for contexts created by io_setup2().
+ *
+ * IOCB_FLAG_FIXED_FILE: aio_fildes is an index into the registered files.
+ * IOCB_FLAG_FIXED_BUF: aio_buf/aio_nbytes lie within the registered
+ * buffer whose index is in aio_reserved2.  PREAD/PWRITE only.
+ *
+ * The SQPOLL thread has no file table, so it only accepts fixed files.
+ */
+#define IOCB_FLAG_FIXED_FILE	(1 << 1)
+#define IOCB_FLAG_FIXED_BUF	(1 << 2)
+
+/* aio_sq_ring flags, written by the kernel */
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)	/* poll thread went to sleep */
+
+struct aio_sq_ring {
+	__u32	head;		/* next entry the kernel will consume */
+	__u32	tail;		/* next entry the application will fill */
+	__u32	nr;		/* number of entries, a power of two */
+	__u32	flags;		/* AIO_SQ_* */
+	__u32	dropped;	/* invalid entries skipped */
+	__u32	resv[3];
+	struct iocb iocbs[0];
+};
+
+struct aio_setup_params {
+	__u32	flags;		/* IOCTX_FLAG_* */
+	__u32	sq_entries;	/* rounded up to a power of two */
+	__u32	sq_thread_idle;	/* ms the poll thread spins before sleeping */
+	__s32	sq_thread_cpu;	/* CPU to bind the poll thread to, or -1 */
+	__u64	files;		/* __s32 array of file descriptors */
+	__u64	iovecs;		/* struct iovec array of buffers */
+	__u32	nr_files;
+	__u32	nr_iovecs;
+	__u64	sq_off;		/* out: offset of the aio_sq_ring */
+	__u64	resv[2];
+};
+
+/* io_ring_enter() flags */
+#define IORING_ENTER_GETEVENTS	(1 << 0)	/* wait for min_complete */
+#define IORING_ENTER_SQ_WAKEUP	(1 << 1)	/* wake the poll thread */
+
+#endif /* _UAPI_LINUX_AIO_RING_H */
@@ -0,0 +1,62 @@
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * struct trace_buffer_meta - Ring-buffer meta-page description
+ * @meta_page_size:	Size of this meta-page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer.
+ * @nr_subbufs:		Number of subbufs in the ring-buffer, including
+ *			the reader.
+ * @reader.lost_events:	Number of events lost before the reader page.
+ * @reader.id:		ID of the sub-buffer currently owned by the reader.
+ * @reader.read:	Offset of the first unread byte in the reader
+ *			sub-buffer data.
+ * @reader.commit:	Offset of the end of the data handed over to the
+ *			reader in the reader sub-buffer data.
+ * @entries:		Number of entries in the ring-buffer.
+ * @overrun:		Number of entries lost in the ring-buffer.
+ * @read:		Number of entries that have been read.
+ *
+ * The meta-page is mapped at offset 0 of a trace_pipe_raw file and
+ * sub-buffer N is mapped at page N + 1.  Each sub-buffer has the layout
+ * described in events/header_page.  Only the reader sub-buffer is
+ * stable: its data from @reader.read to @reader.commit can be parsed in
+ * place until the next TRACE_MMAP_IOCTL_GET_READER.  Event time stamps
+ * are deltas from the sub-buffer time stamp, so a reader handed data
+ * from @reader.read > 0 walks the events from offset 0 to rebuild them.
+ * While a CPU buffer is mapped, reads of trace_pipe and trace_pipe_raw
+ * of the instance fail with EBUSY.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	__reserved;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+/*
+ * Hand the data read so far back to the ring-buffer and make the next
+ * unread data available in the reader sub-buffer.  The reader fields of
+ * the meta-page describe it on return; reader.read == reader.commit
+ * means that the ring-buffer is empty.
+ */
+#define TRACE_MMAP_IOCTL_GET_READER		_IO('T', 0x1)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
@@ -12,6 +12,7 @@
  */
 
 #include <asm/arch_timer.h>
+#include <asm/sections.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/module.h>
@@ -27,12 +28,16 @@
 #include <linux/wait.h>
 #include <linux/delay.h>
 #include <linux/completion.h>
+#include <linux/ctype.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
 #include <linux/ipc_logging.h>
 
 #include "ipc_logging_private.h"
 
 #define LOG_PAGE_DATA_SIZE	sizeof(((struct ipc_log_page *)0)->data)
 #define LOG_PAGE_FLAG (1 << 31)
+#define IPC_LOG_BIN_WORDS	DIV_ROUND_UP(MAX_MSG_SIZE, sizeof(u32))
 
 static LIST_HEAD(ipc_log_context_list);
 static DEFINE_RWLOCK(context_list_lock_lha1);
@@ -274,9 +279,226 @@ static void msg_drop(struct ipc_log_context *ilctxt)
 	if (!is_read_empty(ilctxt)) {
 		ipc_log_drop(ilctxt, &hdr, sizeof(hdr));
 		ipc_log_drop(ilctxt, NULL, (int)hdr.size);
+		ilctxt->stats.overwritten_records++;
+		ilctxt->stats.overwritten_bytes += sizeof(hdr) + hdr.size;
 	}
 }
 
+/*
+ * Helper functions to copy data to and from the per-CPU ring of a
+ * deferred-format log.  @pos is a ring position, which wraps around at
+ * cpu_buf::size and may span log pages.
+ */
+static void ipc_log_cpu_write_data(struct ipc_log_cpu_buf *cb, uint64_t pos,
+				   const void *data, uint32_t size)
+{
+	uint32_t off, pg_off, n;
+
+	div_u64_rem(pos, cb->size, &off);
+	while (size) {
+		pg_off = off % LOG_PAGE_DATA_SIZE;
+		n = min_t(uint32_t, size, LOG_PAGE_DATA_SIZE - pg_off);
+		memcpy(cb->pages[off / LOG_PAGE_DATA_SIZE]->data + pg_off,
+		       data, n);
+		data += n;
+		size -= n;
+		off += n;
+		if (off == cb->size)
+			off = 0;
+	}
+}
+
+static void ipc_log_cpu_read_data(struct ipc_log_cpu_buf *cb, uint64_t pos,
+				  void *data, uint32_t size)
+{
+	uint32_t off, pg_off, n;
+
+	div_u64_rem(pos, cb->size, &off);
+	while (size) {
+		pg_off = off % LOG_PAGE_DATA_SIZE;
+		n = min_t(uint32_t, size, LOG_PAGE_DATA_SIZE - pg_off);
+		memcpy(data, cb->pages[off / LOG_PAGE_DATA_SIZE]->data + pg_off,
+		       n);
+		data += n;
+		size -= n;
+		off += n;
+		if (off == cb->size)
+			off = 0;
+	}
+}
+
+/*
+ * Publishes the records reserved on this CPU.  Only the outermost writer
+ * moves the commit position, so records of interrupted writers are never
+ * visible half written.  An interrupt may reserve a record after the
+ * commit position was read, in which case the commit is redone.
+ */
+static void ipc_log_cpu_commit(struct ipc_log_cpu_buf *cb)
+{
+	uint64_t head;
+
+again:
+	if (local_read(&cb->nesting) != 1) {
+		local_dec(&cb->nesting);
+		return;
+	}
+
+	head = local64_read(&cb->head);
+	/* order the record data before the commit for remote readers */
+	smp_wmb();
+	local64_set(&cb->commit, head);
+	local_dec(&cb->nesting);
+	barrier();
+	if (unlikely(local64_read(&cb->head) != head)) {
+		local_inc(&cb->nesting);
+		goto again;
+	}
+}
+
+/*
+ * Wakes readers blocked on ilctxt::read_avail.  The completion is only
+ * touched when a reader reinitialized it, so writers on different CPUs
+ * do not bounce its lock.
+ */
+static void ipc_log_wake_readers(struct ipc_log_context *ilctxt)
+{
+	/* pairs with the barrier in ipc_log_extract_deferred() */
+	smp_mb();
+	if (!ACCESS_ONCE(ilctxt->read_avail.done))
+		complete(&ilctxt->read_avail);
+}
+
+/**
+ * ipc_log_cpu_write - Writes a record to the ring of the current CPU
+ *
+ * @ilctxt:  Logging context created with IPC_LOG_DEFERRED_FMT
+ * @fmt:  Format string of the binary arguments in @data, or NULL for a
+ *        TSV message
+ * @data:  Record data
+ * @len:  Size of @data
+ *
+ * Space is reserved with a cmpxchg on the head position, which only has
+ * to be atomic against interrupts of the current CPU.  The oldest
+ * committed records are overwritten to make room.  If the record does
+ * not fit in front of records that are still being written by
+ * interrupted writers, it is dropped and accounted for.
+ */
+static void ipc_log_cpu_write(struct ipc_log_context *ilctxt,
+			      const char *fmt, const void *data, uint32_t len)
+{
+	struct ipc_log_cpu_buf *cb;
+	struct ipc_log_rec_hdr hdr;
+	uint64_t head, next, tail;
+	bool written = false;
+	uint32_t size;
+
+	hdr.fmt = (uint64_t)(uintptr_t)fmt;
+	hdr.len = len;
+	hdr.size = ALIGN(sizeof(hdr) + len, 8);
+
+	preempt_disable();
+	cb = this_cpu_ptr(ilctxt->cpu_buf);
+	local_inc(&cb->nesting);
+	barrier();
+
+	do {
+		head = local64_read(&cb->head);
+		next = head + hdr.size;
+		if (unlikely(next > local64_read(&cb->commit) + cb->size)) {
+			local64_inc(&cb->dropped_records);
+			local64_add(hdr.size, &cb->dropped_bytes);
+			goto out;
+		}
+	} while (local64_cmpxchg(&cb->head, head, next) != head);
+
+	for (;;) {
+		tail = local64_read(&cb->tail);
+		if (next - tail <= cb->size)
+			break;
+		ipc_log_cpu_read_data(cb, tail +
+				      offsetof(struct ipc_log_rec_hdr, size),
+				      &size, sizeof(size));
+		if (local64_cmpxchg(&cb->tail, tail, tail + size) == tail) {
+			local64_inc(&cb->overwritten_records);
+			local64_add(size, &cb->overwritten_bytes);
+		}
+	}
+	/* order the tail update before the overwrite for remote readers */
+	smp_mb();
+
+	hdr.timestamp = sched_clock();
+	hdr.qtimer = arch_counter_get_cntpct();
+	ipc_log_cpu_write_data(cb, head, &hdr, sizeof(hdr));
+	ipc_log_cpu_write_data(cb, head + sizeof(hdr), data, len);
+	local64_inc(&cb->records);
+	local64_add(hdr.size, &cb->bytes);
+	written = true;
+out:
+	ipc_log_cpu_commit(cb);
+	preempt_enable();
+	if (written)
+		ipc_log_wake_readers(ilctxt);
+}
+
+/**
+ * ipc_log_cpu_peek - Reads the header of the next unread record
+ *
+ * @cb:  Per-CPU ring
+ * @hdr:  Receives the record header
+ * @returns: 1 if a record is available; 0 otherwise
+ *
+ * Records overwritten before they were read are skipped.  Must be called
+ * with ilctxt::context_lock_lhb1 held.
+ */
+static int ipc_log_cpu_peek(struct ipc_log_cpu_buf *cb,
+			    struct ipc_log_rec_hdr *hdr)
+{
+	uint64_t tail, commit;
+
+	for (;;) {
+		tail = local64_read(&cb->tail);
+		if (cb->rpos < tail)
+			cb->rpos = tail;
+		commit = local64_read(&cb->commit);
+		smp_rmb();
+		if (cb->rpos >= commit)
+			return 0;
+
+		ipc_log_cpu_read_data(cb, cb->rpos, hdr, sizeof(*hdr));
+		smp_rmb();
+		if (cb->rpos >= local64_read(&cb->tail))
+			return 1;
+	}
+}
+
+/**
+ * ipc_log_cpu_read - Reads the data of the record found by ipc_log_cpu_peek()
+ *
+ * @cb:  Per-CPU ring
+ * @hdr:  Record header returned by ipc_log_cpu_peek()
+ * @data:  Receives the record data (IPC_LOG_BIN_WORDS words)
+ * @returns: 1 if the record was read; 0 if it was overwritten meanwhile
+ *
+ * Must be called with ilctxt::context_lock_lhb1 held.
+ */
+static int ipc_log_cpu_read(struct ipc_log_cpu_buf *cb,
+			    struct ipc_log_rec_hdr *hdr, u32 *data)
+{
+	if (hdr->len > IPC_LOG_BIN_WORDS * sizeof(u32)) {
+		pr_err("%s: invalid record size %u\n", __func__, hdr->len);
+		cb->rpos += hdr->size;
+		return 0;
+	}
+
+	ipc_log_cpu_read_data(cb, cb->rpos + sizeof(*hdr), data, hdr->len);
+	smp_rmb();
+	if (cb->rpos < local64_read(&cb->tail))
+		return 0;
+
+	cb->rpos += hdr->size;
+	return 1;
+}
+
 /*
  * Commits messages to the FIFO.  If the FIFO is full, then enough
  * messages are dropped to create space for the new message.
@@ -292,6 +514,11 @@ void ipc_log_write(void *ctxt, struct encode_context *ectxt)
 		return;
 	}
 
+	if (ilctxt->flags & IPC_LOG_DEFERRED_FMT) {
+		ipc_log_cpu_write(ilctxt, NULL, ectxt->buff, ectxt->offset);
+		return;
+	}
+
 	read_lock_irqsave(&context_list_lock_lha1, flags);
 	spin_lock(&ilctxt->context_lock_lhb1);
 	while (ilctxt->write_avail <= ectxt->offset)
@@ -322,6 +549,8 @@ void ipc_log_write(void *ctxt, struct encode_context *ectxt)
 	}
 	ilctxt->write_page->hdr.write_offset += bytes_to_write;
 	ilctxt->write_avail -= ectxt->offset;
+	ilctxt->stats.records++;
+	ilctxt->stats.bytes += ectxt->offset;
 	complete(&ilctxt->read_avail);
 	spin_unlock(&ilctxt->context_lock_lhb1);
 	read_unlock_irqrestore(&context_list_lock_lha1, flags);
@@ -488,36 +717,239 @@ int tsv_byte_array_write(struct encode_context *ectxt,
 EXPORT_SYMBOL(tsv_byte_array_write);
 
 /*
- * Helper function to log a string
+ * Formats a string and logs it as a TSV_TYPE_STRING message.
  *
  * @ilctxt ipc_log_context created using ipc_log_context_create()
  * @fmt Data specified using format specifiers
+ * @arg_list Arguments of @fmt
  */
-int ipc_log_string(void *ilctxt, const char *fmt, ...)
+static int ipc_log_vstring(void *ilctxt, const char *fmt, va_list arg_list)
 {
 	struct encode_context ectxt;
 	int avail_size, data_size, hdr_size = sizeof(struct tsv_header);
-	va_list arg_list;
-
-	if (!ilctxt)
-		return -EINVAL;
 
 	msg_encode_start(&ectxt, TSV_TYPE_STRING);
 	tsv_timestamp_write(&ectxt);
 	tsv_qtimer_write(&ectxt);
 	avail_size = (MAX_MSG_SIZE - (ectxt.offset + hdr_size));
-	va_start(arg_list, fmt);
 	data_size = vsnprintf((ectxt.buff + ectxt.offset + hdr_size),
 			      avail_size, fmt, arg_list);
-	va_end(arg_list);
 	tsv_write_header(&ectxt, TSV_TYPE_BYTE_ARRAY, data_size);
 	ectxt.offset += data_size;
 	msg_encode_end(&ectxt);
 	ipc_log_write(ilctxt, &ectxt);
 	return 0;
 }
+
+/*
+ * Returns true if the arguments of @fmt can be formatted after the call.
+ * Pointer extensions such as %pI4 or %ph dereference their argument,
+ * which may no longer be valid by the time the log is read.
+ */
+static bool ipc_log_fmt_deferrable(const char *fmt)
+{
+	while ((fmt = strchr(fmt, '%'))) {
+		fmt++;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+		fmt += strspn(fmt, "-+ #0123456789.*hlLzjt");
+		if (*fmt == 'p' && isalnum(fmt[1]))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Logs the format pointer and the binary arguments of a string.  Strings
+ * that do not fit into a record or need their arguments dereferenced are
+ * formatted right away instead.
+ *
+ * @ilctxt ipc_log_context created with IPC_LOG_DEFERRED_FMT
+ * @fmt Data specified using format specifiers
+ * @arg_list Arguments of @fmt
+ */
+static int ipc_log_bin_string(struct ipc_log_context *ilctxt,
+			      const char *fmt, va_list arg_list)
+{
+	u32 bin_buf[IPC_LOG_BIN_WORDS];
+	va_list bin_args;
+	int words;
+
+	if (!ipc_log_fmt_deferrable(fmt))
+		return ipc_log_vstring(ilctxt, fmt, arg_list);
+
+	va_copy(bin_args, arg_list);
+	words = vbin_printf(bin_buf, IPC_LOG_BIN_WORDS, fmt, bin_args);
+	va_end(bin_args);
+	if (words > IPC_LOG_BIN_WORDS)
+		return ipc_log_vstring(ilctxt, fmt, arg_list);
+
+	ipc_log_cpu_write(ilctxt, fmt, bin_buf, words * sizeof(u32));
+	return 0;
+}
+
+/*
+ * Helper function to log a string
+ *
+ * @ilctxt ipc_log_context created using ipc_log_context_create()
+ * @fmt Data specified using format specifiers
+ */
+int ipc_log_string(void *ilctxt, const char *fmt, ...)
+{
+	struct ipc_log_context *ctxt = (struct ipc_log_context *)ilctxt;
+	va_list arg_list;
+	int ret;
+
+	if (!ctxt)
+		return -EINVAL;
+
+	va_start(arg_list, fmt);
+	if (ctxt->flags & IPC_LOG_DEFERRED_FMT)
+		ret = ipc_log_bin_string(ctxt, fmt, arg_list);
+	else
+		ret = ipc_log_vstring(ctxt, fmt, arg_list);
+	va_end(arg_list);
+	return ret;
+}
 EXPORT_SYMBOL(ipc_log_string);
 
+/*
+ * Returns true if @fmt still points to a format string, i.e. to read-only
+ * data of the kernel or to the core read-only data of a loaded module.
+ * Must be called with preemption disabled, which keeps the module from
+ * being freed while its format is used.
+ */
+static bool ipc_log_fmt_valid(const char *fmt)
+{
+	unsigned long addr = (unsigned long)fmt;
+	unsigned long ro_start, ro_end;
+	struct module *mod;
+
+	if (addr >= (unsigned long)__start_rodata &&
+	    addr < (unsigned long)__end_rodata)
+		return true;
+
+	mod = __module_address(addr);
+	if (!mod)
+		return false;
+	ro_start = (unsigned long)mod->module_core + mod->core_text_size;
+	ro_end = (unsigned long)mod->module_core + mod->core_ro_size;
+	return addr >= ro_start && addr < ro_end;
+}
+
+/*
+ * Formats a binary record the way dfunc_string() prints a string message.
+ *
+ * @hdr    record header
+ * @bin    binary arguments of the record
+ * @dctxt  deserialization context
+ */
+static void ipc_log_decode_bin(struct ipc_log_rec_hdr *hdr, const u32 *bin,
+			       struct decode_context *dctxt)
+{
+	const char *fmt = (const char *)(uintptr_t)hdr->fmt;
+	uint64_t val = hdr->timestamp;
+	unsigned long nanosec_rem;
+	int len;
+
+	nanosec_rem = do_div(val, 1000000000U);
+	IPC_SPRINTF_DECODE(dctxt, "[%6u.%09lu/%#18llx] ",
+			(unsigned)val, nanosec_rem, hdr->qtimer);
+
+	/* keep room for the trailing \n */
+	preempt_disable();
+	if (ipc_log_fmt_valid(fmt)) {
+		len = bstr_printf(dctxt->buff, dctxt->size - 1, fmt, bin);
+		len = min(len, dctxt->size - 2);
+	} else {
+		len = scnprintf(dctxt->buff, dctxt->size - 1,
+				"<stale format %p>", fmt);
+	}
+	preempt_enable();
+	dctxt->buff += len;
+	dctxt->size -= len;
+
+	if (!len || *(dctxt->buff - 1) != '\n') {
+		*dctxt->buff++ = '\n';
+		dctxt->size--;
+	}
+}
+
+/*
+ * Extracts the records of a deferred-format log.  The per-CPU rings are
+ * merged by timestamp and the records are formatted without holding any
+ * lock.  See ipc_log_extract().
+ */
+static int ipc_log_extract_deferred(struct ipc_log_context *ilctxt,
+				    char *buff, int size)
+{
+	struct ipc_log_rec_hdr hdr, next_hdr;
+	struct ipc_log_cpu_buf *cb, *next_cb;
+	u32 data[IPC_LOG_BIN_WORDS];
+	struct encode_context ectxt;
+	struct decode_context dctxt;
+	void (*deserialize_func)(struct encode_context *ectxt,
+				 struct decode_context *dctxt);
+	unsigned long flags;
+	int cpu;
+
+	dctxt.output_format = OUTPUT_DEBUGFS;
+	dctxt.buff = buff;
+	dctxt.size = size;
+	spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
+	while (dctxt.size >= MAX_MSG_DECODED_SIZE) {
+		next_cb = NULL;
+		for_each_possible_cpu(cpu) {
+			cb = per_cpu_ptr(ilctxt->cpu_buf, cpu);
+			if (!ipc_log_cpu_peek(cb, &hdr))
+				continue;
+			if (!next_cb || hdr.timestamp < next_hdr.timestamp) {
+				next_cb = cb;
+				next_hdr = hdr;
+			}
+		}
+		if (!next_cb)
+			break;
+		if (!ipc_log_cpu_read(next_cb, &next_hdr, data))
+			continue;
+
+		deserialize_func = NULL;
+		if (!next_hdr.fmt) {
+			memcpy(ectxt.buff, data, min_t(uint32_t, next_hdr.len,
+						       sizeof(ectxt.buff)));
+			memcpy(&ectxt.hdr, ectxt.buff, sizeof(ectxt.hdr));
+			ectxt.offset = sizeof(ectxt.hdr);
+			deserialize_func = get_deserialization_func(ilctxt,
+							ectxt.hdr.type);
+		}
+		spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
+		if (next_hdr.fmt)
+			ipc_log_decode_bin(&next_hdr, data, &dctxt);
+		else if (deserialize_func)
+			deserialize_func(&ectxt, &dctxt);
+		else
+			pr_err("%s: unknown message 0x%x\n",
+				__func__, ectxt.hdr.type);
+		spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
+	}
+	if ((size - dctxt.size) == 0) {
+		reinit_completion(&ilctxt->read_avail);
+		/* pairs with the barrier in ipc_log_wake_readers() */
+		smp_mb();
+		for_each_possible_cpu(cpu) {
+			cb = per_cpu_ptr(ilctxt->cpu_buf, cpu);
+			if (ipc_log_cpu_peek(cb, &hdr)) {
+				complete(&ilctxt->read_avail);
+				break;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
+	return size - dctxt.size;
+}
+
 /**
  * ipc_log_extract - Reads and deserializes log
  *
@@ -542,6 +974,9 @@ int ipc_log_extract(void *ctxt, char *buff, int size)
 	if (size < MAX_MSG_DECODED_SIZE)
 		return -EINVAL;
 
+	if (ilctxt->flags & IPC_LOG_DEFERRED_FMT)
+		return ipc_log_extract_deferred(ilctxt, buff, size);
+
 	dctxt.output_format = OUTPUT_DEBUGFS;
 	dctxt.buff = buff;
 	dctxt.size = size;
@@ -752,6 +1187,131 @@ static void *get_deserialization_func(struct ipc_log_context *ilctxt,
 	return NULL;
 }
 
+/*
+ * Allocates a log page and adds it to the page list of the context.
+ *
+ * @ctxt     logging context
+ * @page_num index of the page
+ */
+static struct ipc_log_page *ipc_log_page_alloc(struct ipc_log_context *ctxt,
+					       uint32_t page_num)
+{
+	struct ipc_log_page *pg;
+	unsigned long flags;
+
+	pg = kzalloc(sizeof(struct ipc_log_page), GFP_KERNEL);
+	if (!pg) {
+		pr_err("%s: cannot create ipc_log_page\n", __func__);
+		return NULL;
+	}
+	pg->hdr.log_id = (uint64_t)(uintptr_t)ctxt;
+	pg->hdr.page_num = LOG_PAGE_FLAG | page_num;
+	pg->hdr.ctx_offset = (int64_t)((uint64_t)(uintptr_t)ctxt -
+		(uint64_t)(uintptr_t)&pg->hdr);
+
+	/* set magic last to signal that page init is complete */
+	pg->hdr.magic = IPC_LOGGING_MAGIC_NUM;
+	pg->hdr.nmagic = ~(IPC_LOGGING_MAGIC_NUM);
+
+	spin_lock_irqsave(&ctxt->context_lock_lhb1, flags);
+	list_add_tail(&pg->hdr.list, &ctxt->page_list);
+	spin_unlock_irqrestore(&ctxt->context_lock_lhb1, flags);
+	return pg;
+}
+
+static void ipc_log_pages_free(struct ipc_log_context *ctxt)
+{
+	struct ipc_log_cpu_buf *cb;
+	struct ipc_log_page *pg;
+	int cpu;
+
+	while (!list_empty(&ctxt->page_list)) {
+		pg = get_first_page(ctxt);
+		list_del(&pg->hdr.list);
+		kfree(pg);
+	}
+
+	if (!ctxt->cpu_buf)
+		return;
+	for_each_possible_cpu(cpu) {
+		cb = per_cpu_ptr(ctxt->cpu_buf, cpu);
+		kfree(cb->pages);
+	}
+	free_percpu(ctxt->cpu_buf);
+	ctxt->cpu_buf = NULL;
+}
+
+/*
+ * Allocates the per-CPU rings of a deferred-format log.  Each CPU gets an
+ * even share of @max_num_pages, but at least two pages.  The pages are
+ * also on the page list of the context and are numbered (cpu << 8 | index)
+ * for log extraction.
+ *
+ * @ctxt          logging context
+ * @max_num_pages number of pages requested for the log
+ */
+static int ipc_log_cpu_bufs_alloc(struct ipc_log_context *ctxt,
+				  int max_num_pages)
+{
+	struct ipc_log_cpu_buf *cb;
+	int cpu, i, nr_pages;
+
+	nr_pages = max_t(int, 2,
+			 DIV_ROUND_UP(max_num_pages, num_possible_cpus()));
+	ctxt->cpu_buf = alloc_percpu(struct ipc_log_cpu_buf);
+	if (!ctxt->cpu_buf)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		cb = per_cpu_ptr(ctxt->cpu_buf, cpu);
+		cb->pages = kcalloc(nr_pages, sizeof(*cb->pages), GFP_KERNEL);
+		if (!cb->pages)
+			return -ENOMEM;
+		for (i = 0; i < nr_pages; i++) {
+			cb->pages[i] = ipc_log_page_alloc(ctxt, cpu << 8 | i);
+			if (!cb->pages[i])
+				return -ENOMEM;
+		}
+		cb->nr_pages = nr_pages;
+		cb->size = nr_pages * LOG_PAGE_DATA_SIZE;
+	}
+	return 0;
+}
+
+/**
+ * ipc_log_get_stats - Returns the statistics of a log
+ *
+ * @ilctxt: logging context
+ * @stats:  receives the statistics
+ */
+void ipc_log_get_stats(struct ipc_log_context *ilctxt,
+		       struct ipc_log_stats *stats)
+{
+	struct ipc_log_cpu_buf *cb;
+	unsigned long flags;
+	int cpu;
+
+	if (!(ilctxt->flags & IPC_LOG_DEFERRED_FMT)) {
+		spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
+		*stats = ilctxt->stats;
+		spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
+		return;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		cb = per_cpu_ptr(ilctxt->cpu_buf, cpu);
+		stats->records += local64_read(&cb->records);
+		stats->bytes += local64_read(&cb->bytes);
+		stats->dropped_records += local64_read(&cb->dropped_records);
+		stats->dropped_bytes += local64_read(&cb->dropped_bytes);
+		stats->overwritten_records +=
+			local64_read(&cb->overwritten_records);
+		stats->overwritten_bytes +=
+			local64_read(&cb->overwritten_bytes);
+	}
+}
+
 /**
  * ipc_log_context_create: Create a debug log context
  *                         Should not be called from atomic context
@@ -764,11 +1324,34 @@ static void *get_deserialization_func(struct ipc_log_context *ilctxt,
  */
 void *ipc_log_context_create(int max_num_pages,
 			     const char *mod_name, uint16_t user_version)
+{
+	return ipc_log_context_create_flags(max_num_pages, mod_name,
+			user_version, IS_ENABLED(CONFIG_IPC_LOGGING_DEFERRED) ?
+			IPC_LOG_DEFERRED_FMT : 0);
+}
+EXPORT_SYMBOL(ipc_log_context_create);
+
+/**
+ * ipc_log_context_create_flags: Create a debug log context with flags
+ *                               Should not be called from atomic context
+ *
+ * @max_num_pages: Number of pages of logging space required (max. 10)
+ * @mod_name     : Name of the directory entry under DEBUGFS
+ * @user_version : Version number of user-defined message formats
+ * @flags        : IPC_LOG_* creation flags
+ *
+ * With IPC_LOG_DEFERRED_FMT every CPU gets its own share of
+ * @max_num_pages, but at least two pages.
+ *
+ * returns context id on success, NULL on failure
+ */
+void *ipc_log_context_create_flags(int max_num_pages, const char *mod_name,
+				   uint16_t user_version, unsigned int flags)
 {
 	struct ipc_log_context *ctxt;
 	struct ipc_log_page *pg = NULL;
 	int page_cnt;
-	unsigned long flags;
+	unsigned long irq_flags;
 
 	ctxt = kzalloc(sizeof(struct ipc_log_context), GFP_KERNEL);
 	if (!ctxt) {
@@ -780,28 +1363,25 @@ void *ipc_log_context_create(int max_num_pages,
 	INIT_LIST_HEAD(&ctxt->page_list);
 	INIT_LIST_HEAD(&ctxt->dfunc_info_list);
 	spin_lock_init(&ctxt->context_lock_lhb1);
-	for (page_cnt = 0; page_cnt < max_num_pages; page_cnt++) {
-		pg = kzalloc(sizeof(struct ipc_log_page), GFP_KERNEL);
-		if (!pg) {
-			pr_err("%s: cannot create ipc_log_page\n", __func__);
+	ctxt->flags = flags;
+	if (flags & IPC_LOG_DEFERRED_FMT) {
+		if (ipc_log_cpu_bufs_alloc(ctxt, max_num_pages))
 			goto release_ipc_log_context;
+		pg = list_last_entry(&ctxt->page_list, struct ipc_log_page,
+				     hdr.list);
+	} else {
+		for (page_cnt = 0; page_cnt < max_num_pages; page_cnt++) {
+			pg = ipc_log_page_alloc(ctxt, page_cnt);
+			if (!pg)
+				goto release_ipc_log_context;
 		}
-		pg->hdr.log_id = (uint64_t)(uintptr_t)ctxt;
-		pg->hdr.page_num = LOG_PAGE_FLAG | page_cnt;
-		pg->hdr.ctx_offset = (int64_t)((uint64_t)(uintptr_t)ctxt -
-			(uint64_t)(uintptr_t)&pg->hdr);
-
-		/* set magic last to signal that page init is complete */
-		pg->hdr.magic = IPC_LOGGING_MAGIC_NUM;
-		pg->hdr.nmagic = ~(IPC_LOGGING_MAGIC_NUM);
-
-		spin_lock_irqsave(&ctxt->context_lock_lhb1, flags);
-		list_add_tail(&pg->hdr.list, &ctxt->page_list);
-		spin_unlock_irqrestore(&ctxt->context_lock_lhb1, flags);
 	}
 
 	ctxt->log_id = (uint64_t)(uintptr_t)ctxt;
-	ctxt->version = IPC_LOG_VERSION;
+	if (flags & IPC_LOG_DEFERRED_FMT)
+		ctxt->version = IPC_LOG_DEFERRED_VERSION;
+	else
+		ctxt->version = IPC_LOG_VERSION;
 	strlcpy(ctxt->name, mod_name, IPC_LOG_MAX_CONTEXT_NAME_LEN);
 	ctxt->user_version = user_version;
 	ctxt->first_page = get_first_page(ctxt);
@@ -817,21 +1397,17 @@ void *ipc_log_context_create(int max_num_pages,
 	ctxt->magic = IPC_LOG_CONTEXT_MAGIC_NUM;
 	ctxt->nmagic = ~(IPC_LOG_CONTEXT_MAGIC_NUM);
 
-	write_lock_irqsave(&context_list_lock_lha1, flags);
+	write_lock_irqsave(&context_list_lock_lha1, irq_flags);
 	list_add_tail(&ctxt->list, &ipc_log_context_list);
-	write_unlock_irqrestore(&context_list_lock_lha1, flags);
+	write_unlock_irqrestore(&context_list_lock_lha1, irq_flags);
 	return (void *)ctxt;
 
 release_ipc_log_context:
-	while (page_cnt-- > 0) {
-		pg = get_first_page(ctxt);
-		list_del(&pg->hdr.list);
-		kfree(pg);
-	}
+	ipc_log_pages_free(ctxt);
 	kfree(ctxt);
 	return 0;
 }
-EXPORT_SYMBOL(ipc_log_context_create);
+EXPORT_SYMBOL(ipc_log_context_create_flags);
 
 /*
  * Destroy debug log context
@@ -841,17 +1417,12 @@ EXPORT_SYMBOL(ipc_log_context_create);
 int ipc_log_context_destroy(void *ctxt)
 {
 	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
-	struct ipc_log_page *pg = NULL;
 	unsigned long flags;
 
 	if (!ilctxt)
 		return 0;
 
-	while (!list_empty(&ilctxt->page_list)) {
-		pg = get_first_page(ctxt);
-		list_del(&pg->hdr.list);
-		kfree(pg);
-	}
+	ipc_log_pages_free(ilctxt);
 
 	write_lock_irqsave(&context_list_lock_lha1, flags);
 	list_del(&ilctxt->list);
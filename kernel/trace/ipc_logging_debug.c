@@ -26,6 +26,7 @@
 #include <linux/wait.h>
 #include <linux/delay.h>
 #include <linux/completion.h>
+#include <linux/seq_file.h>
 #include <linux/ipc_logging.h>
 
 #include "ipc_logging_private.h"
@@ -122,6 +123,35 @@ static const struct file_operations debug_ops_cont = {
 	.open = debug_open,
 };
 
+static int debug_stats_show(struct seq_file *s, void *unused)
+{
+	struct ipc_log_context *ilctxt = s->private;
+	struct ipc_log_stats stats;
+
+	ipc_log_get_stats(ilctxt, &stats);
+	seq_printf(s, "format: %s\n", ilctxt->flags & IPC_LOG_DEFERRED_FMT ?
+		   "deferred" : "immediate");
+	seq_printf(s, "records: %llu\n", stats.records);
+	seq_printf(s, "bytes: %llu\n", stats.bytes);
+	seq_printf(s, "dropped_records: %llu\n", stats.dropped_records);
+	seq_printf(s, "dropped_bytes: %llu\n", stats.dropped_bytes);
+	seq_printf(s, "overwritten_records: %llu\n", stats.overwritten_records);
+	seq_printf(s, "overwritten_bytes: %llu\n", stats.overwritten_bytes);
+	return 0;
+}
+
+static int debug_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, debug_stats_show, inode->i_private);
+}
+
+static const struct file_operations debug_ops_stats = {
+	.open = debug_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static void debug_create(const char *name, mode_t mode,
 			 struct dentry *dent,
 			 struct ipc_log_context *ilctxt,
@@ -176,6 +206,8 @@ void create_ctx_debugfs(struct ipc_log_context *ctxt,
 				     ctxt, &debug_ops);
 			debug_create("log_cont", 0444, ctxt->dent,
 				     ctxt, &debug_ops_cont);
+			debug_create("stats", 0444, ctxt->dent,
+				     ctxt, &debug_ops_stats);
 		}
 	}
 	add_deserialization_func((void *)ctxt,
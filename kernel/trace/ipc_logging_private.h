@@ -14,8 +14,11 @@
 #define _IPC_LOGGING_PRIVATE_H
 
 #include <linux/ipc_logging.h>
+#include <asm/local.h>
+#include <asm/local64.h>
 
 #define IPC_LOG_VERSION 0x0003
+#define IPC_LOG_DEFERRED_VERSION 0x0004
 #define IPC_LOG_MAX_CONTEXT_NAME_LEN 32
 
 /**
@@ -70,6 +73,88 @@ struct ipc_log_page {
 	char data[PAGE_SIZE - sizeof(struct ipc_log_page_header)];
 };
 
+/**
+ * struct ipc_log_rec_hdr - Record header of a deferred-format log
+ *
+ * @timestamp:  Scheduler clock when the record was written
+ * @qtimer:  QTimer count when the record was written
+ * @fmt:  Format string address, or 0 for a TSV message written by
+ *        ipc_log_write() which follows the header as is
+ * @size:  Size of the record including this header (multiple of 8 bytes)
+ * @len:  Number of data bytes following this header
+ *
+ * The data of a formatted record is the vbin_printf() encoding of the
+ * arguments of @fmt.
+ */
+struct ipc_log_rec_hdr {
+	uint64_t timestamp;
+	uint64_t qtimer;
+	uint64_t fmt;
+	uint32_t size;
+	uint32_t len;
+};
+
+/**
+ * struct ipc_log_cpu_buf - Per-CPU record ring of a deferred-format log
+ *
+ * @head:  Position where the next record is reserved
+ * @commit:  Position up to which all records have been written
+ * @tail:  Position of the oldest record that has not been overwritten
+ * @nesting:  Number of writers in progress on this CPU (task, IRQs, ...)
+ * @records:  Number of records written
+ * @bytes:  Number of bytes written
+ * @dropped_records:  Number of records dropped because they did not fit
+ * @dropped_bytes:  Number of bytes dropped because they did not fit
+ * @overwritten_records:  Number of records overwritten by newer ones
+ * @overwritten_bytes:  Number of bytes overwritten by newer ones
+ * @pages:  Log pages of this CPU in ring order
+ * @nr_pages:  Number of entries in @pages
+ * @size:  Ring size in bytes
+ * @rpos:  Non-destructive read position (used for debugfs)
+ *
+ * Positions only increase; the ring offset of a position is the position
+ * modulo @size.  Writers only touch the buffer of the CPU they run on, so
+ * reservation only has to be atomic against interrupts.  Readers on other
+ * CPUs see data below @commit and revalidate @tail after copying a record.
+ */
+struct ipc_log_cpu_buf {
+	local64_t head;
+	local64_t commit;
+	local64_t tail;
+	local_t nesting;
+
+	local64_t records;
+	local64_t bytes;
+	local64_t dropped_records;
+	local64_t dropped_bytes;
+	local64_t overwritten_records;
+	local64_t overwritten_bytes;
+
+	struct ipc_log_page **pages;
+	int nr_pages;
+	uint32_t size;
+	uint64_t rpos;
+};
+
+/**
+ * struct ipc_log_stats - Log statistics
+ *
+ * @records:  Number of records written
+ * @bytes:  Number of bytes written
+ * @dropped_records:  Number of records dropped because they did not fit
+ * @dropped_bytes:  Number of bytes dropped because they did not fit
+ * @overwritten_records:  Number of records overwritten by newer ones
+ * @overwritten_bytes:  Number of bytes overwritten by newer ones
+ */
+struct ipc_log_stats {
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t dropped_records;
+	uint64_t dropped_bytes;
+	uint64_t overwritten_records;
+	uint64_t overwritten_bytes;
+};
+
 /**
  * struct ipc_log_context - main logging context
  *
@@ -95,6 +180,11 @@ struct ipc_log_page {
  * @dfunc_info_list:  List of deserialization functions
  * @context_lock_lhb1:  Lock for entire structure
  * @read_avail:  Completed when new data is added to the log
+ *
+ * @flags:  IPC_LOG_* creation flags
+ * @cpu_buf:  Per-CPU record rings (IPC_LOG_DEFERRED_FMT only)
+ * @stats:  Log statistics (protected by @context_lock_lhb1; the
+ *          IPC_LOG_DEFERRED_FMT statistics are kept in @cpu_buf)
  */
 struct ipc_log_context {
 	uint32_t magic;
@@ -119,6 +209,10 @@ struct ipc_log_context {
 	struct list_head dfunc_info_list;
 	spinlock_t context_lock_lhb1;
 	struct completion read_avail;
+
+	unsigned int flags;
+	struct ipc_log_cpu_buf __percpu *cpu_buf;
+	struct ipc_log_stats stats;
 };
 
 struct dfunc_info {
@@ -147,6 +241,9 @@ enum {
 			((x) < TSV_TYPE_MSG_END))
 #define MAX_MSG_DECODED_SIZE (MAX_MSG_SIZE*4)
 
+void ipc_log_get_stats(struct ipc_log_context *ilctxt,
+		       struct ipc_log_stats *stats);
+
 #if (defined(CONFIG_DEBUG_FS))
 void check_and_create_debugfs(void);
 
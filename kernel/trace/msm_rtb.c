@@ -25,7 +25,10 @@
 #include <linux/of.h>
 #include <linux/of_address.h>
 #include <linux/io.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
 #include <asm-generic/sizes.h>
+#include <asm/local.h>
 #include <linux/msm_rtb.h>
 
 #define SENTINEL_BYTE_1 0xFF
@@ -34,6 +37,9 @@
 
 #define RTB_COMPAT_STR	"qcom,msm-rtb"
 
+#define RTB_MAGIC	0x48425452	/* "RTBH" */
+#define RTB_VERSION	2
+
 /* Write
  * 1) 3 bytes sentinel
  * 2) 1 bytes of log type
@@ -53,25 +59,38 @@ struct msm_rtb_layout {
 	uint64_t timestamp;
 } __attribute__ ((__packed__));
 
+/*
+ * The first entry of the buffer holds this header, so that tools can
+ * find the per-cpu segments in a RAM dump (see tools/rtb).  Segment N
+ * follows it at entry 1 + N * segment_entries and is written by CPU N
+ * only, with idx counting that CPU's entries.
+ */
+struct msm_rtb_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t nr_segments;
+	uint32_t segment_entries;
+} __attribute__ ((__packed__));
 
 struct msm_rtb_state {
 	struct msm_rtb_layout *rtb;
 	phys_addr_t phys;
 	int nentries;
+	int segment_entries;
 	int size;
 	int enabled;
 	int initialized;
 	uint32_t filter;
-	int step_size;
+	unsigned long caller_start;
+	unsigned long caller_end;
 };
 
-#if defined(CONFIG_MSM_RTB_SEPARATE_CPUS)
-DEFINE_PER_CPU(atomic_t, msm_rtb_idx_cpu);
-#else
-static atomic_t msm_rtb_idx;
-#endif
+/* Each CPU only ever touches its own index, nesting through interrupts */
+static DEFINE_PER_CPU(local_t, msm_rtb_idx);
 
-static struct msm_rtb_state msm_rtb = {
+static struct msm_rtb_state msm_rtb __read_mostly = {
 	.filter = 1 << LOGK_LOGBUF,
 	.enabled = 1,
 };
@@ -79,6 +98,10 @@ static struct msm_rtb_state msm_rtb = {
 module_param_named(filter, msm_rtb.filter, uint, 0644);
 module_param_named(enable, msm_rtb.enabled, int, 0644);
 
+/* Only log callers in [caller_start, caller_end) when caller_end is set */
+module_param_named(caller_start, msm_rtb.caller_start, ulong, 0644);
+module_param_named(caller_end, msm_rtb.caller_end, ulong, 0644);
+
 static int msm_rtb_panic_notifier(struct notifier_block *this,
 					unsigned long event, void *ptr)
 {
@@ -132,12 +155,20 @@ static void msm_rtb_write_timestamp(struct msm_rtb_layout *start)
 	start->timestamp = sched_clock();
 }
 
+static int notrace msm_rtb_caller_should_log(uint64_t caller)
+{
+	return !msm_rtb.caller_end ||
+		(caller >= msm_rtb.caller_start && caller < msm_rtb.caller_end);
+}
+
 static void uncached_logk_pc_idx(enum logk_event_type log_type, uint64_t caller,
-				 uint64_t data, int idx)
+				 uint64_t data, int cpu, uint32_t idx)
 {
 	struct msm_rtb_layout *start;
 
-	start = &msm_rtb.rtb[idx & (msm_rtb.nentries - 1)];
+	/* entry 0 is the header */
+	start = &msm_rtb.rtb[1 + cpu * msm_rtb.segment_entries +
+			     (idx & (msm_rtb.segment_entries - 1))];
 
 	msm_rtb_emit_sentinel(start);
 	msm_rtb_write_type(log_type, start);
@@ -150,76 +181,25 @@ static void uncached_logk_pc_idx(enum logk_event_type log_type, uint64_t caller,
 	return;
 }
 
-static void uncached_logk_timestamp(int idx)
-{
-	unsigned long long timestamp;
-
-	timestamp = sched_clock();
-	uncached_logk_pc_idx(LOGK_TIMESTAMP|LOGTYPE_NOPC,
-			(uint64_t)lower_32_bits(timestamp),
-			(uint64_t)upper_32_bits(timestamp), idx);
-}
-
-#if defined(CONFIG_MSM_RTB_SEPARATE_CPUS)
-static int msm_rtb_get_idx(void)
-{
-	int cpu, i, offset;
-	atomic_t *index;
-
-	/*
-	 * ideally we would use get_cpu but this is a close enough
-	 * approximation for our purposes.
-	 */
-	cpu = raw_smp_processor_id();
-
-	index = &per_cpu(msm_rtb_idx_cpu, cpu);
-
-	i = atomic_add_return(msm_rtb.step_size, index);
-	i -= msm_rtb.step_size;
-
-	/* Check if index has wrapped around */
-	offset = (i & (msm_rtb.nentries - 1)) -
-		 ((i - msm_rtb.step_size) & (msm_rtb.nentries - 1));
-	if (offset < 0) {
-		uncached_logk_timestamp(i);
-		i = atomic_add_return(msm_rtb.step_size, index);
-		i -= msm_rtb.step_size;
-	}
-
-	return i;
-}
-#else
-static int msm_rtb_get_idx(void)
-{
-	int i, offset;
-
-	i = atomic_inc_return(&msm_rtb_idx);
-	i--;
-
-	/* Check if index has wrapped around */
-	offset = (i & (msm_rtb.nentries - 1)) -
-		 ((i - 1) & (msm_rtb.nentries - 1));
-	if (offset < 0) {
-		uncached_logk_timestamp(i);
-		i = atomic_inc_return(&msm_rtb_idx);
-		i--;
-	}
-
-	return i;
-}
-#endif
-
 int notrace uncached_logk_pc(enum logk_event_type log_type, void *caller,
 				void *data)
 {
-	int i;
+	uint32_t idx;
+	int cpu;
 
 	if (!msm_rtb_event_should_log(log_type))
 		return 0;
 
-	i = msm_rtb_get_idx();
+	if (!msm_rtb_caller_should_log((uint64_t)((unsigned long) caller)))
+		return 0;
+
+	/* keep the index and the segment on the same cpu */
+	preempt_disable_notrace();
+	cpu = raw_smp_processor_id();
+	idx = local_inc_return(this_cpu_ptr(&msm_rtb_idx)) - 1;
 	uncached_logk_pc_idx(log_type, (uint64_t)((unsigned long) caller),
-				(uint64_t)((unsigned long) data), i);
+				(uint64_t)((unsigned long) data), cpu, idx);
+	preempt_enable_notrace();
 
 	return 1;
 }
@@ -234,9 +214,8 @@ EXPORT_SYMBOL(uncached_logk);
 static int msm_rtb_probe(struct platform_device *pdev)
 {
 	struct msm_rtb_platform_data *d = pdev->dev.platform_data;
-#if defined(CONFIG_MSM_RTB_SEPARATE_CPUS)
+	struct msm_rtb_header *hdr;
 	unsigned int cpu;
-#endif
 	int ret;
 
 	if (!pdev->dev.of_node) {
@@ -280,22 +259,29 @@ static int msm_rtb_probe(struct platform_device *pdev)
 
 	msm_rtb.nentries = msm_rtb.size / sizeof(struct msm_rtb_layout);
 
-	/* Round this down to a power of 2 */
-	msm_rtb.nentries = __rounddown_pow_of_two(msm_rtb.nentries);
+	/* One entry for the header, a power of 2 entries for each cpu */
+	msm_rtb.segment_entries = (msm_rtb.nentries - 1) / nr_cpu_ids;
+	if (!msm_rtb.segment_entries) {
+		dma_free_coherent(&pdev->dev, msm_rtb.size, msm_rtb.rtb,
+				  msm_rtb.phys);
+		return -EINVAL;
+	}
+	msm_rtb.segment_entries =
+		__rounddown_pow_of_two(msm_rtb.segment_entries);
+	msm_rtb.nentries = 1 + nr_cpu_ids * msm_rtb.segment_entries;
 
 	memset(msm_rtb.rtb, 0, msm_rtb.size);
 
+	hdr = (struct msm_rtb_header *)msm_rtb.rtb;
+	hdr->magic = RTB_MAGIC;
+	hdr->version = RTB_VERSION;
+	hdr->header_size = sizeof(struct msm_rtb_layout);
+	hdr->entry_size = sizeof(struct msm_rtb_layout);
+	hdr->nr_segments = nr_cpu_ids;
+	hdr->segment_entries = msm_rtb.segment_entries;
 
-#if defined(CONFIG_MSM_RTB_SEPARATE_CPUS)
-	for_each_possible_cpu(cpu) {
-		atomic_t *a = &per_cpu(msm_rtb_idx_cpu, cpu);
-		atomic_set(a, cpu);
-	}
-	msm_rtb.step_size = num_possible_cpus();
-#else
-	atomic_set(&msm_rtb_idx, 0);
-	msm_rtb.step_size = 1;
-#endif
+	for_each_possible_cpu(cpu)
+		local_set(&per_cpu(msm_rtb_idx, cpu), 0);
 
 	atomic_notifier_chain_register(&panic_notifier_list,
 						&msm_rtb_panic_blk);
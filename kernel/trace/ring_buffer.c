@@ -7,6 +7,7 @@
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
 #include <linux/trace_seq.h>
+#include <linux/trace_mmap.h>
 #include <linux/spinlock.h>
 #include <linux/irq_work.h>
 #include <linux/debugfs.h>
@@ -25,6 +26,7 @@
 #include <linux/cpu.h>
 #include <linux/fs.h>
 
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -357,6 +359,7 @@ struct buffer_page {
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
 	struct buffer_data_page *page;	/* Actual data page */
+	u32		 id;		/* page index in a user mapping */
 };
 
 /*
@@ -492,6 +495,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping, see ring_buffer_map() */
+	int				mapped;
+	struct trace_buffer_meta	*meta_page;
+	struct buffer_page		**subbufs;	/* indexed by id */
 };
 
 struct ring_buffer {
@@ -1295,6 +1303,10 @@ static void rb_free_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 	struct list_head *head = cpu_buffer->pages;
 	struct buffer_page *bpage, *tmp;
 
+	if (cpu_buffer->meta_page)
+		free_page((unsigned long)cpu_buffer->meta_page);
+	kfree(cpu_buffer->subbufs);
+
 	free_buffer_page(cpu_buffer->reader_page);
 
 	rb_head_page_deactivate(cpu_buffer);
@@ -1717,6 +1729,12 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 		for_each_buffer_cpu(buffer, cpu) {
 			cpu_buffer = buffer->buffers[cpu];
 
+			/* the page set of a mapped buffer is fixed */
+			if (cpu_buffer->mapped) {
+				err = -EBUSY;
+				goto out_err;
+			}
+
 			cpu_buffer->nr_pages_to_update = nr_pages -
 							cpu_buffer->nr_pages;
 			/*
@@ -1780,6 +1798,11 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 		if (nr_pages == cpu_buffer->nr_pages)
 			goto out;
 
+		if (cpu_buffer->mapped) {
+			err = -EBUSY;
+			goto out_err;
+		}
+
 		cpu_buffer->nr_pages_to_update = nr_pages -
 						cpu_buffer->nr_pages;
 
@@ -3729,6 +3752,13 @@ rb_buffer_peek(struct ring_buffer_per_cpu *cpu_buffer, u64 *ts,
 	struct buffer_page *reader;
 	int nr_loops = 0;
 
+	/*
+	 * A mapped buffer is consumed through ring_buffer_map_get_reader()
+	 * only, anything else would move the reader page under the meta page.
+	 */
+	if (cpu_buffer->mapped)
+		return NULL;
+
  again:
 	/*
 	 * We repeat when a time extend is encountered.
@@ -3890,7 +3920,8 @@ static inline int rb_ok_to_lock(void)
  * @lost_events: a variable to store if events were lost (may be NULL)
  *
  * This will return the event that will be read next, but does
- * not consume the data.
+ * not consume the data.  Returns NULL while the CPU buffer is mapped
+ * to user space.
  */
 struct ring_buffer_event *
 ring_buffer_peek(struct ring_buffer *buffer, int cpu, u64 *ts,
@@ -3958,6 +3989,7 @@ ring_buffer_iter_peek(struct ring_buffer_iter *iter, u64 *ts)
  * Returns the next event in the ring buffer, and that event is consumed.
  * Meaning, that sequential reads will keep returning a different event,
  * and eventually empty the ring buffer if the producer is slower.
+ * Returns NULL while the CPU buffer is mapped to user space.
  */
 struct ring_buffer_event *
 ring_buffer_consume(struct ring_buffer *buffer, int cpu, u64 *ts,
@@ -4169,6 +4201,31 @@ unsigned long ring_buffer_size(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_size);
 
+/*
+ * Publish the reader page and the buffer counters to a user mapping.
+ * Must be called with the reader_lock held.
+ */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				unsigned int read, unsigned int commit,
+				unsigned long lost_events)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	struct buffer_page *reader = cpu_buffer->reader_page;
+
+	meta->reader.id = reader->id;
+	meta->reader.read = read;
+	meta->reader.commit = commit;
+	meta->reader.lost_events = lost_events;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* user space may see these pages through a different alias */
+	flush_dcache_page(virt_to_page(reader->page));
+	flush_dcache_page(virt_to_page(meta));
+}
+
 static void
 rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4241,6 +4298,9 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer, 0, 0, 0);
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4354,6 +4414,11 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* A user mapping must keep pointing at its buffer */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (ring_buffer_flags != RB_BUFFERS_ON)
@@ -4481,6 +4546,7 @@ EXPORT_SYMBOL_GPL(ring_buffer_free_read_page);
  *
  * Returns:
  *  >=0 if data has been transferred, returns the offset of consumed data.
+ *  -EBUSY if the CPU buffer is mapped to user space (see ring_buffer_map()).
  *  <0 if no data has been transferred.
  */
 int ring_buffer_read_page(struct ring_buffer *buffer,
@@ -4518,6 +4584,12 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 
 	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
 
+	/* Swapping pages out would pull them from under a user mapping */
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	reader = rb_get_reader_page(cpu_buffer);
 	if (!reader)
 		goto out_unlock;
@@ -4647,6 +4719,237 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/**
+ * ring_buffer_map - prepare a CPU buffer to be mapped to user space
+ * @buffer: the buffer to map
+ * @cpu: the CPU buffer to map
+ *
+ * Sets up the meta page of the CPU buffer and gives each of its pages
+ * a fixed id, so that a single consumer can map the whole buffer
+ * read-only and parse the events in place: the meta page is page 0 of
+ * the mapping and the buffer page with id N is page N + 1 (see
+ * ring_buffer_map_page()).  The consumer then takes pages with
+ * ring_buffer_map_get_reader() instead of ring_buffer_read_page().
+ *
+ * The page set stays fixed until ring_buffer_unmap(): resizing the
+ * buffer, swapping it for a snapshot and extracting pages from it fail
+ * with -EBUSY in the meantime.
+ *
+ * Returns 0 on success, -EBUSY if the CPU buffer is already mapped.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page **subbufs;
+	struct buffer_page *bpage;
+	unsigned long flags;
+	unsigned int id;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	/* buffer->mutex keeps the page set stable against resizing */
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	subbufs = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbufs),
+			  GFP_KERNEL);
+	if (!meta || !subbufs) {
+		free_page((unsigned long)meta);
+		kfree(subbufs);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = cpu_buffer->nr_pages + 1;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	/*
+	 * Page ids survive the reader page swaps, which only exchange
+	 * pages between the reader and the ring.
+	 */
+	cpu_buffer->reader_page->id = 0;
+	subbufs[0] = cpu_buffer->reader_page;
+	bpage = list_entry(cpu_buffer->pages, struct buffer_page, list);
+	for (id = 1; id <= cpu_buffer->nr_pages; id++) {
+		bpage->id = id;
+		subbufs[id] = bpage;
+		rb_inc_page(cpu_buffer, &bpage);
+	}
+	RB_WARN_ON(cpu_buffer, &bpage->list != cpu_buffer->pages);
+
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbufs = subbufs;
+	cpu_buffer->mapped = 1;
+
+	/* nothing is handed over until the first ring_buffer_map_get_reader */
+	rb_update_meta_page(cpu_buffer, cpu_buffer->reader_page->read,
+			    cpu_buffer->reader_page->read, 0);
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - release a CPU buffer from its user space mapping
+ * @buffer: the buffer to unmap
+ * @cpu: the CPU buffer to unmap
+ *
+ * Must be called once the mapping is gone.  The pages of the mapping
+ * keep their own references, so this can not free them under the
+ * consumer.
+ */
+int ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page **subbufs;
+	unsigned long flags;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (!cpu_buffer->mapped) {
+		mutex_unlock(&buffer->mutex);
+		return -ENODEV;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	meta = cpu_buffer->meta_page;
+	subbufs = cpu_buffer->subbufs;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbufs = NULL;
+	cpu_buffer->mapped = 0;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	mutex_unlock(&buffer->mutex);
+
+	free_page((unsigned long)meta);
+	kfree(subbufs);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_page - get a page of a mapped CPU buffer
+ * @buffer: the mapped buffer
+ * @cpu: the mapped CPU buffer
+ * @pgoff: the page offset in the mapping
+ *
+ * Returns the page to map at @pgoff, or NULL if @pgoff is past the end
+ * of the mapping or the CPU buffer is not mapped.
+ */
+struct page *ring_buffer_map_page(struct ring_buffer *buffer, int cpu,
+				  unsigned long pgoff)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return NULL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	if (!cpu_buffer->mapped || pgoff > cpu_buffer->nr_pages + 1)
+		return NULL;
+
+	if (!pgoff)
+		return virt_to_page(cpu_buffer->meta_page);
+
+	return virt_to_page(cpu_buffer->subbufs[pgoff - 1]->page);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_page);
+
+/**
+ * ring_buffer_map_get_reader - hand the next unread data to a mapping
+ * @buffer: the mapped buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * Consumes what was handed over by the previous call, moves the next
+ * full page into the reader page if the current one is exhausted, and
+ * hands over everything committed on the reader page.  The reader
+ * fields of the meta page describe the handed over data on return; it
+ * stays in place until the next call since the writer never writes
+ * behind the commit of the reader page.
+ *
+ * Returns 0 on success (with reader.read == reader.commit if the
+ * buffer is empty), -ENODEV if the CPU buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long lost_events = 0;
+	struct buffer_page *reader;
+	unsigned int read, commit;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader) {
+		reader = cpu_buffer->reader_page;
+		read = commit = reader->read;
+		goto out_update;
+	}
+
+	read = reader->read;
+	commit = rb_page_size(reader);
+
+	lost_events = cpu_buffer->lost_events;
+	cpu_buffer->lost_events = 0;
+
+	if (!read && reader != cpu_buffer->commit_page) {
+		/* a full page, account it in one go like a page swap */
+		cpu_buffer->read += rb_page_entries(reader);
+		cpu_buffer->read_bytes += BUF_PAGE_SIZE;
+		reader->read = commit;
+	} else {
+		/* the writer may still be on this page, walk the events */
+		while (reader->read < commit)
+			rb_advance_reader(cpu_buffer);
+	}
+
+ out_update:
+	rb_update_meta_page(cpu_buffer, read, commit, lost_events);
+ out_unlock:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_HOTPLUG_CPU
 static int rb_cpu_notify(struct notifier_block *self,
 			 unsigned long action, void *hcpu)
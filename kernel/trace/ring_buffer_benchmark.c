@@ -4,6 +4,7 @@
  * Copyright (C) 2009 Steven Rostedt <srostedt@redhat.com>
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_mmap.h>
 #include <linux/completion.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
@@ -31,6 +32,7 @@ static struct ring_buffer *buffer;
 static struct task_struct *producer;
 static struct task_struct *consumer;
 static unsigned long read;
+static u64 read_time;
 
 static int disable_reader;
 module_param(disable_reader, uint, 0644);
@@ -58,7 +60,24 @@ MODULE_PARM_DESC(producer_fifo, "fifo prio for producer");
 module_param(consumer_fifo, uint, 0644);
 MODULE_PARM_DESC(consumer_fifo, "fifo prio for consumer");
 
-static int read_events;
+/*
+ * The consumer cycles through the ways of reading the buffer: by event,
+ * by page as splice does, and in place through a mapping.
+ */
+enum read_mode {
+	READ_EVENTS,
+	READ_PAGES,
+	READ_MAPPED,
+	NR_READ_MODES,
+};
+
+static const char *read_mode_names[NR_READ_MODES] = {
+	[READ_EVENTS]	= "events",
+	[READ_PAGES]	= "pages",
+	[READ_MAPPED]	= "mapped pages",
+};
+
+static int read_mode = NR_READ_MODES - 1;
 
 static int kill_test;
 
@@ -95,76 +114,83 @@ static enum event_status read_event(int cpu)
 	return EVENT_FOUND;
 }
 
-static enum event_status read_page(int cpu)
+static void read_page_events(int cpu, struct rb_page *rpage,
+			     unsigned long start, unsigned long commit)
 {
 	struct ring_buffer_event *event;
-	struct rb_page *rpage;
-	unsigned long commit;
-	void *bpage;
 	int *entry;
-	int ret;
 	int inc;
 	int i;
 
-	bpage = ring_buffer_alloc_read_page(buffer, cpu);
-	if (!bpage)
-		return EVENT_DROPPED;
+	for (i = start; i < commit && !kill_test; i += inc) {
 
-	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
-	if (ret >= 0) {
-		rpage = bpage;
-		/* The commit may have missed event flags set, clear them */
-		commit = local_read(&rpage->commit) & 0xfffff;
-		for (i = 0; i < commit && !kill_test; i += inc) {
+		if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+			KILL_TEST();
+			break;
+		}
 
-			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+		inc = -1;
+		event = (void *)&rpage->data[i];
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* failed writes may be discarded events */
+			if (!event->time_delta)
+				KILL_TEST();
+			inc = event->array[0] + 4;
+			break;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			inc = 8;
+			break;
+		case 0:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
-
-			inc = -1;
-			event = (void *)&rpage->data[i];
-			switch (event->type_len) {
-			case RINGBUF_TYPE_PADDING:
-				/* failed writes may be discarded events */
-				if (!event->time_delta)
-					KILL_TEST();
-				inc = event->array[0] + 4;
-				break;
-			case RINGBUF_TYPE_TIME_EXTEND:
-				inc = 8;
-				break;
-			case 0:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				if (!event->array[0]) {
-					KILL_TEST();
-					break;
-				}
-				inc = event->array[0] + 4;
+			read++;
+			if (!event->array[0]) {
+				KILL_TEST();
 				break;
-			default:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					KILL_TEST();
-					break;
-				}
-				read++;
-				inc = ((event->type_len + 1) * 4);
 			}
-			if (kill_test)
-				break;
-
-			if (inc <= 0) {
+			inc = event->array[0] + 4;
+			break;
+		default:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				KILL_TEST();
 				break;
 			}
+			read++;
+			inc = ((event->type_len + 1) * 4);
+		}
+		if (kill_test)
+			break;
+
+		if (inc <= 0) {
+			KILL_TEST();
+			break;
 		}
 	}
+}
+
+static enum event_status read_page(int cpu)
+{
+	struct rb_page *rpage;
+	unsigned long commit;
+	void *bpage;
+	int ret;
+
+	bpage = ring_buffer_alloc_read_page(buffer, cpu);
+	if (!bpage)
+		return EVENT_DROPPED;
+
+	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
+	if (ret >= 0) {
+		rpage = bpage;
+		/* The commit may have missed event flags set, clear them */
+		commit = local_read(&rpage->commit) & 0xfffff;
+		read_page_events(cpu, rpage, 0, commit);
+	}
 	ring_buffer_free_read_page(buffer, bpage);
 
 	if (ret < 0)
@@ -172,26 +198,62 @@ static enum event_status read_page(int cpu)
 	return EVENT_FOUND;
 }
 
+/* Parse the reader page in place, as a consumer of a mapping would */
+static enum event_status read_mapped(int cpu)
+{
+	struct trace_buffer_meta *meta;
+	struct rb_page *rpage;
+
+	if (ring_buffer_map_get_reader(buffer, cpu) < 0)
+		return EVENT_DROPPED;
+
+	meta = page_address(ring_buffer_map_page(buffer, cpu, 0));
+	if (meta->reader.read == meta->reader.commit)
+		return EVENT_DROPPED;
+
+	rpage = page_address(ring_buffer_map_page(buffer, cpu,
+						  meta->reader.id + 1));
+	read_page_events(cpu, rpage, meta->reader.read, meta->reader.commit);
+
+	return EVENT_FOUND;
+}
+
 static void ring_buffer_consumer(void)
 {
-	/* toggle between reading pages and events */
-	read_events ^= 1;
+	u64 start;
+	int cpu;
+
+	/* cycle between reading events, pages and mapped pages */
+	read_mode = (read_mode + 1) % NR_READ_MODES;
+
+	if (read_mode == READ_MAPPED) {
+		for_each_online_cpu(cpu) {
+			if (ring_buffer_map(buffer, cpu))
+				trace_printk("Failed to map CPU %d\n", cpu);
+		}
+	}
 
 	read = 0;
+	read_time = 0;
 	while (!reader_finish && !kill_test) {
 		int found;
 
+		start = local_clock();
 		do {
-			int cpu;
-
 			found = 0;
 			for_each_online_cpu(cpu) {
 				enum event_status stat;
 
-				if (read_events)
+				switch (read_mode) {
+				case READ_EVENTS:
 					stat = read_event(cpu);
-				else
+					break;
+				case READ_PAGES:
 					stat = read_page(cpu);
+					break;
+				default:
+					stat = read_mapped(cpu);
+				}
 
 				if (kill_test)
 					break;
@@ -199,6 +261,7 @@ static void ring_buffer_consumer(void)
 					found = 1;
 			}
 		} while (found && !kill_test);
+		read_time += local_clock() - start;
 
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (reader_finish)
@@ -206,6 +269,12 @@ static void ring_buffer_consumer(void)
 
 		schedule();
 	}
+
+	if (read_mode == READ_MAPPED) {
+		for_each_online_cpu(cpu)
+			ring_buffer_unmap(buffer, cpu);
+	}
+
 	reader_finish = 0;
 	complete(&read_done);
 }
@@ -316,7 +385,7 @@ static void ring_buffer_producer(void)
 		trace_printk("Read:     (reader disabled)\n");
 	else
 		trace_printk("Read:     %ld  (by %s)\n", read,
-			read_events ? "events" : "pages");
+			read_mode_names[read_mode]);
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
@@ -337,6 +406,13 @@ static void ring_buffer_producer(void)
 		trace_printk("%ld ns per entry\n", avg);
 	}
 
+	/* the cost of draining the buffer in the current read mode */
+	if (!disable_reader && read) {
+		read_time = div64_ul(read_time, read);
+		trace_printk("%lld ns per read entry (by %s)\n", read_time,
+			     read_mode_names[read_mode]);
+	}
+
 	if (missed) {
 		if (time)
 			missed /= (long)time;
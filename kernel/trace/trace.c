@@ -38,6 +38,7 @@
 #include <linux/poll.h>
 #include <linux/nmi.h>
 #include <linux/fs.h>
+#include <linux/trace_mmap.h>
 #include <linux/sched/rt.h>
 #include <linux/coresight-stm.h>
 
@@ -606,11 +607,24 @@ static int alloc_snapshot(struct trace_array *tr)
 
 	if (!tr->allocated_snapshot) {
 
+		/* a snapshot would swap the buffers under a user mapping */
+		spin_lock(&tr->mmap_lock);
+		if (tr->mapped) {
+			spin_unlock(&tr->mmap_lock);
+			return -EBUSY;
+		}
+		tr->snapshot_reserved = true;
+		spin_unlock(&tr->mmap_lock);
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->trace_buffer, RING_BUFFER_ALL_CPUS);
-		if (ret < 0)
+		if (ret < 0) {
+			spin_lock(&tr->mmap_lock);
+			tr->snapshot_reserved = false;
+			spin_unlock(&tr->mmap_lock);
 			return ret;
+		}
 
 		tr->allocated_snapshot = true;
 	}
@@ -629,6 +643,10 @@ static void free_snapshot(struct trace_array *tr)
 	set_buffer_entries(&tr->max_buffer, 1);
 	tracing_reset_online_cpus(&tr->max_buffer);
 	tr->allocated_snapshot = false;
+
+	spin_lock(&tr->mmap_lock);
+	tr->snapshot_reserved = false;
+	spin_unlock(&tr->mmap_lock);
 }
 
 /**
@@ -4579,6 +4597,12 @@ tracing_read_pipe(struct file *filp, char __user *ubuf,
 	}
 
 waitagain:
+	/* the ring buffer hides the events of a mapped CPU buffer */
+	if (ACCESS_ONCE(iter->tr->mapped)) {
+		sret = -EBUSY;
+		goto out;
+	}
+
 	sret = tracing_wait_pipe(filp);
 	if (sret <= 0)
 		goto out;
@@ -5125,6 +5149,7 @@ struct ftrace_buffer_info {
 	struct trace_iterator	iter;
 	void			*spare;
 	unsigned int		read;
+	atomic_t		mapped;		/* vmas mapping the buffer */
 };
 
 #ifdef CONFIG_TRACER_SNAPSHOT
@@ -5466,6 +5491,10 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 	trace_access_unlock(iter->cpu_file);
 
 	if (ret < 0) {
+		if (ret == -EBUSY) {
+			size = ret;
+			goto out_unlock;
+		}
 		if (trace_empty(iter)) {
 			if ((filp->f_flags & O_NONBLOCK)) {
 				size = -EAGAIN;
@@ -5651,6 +5680,8 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		r = ring_buffer_read_page(ref->buffer, &ref->page,
 					  len, iter->cpu_file, 1);
 		if (r < 0) {
+			if (r == -EBUSY)
+				ret = r;
 			ring_buffer_free_read_page(ref->buffer, ref->page);
 			kfree(ref);
 			break;
@@ -5705,12 +5736,146 @@ out:
 	return ret;
 }
 
+/*
+ * ->mmap() and ->close() run under mmap_sem, which readers of the trace
+ * files may take on a fault while holding trace_types_lock.  So mappings
+ * are accounted under tr->mmap_lock instead.
+ */
+static int tracing_map_get(struct trace_array *tr)
+{
+	int ret = 0;
+
+	spin_lock(&tr->mmap_lock);
+	if (tr->snapshot_reserved)
+		ret = -EBUSY;
+	else
+		tr->mapped++;
+	spin_unlock(&tr->mmap_lock);
+
+	return ret;
+}
+
+static void tracing_map_put(struct trace_array *tr)
+{
+	spin_lock(&tr->mmap_lock);
+	tr->mapped--;
+	spin_unlock(&tr->mmap_lock);
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	atomic_inc(&info->mapped);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	if (!atomic_dec_and_test(&info->mapped))
+		return;
+
+	WARN_ON(ring_buffer_unmap(iter->trace_buffer->buffer, iter->cpu_file));
+	tracing_map_put(iter->tr);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+/*
+ * Map the meta page and all the pages of a CPU buffer read-only, so
+ * that one consumer can parse the events in place.  See
+ * include/uapi/linux/trace_mmap.h for the layout.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	struct ring_buffer *buffer;
+	unsigned long pgoff, addr;
+	struct page *page;
+	int ret = 0;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+
+	ret = tracing_map_get(iter->tr);
+	if (ret)
+		return ret;
+
+	buffer = iter->trace_buffer->buffer;
+	ret = ring_buffer_map(buffer, iter->cpu_file);
+	if (ret)
+		goto out;
+
+	for (pgoff = 0, addr = vma->vm_start; addr < vma->vm_end;
+	     pgoff++, addr += PAGE_SIZE) {
+		page = ring_buffer_map_page(buffer, iter->cpu_file, pgoff);
+		if (!page) {
+			ret = -EINVAL;
+			break;
+		}
+		ret = vm_insert_page(vma, addr, page);
+		if (ret)
+			break;
+	}
+
+	if (ret) {
+		/* a failed mmap tears the vma down without ->close() */
+		ring_buffer_unmap(buffer, iter->cpu_file);
+		goto out;
+	}
+
+	atomic_set(&info->mapped, 1);
+	vma->vm_ops = &tracing_buffers_vmops;
+	return 0;
+ out:
+	tracing_map_put(iter->tr);
+
+	return ret;
+}
+
+static long tracing_buffers_ioctl(struct file *filp, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	/* only the owner of the mapping consumes through it */
+	if (!atomic_read(&info->mapped))
+		return -ENODEV;
+
+	trace_access_lock(iter->cpu_file);
+	ret = ring_buffer_map_get_reader(iter->trace_buffer->buffer,
+					 iter->cpu_file);
+	trace_access_unlock(iter->cpu_file);
+
+	return ret;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.mmap		= tracing_buffers_mmap,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.compat_ioctl	= tracing_buffers_ioctl,
 	.llseek		= no_llseek,
 };
 
@@ -6370,6 +6535,7 @@ static int allocate_trace_buffers(struct trace_array *tr, int size)
 		return -ENOMEM;
 	}
 	tr->allocated_snapshot = allocate_snapshot;
+	tr->snapshot_reserved = allocate_snapshot;
 
 	/*
 	 * Only the top level trace array gets its snapshot allocated
@@ -6430,6 +6596,7 @@ static int new_instance_create(const char *name)
 	cpumask_copy(tr->tracing_cpumask, cpu_all_mask);
 
 	raw_spin_lock_init(&tr->start_lock);
+	spin_lock_init(&tr->mmap_lock);
 
 	tr->max_lock = (arch_spinlock_t)__ARCH_SPIN_LOCK_UNLOCKED;
 
@@ -6903,6 +7070,7 @@ __init static int tracer_alloc_buffers(void)
 	cpumask_copy(global_trace.tracing_cpumask, cpu_all_mask);
 
 	raw_spin_lock_init(&global_trace.start_lock);
+	spin_lock_init(&global_trace.mmap_lock);
 
 	/* Used for event triggers */
 	temp_buffer = ring_buffer_alloc(PAGE_SIZE, RB_FL_OVERWRITE);
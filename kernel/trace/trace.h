@@ -192,6 +192,15 @@ struct trace_array {
 	bool			allocated_snapshot;
 	unsigned long		max_latency;
 #endif
+	/*
+	 * trace_pipe_raw mappings, no snapshot can be taken while > 0, and
+	 * snapshot_reserved, set while a snapshot is being or has been
+	 * allocated.  Both are protected by mmap_lock, which is taken from
+	 * ->mmap() under mmap_sem and is never held across user copies.
+	 */
+	spinlock_t		mmap_lock;
+	int			mapped;
+	bool			snapshot_reserved;
 	/*
 	 * max_lock is used to protect the swapping of buffers
 	 * when taking a max snapshot. The buffers themselves are
@@ -989,6 +998,13 @@ struct ftrace_event_field {
 	int			is_signed;
 };
 
+static inline bool is_string_field(struct ftrace_event_field *field)
+{
+	return field->filter_type == FILTER_DYN_STRING ||
+	       field->filter_type == FILTER_STATIC_STRING ||
+	       field->filter_type == FILTER_PTR_STRING;
+}
+
 struct event_filter {
 	int			n_preds;	/* Number assigned */
 	int			a_preds;	/* allocated */
@@ -1102,6 +1118,13 @@ extern const struct file_operations event_trigger_fops;
 extern int register_trigger_cmds(void);
 extern void clear_event_triggers(struct trace_array *tr);
 
+#ifdef CONFIG_HIST_TRIGGERS
+extern const struct file_operations event_hist_fops;
+extern int register_trigger_hist_cmd(void);
+#else
+static inline int register_trigger_hist_cmd(void) { return 0; }
+#endif
+
 struct event_trigger_data {
 	unsigned long			count;
 	int				ref;
@@ -1125,7 +1148,10 @@ struct event_trigger_data {
  * @func: The trigger 'probe' function called when the triggering
  *	event occurs.  The data passed into this callback is the data
  *	that was supplied to the event_command @reg() function that
- *	registered the trigger (see struct event_command).
+ *	registered the trigger (see struct event_command).  The record
+ *	is the trace entry of the event, or NULL if the trigger was
+ *	invoked unconditionally or after the event was committed (see
+ *	@needs_rec in struct event_command).
  *
  * @init: An optional initialization function called for the trigger
  *	when the trigger is registered (via the event_command reg()
@@ -1150,7 +1176,8 @@ struct event_trigger_data {
  *	(see trace_event_triggers.c).
  */
 struct event_trigger_ops {
-	void			(*func)(struct event_trigger_data *data);
+	void			(*func)(struct event_trigger_data *data,
+					void *rec);
 	int			(*init)(struct event_trigger_ops *ops,
 					struct event_trigger_data *data);
 	void			(*free)(struct event_trigger_ops *ops,
@@ -1174,8 +1201,8 @@ struct event_trigger_ops {
  * The data members in this structure provide per-event command data
  * for various event commands.
  *
- * All the data members below, except for @post_trigger, must be set
- * for each event command.
+ * All the data members below, except for @post_trigger and
+ * @needs_rec, must be set for each event command.
  *
  * @name: The unique name that identifies the event command.  This is
  *	the name used when setting triggers via trigger files.
@@ -1213,6 +1240,11 @@ struct event_trigger_ops {
  *	itself logs to the trace buffer, this flag should be set,
  *	otherwise it can be left unspecified.
  *
+ * @needs_rec: A flag that says whether or not this command needs
+ *	the trace record of the event, e.g. to read its fields.  If
+ *	set, the trigger is never invoked unconditionally and its
+ *	@func() is always passed the current record.
+ *
  * All the methods below, except for @set_filter(), must be
  * implemented.
  *
@@ -1253,6 +1285,7 @@ struct event_command {
 	char			*name;
 	enum event_trigger_type	trigger_type;
 	bool			post_trigger;
+	bool			needs_rec;
 	int			(*func)(struct event_command *cmd_ops,
 					struct ftrace_event_file *file,
 					char *glob, char *cmd, char *params);
@@ -1272,6 +1305,21 @@ struct event_command {
 
 extern int trace_event_enable_disable(struct ftrace_event_file *file,
 				      int enable, int soft_disable);
+
+extern int register_event_command(struct event_command *cmd);
+extern int unregister_event_command(struct event_command *cmd);
+extern void trigger_data_free(struct event_trigger_data *data);
+extern int event_trigger_init(struct event_trigger_ops *ops,
+			      struct event_trigger_data *data);
+extern int trace_event_trigger_enable_disable(struct ftrace_event_file *file,
+					      int trigger_enable);
+extern void update_cond_flag(struct ftrace_event_file *file);
+extern void unregister_trigger(char *glob, struct event_trigger_ops *ops,
+			       struct event_trigger_data *test,
+			       struct ftrace_event_file *file);
+extern int set_trigger_filter(char *filter_str,
+			      struct event_trigger_data *trigger_data,
+			      struct ftrace_event_file *file);
 extern int tracing_alloc_snapshot(void);
 
 extern const char *__start___trace_bprintk_fmt[];
@@ -0,0 +1,1164 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * A hist trigger aggregates the fields of every hit of an event into a
+ * hash map, so that high rate events can be summarized without copying
+ * them out of the trace buffer:
+ *
+ *   echo 'hist:keys=common_pid.execname:vals=bytes_req:\
+ *	sort=hitcount.descending' > events/kmem/kmalloc/trigger
+ *   cat events/kmem/kmalloc/hist
+ *
+ * The trigger is written as
+ *
+ *   hist:keys=<field1[,field2,...]>[:vals=<field1[,field2,...]>]
+ *	 [:sort=<field1[,field2]>][:size=#entries][:pause][:cont][:clear]
+ *	 [if <filter>]
+ *
+ * Up to HIST_KEYS_MAX numeric or string fields make up the key of an
+ * entry.  A numeric key can be displayed as hex (.hex), as a symbol
+ * (.sym) or, for common_pid, with the command name of the task (.execname).
+ * Each entry counts its hits and sums the numeric fields listed in vals.
+ * Entries are sorted by hitcount, or by up to two keys or values, each
+ * optionally suffixed by .ascending or .descending.  The map holds up to
+ * size entries; hits of new keys are dropped once it is full.
+ *
+ * Appending 'hist:...:pause', ':cont' or ':clear' to the trigger file
+ * pauses, continues or clears the existing hist trigger of the event.
+ * '!hist:...' removes it.
+ *
+ * The map is filled without locks: slots are claimed with cmpxchg on
+ * the key hash and entries come from a preallocated array, so the
+ * trigger can run in any context.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		4	/* including hitcount */
+#define HIST_FIELDS_MAX		(HIST_KEYS_MAX + HIST_VALS_MAX)
+#define HIST_SORT_KEYS_MAX	2
+#define HIST_KEY_SIZE_MAX	(MAX_FILTER_STR_VAL + 2 * sizeof(u64))
+
+#define HIST_MAP_BITS_DEFAULT	11
+#define HIST_MAP_BITS_MIN	7
+#define HIST_MAP_BITS_MAX	17
+#define HIST_MAP_DUP_TRIES	16
+
+struct hist_field;
+
+typedef u64 (*hist_field_fn_t) (struct hist_field *field, void *event);
+
+enum hist_field_flags {
+	HIST_FIELD_HITCOUNT	= 1,
+	HIST_FIELD_KEY		= 2,
+	HIST_FIELD_STRING	= 4,
+	HIST_FIELD_HEX		= 8,
+	HIST_FIELD_SYM		= 16,
+	HIST_FIELD_EXECNAME	= 32,
+};
+
+struct hist_field {
+	struct ftrace_event_field	*field;
+	unsigned long			flags;
+	hist_field_fn_t			fn;
+	unsigned int			size;
+	unsigned int			offset;
+};
+
+struct hist_elt {
+	struct hist_map			*map;
+	void				*key;
+	atomic64_t			*sums;
+	char				*comm;
+};
+
+struct hist_map_entry {
+	u32				key;
+	struct hist_elt			*elt;
+};
+
+struct hist_map {
+	unsigned int			map_bits;
+	unsigned int			map_size;
+	unsigned int			max_elts;
+	unsigned int			key_size;
+	unsigned int			n_vals;
+	atomic_t			next_elt;
+	atomic64_t			drops;
+	struct hist_map_entry		*entries;
+	struct hist_elt			*elts;
+	void				*keys;
+	atomic64_t			*sums;
+	char				*comms;
+	struct hist_trigger_data	*hist_data;
+};
+
+struct hist_trigger_attrs {
+	char				*keys_str;
+	char				*vals_str;
+	char				*sort_key_str;
+	bool				pause;
+	bool				cont;
+	bool				clear;
+	unsigned int			map_bits;
+};
+
+struct hist_sort_key {
+	unsigned int			field_idx;
+	bool				descending;
+};
+
+/*
+ * fields[0] is the hitcount, fields[1..n_vals - 1] are the summed values
+ * and fields[n_vals..n_fields - 1] are the keys.
+ */
+struct hist_trigger_data {
+	struct hist_field		*fields[HIST_FIELDS_MAX];
+	unsigned int			n_vals;
+	unsigned int			n_fields;
+	unsigned int			key_size;
+	struct hist_sort_key		sort_keys[HIST_SORT_KEYS_MAX];
+	unsigned int			n_sort_keys;
+	bool				paused;
+	struct hist_trigger_attrs	*attrs;
+	struct hist_map			*map;
+};
+
+#define for_each_hist_val_field(i, hist_data)	\
+	for ((i) = 0; (i) < (hist_data)->n_vals; (i)++)
+
+#define for_each_hist_key_field(i, hist_data)	\
+	for ((i) = (hist_data)->n_vals; (i) < (hist_data)->n_fields; (i)++)
+
+static u64 hist_field_counter(struct hist_field *field, void *event)
+{
+	return 1;
+}
+
+static u64 hist_field_string(struct hist_field *hist_field, void *event)
+{
+	char *addr = (char *)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_dynstring(struct hist_field *hist_field, void *event)
+{
+	u32 str_item = *(u32 *)(event + hist_field->field->offset);
+	int str_loc = str_item & 0xffff;
+	char *addr = (char *)(event + str_loc);
+
+	return (u64)(unsigned long)addr;
+}
+
+static u64 hist_field_pstring(struct hist_field *hist_field, void *event)
+{
+	char **addr = (char **)(event + hist_field->field->offset);
+
+	return (u64)(unsigned long)*addr;
+}
+
+#define DEFINE_HIST_FIELD_FN(type)					\
+static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
+{									\
+	type *addr = (type *)(event + hist_field->field->offset);	\
+									\
+	return (u64)*addr;						\
+}
+
+DEFINE_HIST_FIELD_FN(s64);
+DEFINE_HIST_FIELD_FN(u64);
+DEFINE_HIST_FIELD_FN(s32);
+DEFINE_HIST_FIELD_FN(u32);
+DEFINE_HIST_FIELD_FN(s16);
+DEFINE_HIST_FIELD_FN(u16);
+DEFINE_HIST_FIELD_FN(s8);
+DEFINE_HIST_FIELD_FN(u8);
+
+static hist_field_fn_t select_value_fn(int field_size, int field_is_signed)
+{
+	switch (field_size) {
+	case 8:
+		return field_is_signed ? hist_field_s64 : hist_field_u64;
+	case 4:
+		return field_is_signed ? hist_field_s32 : hist_field_u32;
+	case 2:
+		return field_is_signed ? hist_field_s16 : hist_field_u16;
+	case 1:
+		return field_is_signed ? hist_field_s8 : hist_field_u8;
+	}
+
+	return NULL;
+}
+
+static void hist_map_clear(struct hist_map *map)
+{
+	memset(map->entries, 0, map->map_size * sizeof(*map->entries));
+	memset(map->keys, 0, map->max_elts * map->key_size);
+	memset(map->sums, 0, map->max_elts * map->n_vals * sizeof(*map->sums));
+	if (map->comms)
+		memset(map->comms, 0, map->max_elts * TASK_COMM_LEN);
+	atomic_set(&map->next_elt, -1);
+	atomic64_set(&map->drops, 0);
+}
+
+static void hist_map_destroy(struct hist_map *map)
+{
+	if (!map)
+		return;
+
+	vfree(map->comms);
+	vfree(map->sums);
+	vfree(map->keys);
+	vfree(map->elts);
+	vfree(map->entries);
+	kfree(map);
+}
+
+/*
+ * The map has twice as many slots as entries, which keeps the probe
+ * sequences short while it fills up.
+ */
+static struct hist_map *hist_map_create(unsigned int map_bits,
+					unsigned int key_size,
+					unsigned int n_vals, bool save_comm)
+{
+	struct hist_elt *elt;
+	struct hist_map *map;
+	unsigned int i;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return NULL;
+
+	map->map_bits = map_bits;
+	map->max_elts = 1 << map_bits;
+	map->map_size = 1 << (map_bits + 1);
+	map->key_size = key_size;
+	map->n_vals = n_vals;
+
+	map->entries = vzalloc(map->map_size * sizeof(*map->entries));
+	map->elts = vzalloc(map->max_elts * sizeof(*map->elts));
+	map->keys = vzalloc(map->max_elts * key_size);
+	map->sums = vzalloc(map->max_elts * n_vals * sizeof(*map->sums));
+	if (save_comm)
+		map->comms = vzalloc(map->max_elts * TASK_COMM_LEN);
+	if (!map->entries || !map->elts || !map->keys || !map->sums ||
+	    (save_comm && !map->comms)) {
+		hist_map_destroy(map);
+		return NULL;
+	}
+
+	for (i = 0; i < map->max_elts; i++) {
+		elt = &map->elts[i];
+		elt->map = map;
+		elt->key = map->keys + i * key_size;
+		elt->sums = &map->sums[i * n_vals];
+		if (map->comms)
+			elt->comm = map->comms + i * TASK_COMM_LEN;
+	}
+	atomic_set(&map->next_elt, -1);
+
+	return map;
+}
+
+static struct hist_elt *hist_map_get_elt(struct hist_map *map)
+{
+	int idx;
+
+	/* don't let next_elt run away once the map is full */
+	if (atomic_read(&map->next_elt) >= (int)map->max_elts - 1)
+		return NULL;
+
+	idx = atomic_inc_return(&map->next_elt);
+	if (idx >= map->max_elts)
+		return NULL;
+
+	return &map->elts[idx];
+}
+
+/**
+ * hist_map_insert - Find or add the map entry of a key
+ * @map: The map
+ * @key: The key, map->key_size bytes
+ *
+ * Slots are claimed by a cmpxchg of the key hash.  The claiming CPU
+ * then takes a preallocated entry, copies the key into it and
+ * publishes it.  A CPU that finds a slot of its hash still being
+ * published waits for it a little before probing on, so concurrent
+ * first hits of a key normally end up in the same entry.
+ *
+ * Return: the entry of @key, or NULL if the map is full.
+ */
+static struct hist_elt *hist_map_insert(struct hist_map *map, void *key)
+{
+	struct hist_map_entry *entry;
+	unsigned int probes = 0, dup_tries = 0;
+	u32 idx, key_hash, test_key;
+	struct hist_elt *elt;
+
+	key_hash = jhash(key, map->key_size, 0);
+	if (key_hash == 0)
+		key_hash = 1;
+	idx = key_hash >> (32 - (map->map_bits + 1));
+
+	while (probes < map->map_size) {
+		idx &= (map->map_size - 1);
+		entry = &map->entries[idx];
+		test_key = ACCESS_ONCE(entry->key);
+
+		if (test_key == key_hash) {
+			elt = ACCESS_ONCE(entry->elt);
+			if (elt) {
+				/* pairs with the smp_wmb() below */
+				smp_rmb();
+				if (!memcmp(elt->key, key, map->key_size))
+					return elt;
+			} else if (dup_tries++ < HIST_MAP_DUP_TRIES) {
+				cpu_relax();
+				continue;
+			}
+		} else if (!test_key) {
+			if (cmpxchg(&entry->key, 0, key_hash) != 0)
+				continue;
+
+			elt = hist_map_get_elt(map);
+			if (!elt) {
+				ACCESS_ONCE(entry->key) = 0;
+				break;
+			}
+			memcpy(elt->key, key, map->key_size);
+			if (elt->comm)
+				memcpy(elt->comm, current->comm, TASK_COMM_LEN);
+			/* publish the key before the entry */
+			smp_wmb();
+			ACCESS_ONCE(entry->elt) = elt;
+			return elt;
+		}
+
+		dup_tries = 0;
+		probes++;
+		idx++;
+	}
+
+	atomic64_inc(&map->drops);
+	return NULL;
+}
+
+static void event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	char compound_key[HIST_KEY_SIZE_MAX];
+	struct hist_field *hist_field;
+	struct hist_elt *elt;
+	u64 field_contents;
+	unsigned int i;
+
+	/* the trigger can run once before the event starts passing records */
+	if (!rec)
+		return;
+
+	if (ACCESS_ONCE(hist_data->paused))
+		return;
+
+	memset(compound_key, 0, hist_data->key_size);
+	for_each_hist_key_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		field_contents = hist_field->fn(hist_field, rec);
+		if (hist_field->flags & HIST_FIELD_STRING)
+			strncpy(compound_key + hist_field->offset,
+				(char *)(unsigned long)field_contents,
+				hist_field->size - 1);
+		else
+			memcpy(compound_key + hist_field->offset,
+			       &field_contents, sizeof(u64));
+	}
+
+	elt = hist_map_insert(hist_data->map, compound_key);
+	if (!elt)
+		return;
+
+	for_each_hist_val_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		atomic64_add(hist_field->fn(hist_field, rec), &elt->sums[i]);
+	}
+}
+
+static const char *hist_field_name(struct hist_field *hist_field)
+{
+	if (hist_field->flags & HIST_FIELD_HITCOUNT)
+		return "hitcount";
+
+	return hist_field->field->name;
+}
+
+static const char *hist_field_modifier(struct hist_field *hist_field)
+{
+	if (hist_field->flags & HIST_FIELD_HEX)
+		return ".hex";
+	if (hist_field->flags & HIST_FIELD_SYM)
+		return ".sym";
+	if (hist_field->flags & HIST_FIELD_EXECNAME)
+		return ".execname";
+
+	return "";
+}
+
+static int hist_cmp_field(struct hist_trigger_data *hist_data,
+			  struct hist_sort_key *sort_key,
+			  struct hist_elt *a, struct hist_elt *b)
+{
+	struct hist_field *hist_field = hist_data->fields[sort_key->field_idx];
+	u64 val_a, val_b;
+
+	if (sort_key->field_idx < hist_data->n_vals) {
+		val_a = atomic64_read(&a->sums[sort_key->field_idx]);
+		val_b = atomic64_read(&b->sums[sort_key->field_idx]);
+	} else if (hist_field->flags & HIST_FIELD_STRING) {
+		return strcmp(a->key + hist_field->offset,
+			      b->key + hist_field->offset);
+	} else {
+		memcpy(&val_a, a->key + hist_field->offset, sizeof(u64));
+		memcpy(&val_b, b->key + hist_field->offset, sizeof(u64));
+	}
+
+	if (hist_field->field && hist_field->field->is_signed) {
+		if ((s64)val_a == (s64)val_b)
+			return 0;
+		return (s64)val_a < (s64)val_b ? -1 : 1;
+	}
+	if (val_a == val_b)
+		return 0;
+	return val_a < val_b ? -1 : 1;
+}
+
+static int cmp_hist_elts(const void *a, const void *b)
+{
+	struct hist_elt *elt_a = *(struct hist_elt **)a;
+	struct hist_elt *elt_b = *(struct hist_elt **)b;
+	struct hist_trigger_data *hist_data = elt_a->map->hist_data;
+	struct hist_sort_key *sort_key;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < hist_data->n_sort_keys; i++) {
+		sort_key = &hist_data->sort_keys[i];
+		ret = hist_cmp_field(hist_data, sort_key, elt_a, elt_b);
+		if (ret)
+			return sort_key->descending ? -ret : ret;
+	}
+
+	return 0;
+}
+
+static void hist_trigger_entry_print(struct seq_file *m,
+				     struct hist_trigger_data *hist_data,
+				     struct hist_elt *elt)
+{
+	char str[KSYM_SYMBOL_LEN];
+	struct hist_field *hist_field;
+	const char *field_name;
+	unsigned int i;
+	u64 uval;
+
+	seq_puts(m, "{ ");
+	for_each_hist_key_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		field_name = hist_field_name(hist_field);
+
+		if (i > hist_data->n_vals)
+			seq_puts(m, ", ");
+
+		if (hist_field->flags & HIST_FIELD_STRING) {
+			seq_printf(m, "%s: %-50s", field_name,
+				   (char *)(elt->key + hist_field->offset));
+			continue;
+		}
+
+		memcpy(&uval, elt->key + hist_field->offset, sizeof(u64));
+		if (hist_field->flags & HIST_FIELD_HEX) {
+			seq_printf(m, "%s: %llx", field_name, uval);
+		} else if (hist_field->flags & HIST_FIELD_SYM) {
+			sprint_symbol_no_offset(str, (unsigned long)uval);
+			seq_printf(m, "%s: [%llx] %-45s", field_name,
+				   uval, str);
+		} else if (hist_field->flags & HIST_FIELD_EXECNAME) {
+			seq_printf(m, "%s: %-16s[%10llu]", field_name,
+				   elt->comm, uval);
+		} else if (hist_field->field->is_signed) {
+			seq_printf(m, "%s: %10lld", field_name, (s64)uval);
+		} else {
+			seq_printf(m, "%s: %10llu", field_name, uval);
+		}
+	}
+	seq_puts(m, " }");
+
+	for_each_hist_val_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		field_name = hist_field_name(hist_field);
+		uval = atomic64_read(&elt->sums[i]);
+		if (hist_field->field && hist_field->field->is_signed)
+			seq_printf(m, " %s: %10lld", field_name, (s64)uval);
+		else
+			seq_printf(m, " %s: %10llu", field_name, uval);
+	}
+	seq_putc(m, '\n');
+}
+
+static int hist_trigger_show(struct seq_file *m,
+			     struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct hist_map *map = hist_data->map;
+	struct hist_elt **sort_elts;
+	unsigned int i, n_elts;
+	u64 hits, drops;
+
+	seq_puts(m, "# event histogram\n#\n# trigger info: ");
+	data->ops->print(m, data->ops, data);
+	seq_puts(m, "#\n\n");
+
+	n_elts = min_t(unsigned int, atomic_read(&map->next_elt) + 1,
+		       map->max_elts);
+	sort_elts = vmalloc(max(n_elts, 1U) * sizeof(*sort_elts));
+	if (!sort_elts)
+		return -ENOMEM;
+
+	for (i = 0; i < n_elts; i++)
+		sort_elts[i] = &map->elts[i];
+	sort(sort_elts, n_elts, sizeof(*sort_elts), cmp_hist_elts, NULL);
+
+	drops = atomic64_read(&map->drops);
+	hits = drops;
+	for (i = 0; i < n_elts; i++) {
+		hist_trigger_entry_print(m, hist_data, sort_elts[i]);
+		hits += atomic64_read(&sort_elts[i]->sums[0]);
+	}
+	vfree(sort_elts);
+
+	seq_puts(m, "\nTotals:\n");
+	seq_printf(m, "    Hits: %llu\n", hits);
+	seq_printf(m, "    Entries: %u\n", n_elts);
+	seq_printf(m, "    Dropped: %llu\n", drops);
+
+	return 0;
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct ftrace_event_file *event_file;
+	struct event_trigger_data *data;
+	int ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	event_file = event_file_data(m->private);
+	if (unlikely(!event_file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	list_for_each_entry_rcu(data, &event_file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST) {
+			ret = hist_trigger_show(m, data);
+			break;
+		}
+	}
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+{
+	if (!attrs)
+		return;
+
+	kfree(attrs->sort_key_str);
+	kfree(attrs->vals_str);
+	kfree(attrs->keys_str);
+	kfree(attrs);
+}
+
+static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+{
+	struct hist_trigger_attrs *attrs;
+	unsigned int size;
+	char *str, **dst;
+	int ret = 0;
+
+	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
+	if (!attrs)
+		return ERR_PTR(-ENOMEM);
+	attrs->map_bits = HIST_MAP_BITS_DEFAULT;
+
+	while (trigger_str) {
+		str = strsep(&trigger_str, ":");
+		dst = NULL;
+
+		if (!strncmp(str, "keys=", strlen("keys=")) ||
+		    !strncmp(str, "key=", strlen("key="))) {
+			dst = &attrs->keys_str;
+		} else if (!strncmp(str, "vals=", strlen("vals=")) ||
+			   !strncmp(str, "values=", strlen("values="))) {
+			dst = &attrs->vals_str;
+		} else if (!strncmp(str, "sort=", strlen("sort="))) {
+			dst = &attrs->sort_key_str;
+		} else if (!strncmp(str, "size=", strlen("size="))) {
+			ret = kstrtouint(str + strlen("size="), 0, &size);
+			if (ret || !size)
+				goto fail;
+			attrs->map_bits = ilog2(roundup_pow_of_two(size));
+			if (attrs->map_bits < HIST_MAP_BITS_MIN ||
+			    attrs->map_bits > HIST_MAP_BITS_MAX)
+				goto fail;
+		} else if (!strcmp(str, "pause")) {
+			attrs->pause = true;
+		} else if (!strcmp(str, "cont") || !strcmp(str, "continue")) {
+			attrs->cont = true;
+		} else if (!strcmp(str, "clear")) {
+			attrs->clear = true;
+		} else {
+			goto fail;
+		}
+
+		if (dst) {
+			kfree(*dst);
+			*dst = kstrdup(strchr(str, '=') + 1, GFP_KERNEL);
+			if (!*dst) {
+				ret = -ENOMEM;
+				goto free;
+			}
+		}
+	}
+
+	if (!attrs->keys_str)
+		goto fail;
+
+	return attrs;
+ fail:
+	ret = -EINVAL;
+ free:
+	destroy_hist_trigger_attrs(attrs);
+	return ERR_PTR(ret);
+}
+
+static void destroy_hist_data(struct hist_trigger_data *hist_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < hist_data->n_fields; i++)
+		kfree(hist_data->fields[i]);
+	destroy_hist_trigger_attrs(hist_data->attrs);
+	hist_map_destroy(hist_data->map);
+	kfree(hist_data);
+}
+
+static struct hist_field *create_hist_field(struct ftrace_event_call *call,
+					    char *field_str,
+					    unsigned long flags)
+{
+	struct ftrace_event_field *field = NULL;
+	struct hist_field *hist_field;
+	char *field_name, *modifier;
+
+	if (!(flags & HIST_FIELD_HITCOUNT)) {
+		field_name = strsep(&field_str, ".");
+		modifier = field_str;
+		field = trace_find_event_field(call, field_name);
+		if (!field)
+			return NULL;
+
+		if (modifier && !(flags & HIST_FIELD_KEY))
+			return NULL;
+		if (!modifier)
+			;
+		else if (!strcmp(modifier, "hex"))
+			flags |= HIST_FIELD_HEX;
+		else if (!strcmp(modifier, "sym"))
+			flags |= HIST_FIELD_SYM;
+		else if (!strcmp(modifier, "execname") &&
+			 !strcmp(field->name, "common_pid"))
+			flags |= HIST_FIELD_EXECNAME;
+		else
+			return NULL;
+
+		if (is_string_field(field)) {
+			if (!(flags & HIST_FIELD_KEY) || modifier)
+				return NULL;
+			flags |= HIST_FIELD_STRING;
+		}
+	}
+
+	hist_field = kzalloc(sizeof(*hist_field), GFP_KERNEL);
+	if (!hist_field)
+		return NULL;
+
+	hist_field->field = field;
+	hist_field->flags = flags;
+	hist_field->size = sizeof(u64);
+
+	if (flags & HIST_FIELD_HITCOUNT) {
+		hist_field->fn = hist_field_counter;
+	} else if (flags & HIST_FIELD_STRING) {
+		if (field->filter_type == FILTER_STATIC_STRING) {
+			hist_field->fn = hist_field_string;
+			hist_field->size = ALIGN(field->size, sizeof(u64));
+		} else if (field->filter_type == FILTER_DYN_STRING) {
+			hist_field->fn = hist_field_dynstring;
+			hist_field->size = MAX_FILTER_STR_VAL;
+		} else {
+			hist_field->fn = hist_field_pstring;
+			hist_field->size = MAX_FILTER_STR_VAL;
+		}
+	} else {
+		hist_field->fn = select_value_fn(field->size,
+						 field->is_signed);
+		if (!hist_field->fn) {
+			kfree(hist_field);
+			return NULL;
+		}
+	}
+
+	return hist_field;
+}
+
+static int create_val_fields(struct hist_trigger_data *hist_data,
+			     struct ftrace_event_file *file)
+{
+	struct ftrace_event_call *call = file->event_call;
+	char *fields_str, *field_str;
+
+	hist_data->fields[0] = create_hist_field(call, NULL,
+						 HIST_FIELD_HITCOUNT);
+	if (!hist_data->fields[0])
+		return -ENOMEM;
+	hist_data->n_vals = hist_data->n_fields = 1;
+
+	fields_str = hist_data->attrs->vals_str;
+	while (fields_str) {
+		field_str = strsep(&fields_str, ",");
+		if (!*field_str || !strcmp(field_str, "hitcount"))
+			continue;
+		if (hist_data->n_vals == HIST_VALS_MAX)
+			return -EINVAL;
+
+		hist_data->fields[hist_data->n_vals] =
+			create_hist_field(call, field_str, 0);
+		if (!hist_data->fields[hist_data->n_vals])
+			return -EINVAL;
+		hist_data->n_vals = ++hist_data->n_fields;
+	}
+
+	return 0;
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     struct ftrace_event_file *file)
+{
+	struct ftrace_event_call *call = file->event_call;
+	char *fields_str, *field_str;
+	struct hist_field *hist_field;
+
+	fields_str = hist_data->attrs->keys_str;
+	while (fields_str) {
+		field_str = strsep(&fields_str, ",");
+		if (!*field_str)
+			continue;
+		if (hist_data->n_fields - hist_data->n_vals == HIST_KEYS_MAX)
+			return -EINVAL;
+
+		hist_field = create_hist_field(call, field_str,
+					       HIST_FIELD_KEY);
+		if (!hist_field)
+			return -EINVAL;
+		hist_data->fields[hist_data->n_fields++] = hist_field;
+
+		hist_field->offset = hist_data->key_size;
+		hist_data->key_size += hist_field->size;
+		if (hist_data->key_size > HIST_KEY_SIZE_MAX)
+			return -EINVAL;
+	}
+
+	if (hist_data->n_fields == hist_data->n_vals)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int create_sort_keys(struct hist_trigger_data *hist_data)
+{
+	char *fields_str = hist_data->attrs->sort_key_str;
+	struct hist_sort_key *sort_key;
+	char *field_str, *field_name;
+	unsigned int i;
+
+	hist_data->n_sort_keys = 1;
+	if (!fields_str)
+		return 0;
+
+	hist_data->n_sort_keys = 0;
+	while (fields_str) {
+		field_str = strsep(&fields_str, ",");
+		if (!*field_str)
+			continue;
+		if (hist_data->n_sort_keys == HIST_SORT_KEYS_MAX)
+			return -EINVAL;
+
+		sort_key = &hist_data->sort_keys[hist_data->n_sort_keys++];
+		field_name = strsep(&field_str, ".");
+		if (!field_str || !strcmp(field_str, "ascending"))
+			sort_key->descending = false;
+		else if (!strcmp(field_str, "descending"))
+			sort_key->descending = true;
+		else
+			return -EINVAL;
+
+		for (i = 0; i < hist_data->n_fields; i++) {
+			if (!strcmp(field_name,
+				    hist_field_name(hist_data->fields[i])))
+				break;
+		}
+		if (i == hist_data->n_fields)
+			return -EINVAL;
+		sort_key->field_idx = i;
+	}
+
+	if (!hist_data->n_sort_keys)
+		hist_data->n_sort_keys = 1;
+
+	return 0;
+}
+
+static struct hist_trigger_data *
+create_hist_data(struct hist_trigger_attrs *attrs,
+		 struct ftrace_event_file *file)
+{
+	struct hist_trigger_data *hist_data;
+	bool save_comm = false;
+	unsigned int i;
+	int ret;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	hist_data->attrs = attrs;
+
+	ret = create_val_fields(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = create_key_fields(hist_data, file);
+	if (ret)
+		goto free;
+
+	ret = create_sort_keys(hist_data);
+	if (ret)
+		goto free;
+
+	for_each_hist_key_field(i, hist_data) {
+		if (hist_data->fields[i]->flags & HIST_FIELD_EXECNAME)
+			save_comm = true;
+	}
+
+	ret = -ENOMEM;
+	hist_data->map = hist_map_create(attrs->map_bits, hist_data->key_size,
+					 hist_data->n_vals, save_comm);
+	if (!hist_data->map)
+		goto free;
+	hist_data->map->hist_data = hist_data;
+	hist_data->paused = attrs->pause;
+
+	return hist_data;
+ free:
+	/* the caller still owns attrs on failure */
+	hist_data->attrs = NULL;
+	destroy_hist_data(hist_data);
+	return ERR_PTR(ret);
+}
+
+static int event_hist_trigger_print(struct seq_file *m,
+				    struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	struct hist_field *hist_field;
+	struct hist_sort_key *sort_key;
+	unsigned int i;
+
+	seq_puts(m, "hist:keys=");
+	for_each_hist_key_field(i, hist_data) {
+		hist_field = hist_data->fields[i];
+		if (i > hist_data->n_vals)
+			seq_putc(m, ',');
+		seq_printf(m, "%s%s", hist_field_name(hist_field),
+			   hist_field_modifier(hist_field));
+	}
+
+	seq_puts(m, ":vals=");
+	for_each_hist_val_field(i, hist_data) {
+		if (i)
+			seq_putc(m, ',');
+		seq_puts(m, hist_field_name(hist_data->fields[i]));
+	}
+
+	seq_puts(m, ":sort=");
+	for (i = 0; i < hist_data->n_sort_keys; i++) {
+		sort_key = &hist_data->sort_keys[i];
+		hist_field = hist_data->fields[sort_key->field_idx];
+		if (i)
+			seq_putc(m, ',');
+		seq_printf(m, "%s%s", hist_field_name(hist_field),
+			   sort_key->descending ? ".descending" : "");
+	}
+
+	seq_printf(m, ":size=%u", hist_data->map->max_elts);
+
+	if (data->filter_str)
+		seq_printf(m, " if %s", data->filter_str);
+
+	if (ACCESS_ONCE(hist_data->paused))
+		seq_puts(m, " [paused]\n");
+	else
+		seq_puts(m, " [active]\n");
+
+	return 0;
+}
+
+static void event_hist_trigger_free(struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		trigger_data_free(data);
+		destroy_hist_data(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *event_hist_get_trigger_ops(char *cmd,
+							     char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static struct event_trigger_data *
+find_hist_trigger(struct ftrace_event_file *file)
+{
+	struct event_trigger_data *data;
+
+	list_for_each_entry_rcu(data, &file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			return data;
+	}
+
+	return NULL;
+}
+
+/* Must be called with event_mutex held */
+static void hist_clear(struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	bool paused = hist_data->paused;
+
+	ACCESS_ONCE(hist_data->paused) = true;
+	synchronize_sched(); /* make sure current triggers exit */
+	hist_map_clear(hist_data->map);
+	ACCESS_ONCE(hist_data->paused) = paused;
+}
+
+static int hist_register_trigger(char *glob, struct event_trigger_ops *ops,
+				 struct event_trigger_data *data,
+				 struct ftrace_event_file *file)
+{
+	int ret = 0;
+
+	if (find_hist_trigger(file)) {
+		ret = -EEXIST;
+		goto out;
+	}
+
+	if (data->ops->init) {
+		ret = data->ops->init(data->ops, data);
+		if (ret < 0)
+			goto out;
+	}
+
+	list_add_rcu(&data->list, &file->triggers);
+	ret++;
+
+	/*
+	 * Set TRIGGER_COND before enabling the event so the trigger is
+	 * never called without a record.
+	 */
+	update_cond_flag(file);
+	if (trace_event_trigger_enable_disable(file, 1) < 0) {
+		list_del_rcu(&data->list);
+		update_cond_flag(file);
+		ret--;
+	}
+ out:
+	return ret;
+}
+
+static int event_hist_trigger_func(struct event_command *cmd_ops,
+				   struct ftrace_event_file *file,
+				   char *glob, char *cmd, char *param)
+{
+	struct event_trigger_data *trigger_data, *test;
+	struct hist_trigger_data *hist_data;
+	struct event_trigger_ops *trigger_ops;
+	struct hist_trigger_attrs *attrs;
+	char *trigger;
+	int ret = 0;
+
+	if (!param)
+		return -EINVAL;
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+	if (!trigger)
+		return -EINVAL;
+
+	attrs = parse_hist_trigger_attrs(trigger);
+	if (IS_ERR(attrs))
+		return PTR_ERR(attrs);
+
+	test = find_hist_trigger(file);
+	if (glob[0] == '!') {
+		if (test)
+			cmd_ops->unreg(glob + 1, test->ops, test, file);
+		goto out_free_attrs;
+	}
+
+	/* pause, cont and clear apply to the existing trigger */
+	if (test && (attrs->pause || attrs->cont || attrs->clear)) {
+		hist_data = test->private_data;
+		if (attrs->clear)
+			hist_clear(test);
+		if (attrs->pause)
+			ACCESS_ONCE(hist_data->paused) = true;
+		else if (attrs->cont)
+			ACCESS_ONCE(hist_data->paused) = false;
+		goto out_free_attrs;
+	}
+
+	hist_data = create_hist_data(attrs, file);
+	if (IS_ERR(hist_data)) {
+		ret = PTR_ERR(hist_data);
+		goto out_free_attrs;
+	}
+
+	trigger_ops = cmd_ops->get_trigger_ops(cmd, NULL);
+
+	ret = -ENOMEM;
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		goto out_free_hist;
+
+	trigger_data->count = -1;
+	trigger_data->ops = trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	INIT_LIST_HEAD(&trigger_data->list);
+	RCU_INIT_POINTER(trigger_data->filter, NULL);
+	trigger_data->private_data = hist_data;
+
+	if (param) { /* if param is non-empty, it's supposed to be a filter */
+		ret = cmd_ops->set_filter(param, trigger_data, file);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = cmd_ops->reg(glob, trigger_ops, trigger_data, file);
+	/*
+	 * The above returns on success the # of triggers registered,
+	 * but if it didn't register any it returns zero.  Consider no
+	 * triggers registered a failure too.
+	 */
+	if (!ret) {
+		ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+
+	return 0;
+
+ out_free:
+	cmd_ops->set_filter(NULL, trigger_data, NULL);
+	kfree(trigger_data);
+ out_free_hist:
+	destroy_hist_data(hist_data);
+	return ret;
+
+ out_free_attrs:
+	destroy_hist_trigger_attrs(attrs);
+	return ret;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= hist_register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
@@ -92,6 +92,12 @@ static int _qmi_kernel_decode(struct elem_info *ei_array,
 static struct elem_info *skip_to_next_elem(struct elem_info *ei_array,
 					   int level);
 
+static int qmi_plan_encode(struct qmi_msg_plan *plan, uint8_t *out_buf,
+			   uint8_t *in_c_struct, uint32_t out_buf_len);
+
+static int qmi_plan_decode(struct qmi_msg_plan *plan, uint8_t *out_c_struct,
+			   uint8_t *in_buf, uint32_t in_buf_len);
+
 /**
  * qmi_calc_max_msg_len() - Calculate the maximum length of a QMI message
  * @ei_array: Struct info array describing the structure.
@@ -257,8 +263,12 @@ int qmi_kernel_encode(struct msg_desc *desc,
 	if (desc->max_msg_len < out_buf_len)
 		return -ETOOSMALL;
 
-	ret = _qmi_kernel_encode(desc->ei_array, out_buf,
-				 in_c_struct, out_buf_len, enc_level);
+	if (desc->plan)
+		ret = qmi_plan_encode(desc->plan, out_buf,
+				      in_c_struct, out_buf_len);
+	else
+		ret = _qmi_kernel_encode(desc->ei_array, out_buf,
+					 in_c_struct, out_buf_len, enc_level);
 	if (ret == -ETOOSMALL) {
 		calc_max_msg_len = qmi_calc_max_msg_len(desc->ei_array, 1);
 		pr_err("%s: Calc. len %d != Out buf len %d\n",
@@ -381,7 +391,12 @@ static int qmi_encode_string_elem(struct elem_info *ei_array,
 			return -ETOOSMALL;
 		}
 	} else {
-		if (string_len + string_len_sz > out_buf_len) {
+		/*
+		 * As for the other nested elements, the space passed down
+		 * still includes the Type & Length info. of the outer TLV.
+		 */
+		if (string_len + string_len_sz + TLV_LEN_SIZE +
+		    TLV_TYPE_SIZE > out_buf_len) {
 			pr_err("%s: Output len %d > Out Buf len %d\n",
 				__func__, string_len, out_buf_len);
 			return -ETOOSMALL;
@@ -486,6 +501,7 @@ static int _qmi_kernel_encode(struct elem_info *ei_array,
 			break;
 
 		case QMI_DATA_LEN:
+			data_len_value = 0;
 			memcpy(&data_len_value, buf_src, temp_ei->elem_size);
 			data_len_sz = temp_ei->elem_size == sizeof(uint8_t) ?
 					sizeof(uint8_t) : sizeof(uint16_t);
@@ -590,8 +606,12 @@ int qmi_kernel_decode(struct msg_desc *desc, void *out_c_struct,
 	if (desc->max_msg_len < in_buf_len)
 		return -EINVAL;
 
-	rc = _qmi_kernel_decode(desc->ei_array, out_c_struct,
-				in_buf, in_buf_len, dec_level);
+	if (desc->plan)
+		rc = qmi_plan_decode(desc->plan, out_c_struct,
+				     in_buf, in_buf_len);
+	else
+		rc = _qmi_kernel_decode(desc->ei_array, out_c_struct,
+					in_buf, in_buf_len, dec_level);
 	if (rc < 0)
 		return rc;
 	else
@@ -819,6 +839,7 @@ static int _qmi_kernel_decode(struct elem_info *ei_array,
 		if (temp_ei->data_type == QMI_DATA_LEN) {
 			data_len_sz = temp_ei->elem_size == sizeof(uint8_t) ?
 					sizeof(uint8_t) : sizeof(uint16_t);
+			data_len_value = 0;
 			rc = qmi_decode_basic_elem(&data_len_value, buf_src,
 						   1, data_len_sz);
 			memcpy(buf_dst, &data_len_value, sizeof(uint32_t));
@@ -876,5 +897,498 @@ static int _qmi_kernel_decode(struct elem_info *ei_array,
 	}
 	return decoded_bytes;
 }
+/**
+ * qmi_plan_add_run() - Add a block to the copy runs of a flat structure
+ * @tlv: Compiled TLV the runs belong to.
+ * @offset: Offset of the block in the C structure.
+ * @len: Length of the block.
+ *
+ * @return: 0 on success, -EOPNOTSUPP if the structure needs too many runs.
+ */
+static int qmi_plan_add_run(struct qmi_plan_tlv *tlv, uint32_t offset,
+			    uint32_t len)
+{
+	struct qmi_plan_run *run;
+
+	if (tlv->nr_runs) {
+		run = &tlv->runs[tlv->nr_runs - 1];
+		if (run->offset + run->len == offset) {
+			run->len += len;
+			return 0;
+		}
+	}
+	if (tlv->nr_runs == QMI_PLAN_MAX_RUNS)
+		return -EOPNOTSUPP;
+
+	run = &tlv->runs[tlv->nr_runs++];
+	run->offset = offset;
+	run->len = len;
+	return 0;
+}
+
+/**
+ * qmi_plan_flatten() - Compile a nested structure into copy runs
+ * @tlv: Compiled TLV to store the runs in.
+ * @ei_array: Struct info array describing the nested structure.
+ * @base: Offset of the nested structure in the outer C structure.
+ * @level: Depth of the nested structure from the main structure.
+ *
+ * @return: Encoded size of the structure on success, -EOPNOTSUPP if the
+ *          structure contains elements whose encoded size is not fixed.
+ *
+ * A structure made of basic elements and static arrays only is encoded
+ * as the concatenation of its elements, so it can be copied as a list of
+ * blocks computed once instead of being walked element by element.
+ */
+static int qmi_plan_flatten(struct qmi_plan_tlv *tlv,
+			    struct elem_info *ei_array, uint32_t base,
+			    int level)
+{
+	struct elem_info *temp_ei;
+	uint32_t i, data_len_value;
+	int rc, wire_size = 0;
+
+	if (!ei_array || level > QMI_PLAN_MAX_DEPTH)
+		return -EOPNOTSUPP;
+
+	for (temp_ei = ei_array; temp_ei->data_type != QMI_EOTI; temp_ei++) {
+		if (temp_ei->is_array == NO_ARRAY)
+			data_len_value = 1;
+		else if (temp_ei->is_array == STATIC_ARRAY)
+			data_len_value = temp_ei->elem_len;
+		else
+			return -EOPNOTSUPP;
+
+		switch (temp_ei->data_type) {
+		case QMI_UNSIGNED_1_BYTE:
+		case QMI_UNSIGNED_2_BYTE:
+		case QMI_UNSIGNED_4_BYTE:
+		case QMI_UNSIGNED_8_BYTE:
+		case QMI_SIGNED_2_BYTE_ENUM:
+		case QMI_SIGNED_4_BYTE_ENUM:
+			rc = data_len_value * temp_ei->elem_size;
+			if (rc && qmi_plan_add_run(tlv, base + temp_ei->offset,
+						   rc))
+				return -EOPNOTSUPP;
+			break;
+
+		case QMI_STRUCT:
+			for (i = 0; i < data_len_value; i++) {
+				rc = qmi_plan_flatten(tlv, temp_ei->ei_array,
+					base + temp_ei->offset +
+					i * temp_ei->elem_size, level + 1);
+				if (rc < 0)
+					return rc;
+				wire_size += rc;
+			}
+			continue;
+
+		default:
+			return -EOPNOTSUPP;
+		}
+		wire_size += rc;
+	}
+	return wire_size;
+}
+
+/**
+ * qmi_plan_compile_tlv() - Compile the elements of a top level TLV
+ * @tlv: Compiled TLV to be filled.
+ * @ei_array: First element of the TLV in the struct info array.
+ *
+ * @return: Struct info of the element following the TLV on success,
+ *          NULL if the TLV has no plan form.
+ *
+ * A TLV is an optional element flag, if the element is optional, the
+ * array length, if the element is a variable length array, and the data
+ * element itself, all sharing the same TLV type.
+ */
+static struct elem_info *qmi_plan_compile_tlv(struct qmi_plan_tlv *tlv,
+					      struct elem_info *ei_array)
+{
+	struct elem_info *temp_ei = ei_array;
+	int rc;
+
+	tlv->tlv_type = temp_ei->tlv_type;
+	tlv->opt_offset = -1;
+	if (temp_ei->data_type == QMI_OPT_FLAG) {
+		tlv->opt_offset = temp_ei->offset;
+		temp_ei++;
+	}
+
+	if (temp_ei->tlv_type != tlv->tlv_type)
+		return NULL;
+	if (temp_ei->data_type == QMI_DATA_LEN) {
+		tlv->len_sz = temp_ei->elem_size == sizeof(uint8_t) ?
+				sizeof(uint8_t) : sizeof(uint16_t);
+		tlv->len_c_size = min_t(uint32_t, temp_ei->elem_size,
+					sizeof(uint32_t));
+		tlv->len_offset = temp_ei->offset;
+		temp_ei++;
+	}
+
+	if (temp_ei->tlv_type != tlv->tlv_type ||
+	    (temp_ei->is_array == VAR_LEN_ARRAY) != !!tlv->len_sz)
+		return NULL;
+
+	tlv->is_array = temp_ei->is_array;
+	tlv->offset = temp_ei->offset;
+	tlv->elem_len = temp_ei->elem_len;
+	tlv->elem_size = temp_ei->elem_size;
+	tlv->ei = temp_ei;
+
+	switch (temp_ei->data_type) {
+	case QMI_UNSIGNED_1_BYTE:
+	case QMI_UNSIGNED_2_BYTE:
+	case QMI_UNSIGNED_4_BYTE:
+	case QMI_UNSIGNED_8_BYTE:
+	case QMI_SIGNED_2_BYTE_ENUM:
+	case QMI_SIGNED_4_BYTE_ENUM:
+		tlv->op = QMI_PLAN_OP_BASIC;
+		tlv->wire_size = temp_ei->elem_size;
+		break;
+
+	case QMI_STRUCT:
+		rc = qmi_plan_flatten(tlv, temp_ei->ei_array, 0, 2);
+		if (rc > 0) {
+			tlv->op = QMI_PLAN_OP_FLAT_STRUCT;
+			tlv->wire_size = rc;
+		} else {
+			tlv->op = QMI_PLAN_OP_STRUCT;
+			tlv->nr_runs = 0;
+		}
+		break;
+
+	case QMI_STRING:
+		if (tlv->len_sz)
+			return NULL;
+		tlv->op = QMI_PLAN_OP_STRING;
+		break;
+
+	default:
+		return NULL;
+	}
+
+	temp_ei++;
+	if (temp_ei->data_type != QMI_EOTI &&
+	    temp_ei->tlv_type == tlv->tlv_type)
+		return NULL;
+	return temp_ei;
+}
+
+/**
+ * qmi_kernel_compile_desc() - Compile a structure descriptor into a plan
+ * @desc: Pointer to structure descriptor.
+ *
+ * @return: 0 on success, -EOPNOTSUPP if the descriptor layout has no plan
+ *          form and is left to the interpreter, < 0 on other errors.
+ */
+int qmi_kernel_compile_desc(struct msg_desc *desc)
+{
+	struct qmi_msg_plan *plan;
+	struct elem_info *temp_ei;
+	uint32_t nr_elems = 0;
+
+	if (!desc || !desc->ei_array)
+		return -EINVAL;
+	if (desc->plan)
+		return 0;
+
+	for (temp_ei = desc->ei_array; temp_ei->data_type != QMI_EOTI;
+	     temp_ei++)
+		nr_elems++;
+	nr_elems = min_t(uint32_t, nr_elems, U8_MAX);
+
+	plan = kzalloc(sizeof(*plan) + nr_elems * sizeof(plan->tlvs[0]),
+		       GFP_KERNEL);
+	if (!plan)
+		return -ENOMEM;
+
+	temp_ei = desc->ei_array;
+	while (temp_ei->data_type != QMI_EOTI) {
+		struct qmi_plan_tlv *tlv = &plan->tlvs[plan->nr_tlvs];
+
+		if (plan->nr_tlvs == nr_elems ||
+		    plan->tlv_index[temp_ei->tlv_type])
+			goto not_supported;
+		temp_ei = qmi_plan_compile_tlv(tlv, temp_ei);
+		if (!temp_ei)
+			goto not_supported;
+		plan->tlv_index[tlv->tlv_type] = ++plan->nr_tlvs;
+	}
+
+	desc->plan = plan;
+	return 0;
+
+not_supported:
+	pr_debug("%s: msg_id 0x%x left to the interpreter\n",
+		 __func__, desc->msg_id);
+	kfree(plan);
+	return -EOPNOTSUPP;
+}
+EXPORT_SYMBOL(qmi_kernel_compile_desc);
+
+/**
+ * qmi_kernel_free_desc_plan() - Free the plan compiled for a descriptor
+ * @desc: Pointer to structure descriptor.
+ */
+void qmi_kernel_free_desc_plan(struct msg_desc *desc)
+{
+	if (!desc)
+		return;
+
+	kfree(desc->plan);
+	desc->plan = NULL;
+}
+EXPORT_SYMBOL(qmi_kernel_free_desc_plan);
+
+/**
+ * qmi_plan_copy_runs() - Copy flat structures between C and wire format
+ * @tlv: Compiled TLV describing the flat structure.
+ * @wire: Buffer holding the structures in QMI wire format.
+ * @c_struct: Buffer holding the structures in C format.
+ * @elem_len: Number of structures to be copied.
+ * @encode: Copy from C to wire format if set, else from wire to C format.
+ */
+static void qmi_plan_copy_runs(struct qmi_plan_tlv *tlv, uint8_t *wire,
+			       uint8_t *c_struct, uint32_t elem_len,
+			       int encode)
+{
+	struct qmi_plan_run *run;
+	uint32_t i;
+
+	/* Structures without padding are encoded as they are laid out */
+	if (tlv->nr_runs == 1 && tlv->runs[0].offset == 0 &&
+	    tlv->wire_size == tlv->elem_size) {
+		if (encode)
+			memcpy(wire, c_struct, elem_len * tlv->elem_size);
+		else
+			memcpy(c_struct, wire, elem_len * tlv->elem_size);
+		return;
+	}
+
+	for (i = 0; i < elem_len; i++) {
+		for (run = tlv->runs; run < tlv->runs + tlv->nr_runs; run++) {
+			if (encode)
+				memcpy(wire, c_struct + run->offset, run->len);
+			else
+				memcpy(c_struct + run->offset, wire, run->len);
+			wire += run->len;
+		}
+		c_struct += tlv->elem_size;
+	}
+}
+
+/**
+ * qmi_plan_encode() - Encode a C structure using a compiled plan
+ * @plan: Compiled plan of the message.
+ * @out_buf: Buffer to hold the encoded QMI message.
+ * @in_c_struct: Pointer to the C structure to be encoded.
+ * @out_buf_len: Available space in the encode buffer.
+ *
+ * @return: Number of bytes of encoded information, on success.
+ *          < 0 on error.
+ */
+static int qmi_plan_encode(struct qmi_msg_plan *plan, uint8_t *out_buf,
+			   uint8_t *in_c_struct, uint32_t out_buf_len)
+{
+	struct qmi_plan_tlv *tlv;
+	uint32_t encoded_bytes = 0, tlv_len, data_len_value, size;
+	uint8_t *buf_dst, *tlv_pointer;
+	int rc;
+
+	for (tlv = plan->tlvs; tlv < plan->tlvs + plan->nr_tlvs; tlv++) {
+		if (tlv->opt_offset >= 0 && !in_c_struct[tlv->opt_offset])
+			continue;
+
+		tlv_pointer = out_buf + encoded_bytes;
+		buf_dst = tlv_pointer + TLV_TYPE_SIZE + TLV_LEN_SIZE;
+		tlv_len = 0;
+
+		if (tlv->len_sz) {
+			data_len_value = 0;
+			memcpy(&data_len_value, in_c_struct + tlv->len_offset,
+			       tlv->len_c_size);
+			if (data_len_value > tlv->elem_len) {
+				pr_err("%s: Invalid data length\n", __func__);
+				return -EINVAL;
+			}
+			if (encoded_bytes + TLV_TYPE_SIZE + TLV_LEN_SIZE +
+			    tlv->len_sz > out_buf_len) {
+				pr_err("%s: Too Small Buffer @DATA_LEN\n",
+					__func__);
+				return -ETOOSMALL;
+			}
+			memcpy(buf_dst, &data_len_value, tlv->len_sz);
+			buf_dst += tlv->len_sz;
+			tlv_len = tlv->len_sz;
+		} else if (tlv->is_array == STATIC_ARRAY) {
+			data_len_value = tlv->elem_len;
+		} else {
+			data_len_value = 1;
+		}
+
+		switch (tlv->op) {
+		case QMI_PLAN_OP_BASIC:
+		case QMI_PLAN_OP_FLAT_STRUCT:
+			size = data_len_value * tlv->wire_size;
+			if (encoded_bytes + TLV_TYPE_SIZE + TLV_LEN_SIZE +
+			    tlv_len + size > out_buf_len) {
+				pr_err("%s: Too Small Buffer @tlv_type:%d\n",
+					__func__, tlv->tlv_type);
+				return -ETOOSMALL;
+			}
+			if (tlv->op == QMI_PLAN_OP_BASIC)
+				memcpy(buf_dst, in_c_struct + tlv->offset,
+				       size);
+			else
+				qmi_plan_copy_runs(tlv, buf_dst,
+					in_c_struct + tlv->offset,
+					data_len_value, 1);
+			rc = size;
+			break;
+
+		case QMI_PLAN_OP_STRUCT:
+			rc = qmi_encode_struct_elem(tlv->ei, buf_dst,
+				in_c_struct + tlv->offset, data_len_value,
+				out_buf_len - encoded_bytes - tlv_len, 2);
+			break;
+
+		case QMI_PLAN_OP_STRING:
+			rc = qmi_encode_string_elem(tlv->ei, buf_dst,
+				in_c_struct + tlv->offset,
+				out_buf_len - encoded_bytes, 1);
+			break;
+
+		default:
+			return -EINVAL;
+		}
+		if (rc < 0)
+			return rc;
+
+		tlv_len += rc;
+		QMI_ENCDEC_ENCODE_TLV(tlv->tlv_type, tlv_len, tlv_pointer);
+		QMI_ENCODE_LOG_TLV(tlv->tlv_type, tlv_len);
+		encoded_bytes += TLV_TYPE_SIZE + TLV_LEN_SIZE + tlv_len;
+	}
+	QMI_ENCODE_LOG_MSG(out_buf, encoded_bytes);
+	return encoded_bytes;
+}
+
+/**
+ * qmi_plan_decode() - Decode a QMI message using a compiled plan
+ * @plan: Compiled plan of the message.
+ * @out_c_struct: Buffer to hold the decoded C struct.
+ * @in_buf: Buffer containing the QMI message to be decoded.
+ * @in_buf_len: Length of the QMI message to be decoded.
+ *
+ * @return: Number of bytes of decoded information, on success.
+ *          < 0 on error.
+ */
+static int qmi_plan_decode(struct qmi_msg_plan *plan, uint8_t *out_c_struct,
+			   uint8_t *in_buf, uint32_t in_buf_len)
+{
+	struct qmi_plan_tlv *tlv;
+	uint32_t decoded_bytes = 0, tlv_type, tlv_len, data_len_value, size;
+	uint8_t *buf_src, *tlv_pointer;
+	int rc;
+
+	QMI_DECODE_LOG_MSG(in_buf, in_buf_len);
+	while (decoded_bytes < in_buf_len) {
+		if (in_buf_len - decoded_bytes < TLV_TYPE_SIZE + TLV_LEN_SIZE) {
+			pr_err("%s: Truncated TLV header\n", __func__);
+			return -EFAULT;
+		}
+		tlv_pointer = in_buf + decoded_bytes;
+		QMI_ENCDEC_DECODE_TLV(&tlv_type, &tlv_len, tlv_pointer);
+		QMI_DECODE_LOG_TLV(tlv_type, tlv_len);
+		decoded_bytes += TLV_TYPE_SIZE + TLV_LEN_SIZE;
+		buf_src = in_buf + decoded_bytes;
+		if (tlv_len > in_buf_len - decoded_bytes) {
+			pr_err("%s: TLV len %d > Input Buffer Len %d\n",
+				__func__, tlv_len, in_buf_len - decoded_bytes);
+			return -EFAULT;
+		}
+
+		if (!plan->tlv_index[tlv_type]) {
+			if (tlv_type < OPTIONAL_TLV_TYPE_START) {
+				pr_err("%s: Inval element info\n", __func__);
+				return -EINVAL;
+			}
+			decoded_bytes += tlv_len;
+			continue;
+		}
+		tlv = &plan->tlvs[plan->tlv_index[tlv_type] - 1];
+
+		if (tlv->opt_offset >= 0)
+			out_c_struct[tlv->opt_offset] = 1;
+
+		if (tlv->len_sz) {
+			if (tlv_len < tlv->len_sz) {
+				pr_err("%s: Truncated data length\n",
+					__func__);
+				return -EFAULT;
+			}
+			data_len_value = 0;
+			memcpy(&data_len_value, buf_src, tlv->len_sz);
+			memcpy(out_c_struct + tlv->len_offset, &data_len_value,
+			       sizeof(uint32_t));
+			buf_src += tlv->len_sz;
+			decoded_bytes += tlv->len_sz;
+			tlv_len -= tlv->len_sz;
+			if (data_len_value > tlv->elem_len) {
+				pr_err("%s: Data len %d > max spec %d\n",
+					__func__, data_len_value,
+					tlv->elem_len);
+				return -ETOOSMALL;
+			}
+		} else if (tlv->is_array == STATIC_ARRAY) {
+			data_len_value = tlv->elem_len;
+		} else {
+			data_len_value = 1;
+		}
+
+		switch (tlv->op) {
+		case QMI_PLAN_OP_BASIC:
+		case QMI_PLAN_OP_FLAT_STRUCT:
+			size = data_len_value * tlv->wire_size;
+			if ((tlv->op == QMI_PLAN_OP_BASIC && size > tlv_len) ||
+			    (tlv->op == QMI_PLAN_OP_FLAT_STRUCT &&
+			     size != tlv_len)) {
+				pr_err("%s: Fault in decoding: size(%d), tl(%d)\n",
+					__func__, size, tlv_len);
+				return -EFAULT;
+			}
+			if (tlv->op == QMI_PLAN_OP_BASIC)
+				memcpy(out_c_struct + tlv->offset, buf_src,
+				       size);
+			else
+				qmi_plan_copy_runs(tlv, buf_src,
+					out_c_struct + tlv->offset,
+					data_len_value, 0);
+			rc = size;
+			break;
+
+		case QMI_PLAN_OP_STRUCT:
+			rc = qmi_decode_struct_elem(tlv->ei,
+				out_c_struct + tlv->offset, buf_src,
+				data_len_value, tlv_len, 2);
+			break;
+
+		case QMI_PLAN_OP_STRING:
+			rc = qmi_decode_string_elem(tlv->ei,
+				out_c_struct + tlv->offset, buf_src,
+				tlv_len, 1);
+			break;
+
+		default:
+			return -EINVAL;
+		}
+		if (rc < 0)
+			return rc;
+		decoded_bytes += rc;
+	}
+	return decoded_bytes;
+}
 MODULE_DESCRIPTION("QMI kernel enc/dec");
 MODULE_LICENSE("GPL v2");
@@ -63,4 +63,79 @@ do { \
 	decoded_bytes += rc; \
 } while (0)
 
+#define QMI_PLAN_MAX_RUNS 8
+#define QMI_PLAN_MAX_DEPTH 8
+
+/**
+ * qmi_plan_op - Enum to identify how the data element of a TLV is
+ *               encoded/decoded by a compiled plan.
+ */
+enum qmi_plan_op {
+	QMI_PLAN_OP_BASIC,
+	QMI_PLAN_OP_FLAT_STRUCT,
+	QMI_PLAN_OP_STRUCT,
+	QMI_PLAN_OP_STRING,
+};
+
+/**
+ * qmi_plan_run - Contiguous bytes copied as one block
+ *
+ * @offset: Offset of the block in the C structure.
+ * @len: Length of the block.
+ */
+struct qmi_plan_run {
+	uint32_t offset;
+	uint32_t len;
+};
+
+/**
+ * qmi_plan_tlv - Compiled information about a top level TLV
+ *
+ * @tlv_type: Type of the TLV in the QMI message.
+ * @op: How the data element is encoded/decoded.
+ * @is_array: Array type of the data element.
+ * @len_sz: Size of the array length in the TLV, 0 if not an array.
+ * @len_c_size: Size of the array length read from the C structure.
+ * @opt_offset: Offset of the optional element flag, < 0 if mandatory.
+ * @len_offset: Offset of the array length in the C structure.
+ * @offset: Offset of the data element in the C structure.
+ * @elem_len: Maximum number of data elements.
+ * @elem_size: Size of a single data element in the C structure.
+ * @wire_size: Encoded size of a single data element, for basic types and
+ *             flat structures.
+ * @nr_runs: Number of blocks a flat structure is copied in.
+ * @runs: Blocks a flat structure is copied in, in encoding order.
+ * @ei: Struct info of the data element, used for nested structures and
+ *      strings that are handed to the interpreter.
+ */
+struct qmi_plan_tlv {
+	uint8_t tlv_type;
+	uint8_t op;
+	uint8_t is_array;
+	uint8_t len_sz;
+	uint32_t len_c_size;
+	int32_t opt_offset;
+	uint32_t len_offset;
+	uint32_t offset;
+	uint32_t elem_len;
+	uint32_t elem_size;
+	uint32_t wire_size;
+	uint32_t nr_runs;
+	struct qmi_plan_run runs[QMI_PLAN_MAX_RUNS];
+	struct elem_info *ei;
+};
+
+/**
+ * qmi_msg_plan - Flat encode/decode plan of a QMI message
+ *
+ * @nr_tlvs: Number of TLVs in the message.
+ * @tlv_index: Index + 1 into @tlvs for every TLV type, 0 if not present.
+ * @tlvs: Compiled TLVs in encoding order.
+ */
+struct qmi_msg_plan {
+	uint32_t nr_tlvs;
+	uint8_t tlv_index[U8_MAX + 1];
+	struct qmi_plan_tlv tlvs[0];
+};
+
 #endif
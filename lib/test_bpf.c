@@ -1756,6 +1756,71 @@ static struct bpf_test tests[] = {
 		{ },
 		{ { 0, 1 } }
 	},
+	{
+		"ST_MEM: store immediates to stack",
+		.u.insns_int = {
+			BPF_ST_MEM(BPF_DW, R10, -8, 0x7ff0),
+			BPF_ST_MEM(BPF_W, R10, -12, 0x10),
+			BPF_ST_MEM(BPF_H, R10, -14, 0x4),
+			BPF_ST_MEM(BPF_B, R10, -15, 0x1),
+			BPF_LDX_MEM(BPF_DW, R0, R10, -8),
+			BPF_LDX_MEM(BPF_W, R1, R10, -12),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_LDX_MEM(BPF_H, R1, R10, -14),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_LDX_MEM(BPF_B, R1, R10, -15),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x8005 } }
+	},
+	{
+		"STX_XADD: atomic add to word and double word",
+		.u.insns_int = {
+			BPF_ST_MEM(BPF_W, R10, -4, 0x100),
+			BPF_ST_MEM(BPF_DW, R10, -16, 0x1000),
+			BPF_MOV64_IMM(R1, 0x234),
+			BPF_RAW_INSN(BPF_STX | BPF_XADD | BPF_W, R10, R1, -4, 0),
+			BPF_RAW_INSN(BPF_STX | BPF_XADD | BPF_DW, R10, R1, -16, 0),
+			BPF_LDX_MEM(BPF_W, R0, R10, -4),
+			BPF_LDX_MEM(BPF_DW, R2, R10, -16),
+			BPF_ALU64_REG(BPF_ADD, R0, R2),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0x1568 } }
+	},
+	{
+		"ALU64_DIV_X: division by zero returns 0",
+		.u.insns_int = {
+			BPF_MOV64_IMM(R0, 1),
+			BPF_MOV64_IMM(R1, 0),
+			BPF_MOV64_IMM(R2, 10),
+			BPF_ALU64_REG(BPF_DIV, R2, R1),
+			BPF_MOV64_REG(R0, R2),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0 } }
+	},
+	{
+		"ALU_MOD_X: modulo by zero returns 0",
+		.u.insns_int = {
+			BPF_MOV64_IMM(R0, 1),
+			BPF_MOV32_IMM(R1, 0),
+			BPF_MOV32_IMM(R2, 10),
+			BPF_ALU32_REG(BPF_MOD, R2, R1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		INTERNAL,
+		{ },
+		{ { 0, 0 } }
+	},
 };
 
 static struct net_device dev;
@@ -1940,7 +2005,7 @@ static int run_one(const struct bpf_prog *fp, struct bpf_test *test)
 
 static __init int test_bpf(void)
 {
-	int i, err_cnt = 0, pass_cnt = 0;
+	int i, err_cnt = 0, pass_cnt = 0, jit_cnt = 0;
 
 	for (i = 0; i < ARRAY_SIZE(tests); i++) {
 		struct bpf_prog *fp;
@@ -1957,6 +2022,11 @@ static __init int test_bpf(void)
 
 			return err;
 		}
+
+		pr_cont("jited:%u ", fp->jited);
+		if (fp->jited)
+			jit_cnt++;
+
 		err = run_one(fp, &tests[i]);
 		release_filter(fp, i);
 
@@ -1969,7 +2039,8 @@ static __init int test_bpf(void)
 		}
 	}
 
-	pr_info("Summary: %d PASSED, %d FAILED\n", pass_cnt, err_cnt);
+	pr_info("Summary: %d PASSED, %d FAILED, [%d JIT'ed]\n",
+		pass_cnt, err_cnt, jit_cnt);
 	return err_cnt ? -EINVAL : 0;
 }
 
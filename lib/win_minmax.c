@@ -0,0 +1,91 @@
+/*
+ * lib/win_minmax.c: windowed min/max tracker
+ *
+ * Kathleen Nichols' algorithm for tracking the minimum (or maximum) of a
+ * data stream over a fixed time window, e.g. the minimum RTT over the past
+ * five minutes. It uses constant space and constant time per update, yet
+ * almost always returns the same value as an implementation that keeps
+ * every sample of the window.
+ *
+ * The tracker keeps the best, 2nd best and 3rd best samples, with the
+ * invariant that the n'th best was measured no earlier than the (n-1)'th
+ * best. The three samples are also kept spread out over the window, which
+ * bounds the error when the data is monotonically worsening.
+ *
+ * A new best sample makes all earlier ones worthless: it is at least as
+ * good as everything else in the window and it is the most recent. So the
+ * tracker restarts from scratch on every new best and overwrites the 2nd
+ * and 3rd choices. The same holds for the 2nd and 3rd best.
+ */
+#include <linux/module.h>
+#include <linux/win_minmax.h>
+
+/* As time advances, update the 1st, 2nd and 3rd choices. */
+static u32 minmax_subwin_update(struct minmax *m, u32 win,
+				const struct minmax_sample *val)
+{
+	u32 dt = val->t - m->s[0].t;
+
+	if (unlikely(dt > win)) {
+		/* The whole window passed without a new best: promote the
+		 * 2nd and 3rd choices. The 2nd choice may be out of the
+		 * window as well (the caller checked the 3rd one is not),
+		 * so this may have to be done twice.
+		 */
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (unlikely(val->t - m->s[0].t > win)) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if (unlikely(m->s[1].t == m->s[0].t) && dt > win / 4) {
+		/* A quarter of the window passed without a new best: take
+		 * the 2nd choice from the 2nd quarter of the window.
+		 */
+		m->s[2] = m->s[1] = *val;
+	} else if (unlikely(m->s[2].t == m->s[1].t) && dt > win / 2) {
+		/* Half of the window passed without a new best: take the
+		 * 3rd choice from the last half of the window.
+		 */
+		m->s[2] = *val;
+	}
+	return m->s[0].v;
+}
+
+/* Check if a new measurement updates the 1st, 2nd or 3rd choice max. */
+u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v >= m->s[0].v) ||	/* found new max? */
+	    unlikely(val.t - m->s[2].t > win))	/* nothing left in window? */
+		return minmax_reset(m, t, meas);	/* forget older samples */
+
+	if (unlikely(val.v >= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v >= m->s[2].v))
+		m->s[2] = val;
+
+	return minmax_subwin_update(m, win, &val);
+}
+EXPORT_SYMBOL(minmax_running_max);
+
+/* Check if a new measurement updates the 1st, 2nd or 3rd choice min. */
+u32 minmax_running_min(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v <= m->s[0].v) ||	/* found new min? */
+	    unlikely(val.t - m->s[2].t > win))	/* nothing left in window? */
+		return minmax_reset(m, t, meas);	/* forget older samples */
+
+	if (unlikely(val.v <= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v <= m->s[2].v))
+		m->s[2] = val;
+
+	return minmax_subwin_update(m, win, &val);
+}
+EXPORT_SYMBOL(minmax_running_min);
@@ -1683,12 +1683,10 @@ EXPORT_SYMBOL_GPL(is_skb_forwardable);
 
 int __dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 {
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, GFP_ATOMIC)) {
-			atomic_long_inc(&dev->rx_dropped);
-			kfree_skb(skb);
-			return NET_RX_DROP;
-		}
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC)) {
+		atomic_long_inc(&dev->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
 	}
 
 	if (unlikely(!is_skb_forwardable(dev, skb))) {
@@ -1733,7 +1731,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -1801,8 +1799,12 @@ static void dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev)
 			pt_prev = ptype;
 		}
 	}
-	if (pt_prev)
-		pt_prev->func(skb2, skb->dev, pt_prev, skb->dev);
+	if (pt_prev) {
+		if (!skb_orphan_frags_rx(skb2, GFP_ATOMIC))
+			pt_prev->func(skb2, skb->dev, pt_prev, skb->dev);
+		else
+			kfree_skb(skb2);
+	}
 	rcu_read_unlock();
 }
 
@@ -3698,7 +3700,13 @@ EXPORT_SYMBOL(athrs_fast_nat_recv);
 int (*embms_tm_multicast_recv)(struct sk_buff *skb) __rcu __read_mostly;
 EXPORT_SYMBOL(embms_tm_multicast_recv);
 
-static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
+/* Runs taps, rx_handlers and protocol lookup for one packet. The last
+ * matching packet_type is not called but returned in @ppt_prev, so that
+ * list receive can hand packets with the same one over as a batch.
+ * @pskb is updated as the packet may be replaced on the way.
+ */
+static int __netif_receive_skb_core(struct sk_buff **pskb, bool pfmemalloc,
+				    struct packet_type **ppt_prev)
 {
 	struct packet_type *ptype, *pt_prev;
 	rx_handler_func_t *rx_handler;
@@ -3709,6 +3717,7 @@ static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
 	__be16 type;
 	int (*fast_recv)(struct sk_buff *skb);
 	int (*embms_recv)(struct sk_buff *skb);
+	struct sk_buff *skb = *pskb;
 
 	net_timestamp_check(!netdev_tstamp_prequeue, skb);
 
@@ -3834,10 +3843,9 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
-		else
-			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+		*ppt_prev = pt_prev;
 	} else {
 drop:
 		atomic_long_inc(&skb->dev->rx_dropped);
@@ -3849,6 +3857,19 @@ drop:
 	}
 
 out:
+	*pskb = skb;
+	return ret;
+}
+
+static int __netif_receive_skb_one_core(struct sk_buff *skb, bool pfmemalloc)
+{
+	struct net_device *orig_dev = skb->dev;
+	struct packet_type *pt_prev = NULL;
+	int ret;
+
+	ret = __netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+	if (pt_prev)
+		ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 	return ret;
 }
 
@@ -3869,14 +3890,101 @@ static int __netif_receive_skb(struct sk_buff *skb)
 		 * context down to all allocation sites.
 		 */
 		current->flags |= PF_MEMALLOC;
-		ret = __netif_receive_skb_core(skb, true);
+		ret = __netif_receive_skb_one_core(skb, true);
 		tsk_restore_flags(current, pflags, PF_MEMALLOC);
 	} else
-		ret = __netif_receive_skb_core(skb, false);
+		ret = __netif_receive_skb_one_core(skb, false);
 
 	return ret;
 }
 
+static void __netif_receive_skb_list_ptype(struct sk_buff_head *list,
+					   struct packet_type *pt_prev,
+					   struct net_device *orig_dev)
+{
+	struct sk_buff *skb;
+
+	if (!pt_prev)
+		return;
+	if (pt_prev->list_func) {
+		pt_prev->list_func(list, pt_prev, orig_dev);
+		return;
+	}
+	while ((skb = __skb_dequeue(list)) != NULL)
+		pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
+}
+
+/* Fast-path assumptions:
+ * - There is no rx_handler.
+ * - Only one packet_type matches.
+ * If either fails, the extra deliveries are done per packet in-line and
+ * only the last packet_type is handled for the whole sublist. This does
+ * not reorder packets for any single packet_type, because the last one
+ * is the same for the entire sublist and all others see packets in order.
+ */
+static void __netif_receive_skb_list_core(struct sk_buff_head *list,
+					  bool pfmemalloc)
+{
+	/* Current (common) ptype and orig_dev of sublist */
+	struct packet_type *pt_curr = NULL;
+	struct net_device *od_curr = NULL;
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct net_device *orig_dev = skb->dev;
+		struct packet_type *pt_prev = NULL;
+
+		__netif_receive_skb_core(&skb, pfmemalloc, &pt_prev);
+		if (!pt_prev)
+			continue;
+		if (pt_curr != pt_prev || od_curr != orig_dev) {
+			/* dispatch old sublist, start a new one */
+			__netif_receive_skb_list_ptype(&sublist, pt_curr,
+						       od_curr);
+			pt_curr = pt_prev;
+			od_curr = orig_dev;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+
+	/* dispatch final sublist */
+	__netif_receive_skb_list_ptype(&sublist, pt_curr, od_curr);
+}
+
+/* Caller holds rcu_read_lock(). @list is empty on return. */
+static void __netif_receive_skb_list(struct sk_buff_head *list)
+{
+	unsigned long pflags = current->flags;
+	bool pfmemalloc = false; /* Is current sublist PF_MEMALLOC? */
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	/* Runs of pfmemalloc and regular packets are processed separately,
+	 * see __netif_receive_skb() for why PF_MEMALLOC is set.
+	 */
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		if ((sk_memalloc_socks() && skb_pfmemalloc(skb)) != pfmemalloc) {
+			if (!skb_queue_empty(&sublist))
+				__netif_receive_skb_list_core(&sublist,
+							      pfmemalloc);
+			pfmemalloc = !pfmemalloc;
+			if (pfmemalloc)
+				current->flags |= PF_MEMALLOC;
+			else
+				tsk_restore_flags(current, pflags,
+						  PF_MEMALLOC);
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+	if (!skb_queue_empty(&sublist))
+		__netif_receive_skb_list_core(&sublist, pfmemalloc);
+	if (pfmemalloc)
+		tsk_restore_flags(current, pflags, PF_MEMALLOC);
+}
+
 static int netif_receive_skb_internal(struct sk_buff *skb)
 {
 	int ret;
@@ -3928,6 +4036,63 @@ int netif_receive_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(netif_receive_skb);
 
+static void netif_receive_skb_list_internal(struct sk_buff_head *list)
+{
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		net_timestamp_check(netdev_tstamp_prequeue, skb);
+		if (!skb_defer_rx_timestamp(skb))
+			__skb_queue_tail(&sublist, skb);
+	}
+
+	rcu_read_lock();
+#ifdef CONFIG_RPS
+	if (static_key_false(&rps_needed)) {
+		skb_queue_splice_init(&sublist, list);
+		while ((skb = __skb_dequeue(list)) != NULL) {
+			struct rps_dev_flow voidflow, *rflow = &voidflow;
+			int cpu = get_rps_cpu(skb->dev, skb, &rflow);
+
+			if (cpu >= 0)
+				enqueue_to_backlog(skb, cpu,
+						   &rflow->last_qtail);
+			else
+				__skb_queue_tail(&sublist, skb);
+		}
+	}
+#endif
+	__netif_receive_skb_list(&sublist);
+	rcu_read_unlock();
+}
+
+/**
+ *	netif_receive_skb_list - process many receive buffers from network
+ *	@list: list of skbs to process.
+ *
+ *	Since return value of netif_receive_skb() is normally ignored, and
+ *	wouldn't be meaningful for a list, this function returns void.
+ *	Packets are passed through the stack as a batch where possible:
+ *	consecutive packets going to the same packet_type are handed to its
+ *	list_func together, amortising the per-packet indirect calls.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled. @list is empty on return.
+ */
+void netif_receive_skb_list(struct sk_buff_head *list)
+{
+	struct sk_buff *skb;
+
+	if (skb_queue_empty(list))
+		return;
+	skb_queue_walk(list, skb)
+		trace_netif_receive_skb_entry(skb);
+	netif_receive_skb_list_internal(list);
+}
+EXPORT_SYMBOL(netif_receive_skb_list);
+
 /* Network device is going away, flush any packets still pending
  * Called with irqs disabled.
  */
@@ -4117,6 +4282,7 @@ static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
 		NAPI_GRO_CB(skb)->udp_mark = 0;
+		NAPI_GRO_CB(skb)->udp_gro_seg = 0;
 
 		/* Setup for GRO checksum validation */
 		switch (skb->ip_summed) {
@@ -4443,18 +4609,31 @@ static int process_backlog(struct napi_struct *napi, int quota)
 	napi->weight = weight_p;
 	local_irq_disable();
 	while (1) {
+		struct sk_buff_head batch;
 		struct sk_buff *skb;
+		int n = 0;
 
-		while ((skb = __skb_dequeue(&sd->process_queue))) {
+		/* Take up to the remaining quota off the process queue and
+		 * run it through the stack as one list.
+		 */
+		__skb_queue_head_init(&batch);
+		while (work + n < quota &&
+		       (skb = __skb_dequeue(&sd->process_queue))) {
+			__skb_queue_tail(&batch, skb);
+			n++;
+		}
+		if (n) {
 			rcu_read_lock();
 			local_irq_enable();
-			__netif_receive_skb(skb);
+			__netif_receive_skb_list(&batch);
 			rcu_read_unlock();
 			local_irq_disable();
-			input_queue_head_incr(sd);
-			if (++work >= quota) {
-				goto state_changed;
+			while (n--) {
+				input_queue_head_incr(sd);
+				work++;
 			}
+			if (work >= quota)
+				goto state_changed;
 		}
 
 		rps_lock(sd);
@@ -0,0 +1,207 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * IPC Router loopback message rate benchmark.
+ *
+ * Each benchmark thread registers a server on a kernel port and sends
+ * messages to it by name from a second kernel port, reading every message
+ * back before sending the next one. Every message therefore goes through
+ * the server, remote port and local port lookups of the router plus the
+ * local loopback delivery, which is the per-message path that all QMI
+ * clients share. Running several threads at once shows how the lookups
+ * scale when many clients are active.
+ *
+ * Usage (debugfs):
+ *   echo 4 > /sys/kernel/debug/ipc_router_bench/threads
+ *   echo 2000 > /sys/kernel/debug/ipc_router_bench/duration_ms
+ *   cat /sys/kernel/debug/ipc_router_bench/run
+ */
+
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/ipc_router.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+
+#define IPC_RTR_BENCH_SVC	0x4254
+#define IPC_RTR_BENCH_MAX_THREADS	32
+#define IPC_RTR_BENCH_MAX_MSG_SIZE	(64 * 1024)
+
+static u32 bench_threads = 1;
+static u32 bench_duration_ms = 1000;
+static u32 bench_msg_size = 64;
+
+static DEFINE_MUTEX(bench_lock);
+
+struct ipc_rtr_bench_thread {
+	int id;
+	u32 msg_size;
+	unsigned long deadline;
+	u64 msgs;
+	u64 errors;
+	struct completion done;
+};
+
+static int ipc_rtr_bench_thread_fn(void *arg)
+{
+	struct ipc_rtr_bench_thread *bt = arg;
+	struct msm_ipc_port *srv_port = NULL, *cli_port = NULL;
+	struct msm_ipc_addr name, src;
+	unsigned char *rx_data;
+	unsigned int rx_len;
+	void *buf;
+	int ret;
+
+	buf = kzalloc(bt->msg_size, GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	srv_port = msm_ipc_router_create_port(NULL, NULL);
+	cli_port = msm_ipc_router_create_port(NULL, NULL);
+	if (!srv_port || !cli_port)
+		goto out;
+
+	name.addrtype = MSM_IPC_ADDR_NAME;
+	name.addr.port_name.service = IPC_RTR_BENCH_SVC;
+	name.addr.port_name.instance = bt->id;
+	ret = msm_ipc_router_register_server(srv_port, &name);
+	if (ret < 0) {
+		pr_err("%s: thread %d server registration failed %d\n",
+		       __func__, bt->id, ret);
+		goto out;
+	}
+
+	while (time_before(jiffies, bt->deadline)) {
+		ret = msm_ipc_router_send_msg(cli_port, &name, buf,
+					      bt->msg_size);
+		if (ret < 0) {
+			bt->errors++;
+			cond_resched();
+			continue;
+		}
+		ret = msm_ipc_router_read_msg(srv_port, &src, &rx_data,
+					      &rx_len);
+		if (ret < 0) {
+			bt->errors++;
+			continue;
+		}
+		kfree(rx_data);
+		bt->msgs++;
+		cond_resched();
+	}
+
+out:
+	if (cli_port)
+		msm_ipc_router_close_port(cli_port);
+	if (srv_port)
+		msm_ipc_router_close_port(srv_port);
+	kfree(buf);
+	complete(&bt->done);
+	return 0;
+}
+
+static int ipc_rtr_bench_run(struct seq_file *s, void *unused)
+{
+	struct ipc_rtr_bench_thread *bt;
+	struct task_struct *task;
+	u32 nr_threads, duration_ms, msg_size;
+	u64 msgs = 0, errors = 0;
+	struct timespec start, end;
+	u64 elapsed_us;
+	int i;
+
+	mutex_lock(&bench_lock);
+	nr_threads = clamp_t(u32, bench_threads, 1,
+			     IPC_RTR_BENCH_MAX_THREADS);
+	duration_ms = max_t(u32, bench_duration_ms, 1);
+	msg_size = clamp_t(u32, bench_msg_size, 1,
+			   IPC_RTR_BENCH_MAX_MSG_SIZE);
+
+	bt = kcalloc(nr_threads, sizeof(*bt), GFP_KERNEL);
+	if (!bt) {
+		mutex_unlock(&bench_lock);
+		return -ENOMEM;
+	}
+
+	getnstimeofday(&start);
+	for (i = 0; i < nr_threads; i++) {
+		bt[i].id = i;
+		bt[i].msg_size = msg_size;
+		bt[i].deadline = jiffies + msecs_to_jiffies(duration_ms);
+		init_completion(&bt[i].done);
+		task = kthread_run(ipc_rtr_bench_thread_fn, &bt[i],
+				   "ipc_rtr_bench/%d", i);
+		if (IS_ERR(task))
+			complete(&bt[i].done);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		wait_for_completion(&bt[i].done);
+		msgs += bt[i].msgs;
+		errors += bt[i].errors;
+	}
+	getnstimeofday(&end);
+
+	elapsed_us = div_u64(timespec_to_ns(&end) - timespec_to_ns(&start),
+			     NSEC_PER_USEC);
+	if (!elapsed_us)
+		elapsed_us = 1;
+
+	seq_printf(s, "threads:      %u\n", nr_threads);
+	seq_printf(s, "msg_size:     %u\n", msg_size);
+	seq_printf(s, "elapsed_us:   %llu\n", elapsed_us);
+	seq_printf(s, "messages:     %llu\n", msgs);
+	seq_printf(s, "errors:       %llu\n", errors);
+	seq_printf(s, "msgs_per_sec: %llu\n",
+		   div64_u64(msgs * USEC_PER_SEC, elapsed_us));
+	for (i = 0; i < nr_threads; i++)
+		seq_printf(s, "  thread %d: %llu msgs\n", i, bt[i].msgs);
+
+	kfree(bt);
+	mutex_unlock(&bench_lock);
+	return 0;
+}
+
+static int ipc_rtr_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ipc_rtr_bench_run, inode->i_private);
+}
+
+static const struct file_operations ipc_rtr_bench_fops = {
+	.open = ipc_rtr_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init ipc_rtr_bench_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("ipc_router_bench", NULL);
+	if (IS_ERR_OR_NULL(dent))
+		return -ENODEV;
+
+	debugfs_create_u32("threads", 0644, dent, &bench_threads);
+	debugfs_create_u32("duration_ms", 0644, dent, &bench_duration_ms);
+	debugfs_create_u32("msg_size", 0644, dent, &bench_msg_size);
+	debugfs_create_file("run", 0400, dent, NULL, &ipc_rtr_bench_fops);
+	return 0;
+}
+late_initcall(ipc_rtr_bench_init);
@@ -26,6 +26,7 @@
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
 #include <linux/rwsem.h>
+#include <linux/rculist.h>
 #include <linux/ipc_logging.h>
 #include <linux/uaccess.h>
 #include <linux/ipc_router.h>
@@ -88,6 +89,7 @@ static DECLARE_RWSEM(server_list_lock_lha2);
 struct msm_ipc_server {
 	struct list_head list;
 	struct kref ref;
+	struct rcu_head rcu;
 	struct msm_ipc_port_name name;
 	char pdev_name[32];
 	int next_pdev_id;
@@ -97,6 +99,7 @@ struct msm_ipc_server {
 
 struct msm_ipc_server_port {
 	struct list_head list;
+	struct rcu_head rcu;
 	struct platform_device *pdev;
 	struct msm_ipc_port_addr server_addr;
 	struct msm_ipc_router_xprt_info *xprt_info;
@@ -122,6 +125,7 @@ enum {
 struct msm_ipc_router_remote_port {
 	struct list_head list;
 	struct kref ref;
+	struct rcu_head rcu;
 	struct mutex rport_lock_lhb2;
 	uint32_t node_id;
 	uint32_t port_id;
@@ -149,21 +153,31 @@ struct msm_ipc_router_xprt_info {
 	void *log_ctx;
 	struct kref ref;
 	struct completion ref_complete;
+	struct rcu_head rcu;
 };
 
 #define RT_HASH_SIZE 4
 struct msm_ipc_routing_table_entry {
 	struct list_head list;
 	struct kref ref;
+	struct rcu_head rcu;
 	uint32_t node_id;
 	uint32_t neighbor_node_id;
 	struct list_head remote_port_list[RP_HASH_SIZE];
-	struct msm_ipc_router_xprt_info *xprt_info;
+	struct msm_ipc_router_xprt_info __rcu *xprt_info;
 	struct rw_semaphore lock_lha4;
 	unsigned long num_tx_bytes;
 	unsigned long num_rx_bytes;
 };
 
+/*
+ * rt_entry->xprt_info only changes with routing_table_lock_lha3 held for
+ * writing.  Lockless readers use ipc_router_get_rt_xprt_ref().
+ */
+#define rt_xprt_info(rt_entry) \
+	rcu_dereference_protected((rt_entry)->xprt_info, \
+				  lockdep_is_held(&routing_table_lock_lha3))
+
 #define LOG_CTX_NAME_LEN 32
 struct ipc_rtr_log_ctx {
 	struct list_head list;
@@ -196,8 +210,8 @@ static void *ipc_router_get_log_ctx(char *sub_name);
 static int process_resume_tx_msg(union rr_control_msg *msg,
 				 struct rr_packet *pkt);
 static void ipc_router_reset_conn(struct msm_ipc_router_remote_port *rport_ptr);
-static int ipc_router_get_xprt_info_ref(
-		struct msm_ipc_router_xprt_info *xprt_info);
+static struct msm_ipc_router_xprt_info *ipc_router_get_rt_xprt_ref(
+		struct msm_ipc_routing_table_entry *rt_entry);
 static void ipc_router_put_xprt_info_ref(
 		struct msm_ipc_router_xprt_info *xprt_info);
 static void ipc_router_release_xprt_info_ref(struct kref *ref);
@@ -410,14 +424,14 @@ static void ipc_router_log_msg(void *log_ctx, uint32_t xchng_type,
 	}
 }
 
-/* Must be called with routing_table_lock_lha3 locked. */
+/* Must be called with routing_table_lock_lha3 locked or under RCU. */
 static struct msm_ipc_routing_table_entry *lookup_routing_table(
 	uint32_t node_id)
 {
 	uint32_t key = (node_id % RT_HASH_SIZE);
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	list_for_each_entry(rt_entry, &routing_table[key], list) {
+	list_for_each_entry_rcu(rt_entry, &routing_table[key], list) {
 		if (rt_entry->node_id == node_id)
 			return rt_entry;
 	}
@@ -456,12 +470,12 @@ static struct msm_ipc_routing_table_entry *create_routing_table_entry(
 	init_rwsem(&rt_entry->lock_lha4);
 	kref_init(&rt_entry->ref);
 	rt_entry->node_id = node_id;
-	rt_entry->xprt_info = xprt_info;
+	rcu_assign_pointer(rt_entry->xprt_info, xprt_info);
 	if (xprt_info)
 		rt_entry->neighbor_node_id = xprt_info->remote_node_id;
 
 	key = (node_id % RT_HASH_SIZE);
-	list_add_tail(&rt_entry->list, &routing_table[key]);
+	list_add_tail_rcu(&rt_entry->list, &routing_table[key]);
 out_create_rtentry1:
 	kref_get(&rt_entry->ref);
 out_create_rtentry2:
@@ -476,18 +490,19 @@ out_create_rtentry2:
  * @return: a reference to the routing table entry on success, NULL on failure.
  *
  * This function is used to obtain a reference to the rounting table entry
- * corresponding to a node id.
+ * corresponding to a node id. The lookup is lockless; an entry whose last
+ * reference is being dropped is treated as already removed.
  */
 static struct msm_ipc_routing_table_entry *ipc_router_get_rtentry_ref(
 	uint32_t node_id)
 {
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	down_read(&routing_table_lock_lha3);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(node_id);
-	if (rt_entry)
-		kref_get(&rt_entry->ref);
-	up_read(&routing_table_lock_lha3);
+	if (rt_entry && !kref_get_unless_zero(&rt_entry->ref))
+		rt_entry = NULL;
+	rcu_read_unlock();
 	return rt_entry;
 }
 
@@ -506,9 +521,10 @@ void ipc_router_release_rtentry(struct kref *ref)
 	/*
 	 * All references to a routing entry will be put only under SSR.
 	 * As part of SSR, all the internals of the routing table entry
-	 * are cleaned. So just free the routing table entry.
+	 * are cleaned. So just free the routing table entry once the lockless
+	 * readers that may still be walking the hash chain are done.
 	 */
-	kfree(rt_entry);
+	kfree_rcu(rt_entry, rcu);
 }
 
 struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
@@ -540,6 +556,17 @@ struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
 	return temp_pkt;
 }
 
+/**
+ * clone_pkt() - Clone a Router packet
+ * @pkt: Packet to be cloned.
+ *
+ * @return: pointer to the cloned packet on success, NULL on failure.
+ *
+ * The clone gets its own packet structure and SKB queue so that it can be
+ * queued to a different port than @pkt, but its SKBs are clones that share
+ * the payload with @pkt. Use this only when a packet is delivered to more
+ * than one consumer; a single consumer takes a reference on @pkt instead.
+ */
 struct rr_packet *clone_pkt(struct rr_packet *pkt)
 {
 	struct rr_packet *cloned_pkt;
@@ -567,6 +594,8 @@ struct rr_packet *clone_pkt(struct rr_packet *pkt)
 	pkt_fragment_q = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
 	if (!pkt_fragment_q) {
 		IPC_RTR_ERR("%s: pkt_frag_q alloc failure\n", __func__);
+		if (cloned_pkt->opt_hdr.len > 0)
+			kfree(cloned_pkt->opt_hdr.data);
 		kfree(cloned_pkt);
 		return NULL;
 	}
@@ -631,13 +660,17 @@ struct rr_packet *create_pkt(struct sk_buff_head *data)
 	return pkt;
 }
 
-void release_pkt(struct rr_packet *pkt)
+/**
+ * ipc_router_free_pkt() - Free a Router packet
+ * @ref: Reference to the packet.
+ *
+ * This function is called when all references to the packet are released.
+ */
+static void ipc_router_free_pkt(struct kref *ref)
 {
+	struct rr_packet *pkt = container_of(ref, struct rr_packet, ref);
 	struct sk_buff *temp_skb;
 
-	if (!pkt)
-		return;
-
 	if (!pkt->pkt_fragment_q) {
 		kfree(pkt);
 		return;
@@ -651,7 +684,20 @@ void release_pkt(struct rr_packet *pkt)
 	if (pkt->opt_hdr.len > 0)
 		kfree(pkt->opt_hdr.data);
 	kfree(pkt);
-	return;
+}
+
+/**
+ * release_pkt() - Release a reference to a Router packet
+ * @pkt: Packet to be released.
+ *
+ * A packet and its SKBs are freed once the last reference is released.
+ */
+void release_pkt(struct rr_packet *pkt)
+{
+	if (!pkt)
+		return;
+
+	kref_put(&pkt->ref, ipc_router_free_pkt);
 }
 
 static struct sk_buff_head *msm_ipc_router_buf_to_skb(void *buf,
@@ -737,9 +783,15 @@ static void *msm_ipc_router_skb_to_buf(struct sk_buff_head *skb_head,
 	}
 	skb_queue_walk(skb_head, temp) {
 		copy_len = buf_len < temp->len ? buf_len : temp->len;
-		memcpy(buf + offset, temp->data, copy_len);
+		if (skb_copy_bits(temp, 0, buf + offset, copy_len)) {
+			IPC_RTR_ERR("%s: skb copy failed\n", __func__);
+			kfree(buf);
+			return NULL;
+		}
 		offset += copy_len;
 		buf_len -= copy_len;
+		if (!buf_len)
+			break;
 	}
 	return buf;
 }
@@ -977,7 +1029,13 @@ static int prepend_header_v1(struct rr_packet *pkt, int hdr_size)
 		return -EINVAL;
 	}
 
-	if (skb_headroom(temp_skb) < hdr_size) {
+	/*
+	 * The payload may be shared with other clones of the packet, so
+	 * write the header into a separate SKB instead of into shared
+	 * headroom.
+	 */
+	if (skb_headroom(temp_skb) < hdr_size ||
+	    skb_header_cloned(temp_skb)) {
 		temp_skb = alloc_skb(hdr_size, GFP_KERNEL);
 		if (!temp_skb) {
 			IPC_RTR_ERR("%s: Could not allocate SKB of size %d\n",
@@ -1018,7 +1076,9 @@ static int prepend_header_v2(struct rr_packet *pkt, int hdr_size)
 		return -EINVAL;
 	}
 
-	if (skb_headroom(temp_skb) < hdr_size) {
+	/* Never write into headroom shared with clones of the packet */
+	if (skb_headroom(temp_skb) < hdr_size ||
+	    skb_header_cloned(temp_skb)) {
 		temp_skb = alloc_skb(hdr_size, GFP_KERNEL);
 		if (!temp_skb) {
 			IPC_RTR_ERR("%s: Could not allocate SKB of size %d\n",
@@ -1097,7 +1157,8 @@ static int prepend_header(struct rr_packet *pkt,
  *
  * Some packets contain fragments of data over multiple SKBs. If an XPRT
  * does not supported fragmented writes, linearize multiple SKBs into one
- * single SKB.
+ * single SKB. When the first SKB is private and has enough tailroom, only
+ * the remaining fragments are appended to it.
  */
 static int defragment_pkt(struct rr_packet *pkt)
 {
@@ -1111,10 +1172,24 @@ static int defragment_pkt(struct rr_packet *pkt)
 		return -EINVAL;
 	}
 
-	if (skb_queue_len(pkt->pkt_fragment_q) == 1)
+	if (skb_queue_len(pkt->pkt_fragment_q) == 1 &&
+	    !skb_is_nonlinear(skb_peek(pkt->pkt_fragment_q)))
 		return 0;
 
 	align_size = ALIGN_SIZE(pkt->length);
+	dst_skb = skb_peek(pkt->pkt_fragment_q);
+	if (!skb_cloned(dst_skb) && !skb_is_nonlinear(dst_skb) &&
+	    skb_tailroom(dst_skb) >= pkt->length - dst_skb->len + align_size) {
+		skb_unlink(dst_skb, pkt->pkt_fragment_q);
+		while ((src_skb = skb_dequeue(pkt->pkt_fragment_q))) {
+			skb_copy_bits(src_skb, 0, skb_put(dst_skb, src_skb->len),
+				      src_skb->len);
+			kfree_skb(src_skb);
+		}
+		skb_queue_tail(pkt->pkt_fragment_q, dst_skb);
+		return 0;
+	}
+
 	dst_skb = alloc_skb(pkt->length + align_size, GFP_KERNEL);
 	if (!dst_skb) {
 		IPC_RTR_ERR("%s: could not allocate one skb of size %d\n",
@@ -1126,7 +1201,7 @@ static int defragment_pkt(struct rr_packet *pkt)
 
 	skb_queue_walk(pkt->pkt_fragment_q, src_skb) {
 		copy_len =  buf_len < src_skb->len ? buf_len : src_skb->len;
-		memcpy(buf + offset, src_skb->data, copy_len);
+		skb_copy_bits(src_skb, 0, buf + offset, copy_len);
 		offset += copy_len;
 		buf_len -= copy_len;
 	}
@@ -1276,7 +1351,7 @@ void msm_ipc_router_add_local_port(struct msm_ipc_port *port_ptr)
 
 	key = (port_ptr->this_port.port_id & (LP_HASH_SIZE - 1));
 	down_write(&local_ports_lock_lhc2);
-	list_add_tail(&port_ptr->list, &local_ports[key]);
+	list_add_tail_rcu(&port_ptr->list, &local_ports[key]);
 	up_write(&local_ports_lock_lhc2);
 }
 
@@ -1352,15 +1427,16 @@ static struct msm_ipc_port *ipc_router_get_port_ref(uint32_t port_id)
 	int key = (port_id & (LP_HASH_SIZE - 1));
 	struct msm_ipc_port *port_ptr;
 
-	down_read(&local_ports_lock_lhc2);
-	list_for_each_entry(port_ptr, &local_ports[key], list) {
-		if (port_ptr->this_port.port_id == port_id) {
-			kref_get(&port_ptr->ref);
-			up_read(&local_ports_lock_lhc2);
-			return port_ptr;
-		}
+	rcu_read_lock();
+	list_for_each_entry_rcu(port_ptr, &local_ports[key], list) {
+		if (port_ptr->this_port.port_id != port_id)
+			continue;
+		if (!kref_get_unless_zero(&port_ptr->ref))
+			break;
+		rcu_read_unlock();
+		return port_ptr;
 	}
-	up_read(&local_ports_lock_lhc2);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -1385,7 +1461,7 @@ void ipc_router_release_port(struct kref *ref)
 	wakeup_source_unregister(port_ptr->port_rx_ws);
 	if (port_ptr->endpoint)
 		sock_put(ipc_port_sk(port_ptr->endpoint));
-	kfree(port_ptr);
+	kfree_rcu(port_ptr, rcu);
 }
 
 /**
@@ -1402,24 +1478,25 @@ static struct msm_ipc_router_remote_port *ipc_router_get_rport_ref(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	rt_entry = ipc_router_get_rtentry_ref(node_id);
+	rcu_read_lock();
+	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
+		rcu_read_unlock();
 		IPC_RTR_ERR("%s: Node is not up\n", __func__);
 		return NULL;
 	}
 
-	down_read(&rt_entry->lock_lha4);
-	list_for_each_entry(rport_ptr,
-			    &rt_entry->remote_port_list[key], list) {
-		if (rport_ptr->port_id == port_id) {
-			kref_get(&rport_ptr->ref);
+	list_for_each_entry_rcu(rport_ptr,
+				&rt_entry->remote_port_list[key], list) {
+		if (rport_ptr->port_id != port_id)
+			continue;
+		if (kref_get_unless_zero(&rport_ptr->ref))
 			goto out_lookup_rmt_port1;
-		}
+		break;
 	}
 	rport_ptr = NULL;
 out_lookup_rmt_port1:
-	up_read(&rt_entry->lock_lha4);
-	kref_put(&rt_entry->ref, ipc_router_release_rtentry);
+	rcu_read_unlock();
 	return rport_ptr;
 }
 
@@ -1468,8 +1545,8 @@ static struct msm_ipc_router_remote_port *ipc_router_create_rport(
 	mutex_init(&rport_ptr->rport_lock_lhb2);
 	INIT_LIST_HEAD(&rport_ptr->resume_tx_port_list);
 	INIT_LIST_HEAD(&rport_ptr->conn_info_list);
-	list_add_tail(&rport_ptr->list,
-		      &rt_entry->remote_port_list[key]);
+	list_add_tail_rcu(&rport_ptr->list,
+			  &rt_entry->remote_port_list[key]);
 out_create_rmt_port1:
 	kref_get(&rport_ptr->ref);
 out_create_rmt_port2:
@@ -1626,7 +1703,7 @@ static void ipc_router_release_rport(struct kref *ref)
 	mutex_lock(&rport_ptr->rport_lock_lhb2);
 	msm_ipc_router_free_resume_tx_port(rport_ptr);
 	mutex_unlock(&rport_ptr->rport_lock_lhb2);
-	kfree(rport_ptr);
+	kfree_rcu(rport_ptr, rcu);
 }
 
 /**
@@ -1649,7 +1726,7 @@ static void ipc_router_destroy_rport(
 		return;
 	}
 	down_write(&rt_entry->lock_lha4);
-	list_del(&rport_ptr->list);
+	list_del_rcu(&rport_ptr->list);
 	up_write(&rt_entry->lock_lha4);
 	signal_rport_exit(rport_ptr);
 	kref_put(&rport_ptr->ref, ipc_router_release_rport);
@@ -1666,7 +1743,8 @@ static void ipc_router_destroy_rport(
  *
  * @return: If found Pointer to server structure, else NULL.
  *
- * Note1: Lock the server_list_lock_lha2 before accessing this function.
+ * Note1: Lock the server_list_lock_lha2 or hold rcu_read_lock() before
+ *        accessing this function.
  * Note2: If the <node_id:port_id> are <0:0>, then the lookup is restricted
  *        to <service:instance>. Used only when a client wants to send a
  *        message to any QMI server.
@@ -1681,14 +1759,14 @@ static struct msm_ipc_server *msm_ipc_router_lookup_server(
 	struct msm_ipc_server_port *server_port;
 	int key = (service & (SRV_HASH_SIZE - 1));
 
-	list_for_each_entry(server, &server_list[key], list) {
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != service) ||
 		    (server->name.instance != instance))
 			continue;
 		if ((node_id == 0) && (port_id == 0))
 			return server;
-		list_for_each_entry(server_port, &server->server_port_list,
-				    list) {
+		list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
 			if ((server_port->server_addr.node_id == node_id) &&
 			    (server_port->server_addr.port_id == port_id))
 				return server;
@@ -1711,11 +1789,11 @@ static struct msm_ipc_server *ipc_router_get_server_ref(
 {
 	struct msm_ipc_server *server;
 
-	down_read(&server_list_lock_lha2);
+	rcu_read_lock();
 	server = msm_ipc_router_lookup_server(svc, ins, node_id, port_id);
-	if (server)
-		kref_get(&server->ref);
-	up_read(&server_list_lock_lha2);
+	if (server && !kref_get_unless_zero(&server->ref))
+		server = NULL;
+	rcu_read_unlock();
 	return server;
 }
 
@@ -1730,7 +1808,7 @@ static void ipc_router_release_server(struct kref *ref)
 	struct msm_ipc_server *server =
 		container_of(ref, struct msm_ipc_server, ref);
 
-	kfree(server);
+	kfree_rcu(server, rcu);
 }
 
 /**
@@ -1782,10 +1860,10 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	server->synced_sec_rule = 0;
 	INIT_LIST_HEAD(&server->server_port_list);
 	kref_init(&server->ref);
-	list_add_tail(&server->list, &server_list[key]);
 	scnprintf(server->pdev_name, sizeof(server->pdev_name),
 		  "SVC%08x:%08x", service, instance);
 	server->next_pdev_id = 1;
+	list_add_tail_rcu(&server->list, &server_list[key]);
 
 create_srv_port:
 	server_port = kzalloc(sizeof(struct msm_ipc_server_port), GFP_KERNEL);
@@ -1795,8 +1873,8 @@ create_srv_port:
 		if (pdev)
 			platform_device_put(pdev);
 		if (list_empty(&server->server_port_list)) {
-			list_del(&server->list);
-			kfree(server);
+			list_del_rcu(&server->list);
+			kfree_rcu(server, rcu);
 		}
 		up_write(&server_list_lock_lha2);
 		IPC_RTR_ERR("%s: Server Port allocation failed\n", __func__);
@@ -1806,7 +1884,7 @@ create_srv_port:
 	server_port->server_addr.node_id = node_id;
 	server_port->server_addr.port_id = port_id;
 	server_port->xprt_info = xprt_info;
-	list_add_tail(&server_port->list, &server->server_port_list);
+	list_add_tail_rcu(&server_port->list, &server->server_port_list);
 	server->next_pdev_id++;
 	platform_device_add(server_port->pdev);
 
@@ -1846,11 +1924,11 @@ static void ipc_router_destroy_server_nolock(struct msm_ipc_server *server,
 	}
 	if (server_port_found && server_port) {
 		platform_device_unregister(server_port->pdev);
-		list_del(&server_port->list);
-		kfree(server_port);
+		list_del_rcu(&server_port->list);
+		kfree_rcu(server_port, rcu);
 	}
 	if (list_empty(&server->server_port_list)) {
-		list_del(&server->list);
+		list_del_rcu(&server->list);
 		kref_put(&server->ref, ipc_router_release_server);
 	}
 	return;
@@ -2045,18 +2123,17 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 
 	hdr = &(pkt->hdr);
 	rt_entry = ipc_router_get_rtentry_ref(hdr->dst_node_id);
-	if (!(rt_entry) || !(rt_entry->xprt_info)) {
+	if (!(rt_entry)) {
 		IPC_RTR_ERR("%s: Routing table not initialized\n", __func__);
 		ret = -ENODEV;
 		goto fm_error1;
 	}
 
-	down_read(&rt_entry->lock_lha4);
-	fwd_xprt_info = rt_entry->xprt_info;
-	ret = ipc_router_get_xprt_info_ref(fwd_xprt_info);
-	if (ret < 0) {
+	fwd_xprt_info = ipc_router_get_rt_xprt_ref(rt_entry);
+	if (!fwd_xprt_info) {
 		IPC_RTR_ERR("%s: Abort invalid xprt\n", __func__);
-		goto fm_error_xprt;
+		ret = -ENODEV;
+		goto fm_error1;
 	}
 	ret = prepend_header(pkt, fwd_xprt_info);
 	if (ret < 0) {
@@ -2093,8 +2170,6 @@ fm_error3:
 	mutex_unlock(&fwd_xprt_info->tx_lock_lhb2);
 fm_error2:
 	ipc_router_put_xprt_info_ref(fwd_xprt_info);
-fm_error_xprt:
-	up_read(&rt_entry->lock_lha4);
 fm_error1:
 	if (rt_entry)
 		kref_put(&rt_entry->ref, ipc_router_release_rtentry);
@@ -2202,7 +2277,7 @@ static void cleanup_rmt_ports(struct msm_ipc_router_xprt_info *xprt_info,
 	for (j = 0; j < RP_HASH_SIZE; j++) {
 		list_for_each_entry_safe(rport_ptr, tmp_rport_ptr,
 				&rt_entry->remote_port_list[j], list) {
-			list_del(&rport_ptr->list);
+			list_del_rcu(&rport_ptr->list);
 			mutex_lock(&rport_ptr->rport_lock_lhb2);
 			server = rport_ptr->server;
 			rport_ptr->server = NULL;
@@ -2241,14 +2316,14 @@ static void msm_ipc_cleanup_routing_table(
 		list_for_each_entry_safe(rt_entry, tmp_rt_entry,
 					 &routing_table[i], list) {
 			down_write(&rt_entry->lock_lha4);
-			if (rt_entry->xprt_info != xprt_info) {
+			if (rt_xprt_info(rt_entry) != xprt_info) {
 				up_write(&rt_entry->lock_lha4);
 				continue;
 			}
 			cleanup_rmt_ports(xprt_info, rt_entry);
-			rt_entry->xprt_info = NULL;
+			RCU_INIT_POINTER(rt_entry->xprt_info, NULL);
 			up_write(&rt_entry->lock_lha4);
-			list_del(&rt_entry->list);
+			list_del_rcu(&rt_entry->list);
 			kref_put(&rt_entry->ref, ipc_router_release_rtentry);
 		}
 	}
@@ -2471,6 +2546,7 @@ static int process_hello_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	int i, rc = 0;
 	union rr_control_msg ctl;
 	struct msm_ipc_routing_table_entry *rt_entry;
+	struct msm_ipc_router_xprt_info *rt_xprt;
 
 	if (!hdr)
 		return -EINVAL;
@@ -2506,10 +2582,10 @@ static int process_hello_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	down_read(&routing_table_lock_lha3);
 	for (i = 0; i < RT_HASH_SIZE; i++) {
 		list_for_each_entry(rt_entry, &routing_table[i], list) {
+			rt_xprt = rt_xprt_info(rt_entry);
 			if ((rt_entry->node_id != IPC_ROUTER_NID_LOCAL) &&
-			    (!rt_entry->xprt_info ||
-			     (rt_entry->xprt_info->xprt->link_id ==
-			      xprt_info->xprt->link_id)))
+			    (!rt_xprt || (rt_xprt->xprt->link_id ==
+					  xprt_info->xprt->link_id)))
 				continue;
 			rc = msm_ipc_router_send_server_list(rt_entry->node_id,
 							     xprt_info);
@@ -2932,7 +3008,9 @@ static int loopback_data(struct msm_ipc_port *src,
 						__func__, port_id);
 		return -ENODEV;
 	}
-	post_pkt_to_port(port_ptr, pkt, 1);
+	/* The receiver shares the sender's packet instead of a clone */
+	kref_get(&pkt->ref);
+	post_pkt_to_port(port_ptr, pkt, 0);
 	update_comm_mode_info(&src->mode_info, NULL);
 	kref_put(&port_ptr->ref, ipc_router_release_port);
 
@@ -3061,14 +3139,12 @@ static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
 			__func__, hdr->dst_node_id);
 		return -ENODEV;
 	}
-	down_read(&rt_entry->lock_lha4);
-	xprt_info = rt_entry->xprt_info;
-	ret = ipc_router_get_xprt_info_ref(xprt_info);
-	if (ret < 0) {
+	/* The xprt_info reference pins the transport */
+	xprt_info = ipc_router_get_rt_xprt_ref(rt_entry);
+	if (!xprt_info) {
 		IPC_RTR_ERR("%s: Abort invalid xprt\n", __func__);
-		up_read(&rt_entry->lock_lha4);
 		kref_put(&rt_entry->ref, ipc_router_release_rtentry);
-		return ret;
+		return -ENODEV;
 	}
 	ret = prepend_header(pkt, xprt_info);
 	if (ret < 0) {
@@ -3090,7 +3166,6 @@ static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
 	ret = xprt_info->xprt->write(pkt, pkt->length, xprt_info->xprt);
 	mutex_unlock(&xprt_info->tx_lock_lhb2);
 out_write_pkt:
-	up_read(&rt_entry->lock_lha4);
 	kref_put(&rt_entry->ref, ipc_router_release_rtentry);
 
 	if (ret < 0) {
@@ -3143,21 +3218,24 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 		dst_node_id = dest->addr.port_addr.node_id;
 		dst_port_id = dest->addr.port_addr.port_id;
 	} else if (dest->addrtype == MSM_IPC_ADDR_NAME) {
-		server = ipc_router_get_server_ref(
+		rcu_read_lock();
+		server = msm_ipc_router_lookup_server(
 					dest->addr.port_name.service,
 					dest->addr.port_name.instance,
 					0, 0);
-		if (!server) {
+		server_port = server ? list_first_or_null_rcu(
+					&server->server_port_list,
+					struct msm_ipc_server_port,
+					list) : NULL;
+		if (!server_port) {
+			rcu_read_unlock();
 			IPC_RTR_ERR("%s: Destination not reachable\n",
 								__func__);
 			return -ENODEV;
 		}
-		server_port = list_first_entry(&server->server_port_list,
-					       struct msm_ipc_server_port,
-					       list);
 		dst_node_id = server_port->server_addr.node_id;
 		dst_port_id = server_port->server_addr.port_id;
-		kref_put(&server->ref, ipc_router_release_server);
+		rcu_read_unlock();
 	}
 
 	rport_ptr = ipc_router_get_rport_ref(dst_node_id, dst_port_id);
@@ -3248,6 +3326,7 @@ static int msm_ipc_router_send_resume_tx(void *data)
 	union rr_control_msg msg;
 	struct rr_header_v1 *hdr = (struct rr_header_v1 *)data;
 	struct msm_ipc_routing_table_entry *rt_entry;
+	struct msm_ipc_router_xprt_info *xprt_info;
 	int ret;
 
 	memset(&msg, 0, sizeof(msg));
@@ -3260,15 +3339,14 @@ static int msm_ipc_router_send_resume_tx(void *data)
 				__func__, hdr->src_node_id);
 		return -ENODEV;
 	}
-	ret = ipc_router_get_xprt_info_ref(rt_entry->xprt_info);
-	if (ret < 0) {
+	xprt_info = ipc_router_get_rt_xprt_ref(rt_entry);
+	if (!xprt_info) {
 		IPC_RTR_ERR("%s: Abort invalid xprt\n", __func__);
 		kref_put(&rt_entry->ref, ipc_router_release_rtentry);
-		return ret;
+		return -ENODEV;
 	}
-	ret = ipc_router_send_ctl_msg(rt_entry->xprt_info, &msg,
-				      hdr->src_node_id);
-	ipc_router_put_xprt_info_ref(rt_entry->xprt_info);
+	ret = ipc_router_send_ctl_msg(xprt_info, &msg, hdr->src_node_id);
+	ipc_router_put_xprt_info_ref(xprt_info);
 	kref_put(&rt_entry->ref, ipc_router_release_rtentry);
 	if (ret < 0)
 		IPC_RTR_ERR(
@@ -3488,7 +3566,7 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 
 	if (port_ptr->type == SERVER_PORT || port_ptr->type == CLIENT_PORT) {
 		down_write(&local_ports_lock_lhc2);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		up_write(&local_ports_lock_lhc2);
 
 		mutex_lock(&port_ptr->port_lock_lhc3);
@@ -3523,7 +3601,7 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 		up_write(&control_ports_lock_lha5);
 	} else if (port_ptr->type == IRSC_PORT) {
 		down_write(&local_ports_lock_lhc2);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		up_write(&local_ports_lock_lhc2);
 		signal_irsc_completion();
 	}
@@ -3578,8 +3656,10 @@ int msm_ipc_router_bind_control_port(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 
 	down_write(&local_ports_lock_lhc2);
-	list_del(&port_ptr->list);
+	list_del_rcu(&port_ptr->list);
 	up_write(&local_ports_lock_lhc2);
+	/* Lockless readers may still be on the port; wait before relinking */
+	synchronize_rcu();
 	port_ptr->type = CONTROL_PORT;
 	down_write(&control_ports_lock_lha5);
 	list_add_tail(&port_ptr->list, &control_ports);
@@ -3641,8 +3721,8 @@ int msm_ipc_router_close(void)
 	list_for_each_entry_safe(xprt_info, tmp_xprt_info,
 				 &xprt_info_list, list) {
 		xprt_info->xprt->close(xprt_info->xprt);
-		list_del(&xprt_info->list);
-		kfree(xprt_info);
+		list_del_rcu(&xprt_info->list);
+		kfree_rcu(xprt_info, rcu);
 	}
 	up_write(&xprt_info_list_lock_lha5);
 	return 0;
@@ -3757,7 +3837,7 @@ static void dump_routing_table(struct seq_file *s)
 				       "Loopback", rt_entry->node_id);
 			else
 				seq_printf(s, "%-20s|0x%08x|\n",
-				       rt_entry->xprt_info->xprt->name,
+				       rt_xprt_info(rt_entry)->xprt->name,
 				       rt_entry->node_id);
 			up_read(&rt_entry->lock_lha4);
 		}
@@ -3982,34 +4062,28 @@ static void *ipc_router_get_log_ctx(char *sub_name)
 }
 
 /**
- * ipc_router_get_xprt_info_ref() - Get a reference to the xprt_info structure
- * @xprt_info: pointer to the xprt_info.
+ * ipc_router_get_rt_xprt_ref() - Get a reference to the xprt of a route
+ * @rt_entry: Routing table entry.
  *
- * @return: Zero on success, -ENODEV on failure.
+ * @return: The xprt_info @rt_entry routes through, with a reference held,
+ *          or NULL if there is none or it is being removed.
  *
- * This function is used to obtain a reference to the xprt_info structure
- * corresponding to the requested @xprt_info pointer.
+ * The pointer is loaded and the reference taken in one RCU read-side
+ * critical section: xprt_info is freed a grace period after its last
+ * reference is gone, so it can not be freed and reused in between.
  */
-static int ipc_router_get_xprt_info_ref(
-		struct msm_ipc_router_xprt_info *xprt_info)
+static struct msm_ipc_router_xprt_info *ipc_router_get_rt_xprt_ref(
+		struct msm_ipc_routing_table_entry *rt_entry)
 {
-	int ret = -ENODEV;
-	struct msm_ipc_router_xprt_info *tmp_xprt_info;
-
-	if (!xprt_info)
-		return 0;
+	struct msm_ipc_router_xprt_info *xprt_info;
 
-	down_read(&xprt_info_list_lock_lha5);
-	list_for_each_entry(tmp_xprt_info, &xprt_info_list, list) {
-		if (tmp_xprt_info == xprt_info) {
-			kref_get(&xprt_info->ref);
-			ret = 0;
-			break;
-		}
-	}
-	up_read(&xprt_info_list_lock_lha5);
+	rcu_read_lock();
+	xprt_info = rcu_dereference(rt_entry->xprt_info);
+	if (xprt_info && !kref_get_unless_zero(&xprt_info->ref))
+		xprt_info = NULL;
+	rcu_read_unlock();
 
-	return ret;
+	return xprt_info;
 }
 
 /**
@@ -4080,7 +4154,7 @@ static int msm_ipc_router_add_xprt(struct msm_ipc_router_xprt *xprt)
 	IPC_RTR_INFO(xprt_info->log_ctx, "Adding xprt: [%s]\n",
 						xprt->name);
 	down_write(&xprt_info_list_lock_lha5);
-	list_add_tail(&xprt_info->list, &xprt_info_list);
+	list_add_tail_rcu(&xprt_info->list, &xprt_info_list);
 	up_write(&xprt_info_list_lock_lha5);
 
 	down_write(&routing_table_lock_lha3);
@@ -4119,8 +4193,9 @@ static void msm_ipc_router_remove_xprt(struct msm_ipc_router_xprt *xprt)
 		mutex_unlock(&xprt_info->rx_lock_lhb2);
 
 		down_write(&xprt_info_list_lock_lha5);
-		list_del(&xprt_info->list);
+		list_del_rcu(&xprt_info->list);
 		up_write(&xprt_info_list_lock_lha5);
+		synchronize_rcu();
 
 		msm_ipc_cleanup_routing_table(xprt_info);
 
@@ -4130,7 +4205,8 @@ static void msm_ipc_router_remove_xprt(struct msm_ipc_router_xprt *xprt)
 		wait_for_completion(&xprt_info->ref_complete);
 
 		xprt->priv = 0;
-		kfree(xprt_info);
+		/* see ipc_router_get_rt_xprt_ref() */
+		kfree_rcu(xprt_info, rcu);
 	}
 }
 
@@ -4213,9 +4289,19 @@ void msm_ipc_router_xprt_notify(struct msm_ipc_router_xprt *xprt,
 		xprt_info = xprt->priv;
 	}
 
-	pkt = clone_pkt((struct rr_packet *)data);
-	if (!pkt)
-		return;
+	/*
+	 * An XPRT that opted in to PKT_HANDOFF_ENABLE does not modify the
+	 * packet once this function returns, so take a reference instead of
+	 * cloning it.
+	 */
+	pkt = (struct rr_packet *)data;
+	if (xprt->get_option(xprt) & PKT_HANDOFF_ENABLE) {
+		kref_get(&pkt->ref);
+	} else {
+		pkt = clone_pkt(pkt);
+		if (!pkt)
+			return;
+	}
 
 	mutex_lock(&xprt_info->rx_lock_lhb2);
 	list_add_tail(&pkt->list, &xprt_info->pkt_list);
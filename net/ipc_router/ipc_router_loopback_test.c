@@ -0,0 +1,451 @@
+/* Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * IPC Router packet path test using an in-kernel loopback XPRT.
+ *
+ * The test XPRT plays a remote node: it says HELLO, announces one server
+ * and echoes every data message written to that server back to the
+ * sender. The echo carries cloned SKBs of the written packet, so payload
+ * buffers travel through the router TX path, the XPRT and the router RX
+ * path without being copied. Messages of several sizes are round-tripped
+ * with the XPRT advertising fragmented writes and without, which forces
+ * the router to defragment. A local client/server round trip covers the
+ * loopback delivery that hands packets to the receiver by reference.
+ */
+
+#define pr_fmt(fmt) "ipc_router_loopback_test: " fmt
+
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/ipc_router.h>
+#include <linux/ipc_router_xprt.h>
+
+#include "ipc_router_private.h"
+
+#define IPCR_LB_NODE		0x7E
+#define IPCR_LB_PORT		0x100
+#define IPCR_LB_SVC		0x4C42
+#define IPCR_LB_LOCAL_SVC	0x4C43
+#define IPCR_LB_INS		1
+#define IPCR_LB_TIMEOUT		msecs_to_jiffies(2000)
+
+struct ipcr_lb_xprt {
+	struct msm_ipc_router_xprt xprt;
+	int frag_write;
+	int hello_done;
+	int bad_writes;
+	struct mutex rx_lock;
+	struct list_head rx_list;
+	struct work_struct rx_work;
+	struct completion closed;
+};
+
+static struct ipcr_lb_xprt lb;
+
+static const unsigned int ipcr_lb_sizes[] = {
+	1, 3, 64, 1000, 4096, 4099, 16384, 60000,
+};
+
+static int ipcr_lb_get_version(struct msm_ipc_router_xprt *xprt)
+{
+	return IPC_ROUTER_V1;
+}
+
+static void ipcr_lb_set_version(struct msm_ipc_router_xprt *xprt,
+				unsigned version)
+{
+	/* Only V1 headers are generated by the test peer */
+}
+
+static int ipcr_lb_get_option(struct msm_ipc_router_xprt *xprt)
+{
+	int option = PKT_HANDOFF_ENABLE;
+
+	if (ACCESS_ONCE(lb.frag_write))
+		option |= FRAG_PKT_WRITE_ENABLE;
+	return option;
+}
+
+static int ipcr_lb_close(struct msm_ipc_router_xprt *xprt)
+{
+	return 0;
+}
+
+static void ipcr_lb_sft_close_done(struct msm_ipc_router_xprt *xprt)
+{
+	complete(&lb.closed);
+}
+
+static void ipcr_lb_rx_work(struct work_struct *work)
+{
+	struct rr_packet *pkt;
+
+	for (;;) {
+		mutex_lock(&lb.rx_lock);
+		pkt = list_first_entry_or_null(&lb.rx_list, struct rr_packet,
+					       list);
+		if (pkt)
+			list_del_init(&pkt->list);
+		mutex_unlock(&lb.rx_lock);
+		if (!pkt)
+			break;
+
+		msm_ipc_router_xprt_notify(&lb.xprt, IPC_ROUTER_XPRT_EVENT_DATA,
+					   pkt);
+		release_pkt(pkt);
+	}
+}
+
+static void ipcr_lb_queue_rx(struct rr_packet *pkt)
+{
+	mutex_lock(&lb.rx_lock);
+	list_add_tail(&pkt->list, &lb.rx_list);
+	mutex_unlock(&lb.rx_lock);
+	schedule_work(&lb.rx_work);
+}
+
+static int ipcr_lb_push_hdr(struct rr_packet *pkt, uint32_t type,
+			    uint32_t src_port, uint32_t dst_port, uint32_t size)
+{
+	struct rr_header_v1 *hdr;
+	struct sk_buff *skb;
+
+	skb = alloc_skb(sizeof(*hdr), GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	hdr = (struct rr_header_v1 *)skb_put(skb, sizeof(*hdr));
+	hdr->version = IPC_ROUTER_V1;
+	hdr->type = type;
+	hdr->src_node_id = IPCR_LB_NODE;
+	hdr->src_port_id = src_port;
+	hdr->control_flag = 0;
+	hdr->size = size;
+	hdr->dst_node_id = IPC_ROUTER_NID_LOCAL;
+	hdr->dst_port_id = dst_port;
+	skb_queue_head(pkt->pkt_fragment_q, skb);
+	pkt->length += sizeof(*hdr);
+	return 0;
+}
+
+static int ipcr_lb_send_ctl(union rr_control_msg *msg, uint32_t dst_port)
+{
+	struct rr_packet *pkt;
+	struct sk_buff *skb;
+
+	pkt = create_pkt(NULL);
+	if (!pkt)
+		return -ENOMEM;
+
+	skb = alloc_skb(sizeof(*msg), GFP_KERNEL);
+	if (!skb) {
+		release_pkt(pkt);
+		return -ENOMEM;
+	}
+	memcpy(skb_put(skb, sizeof(*msg)), msg, sizeof(*msg));
+	skb_queue_tail(pkt->pkt_fragment_q, skb);
+	pkt->length = sizeof(*msg);
+
+	if (ipcr_lb_push_hdr(pkt, msg->cmd, IPC_ROUTER_ADDRESS, dst_port,
+			     sizeof(*msg))) {
+		release_pkt(pkt);
+		return -ENOMEM;
+	}
+	ipcr_lb_queue_rx(pkt);
+	return 0;
+}
+
+/*
+ * Echo a data packet back to its sender. The payload SKBs are clones of
+ * the written ones; only a new header SKB is allocated.
+ */
+static int ipcr_lb_echo(struct rr_packet *tx_pkt, struct rr_header_v1 *tx_hdr)
+{
+	unsigned int hdr_left = sizeof(*tx_hdr), pull;
+	struct sk_buff *skb, *clone;
+	struct rr_packet *pkt;
+
+	pkt = create_pkt(NULL);
+	if (!pkt)
+		return -ENOMEM;
+
+	skb_queue_walk(tx_pkt->pkt_fragment_q, skb) {
+		clone = skb_clone(skb, GFP_KERNEL);
+		if (!clone)
+			goto err;
+		pull = min(hdr_left, clone->len);
+		if (pull) {
+			__skb_pull(clone, pull);
+			hdr_left -= pull;
+		}
+		if (!clone->len) {
+			kfree_skb(clone);
+			continue;
+		}
+		skb_queue_tail(pkt->pkt_fragment_q, clone);
+		pkt->length += clone->len;
+	}
+
+	if (ipcr_lb_push_hdr(pkt, IPC_ROUTER_CTRL_CMD_DATA, IPCR_LB_PORT,
+			     tx_hdr->src_port_id, tx_hdr->size))
+		goto err;
+	ipcr_lb_queue_rx(pkt);
+	return 0;
+
+err:
+	release_pkt(pkt);
+	return -ENOMEM;
+}
+
+static int ipcr_lb_write(void *data, uint32_t len,
+			 struct msm_ipc_router_xprt *xprt)
+{
+	struct rr_packet *pkt = data;
+	union rr_control_msg ctl;
+	struct rr_header_v1 hdr;
+	struct sk_buff *skb;
+
+	skb = skb_peek(pkt->pkt_fragment_q);
+	if (!skb || len != pkt->length || len < sizeof(hdr) ||
+	    skb_copy_bits(skb, 0, &hdr, sizeof(hdr))) {
+		lb.bad_writes++;
+		return -EINVAL;
+	}
+	if (!ACCESS_ONCE(lb.frag_write) &&
+	    skb_queue_len(pkt->pkt_fragment_q) != 1) {
+		pr_err("fragmented write to a non-fragmenting XPRT\n");
+		lb.bad_writes++;
+		return -EINVAL;
+	}
+
+	switch (hdr.type) {
+	case IPC_ROUTER_CTRL_CMD_HELLO:
+		if (lb.hello_done)
+			break;
+		lb.hello_done = 1;
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.srv.cmd = IPC_ROUTER_CTRL_CMD_NEW_SERVER;
+		ctl.srv.service = IPCR_LB_SVC;
+		ctl.srv.instance = IPCR_LB_INS;
+		ctl.srv.node_id = IPCR_LB_NODE;
+		ctl.srv.port_id = IPCR_LB_PORT;
+		ipcr_lb_send_ctl(&ctl, IPC_ROUTER_ADDRESS);
+		break;
+	case IPC_ROUTER_CTRL_CMD_DATA:
+		if (hdr.dst_node_id != IPCR_LB_NODE ||
+		    hdr.dst_port_id != IPCR_LB_PORT)
+			break;
+		if (ipcr_lb_echo(pkt, &hdr))
+			return -ENOMEM;
+		if (hdr.control_flag & CONTROL_FLAG_CONFIRM_RX) {
+			memset(&ctl, 0, sizeof(ctl));
+			ctl.cli.cmd = IPC_ROUTER_CTRL_CMD_RESUME_TX;
+			ctl.cli.node_id = IPCR_LB_NODE;
+			ctl.cli.port_id = IPCR_LB_PORT;
+			ipcr_lb_send_ctl(&ctl, hdr.src_port_id);
+		}
+		break;
+	default:
+		break;
+	}
+	return len;
+}
+
+static int ipcr_lb_wait_server(uint32_t service)
+{
+	struct msm_ipc_server_info srv_info;
+	struct msm_ipc_port_name srv_name;
+	int i;
+
+	srv_name.service = service;
+	srv_name.instance = IPCR_LB_INS;
+	for (i = 0; i < 200; i++) {
+		if (msm_ipc_router_lookup_server_name(&srv_name, &srv_info,
+						      1, 0xFFFFFFFF) > 0)
+			return 0;
+		msleep(10);
+	}
+	return -ETIMEDOUT;
+}
+
+static int ipcr_lb_roundtrip(struct msm_ipc_port *tx_port,
+			     struct msm_ipc_port *rx_port, uint32_t service,
+			     unsigned char *tx_buf, unsigned int len)
+{
+	struct msm_ipc_addr dest, src;
+	unsigned char *rx_buf;
+	unsigned int rx_len;
+	int ret, tries;
+
+	dest.addrtype = MSM_IPC_ADDR_NAME;
+	dest.addr.port_name.service = service;
+	dest.addr.port_name.instance = IPCR_LB_INS;
+
+	/* The resume from the peer may still be in flight at the quota */
+	for (tries = 0; tries < 100; tries++) {
+		ret = msm_ipc_router_send_msg(tx_port, &dest, tx_buf, len);
+		if (ret != -EAGAIN)
+			break;
+		msleep(1);
+	}
+	if (ret < 0)
+		return ret;
+
+	ret = msm_ipc_router_rx_data_wait(rx_port, IPCR_LB_TIMEOUT);
+	if (ret)
+		return ret;
+	ret = msm_ipc_router_read_msg(rx_port, &src, &rx_buf, &rx_len);
+	if (ret < 0)
+		return ret;
+
+	if (rx_len != len || memcmp(rx_buf, tx_buf, len))
+		ret = -EBADMSG;
+	kfree(rx_buf);
+	return ret;
+}
+
+static int ipcr_lb_run_sizes(struct msm_ipc_port *tx_port,
+			     struct msm_ipc_port *rx_port, uint32_t service,
+			     unsigned char *buf, const char *name)
+{
+	unsigned int i, j;
+	int ret, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(ipcr_lb_sizes); i++) {
+		for (j = 0; j < ipcr_lb_sizes[i]; j++)
+			buf[j] = (unsigned char)(i + j * 7);
+		/* Cross the TX quota a few times to exercise RESUME_TX */
+		for (j = 0; j < 3 * IPC_ROUTER_HIGH_RX_QUOTA; j++) {
+			ret = ipcr_lb_roundtrip(tx_port, rx_port, service,
+						buf, ipcr_lb_sizes[i]);
+			if (ret) {
+				pr_err("%s: size %u message %u failed %d\n",
+				       name, ipcr_lb_sizes[i], j, ret);
+				failed++;
+				break;
+			}
+		}
+	}
+	return failed;
+}
+
+static int __init ipcr_lb_test_init(void)
+{
+	struct msm_ipc_port *cli_port = NULL, *srv_port = NULL;
+	union rr_control_msg hello;
+	struct msm_ipc_addr name;
+	unsigned char *buf;
+	int passed = 0, failed = 0, ret;
+
+	buf = kmalloc(ipcr_lb_sizes[ARRAY_SIZE(ipcr_lb_sizes) - 1],
+		      GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	lb.xprt.name = "ipcr_loopback_test";
+	lb.xprt.link_id = 1;
+	lb.xprt.get_version = ipcr_lb_get_version;
+	lb.xprt.set_version = ipcr_lb_set_version;
+	lb.xprt.get_option = ipcr_lb_get_option;
+	lb.xprt.write = ipcr_lb_write;
+	lb.xprt.close = ipcr_lb_close;
+	lb.xprt.sft_close_done = ipcr_lb_sft_close_done;
+	lb.frag_write = 1;
+	mutex_init(&lb.rx_lock);
+	INIT_LIST_HEAD(&lb.rx_list);
+	INIT_WORK(&lb.rx_work, ipcr_lb_rx_work);
+	init_completion(&lb.closed);
+
+	msm_ipc_router_xprt_notify(&lb.xprt, IPC_ROUTER_XPRT_EVENT_OPEN, NULL);
+
+	/* The peer opens with HELLO; the router replies and gets NEW_SERVER */
+	memset(&hello, 0, sizeof(hello));
+	hello.hello.cmd = IPC_ROUTER_CTRL_CMD_HELLO;
+	hello.hello.versions = BIT(IPC_ROUTER_V1);
+	if (ipcr_lb_send_ctl(&hello, IPC_ROUTER_ADDRESS)) {
+		failed++;
+		goto out;
+	}
+
+	cli_port = msm_ipc_router_create_port(NULL, NULL);
+	srv_port = msm_ipc_router_create_port(NULL, NULL);
+	if (!cli_port || !srv_port) {
+		failed++;
+		goto out;
+	}
+
+	if (ipcr_lb_wait_server(IPCR_LB_SVC)) {
+		pr_err("remote server was never announced\n");
+		failed++;
+		goto out;
+	}
+
+	ret = ipcr_lb_run_sizes(cli_port, cli_port, IPCR_LB_SVC, buf,
+				"xprt fragmented");
+	if (ret)
+		failed += ret;
+	else
+		passed++;
+
+	ACCESS_ONCE(lb.frag_write) = 0;
+	ret = ipcr_lb_run_sizes(cli_port, cli_port, IPCR_LB_SVC, buf,
+				"xprt linear");
+	if (ret)
+		failed += ret;
+	else
+		passed++;
+
+	name.addrtype = MSM_IPC_ADDR_NAME;
+	name.addr.port_name.service = IPCR_LB_LOCAL_SVC;
+	name.addr.port_name.instance = IPCR_LB_INS;
+	if (msm_ipc_router_register_server(srv_port, &name) < 0) {
+		pr_err("local server registration failed\n");
+		failed++;
+		goto out;
+	}
+	ret = ipcr_lb_run_sizes(cli_port, srv_port, IPCR_LB_LOCAL_SVC, buf,
+				"local");
+	if (ret)
+		failed += ret;
+	else
+		passed++;
+
+out:
+	if (srv_port)
+		msm_ipc_router_close_port(srv_port);
+	if (cli_port)
+		msm_ipc_router_close_port(cli_port);
+
+	flush_work(&lb.rx_work);
+	msm_ipc_router_xprt_notify(&lb.xprt, IPC_ROUTER_XPRT_EVENT_CLOSE, NULL);
+	if (!wait_for_completion_timeout(&lb.closed, IPCR_LB_TIMEOUT)) {
+		pr_err("XPRT close timed out\n");
+		failed++;
+	}
+	if (lb.bad_writes) {
+		pr_err("%d malformed writes to the XPRT\n", lb.bad_writes);
+		failed++;
+	}
+	kfree(buf);
+
+	pr_info("Summary: %d PASSED, %d FAILED\n", passed, failed);
+	return failed ? -EINVAL : 0;
+}
+late_initcall(ipcr_lb_test_init);
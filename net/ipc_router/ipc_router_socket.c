@@ -166,11 +166,16 @@ static int msm_ipc_router_extract_msg(struct msghdr *m,
 		m->msg_namelen = sizeof(struct sockaddr_msm_ipc);
 	}
 
+	/*
+	 * Copy straight from the packet's SKBs, linear or paged, into the
+	 * user iovec; the SKBs may be shared with other receivers.
+	 */
 	data_len = hdr->size;
 	skb_queue_walk(pkt->pkt_fragment_q, temp) {
+		if (!data_len)
+			break;
 		copy_len = data_len < temp->len ? data_len : temp->len;
-		if (copy_to_user(m->msg_iov->iov_base + offset, temp->data,
-				 copy_len)) {
+		if (skb_copy_datagram_iovec(temp, 0, m->msg_iov, copy_len)) {
 			IPC_RTR_ERR("%s: Copy to user failed\n", __func__);
 			return -EFAULT;
 		}
@@ -381,8 +386,6 @@ static int msm_ipc_router_recvmsg(struct kiocb *iocb, struct socket *sock,
 	long timeout;
 	int ret;
 
-	if (m->msg_iovlen != 1)
-		return -EOPNOTSUPP;
 	lock_sock(sk);
 	if (!buf_len) {
 		if (flags & MSG_PEEK)
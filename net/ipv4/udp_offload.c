@@ -142,6 +142,98 @@ out_unlock:
 	return segs;
 }
 
+static void udp_gso_segment_csum(struct sk_buff *seg, struct udphdr *uh,
+				 __sum16 check)
+{
+	uh->check = check;
+	if (seg->ip_summed != CHECKSUM_PARTIAL) {
+		uh->check = gso_make_checksum(seg, ~check);
+		if (uh->check == 0)
+			uh->check = CSUM_MANGLED_0;
+	}
+}
+
+/* Split a UDP_SEGMENT datagram into gso_size sized datagrams. Unlike UFO
+ * every segment is a complete UDP datagram: it carries its own header,
+ * length and checksum, and the IP header of each is not a fragment.
+ * The checksum field holds the pseudo header sum for the whole payload,
+ * as set up for CHECKSUM_PARTIAL by udp4_hwcsum() or udp4_gro_complete().
+ */
+struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+				  netdev_features_t features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	unsigned int sum_truesize = 0;
+	struct sk_buff *skb;
+	struct udphdr *uh;
+	unsigned int oldlen;
+	unsigned int mss;
+	unsigned int len;
+	bool copy_destructor;
+	__sum16 newcheck;
+	__be32 delta;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (unlikely(gso_skb->len <= sizeof(*uh) + mss))
+		goto out;
+
+	if (unlikely(gso_skb->ip_summed != CHECKSUM_PARTIAL))
+		goto out;
+
+	oldlen = (u16)~gso_skb->len;
+	__skb_pull(gso_skb, sizeof(*uh));
+
+	copy_destructor = gso_skb->destructor == sock_wfree;
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		goto out;
+
+	/* all segments but the last carry exactly mss bytes of payload */
+	delta = htonl(oldlen + sizeof(*uh) + mss);
+
+	skb = segs;
+	uh = udp_hdr(skb);
+	newcheck = ~csum_fold((__force __wsum)((__force u32)uh->check +
+					       (__force u32)delta));
+
+	while (skb->next) {
+		uh->len = htons(sizeof(*uh) + mss);
+		udp_gso_segment_csum(skb, uh, newcheck);
+
+		if (copy_destructor) {
+			skb->destructor = gso_skb->destructor;
+			skb->sk = gso_skb->sk;
+			sum_truesize += skb->truesize;
+		}
+		skb = skb->next;
+		uh = udp_hdr(skb);
+	}
+
+	/* Hand the socket reference of gso_skb over to the last segment,
+	 * so send buffer space is released as the segments complete, not
+	 * when the GSO engine frees gso_skb.
+	 */
+	if (copy_destructor) {
+		swap(gso_skb->sk, skb->sk);
+		swap(gso_skb->destructor, skb->destructor);
+		sum_truesize += skb->truesize;
+		atomic_add(sum_truesize - gso_skb->truesize,
+			   &skb->sk->sk_wmem_alloc);
+	}
+
+	/* the last segment may be shorter than mss */
+	len = skb_tail_pointer(skb) - skb_transport_header(skb) + skb->data_len;
+	delta = htonl(oldlen + len);
+	newcheck = ~csum_fold((__force __wsum)((__force u32)uh->check +
+					       (__force u32)delta));
+	uh->len = htons(len);
+	udp_gso_segment_csum(skb, uh, newcheck);
+out:
+	return segs;
+}
+EXPORT_SYMBOL_GPL(__udp_gso_segment);
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -161,6 +253,11 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		segs = __udp_gso_segment(skb, features);
+		goto out;
+	}
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -315,6 +412,76 @@ out:
 	return pp;
 }
 
+/* Bound a GRO train like a UDP_SEGMENT send, which keeps truesize sane
+ * under a flood of small datagrams.
+ */
+#define UDP_GRO_CNT_MAX		UDP_MAX_SEGMENTS
+
+/* Plain UDP GRO for sockets that enabled UDP_GRO: datagrams of one flow
+ * with the payload size of the first one are chained onto it. A shorter
+ * datagram is merged and ends the train, a longer one starts a new train.
+ * The socket gets the train as one skb, see udp_queue_rcv_skb().
+ */
+static struct sk_buff **udp_gro_receive_segment(struct sk_buff **head,
+						struct sk_buff *skb,
+						struct udphdr *uh)
+{
+	unsigned int off = skb_gro_offset(skb);
+	unsigned int ulen = ntohs(uh->len);
+	struct sk_buff *p, **pp = NULL;
+	struct udphdr *uh2;
+	unsigned int mss;
+
+	/* The train is delivered as CHECKSUM_PARTIAL, which needs every
+	 * datagram to carry a checksum; also reject padded frames.
+	 */
+	if (!uh->check || ulen <= sizeof(*uh) || ulen != skb_gro_len(skb)) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	NAPI_GRO_CB(skb)->udp_gro_seg = 1;
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+	ulen -= sizeof(struct udphdr);
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source ||
+		    !NAPI_GRO_CB(p)->udp_gro_seg) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		mss = skb_shinfo(p)->gso_size;
+		if (ulen > mss || skb_gro_receive(head, skb) ||
+		    ulen < mss || NAPI_GRO_CB(*head)->count >= UDP_GRO_CNT_MAX)
+			pp = head;
+		return pp;
+	}
+
+	return NULL;
+}
+
+static bool udp4_gro_sk_enabled(struct sk_buff *skb, struct udphdr *uh)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	struct sock *sk;
+	bool enabled;
+
+	sk = udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			     iph->daddr, uh->dest, skb->dev->ifindex);
+	if (!sk)
+		return false;
+
+	enabled = udp_sk(sk)->gro_enabled;
+	sock_put(sk);
+	return enabled;
+}
+
 static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					 struct sk_buff *skb)
 {
@@ -333,6 +500,13 @@ static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 	else if (uh->check)
 		skb_gro_checksum_try_convert(skb, IPPROTO_UDP, uh->check,
 					     inet_gro_compute_pseudo);
+
+	/* datagrams of a tunnel (udp_mark) are left to the tunnel offload */
+	if (static_key_false(&udp_gro_needed) &&
+	    !NAPI_GRO_CB(skb)->udp_mark && udp4_gro_sk_enabled(skb, uh)) {
+		NAPI_GRO_CB(skb)->is_ipv6 = 0;
+		return udp_gro_receive_segment(head, skb, uh);
+	}
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 0;
 	return udp_gro_receive(head, skb, uh);
@@ -342,6 +516,17 @@ flush:
 	return NULL;
 }
 
+static int udp_gro_complete_segment(struct sk_buff *skb, struct udphdr *uh)
+{
+	skb->csum_start = (unsigned char *)uh - skb->head;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+	skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_L4;
+	return 0;
+}
+
 int udp_gro_complete(struct sk_buff *skb, int nhoff)
 {
 	struct udp_offload_priv *uo_priv;
@@ -378,6 +563,11 @@ static int udp4_gro_complete(struct sk_buff *skb, int nhoff)
 		uh->check = ~udp_v4_check(skb->len - nhoff, iph->saddr,
 					  iph->daddr, 0);
 
+	if (NAPI_GRO_CB(skb)->udp_gro_seg) {
+		uh->len = htons(skb->len - nhoff);
+		return udp_gro_complete_segment(skb, uh);
+	}
+
 	return udp_gro_complete(skb, nhoff);
 }
 
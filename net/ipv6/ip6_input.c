@@ -47,7 +47,7 @@
 #include <net/inet_ecn.h>
 
 
-int ip6_rcv_finish(struct sk_buff *skb)
+static void ip6_rcv_finish_core(struct sk_buff *skb)
 {
 	if (sysctl_ip_early_demux && !skb_dst(skb) && skb->sk == NULL) {
 		const struct inet6_protocol *ipprot;
@@ -58,11 +58,47 @@ int ip6_rcv_finish(struct sk_buff *skb)
 	}
 	if (!skb_dst(skb))
 		ip6_route_input(skb);
+}
+
+int ip6_rcv_finish(struct sk_buff *skb)
+{
+	ip6_rcv_finish_core(skb);
 
 	return dst_input(skb);
 }
 
-int ipv6_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev)
+static void ip6_sublist_rcv_finish(struct sk_buff_head *list)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(list)) != NULL)
+		dst_input(skb);
+}
+
+static void ip6_list_rcv_finish(struct sk_buff_head *list)
+{
+	struct dst_entry *curr_dst = NULL;
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct dst_entry *dst;
+
+		ip6_rcv_finish_core(skb);
+		dst = skb_dst(skb);
+		if (curr_dst != dst) {
+			/* dispatch old sublist, start a new one */
+			ip6_sublist_rcv_finish(&sublist);
+			curr_dst = dst;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+	/* dispatch final sublist */
+	ip6_sublist_rcv_finish(&sublist);
+}
+
+static struct sk_buff *ip6_rcv_core(struct sk_buff *skb, struct net_device *dev)
 {
 	const struct ipv6hdr *hdr;
 	u32 pkt_len;
@@ -71,7 +107,7 @@ int ipv6_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt
 
 	if (skb->pkt_type == PACKET_OTHERHOST) {
 		kfree_skb(skb);
-		return NET_RX_DROP;
+		return NULL;
 	}
 
 	rcu_read_lock();
@@ -174,7 +210,7 @@ int ipv6_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt
 		if (ipv6_parse_hopopts(skb) < 0) {
 			IP6_INC_STATS_BH(net, idev, IPSTATS_MIB_INHDRERRORS);
 			rcu_read_unlock();
-			return NET_RX_DROP;
+			return NULL;
 		}
 	}
 
@@ -183,14 +219,59 @@ int ipv6_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt
 	/* Must drop socket now because of tproxy. */
 	skb_orphan(skb);
 
-	return NF_HOOK(NFPROTO_IPV6, NF_INET_PRE_ROUTING, skb, dev, NULL,
-		       ip6_rcv_finish);
+	return skb;
 err:
 	IP6_INC_STATS_BH(net, idev, IPSTATS_MIB_INHDRERRORS);
 drop:
 	rcu_read_unlock();
 	kfree_skb(skb);
-	return NET_RX_DROP;
+	return NULL;
+}
+
+int ipv6_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt, struct net_device *orig_dev)
+{
+	skb = ip6_rcv_core(skb, dev);
+	if (skb == NULL)
+		return NET_RX_DROP;
+
+	return NF_HOOK(NFPROTO_IPV6, NF_INET_PRE_ROUTING, skb, dev, NULL,
+		       ip6_rcv_finish);
+}
+
+static void ip6_sublist_rcv(struct sk_buff_head *list, struct net_device *dev)
+{
+	NF_HOOK_LIST(NFPROTO_IPV6, NF_INET_PRE_ROUTING, list, dev, NULL,
+		     ip6_rcv_finish);
+	ip6_list_rcv_finish(list);
+}
+
+/* Receive a list of IPv6 packets, see ip_list_rcv() */
+void ipv6_list_rcv(struct sk_buff_head *list, struct packet_type *pt,
+		   struct net_device *orig_dev)
+{
+	struct net_device *curr_dev = NULL;
+	struct sk_buff_head sublist;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&sublist);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct net_device *dev = skb->dev;
+
+		skb = ip6_rcv_core(skb, dev);
+		if (skb == NULL)
+			continue;
+
+		if (curr_dev != dev) {
+			/* dispatch old sublist, start a new one */
+			if (!skb_queue_empty(&sublist))
+				ip6_sublist_rcv(&sublist, curr_dev);
+			curr_dev = dev;
+		}
+		__skb_queue_tail(&sublist, skb);
+	}
+	/* dispatch final sublist */
+	if (!skb_queue_empty(&sublist))
+		ip6_sublist_rcv(&sublist, curr_dev);
 }
 
 /*
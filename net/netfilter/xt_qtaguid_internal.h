@@ -12,6 +12,10 @@
 
 #include <linux/types.h>
 #include <linux/rbtree.h>
+#include <linux/hashtable.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/string.h>
 #include <linux/spinlock_types.h>
 #include <linux/workqueue.h>
 
@@ -197,6 +201,31 @@ static inline uint64_t dc_sum_packets(struct data_counters *counters,
 		+ counters->bpc[set][direction][IFS_PROTO_OTHER].packets;
 }
 
+/*
+ * The packet path only adds to the copy of the current CPU.
+ * Readers sum up all copies into a struct data_counters.
+ */
+static inline void dc_fold(struct data_counters *counters,
+			   struct data_counters __percpu *pcpu_counters)
+{
+	struct byte_packet_counters *sum, *bpc;
+	int cpu, set, dir, proto;
+
+	memset(counters, 0, sizeof(*counters));
+	for_each_possible_cpu(cpu) {
+		struct data_counters *dc = per_cpu_ptr(pcpu_counters, cpu);
+
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS; proto++) {
+					sum = &counters->bpc[set][dir][proto];
+					bpc = &dc->bpc[set][dir][proto];
+					sum->bytes += bpc->bytes;
+					sum->packets += bpc->packets;
+				}
+	}
+}
+
 
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
@@ -206,14 +235,24 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	/* in iface_stat.tag_stat_hash, for lookups from the packet path */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
+	struct data_counters __percpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct data_counters __percpu *parent_counters;
 };
 
+#define IFACE_TAG_STAT_HASH_BITS 6
+
+/*
+ * iface_stat entries are never freed, and they are added to
+ * iface_stat_list with list_add_rcu(), so the packet path can look them up
+ * under rcu_read_lock() alone.
+ */
 struct iface_stat {
 	struct list_head list;  /* in iface_stat_list */
 	char *ifname;
@@ -222,7 +261,7 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
-	struct data_counters totals_via_skb;
+	struct data_counters __percpu *totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -237,7 +276,13 @@ struct iface_stat {
 
 	struct proc_dir_entry *proc_ptr;
 
+	/*
+	 * Both hold the same tag_stats. The tree keeps them sorted for the
+	 * readers, the hash is walked under RCU by the packet path.
+	 * Changes to either need tag_stat_list_lock.
+	 */
 	struct rb_root tag_stat_tree;
+	DECLARE_HASHTABLE(tag_stat_hash, IFACE_TAG_STAT_HASH_BITS);
 	spinlock_t tag_stat_list_lock;
 };
 
@@ -255,6 +300,9 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	/* in sock_tag_hash, for lookups from the packet path */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -300,6 +348,9 @@ struct qtaguid_event_counts {
 /* Track the set active_set for the given tag. */
 struct tag_counter_set {
 	struct tag_node tn;
+	/* in tag_counter_set_hash, for lookups from the packet path */
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
 	int active_set;
 };
 
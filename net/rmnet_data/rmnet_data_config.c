@@ -20,10 +20,13 @@
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
+#include <linux/rtnetlink.h>
+#include <linux/cpumask.h>
 #include <linux/rmnet_data.h>
 #include "rmnet_data_config.h"
 #include "rmnet_data_handlers.h"
 #include "rmnet_data_vnd.h"
+#include "rmnet_map.h"
 #include "rmnet_data_private.h"
 #include "rmnet_data_trace.h"
 
@@ -704,6 +707,7 @@ int rmnet_unassociate_network_device(struct net_device *dev)
 	if (!config)
 		return RMNET_CONFIG_UNKNOWN_ERROR;
 
+	rmnet_map_agg_cleanup(config);
 	kfree(config);
 
 	netdev_rx_handler_unregister(dev);
@@ -830,7 +834,7 @@ int rmnet_associate_network_device(struct net_device *dev)
 
 	memset(config, 0, sizeof(struct rmnet_phys_ep_conf_s));
 	config->dev = dev;
-	spin_lock_init(&config->agg_lock);
+	rmnet_map_agg_init(config);
 
 	rc = netdev_rx_handler_register(dev, rmnet_rx_handler, config);
 
@@ -909,6 +913,7 @@ int _rmnet_unset_logical_endpoint_config(struct net_device *dev,
 				       int config_id)
 {
 	struct rmnet_logical_ep_conf_s *epconfig_l = 0;
+	struct rmnet_steer_map *map;
 
 	ASSERT_RTNL();
 
@@ -924,6 +929,11 @@ int _rmnet_unset_logical_endpoint_config(struct net_device *dev,
 	if (!epconfig_l || !epconfig_l->refcount)
 		return RMNET_CONFIG_NO_SUCH_DEVICE;
 
+	map = rtnl_dereference(epconfig_l->steer_map);
+	RCU_INIT_POINTER(epconfig_l->steer_map, NULL);
+	if (map)
+		kfree_rcu(map, rcu);
+
 	/* Explicitly release the reference from the egress device */
 	dev_put(epconfig_l->egress_dev);
 	memset(epconfig_l, 0, sizeof(struct rmnet_logical_ep_conf_s));
@@ -1058,6 +1068,149 @@ int rmnet_get_logical_endpoint_config(struct net_device *dev,
 	return RMNET_CONFIG_OK;
 }
 
+/**
+ * rmnet_set_logical_endpoint_cpus() - Sets the CPUs ingress flows of a
+ * logical endpoint are spread over
+ * @dev:            Device the logical endpoint is on
+ * @config_id:      logical endpoint id on device
+ * @cpus:           CPUs to steer to. An empty mask delivers every packet on
+ *                  the CPU which received it
+ *
+ * Each flow is always steered to the same CPU of the set, so changing the
+ * set may reorder the packets of a flow which are in flight at the time.
+ *
+ * Return:
+ *      - RMNET_CONFIG_OK if successful
+ *      - RMNET_CONFIG_NO_SUCH_DEVICE if the logical endpoint is not set
+ *      - RMNET_CONFIG_BAD_ARGUMENTS if logical endpoint id is out of range
+ *      - RMNET_CONFIG_NOMEM if the map could not be allocated
+ */
+int rmnet_set_logical_endpoint_cpus(struct net_device *dev,
+				    int config_id,
+				    const struct cpumask *cpus)
+{
+	struct rmnet_logical_ep_conf_s *epconfig_l;
+	struct rmnet_steer_map *map = 0, *old_map;
+	int cpu;
+
+	ASSERT_RTNL();
+
+	if (!dev)
+		return RMNET_CONFIG_NO_SUCH_DEVICE;
+
+	if (config_id < RMNET_LOCAL_LOGICAL_ENDPOINT
+		|| config_id >= RMNET_DATA_MAX_LOGICAL_EP)
+		return RMNET_CONFIG_BAD_ARGUMENTS;
+
+	epconfig_l = _rmnet_get_logical_ep(dev, config_id);
+
+	if (!epconfig_l || !epconfig_l->refcount)
+		return RMNET_CONFIG_NO_SUCH_DEVICE;
+
+	if (cpumask_intersects(cpus, cpu_possible_mask)) {
+		map = kzalloc(sizeof(*map) + cpumask_weight(cpus) *
+			      sizeof(map->cpus[0]), GFP_KERNEL);
+		if (!map)
+			return RMNET_CONFIG_NOMEM;
+
+		for_each_cpu_and(cpu, cpus, cpu_possible_mask)
+			map->cpus[map->len++] = cpu;
+	}
+
+	LOGL("(%s, %d); steering over %u CPUs", dev->name, config_id,
+	     map ? map->len : 0);
+
+	old_map = rtnl_dereference(epconfig_l->steer_map);
+	rcu_assign_pointer(epconfig_l->steer_map, map);
+	if (old_map)
+		kfree_rcu(old_map, rcu);
+
+	return RMNET_CONFIG_OK;
+}
+
+/**
+ * rmnet_ep_cpus_set() - Sets the steering CPUs of a logical endpoint
+ *
+ * Takes "<device> <logical endpoint id> <hex CPU mask>", for instance
+ * "rmnet_ipa0 1 f" to spread the flows of mux id 1 over CPUs 0-3.
+ */
+static int rmnet_ep_cpus_set(const char *val, const struct kernel_param *kp)
+{
+	char name[IFNAMSIZ];
+	struct net_device *dev;
+	cpumask_var_t cpus;
+	int config_id, off, rc;
+
+	if (sscanf(val, "%15s %d %n", name, &config_id, &off) != 2)
+		return -EINVAL;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	rc = cpumask_parse(val + off, cpus);
+	if (rc)
+		goto out;
+
+	rtnl_lock();
+	dev = __dev_get_by_name(&init_net, name);
+	if (!dev)
+		rc = -ENODEV;
+	else if (rmnet_set_logical_endpoint_cpus(dev, config_id, cpus)
+		 != RMNET_CONFIG_OK)
+		rc = -EINVAL;
+	rtnl_unlock();
+out:
+	free_cpumask_var(cpus);
+	return rc;
+}
+
+/**
+ * rmnet_ep_cpus_get() - Lists the steering CPUs of all logical endpoints
+ */
+static int rmnet_ep_cpus_get(char *buffer, const struct kernel_param *kp)
+{
+	struct rmnet_logical_ep_conf_s *epconfig_l;
+	struct rmnet_steer_map *map;
+	struct net_device *dev;
+	int config_id, len = 0;
+	unsigned int i;
+
+	rtnl_lock();
+	for_each_netdev(&init_net, dev) {
+		if (!_rmnet_is_physical_endpoint_associated(dev))
+			continue;
+
+		for (config_id = RMNET_LOCAL_LOGICAL_ENDPOINT;
+		     config_id < RMNET_DATA_MAX_LOGICAL_EP; config_id++) {
+			epconfig_l = _rmnet_get_logical_ep(dev, config_id);
+			if (!epconfig_l || !epconfig_l->refcount)
+				continue;
+
+			map = rtnl_dereference(epconfig_l->steer_map);
+			if (!map)
+				continue;
+
+			len += scnprintf(buffer + len, PAGE_SIZE - len,
+					 "%s %d", dev->name, config_id);
+			for (i = 0; i < map->len; i++)
+				len += scnprintf(buffer + len, PAGE_SIZE - len,
+						 "%c%u", i ? ',' : ' ',
+						 map->cpus[i]);
+			len += scnprintf(buffer + len, PAGE_SIZE - len, "\n");
+		}
+	}
+	rtnl_unlock();
+	return len;
+}
+
+static const struct kernel_param_ops rmnet_ep_cpus_ops = {
+	.set = rmnet_ep_cpus_set,
+	.get = rmnet_ep_cpus_get,
+};
+
+module_param_cb(ep_cpus, &rmnet_ep_cpus_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ep_cpus, "Steer logical endpoint flows: <dev> <ep> <mask>");
+
 /**
  * rmnet_create_vnd() - Create virtual network device node
  * @id:       RmNet virtual device node id
@@ -1211,6 +1364,7 @@ int rmnet_config_notify_cb(struct notifier_block *nb,
 		trace_rmnet_unregister_cb_entry(dev);
 		LOGH("Kernel is trying to unregister %s", dev->name);
 		rmnet_force_unassociate_device(dev);
+		rmnet_steer_flush_dev(dev);
 		trace_rmnet_unregister_cb_exit(dev);
 		break;
 
@@ -17,12 +17,28 @@
 #include <linux/types.h>
 #include <linux/time.h>
 #include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 
 #ifndef _RMNET_DATA_CONFIG_H_
 #define _RMNET_DATA_CONFIG_H_
 
 #define RMNET_DATA_MAX_LOGICAL_EP 256
 
+/**
+ * struct rmnet_steer_map - CPUs ingress flows of a logical endpoint go to
+ * @len:  Number of entries in @cpus
+ * @rcu:  Used to free the map once the ingress path is done with it
+ * @cpus: CPU numbers, indexed by the scaled flow hash
+ */
+struct rmnet_steer_map {
+	unsigned int len;
+	struct rcu_head rcu;
+	u16 cpus[0];
+};
+
 /**
  * struct rmnet_logical_ep_conf_s - Logical end-point configuration
  *
@@ -33,6 +49,8 @@
  * @mux_id: Virtual channel ID used by MAP protocol
  * @egress_dev: Next device to deliver the packet to. Exact usage of this
  *            parmeter depends on the rmnet_mode
+ * @steer_map: CPUs to spread ingress flows over in VND mode. NULL delivers
+ *            every packet on the CPU that received it
  */
 struct rmnet_logical_ep_conf_s {
 	uint8_t refcount;
@@ -40,6 +58,7 @@ struct rmnet_logical_ep_conf_s {
 	uint8_t mux_id;
 	struct timespec flush_time;
 	struct net_device *egress_dev;
+	struct rmnet_steer_map __rcu *steer_map;
 };
 
 /**
@@ -59,8 +78,15 @@ struct rmnet_logical_ep_conf_s {
  *                  Smaller of the two parameters above are chosen for
  *                  aggregation
  * @tail_spacing: Guaranteed padding (bytes) when de-aggregating ingress frames
- * @agg_time: Wall clock time when aggregated frame was created
+ * @agg_tail: Last packet chained to the frag_list of agg_skb
+ * @agg_count_limit: Packets after which the current aggregate is sent
+ * @agg_gap: Moving average of the time (ns) between egress packets
+ * @agg_wait: Sum of the times (ns) packets were queued after agg_time
+ * @agg_time: Time when aggregated frame was created
  * @agg_last: Last time the aggregation routing was invoked
+ * @agg_deadline: Time at which the current aggregate is sent at the latest
+ * @agg_timer: Fires at agg_deadline
+ * @agg_tasklet: Sends the aggregate when agg_timer fired
  */
 struct rmnet_phys_ep_conf_s {
 	struct net_device *dev;
@@ -79,10 +105,17 @@ struct rmnet_phys_ep_conf_s {
 	 */
 	spinlock_t agg_lock;
 	struct sk_buff *agg_skb;
+	struct sk_buff *agg_tail;
 	uint8_t agg_state;
-	uint8_t agg_count;
-	struct timespec agg_time;
-	struct timespec agg_last;
+	uint16_t agg_count;
+	uint16_t agg_count_limit;
+	uint32_t agg_gap;
+	uint64_t agg_wait;
+	ktime_t agg_time;
+	ktime_t agg_last;
+	ktime_t agg_deadline;
+	struct hrtimer agg_timer;
+	struct tasklet_struct agg_tasklet;
 };
 
 int rmnet_config_init(void);
@@ -111,6 +144,9 @@ int rmnet_unset_logical_endpoint_config(struct net_device *dev,
 int _rmnet_get_logical_endpoint_config(struct net_device *dev,
 				       int config_id,
 				      struct rmnet_logical_ep_conf_s *epconfig);
+int rmnet_set_logical_endpoint_cpus(struct net_device *dev,
+				    int config_id,
+				    const struct cpumask *cpus);
 int rmnet_get_logical_endpoint_config(struct net_device *dev,
 				      int config_id,
 				      uint8_t *rmnet_mode,
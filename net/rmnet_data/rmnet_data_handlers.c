@@ -25,16 +25,13 @@
 #include "rmnet_data_private.h"
 #include "rmnet_data_config.h"
 #include "rmnet_data_vnd.h"
+#include "rmnet_data_handlers.h"
 #include "rmnet_map.h"
 #include "rmnet_data_stats.h"
 #include "rmnet_data_trace.h"
 
 RMNET_LOG_MODULE(RMNET_DATA_LOGMASK_HANDLER);
 
-
-void rmnet_egress_handler(struct sk_buff *skb,
-			  struct rmnet_logical_ep_conf_s *ep);
-
 #ifdef CONFIG_RMNET_DATA_DEBUG_PKT
 unsigned int dump_pkt_rx;
 module_param(dump_pkt_rx, uint, S_IRUGO | S_IWUSR);
@@ -224,6 +221,8 @@ static int rmnet_check_skb_can_gro(struct sk_buff *skb)
 
 /**
  * rmnet_optional_gro_flush() - Check if GRO handler needs to flush now
+ * @napi:       NAPI context the packets were coalesced on
+ * @flush_time: Time of the last flush on @napi
  *
  * Determines whether GRO handler needs to flush packets which it has
  * coalesced so far.
@@ -232,30 +231,78 @@ static int rmnet_check_skb_can_gro(struct sk_buff *skb)
  * ratio.
  */
 static void rmnet_optional_gro_flush(struct napi_struct *napi,
-				     struct rmnet_logical_ep_conf_s *ep)
+				     struct timespec *flush_time)
 {
 	struct timespec curr_time, diff;
 
 	if (!gro_flush_time)
 		return;
 
-	if (unlikely(ep->flush_time.tv_sec == 0)) {
-		getnstimeofday(&ep->flush_time);
+	if (unlikely(flush_time->tv_sec == 0)) {
+		getnstimeofday(flush_time);
 	} else {
 		getnstimeofday(&(curr_time));
-		diff = timespec_sub(curr_time, ep->flush_time);
+		diff = timespec_sub(curr_time, *flush_time);
 		if ((diff.tv_sec > 0) || (diff.tv_nsec > gro_flush_time)) {
 			napi_gro_flush(napi, false);
-			getnstimeofday(&ep->flush_time);
+			getnstimeofday(flush_time);
+		}
+	}
+}
+
+/**
+ * rmnet_deliver_vnd_skb() - Deliver skb to the virtual network device
+ * @skb:        Packet to deliver; skb->dev is the VND
+ * @flush_time: GRO flush time of the current NAPI context
+ *
+ * Hands the packet to GRO on the NAPI context being polled on this CPU, or
+ * straight to the network stack if it cannot be coalesced.
+ *
+ * Return:
+ *      - RX_HANDLER_CONSUMED if packet forwarded or dropped
+ *      - RX_HANDLER_PASS if packet is to be consumed by network stack as-is
+ */
+rx_handler_result_t rmnet_deliver_vnd_skb(struct sk_buff *skb,
+					  struct timespec *flush_time)
+{
+	struct napi_struct *napi = NULL;
+	gro_result_t gro_res;
+
+	skb_reset_transport_header(skb);
+	skb_reset_network_header(skb);
+	switch (rmnet_vnd_rx_fixup(skb, skb->dev)) {
+	case RX_HANDLER_CONSUMED:
+		return RX_HANDLER_CONSUMED;
+
+	case RX_HANDLER_PASS:
+		skb->pkt_type = PACKET_HOST;
+		rmnet_reset_mac_header(skb);
+		if (rmnet_check_skb_can_gro(skb) &&
+		    (skb->dev->features & NETIF_F_GRO)) {
+			napi = get_current_napi_context();
+			if (napi != NULL) {
+				gro_res = napi_gro_receive(napi, skb);
+				trace_rmnet_gro_downlink(gro_res);
+				rmnet_optional_gro_flush(napi, flush_time);
+			} else {
+				WARN_ONCE(1, "current napi is NULL\n");
+				netif_receive_skb(skb);
+			}
+		} else {
+			netif_receive_skb(skb);
 		}
+		return RX_HANDLER_CONSUMED;
 	}
+	return RX_HANDLER_PASS;
 }
 
 /**
  * __rmnet_deliver_skb() - Deliver skb
  *
  * Determines where to deliver skb. Options are: consume by network stack,
- * pass to bridge handler, or pass to virtual network device
+ * pass to bridge handler, or pass to virtual network device. Packets for a
+ * virtual network device are first offered to flow steering, which may
+ * deliver them on another CPU.
  *
  * Return:
  *      - RX_HANDLER_CONSUMED if packet forwarded or dropped
@@ -264,9 +311,6 @@ static void rmnet_optional_gro_flush(struct napi_struct *napi,
 static rx_handler_result_t __rmnet_deliver_skb(struct sk_buff *skb,
 					 struct rmnet_logical_ep_conf_s *ep)
 {
-	struct napi_struct *napi = NULL;
-	gro_result_t gro_res;
-
 	trace___rmnet_deliver_skb(skb);
 	switch (ep->rmnet_mode) {
 	case RMNET_EPMODE_NONE:
@@ -276,32 +320,9 @@ static rx_handler_result_t __rmnet_deliver_skb(struct sk_buff *skb,
 		return rmnet_bridge_handler(skb, ep);
 
 	case RMNET_EPMODE_VND:
-		skb_reset_transport_header(skb);
-		skb_reset_network_header(skb);
-		switch (rmnet_vnd_rx_fixup(skb, skb->dev)) {
-		case RX_HANDLER_CONSUMED:
-			return RX_HANDLER_CONSUMED;
-
-		case RX_HANDLER_PASS:
-			skb->pkt_type = PACKET_HOST;
-			rmnet_reset_mac_header(skb);
-			if (rmnet_check_skb_can_gro(skb) &&
-			    (skb->dev->features & NETIF_F_GRO)) {
-				napi = get_current_napi_context();
-				if (napi != NULL) {
-					gro_res = napi_gro_receive(napi, skb);
-					trace_rmnet_gro_downlink(gro_res);
-					rmnet_optional_gro_flush(napi, ep);
-				} else {
-					WARN_ONCE(1, "current napi is NULL\n");
-					netif_receive_skb(skb);
-				}
-			} else {
-				netif_receive_skb(skb);
-			}
+		if (rmnet_steer_skb(skb, ep))
 			return RX_HANDLER_CONSUMED;
-		}
-		return RX_HANDLER_PASS;
+		return rmnet_deliver_vnd_skb(skb, &ep->flush_time);
 
 	default:
 		LOGD("Unkown ep mode %d", ep->rmnet_mode);
@@ -420,7 +441,7 @@ static rx_handler_result_t _rmnet_map_ingress_handler(struct sk_buff *skb,
 
 	/* Subtract MAP header */
 	skb_pull(skb, sizeof(struct rmnet_map_header_s));
-	skb_trim(skb, len);
+	pskb_trim(skb, len);
 	__rmnet_data_set_skb_proto(skb);
 	return __rmnet_deliver_skb(skb, ep);
 }
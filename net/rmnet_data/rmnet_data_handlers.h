@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ * Copyright (c) 2013, 2016 The Linux Foundation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 and
@@ -21,5 +21,12 @@ void rmnet_egress_handler(struct sk_buff *skb,
 			  struct rmnet_logical_ep_conf_s *ep);
 
 rx_handler_result_t rmnet_rx_handler(struct sk_buff **pskb);
+rx_handler_result_t rmnet_deliver_vnd_skb(struct sk_buff *skb,
+					  struct timespec *flush_time);
+
+int rmnet_steer_skb(struct sk_buff *skb, struct rmnet_logical_ep_conf_s *ep);
+void rmnet_steer_flush_dev(struct net_device *dev);
+int rmnet_steer_init(void);
+void rmnet_steer_exit(void);
 
 #endif /* _RMNET_DATA_HANDLERS_H_ */
@@ -18,9 +18,11 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/export.h>
+#include <linux/netdevice.h>
 #include "rmnet_data_private.h"
 #include "rmnet_data_config.h"
 #include "rmnet_data_vnd.h"
+#include "rmnet_data_handlers.h"
 
 /* ***************** Trace Points ******************************************* */
 #define CREATE_TRACE_POINTS
@@ -44,6 +46,7 @@ MODULE_PARM_DESC(rmnet_data_log_module_mask, "Logging module mask");
  */
 static int __init rmnet_init(void)
 {
+	rmnet_steer_init();
 	rmnet_config_init();
 	rmnet_vnd_init();
 
@@ -54,6 +57,7 @@ static int __init rmnet_init(void)
 static void __exit rmnet_exit(void)
 {
 	rmnet_config_exit();
+	rmnet_steer_exit();
 	rmnet_vnd_exit();
 }
 
@@ -21,6 +21,8 @@
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 #include <linux/netdevice.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include "rmnet_data_private.h"
 #include "rmnet_data_stats.h"
 #include "rmnet_data_config.h"
@@ -32,6 +34,15 @@ enum rmnet_deagg_e {
 	RMNET_STATS_AGG_MAX
 };
 
+enum rmnet_agg_latency_e {
+	RMNET_STATS_AGG_LATENCY_TOTAL_US,
+	RMNET_STATS_AGG_LATENCY_MAX_US,
+	RMNET_STATS_AGG_LATENCY_MAX
+};
+
+/* Aggregates of 1, 2-3, 4-7, ... and 64 or more packets */
+#define RMNET_STATS_AGG_DEPTH_MAX 7
+
 static DEFINE_SPINLOCK(rmnet_skb_free_lock);
 unsigned long int skb_free[RMNET_STATS_SKBFREE_MAX];
 module_param_array(skb_free, ulong, 0, S_IRUGO);
@@ -52,6 +63,14 @@ unsigned long int agg_count[RMNET_STATS_AGG_MAX];
 module_param_array(agg_count, ulong, 0, S_IRUGO);
 MODULE_PARM_DESC(agg_count, "SKBs Aggregated");
 
+unsigned long int agg_depth[RMNET_STATS_AGG_DEPTH_MAX];
+module_param_array(agg_depth, ulong, 0, S_IRUGO);
+MODULE_PARM_DESC(agg_depth, "Aggregates by packets: 1, 2-3, 4-7, ..., 64+");
+
+unsigned long int agg_latency[RMNET_STATS_AGG_LATENCY_MAX];
+module_param_array(agg_latency, ulong, 0, S_IRUGO);
+MODULE_PARM_DESC(agg_latency, "Aggregation delay (us): total, max");
+
 static DEFINE_SPINLOCK(rmnet_checksum_dl_stats);
 unsigned long int checksum_dl_stats[RMNET_MAP_CHECKSUM_ENUM_LENGTH];
 module_param_array(checksum_dl_stats, ulong, 0, S_IRUGO);
@@ -91,13 +110,29 @@ void rmnet_stats_queue_xmit(int rc, unsigned int reason)
 	spin_unlock_irqrestore(&rmnet_queue_xmit_lock, flags);
 }
 
-void rmnet_stats_agg_pkts(int aggcount)
+/**
+ * rmnet_stats_agg_pkts() - Accounts for a transmitted aggregate
+ * @aggcount:   Number of packets in the aggregate
+ * @wait_ns:    Sum of the time its packets were held back
+ * @max_ns:     Time its first packet was held back
+ */
+void rmnet_stats_agg_pkts(int aggcount, u64 wait_ns, u64 max_ns)
 {
 	unsigned long flags;
+	unsigned long max_us = div_u64(max_ns, NSEC_PER_USEC);
+	int depth = aggcount > 1 ? ilog2(aggcount) : 0;
+
+	if (depth >= RMNET_STATS_AGG_DEPTH_MAX)
+		depth = RMNET_STATS_AGG_DEPTH_MAX - 1;
 
 	spin_lock_irqsave(&rmnet_agg_count, flags);
 	agg_count[RMNET_STATS_AGG_BUFF]++;
 	agg_count[RMNET_STATS_AGG_PKT] += aggcount;
+	agg_depth[depth]++;
+	agg_latency[RMNET_STATS_AGG_LATENCY_TOTAL_US] +=
+		div_u64(wait_ns, NSEC_PER_USEC);
+	if (max_us > agg_latency[RMNET_STATS_AGG_LATENCY_MAX_US])
+		agg_latency[RMNET_STATS_AGG_LATENCY_MAX_US] = max_us;
 	spin_unlock_irqrestore(&rmnet_agg_count, flags);
 }
 
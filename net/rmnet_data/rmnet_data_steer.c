@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * RMNET Data ingress flow steering
+ *
+ * A logical endpoint with a steering map hashes the IP 5-tuple of every
+ * packet it delivers to a virtual network device and queues the packet to
+ * a per-CPU backlog picked from the map. Each backlog is drained by its own
+ * NAPI context on its CPU, so GRO coalesces per CPU and the flushing done
+ * by rmnet_deliver_vnd_skb() keeps working. All packets of a flow go
+ * through the same backlog, which keeps them in order. Packets of a CPU
+ * that goes offline are handed, in order, to the CPU that replaces it.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/cpu.h>
+#include "rmnet_data_config.h"
+#include "rmnet_data_handlers.h"
+#include "rmnet_data_stats.h"
+
+#define RMNET_STEER_NAPI_WEIGHT 64
+
+unsigned int steer_backlog __read_mostly = 1000;
+module_param(steer_backlog, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(steer_backlog, "Max packets queued to a steering CPU");
+
+/**
+ * struct rmnet_steer_cpu - Per-CPU steering backlog
+ * @input_queue:   Packets queued by other CPUs, protected by its lock
+ * @process_queue: Packets being delivered; only touched by the owner CPU
+ *                 with interrupts disabled
+ * @napi:          NAPI context draining the queues on the owner CPU
+ * @csd:           IPI used to schedule @napi from another CPU
+ * @flush_time:    Last time GRO was flushed on @napi
+ */
+struct rmnet_steer_cpu {
+	struct sk_buff_head input_queue;
+	struct sk_buff_head process_queue;
+	struct napi_struct napi;
+	struct call_single_data csd;
+	struct timespec flush_time;
+};
+
+static DEFINE_PER_CPU_ALIGNED(struct rmnet_steer_cpu, rmnet_steer_cpus);
+
+/* NAPI contexts need a device; this one is never registered */
+static struct net_device rmnet_steer_dev;
+
+/* ***************** Backlog ************************************************ */
+
+/* Called from hardirq (IPI) context on the CPU owning the backlog */
+static void rmnet_steer_ipi(void *data)
+{
+	struct rmnet_steer_cpu *sc = data;
+
+	__napi_schedule(&sc->napi);
+}
+
+static void rmnet_steer_move(struct rmnet_steer_cpu *oldsc, int oldcpu,
+			     bool unschedule);
+
+/**
+ * rmnet_steer_kick() - Run the backlog NAPI context of a CPU
+ * @sc:         Backlog whose NAPI_STATE_SCHED the caller set
+ * @cpu:        CPU owning @sc
+ *
+ * If the IPI cannot be sent because @cpu went offline, the backlog is
+ * handed to the CPU replacing @cpu, so that its packets stay in order
+ * with the ones steered there from now on.
+ */
+static void rmnet_steer_kick(struct rmnet_steer_cpu *sc, int cpu)
+{
+	if (cpu == smp_processor_id())
+		__napi_schedule(&sc->napi);
+	else if (smp_call_function_single_async(cpu, &sc->csd))
+		rmnet_steer_move(sc, cpu, true);
+}
+
+/**
+ * rmnet_steer_enqueue() - Queue a packet to the backlog of a CPU
+ * @skb:        Packet to queue
+ * @cpu:        CPU to deliver the packet on
+ *
+ * Whoever sets NAPI_STATE_SCHED of the backlog NAPI context schedules it,
+ * either directly or with an IPI to @cpu. The poll routine clears the bit
+ * under the input queue lock once it found the queue empty, so a packet
+ * is never left behind without a poll pending.
+ */
+static void rmnet_steer_enqueue(struct sk_buff *skb, int cpu)
+{
+	struct rmnet_steer_cpu *sc = &per_cpu(rmnet_steer_cpus, cpu);
+	unsigned long flags;
+	int schedule = 0;
+
+	spin_lock_irqsave(&sc->input_queue.lock, flags);
+	if (unlikely(skb_queue_len(&sc->input_queue) >= steer_backlog)) {
+		spin_unlock_irqrestore(&sc->input_queue.lock, flags);
+		rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_STEER_BACKLOG);
+		return;
+	}
+
+	__skb_queue_tail(&sc->input_queue, skb);
+	if (!test_bit(NAPI_STATE_SCHED, &sc->napi.state) &&
+	    !test_and_set_bit(NAPI_STATE_SCHED, &sc->napi.state))
+		schedule = 1;
+	spin_unlock_irqrestore(&sc->input_queue.lock, flags);
+
+	if (schedule)
+		rmnet_steer_kick(sc, cpu);
+}
+
+/**
+ * rmnet_steer_poll() - NAPI poll routine of a steering backlog
+ * @napi:       Backlog NAPI context
+ * @budget:     Maximum number of packets to deliver
+ *
+ * Delivers queued packets through rmnet_deliver_vnd_skb(), which finds
+ * @napi as the current NAPI context and coalesces on it.
+ *
+ * Return:
+ *      - Number of packets delivered
+ */
+static int rmnet_steer_poll(struct napi_struct *napi, int budget)
+{
+	struct rmnet_steer_cpu *sc;
+	struct sk_buff *skb;
+	int work = 0;
+
+	sc = container_of(napi, struct rmnet_steer_cpu, napi);
+
+again:
+	local_irq_disable();
+	while (1) {
+		while ((skb = __skb_dequeue(&sc->process_queue))) {
+			rcu_read_lock();
+			local_irq_enable();
+			rmnet_deliver_vnd_skb(skb, &sc->flush_time);
+			rcu_read_unlock();
+			local_irq_disable();
+			if (++work >= budget) {
+				local_irq_enable();
+				return work;
+			}
+		}
+
+		spin_lock(&sc->input_queue.lock);
+		if (skb_queue_empty(&sc->input_queue)) {
+			spin_unlock(&sc->input_queue.lock);
+			break;
+		}
+		skb_queue_splice_tail_init(&sc->input_queue,
+					   &sc->process_queue);
+		spin_unlock(&sc->input_queue.lock);
+	}
+	local_irq_enable();
+
+	/* __napi_complete() needs an empty GRO list, and flushing it may
+	 * race with new packets being queued, so check again afterwards.
+	 */
+	napi_gro_flush(napi, false);
+
+	local_irq_disable();
+	spin_lock(&sc->input_queue.lock);
+	if (!skb_queue_empty(&sc->input_queue)) {
+		spin_unlock(&sc->input_queue.lock);
+		local_irq_enable();
+		goto again;
+	}
+	__napi_complete(napi);
+	spin_unlock(&sc->input_queue.lock);
+	local_irq_enable();
+
+	return work;
+}
+
+/* ***************** Steering *********************************************** */
+
+/* The online CPU after @cpu, which takes over its flows while it is offline */
+static int rmnet_steer_fallback_cpu(int cpu)
+{
+	int next = cpumask_next(cpu, cpu_online_mask);
+
+	if (next >= nr_cpu_ids)
+		next = cpumask_first(cpu_online_mask);
+	return next;
+}
+
+/**
+ * rmnet_steer_skb() - Steer an ingress packet to the CPU of its flow
+ * @skb:        Packet to deliver to a virtual network device
+ * @ep:         Logical endpoint the packet arrived on
+ *
+ * Must be called under rcu_read_lock(), as the rx_handler is. The flow
+ * hash is stored in the packet, so RPS/RFS further up do not compute it
+ * again. A map CPU which went offline is replaced by the next online CPU,
+ * the one its queued packets are moved to.
+ *
+ * Return:
+ *      - 1 if the packet was queued or dropped
+ *      - 0 if the endpoint has no steering map and the caller delivers
+ */
+int rmnet_steer_skb(struct sk_buff *skb, struct rmnet_logical_ep_conf_s *ep)
+{
+	struct rmnet_steer_map *map;
+	int cpu;
+
+	map = rcu_dereference(ep->steer_map);
+	if (!map)
+		return 0;
+
+	skb_reset_network_header(skb);
+	cpu = map->cpus[reciprocal_scale(skb_get_hash(skb), map->len)];
+	if (unlikely(!cpu_online(cpu)))
+		cpu = rmnet_steer_fallback_cpu(cpu);
+
+	rmnet_steer_enqueue(skb, cpu);
+	return 1;
+}
+
+/* Called from hardirq (IPI) context on every CPU */
+static void rmnet_steer_flush_backlog(void *arg)
+{
+	struct rmnet_steer_cpu *sc = this_cpu_ptr(&rmnet_steer_cpus);
+	struct net_device *dev = arg;
+	struct sk_buff *skb, *tmp;
+
+	spin_lock(&sc->input_queue.lock);
+	skb_queue_walk_safe(&sc->input_queue, skb, tmp) {
+		if (skb->dev == dev) {
+			__skb_unlink(skb, &sc->input_queue);
+			kfree_skb(skb);
+		}
+	}
+	spin_unlock(&sc->input_queue.lock);
+
+	skb_queue_walk_safe(&sc->process_queue, skb, tmp) {
+		if (skb->dev == dev) {
+			__skb_unlink(skb, &sc->process_queue);
+			kfree_skb(skb);
+		}
+	}
+}
+
+/**
+ * rmnet_steer_flush_dev() - Drop steered packets of a device
+ * @dev:        Device being unregistered
+ *
+ * Packets sitting in a backlog do not hold a reference on skb->dev.
+ */
+void rmnet_steer_flush_dev(struct net_device *dev)
+{
+	on_each_cpu(rmnet_steer_flush_backlog, dev, 1);
+}
+
+/**
+ * rmnet_steer_move() - Move the queued packets of an offline CPU
+ * @oldsc:      Backlog of the offline CPU
+ * @oldcpu:     Offline CPU
+ * @unschedule: Whether to clear NAPI_STATE_SCHED of @oldsc, which the
+ *              caller set without scheduling the NAPI context
+ *
+ * Packets steered since @oldcpu went offline already went to its fallback
+ * CPU, so the ones left in the backlog are older and go to the head of the
+ * fallback input queue. The caller makes sure nothing polls @oldsc
+ * concurrently.
+ */
+static void rmnet_steer_move(struct rmnet_steer_cpu *oldsc, int oldcpu,
+			     bool unschedule)
+{
+	struct rmnet_steer_cpu *sc;
+	struct sk_buff_head queue;
+	unsigned long flags;
+	int cpu, schedule = 0;
+
+	__skb_queue_head_init(&queue);
+
+	local_irq_save(flags);
+	spin_lock(&oldsc->input_queue.lock);
+	skb_queue_splice_init(&oldsc->process_queue, &queue);
+	skb_queue_splice_tail_init(&oldsc->input_queue, &queue);
+	if (unschedule)
+		clear_bit(NAPI_STATE_SCHED, &oldsc->napi.state);
+	spin_unlock(&oldsc->input_queue.lock);
+
+	if (skb_queue_empty(&queue))
+		goto out;
+
+	cpu = rmnet_steer_fallback_cpu(oldcpu);
+	sc = &per_cpu(rmnet_steer_cpus, cpu);
+	spin_lock(&sc->input_queue.lock);
+	skb_queue_splice(&queue, &sc->input_queue);
+	if (!test_and_set_bit(NAPI_STATE_SCHED, &sc->napi.state))
+		schedule = 1;
+	spin_unlock(&sc->input_queue.lock);
+
+	if (schedule)
+		rmnet_steer_kick(sc, cpu);
+out:
+	local_irq_restore(flags);
+}
+
+/*
+ * Runs on the CPU that took the dead one down, with the dead CPU's NAPI
+ * poll list already moved, or about to be moved, to this CPU by the core.
+ * A scheduled backlog of the dead CPU is thus only polled here, and not
+ * while interrupts are disabled, so its queues can be taken over. The
+ * poll then finds them empty and completes.
+ */
+static int rmnet_steer_cpu_callback(struct notifier_block *nfb,
+				    unsigned long action, void *hcpu)
+{
+	unsigned int oldcpu = (unsigned long)hcpu;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		rmnet_steer_move(&per_cpu(rmnet_steer_cpus, oldcpu), oldcpu,
+				 false);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block rmnet_steer_cpu_notifier = {
+	.notifier_call = rmnet_steer_cpu_callback,
+};
+
+/* ***************** Init and Cleanup *************************************** */
+
+int rmnet_steer_init(void)
+{
+	struct rmnet_steer_cpu *sc;
+	int cpu;
+
+	init_dummy_netdev(&rmnet_steer_dev);
+
+	for_each_possible_cpu(cpu) {
+		sc = &per_cpu(rmnet_steer_cpus, cpu);
+		skb_queue_head_init(&sc->input_queue);
+		__skb_queue_head_init(&sc->process_queue);
+		sc->csd.func = rmnet_steer_ipi;
+		sc->csd.info = sc;
+		netif_napi_add(&rmnet_steer_dev, &sc->napi, rmnet_steer_poll,
+			       RMNET_STEER_NAPI_WEIGHT);
+		napi_enable(&sc->napi);
+	}
+	return register_hotcpu_notifier(&rmnet_steer_cpu_notifier);
+}
+
+void rmnet_steer_exit(void)
+{
+	struct rmnet_steer_cpu *sc;
+	int cpu;
+
+	unregister_hotcpu_notifier(&rmnet_steer_cpu_notifier);
+	for_each_possible_cpu(cpu) {
+		sc = &per_cpu(rmnet_steer_cpus, cpu);
+		napi_disable(&sc->napi);
+		netif_napi_del(&sc->napi);
+		skb_queue_purge(&sc->input_queue);
+		__skb_queue_purge(&sc->process_queue);
+	}
+}
@@ -131,9 +131,14 @@ enum rmnet_map_agg_state_e {
 #define RMNET_MAP_NO_PAD_BYTES        0
 #define RMNET_MAP_ADD_PAD_BYTES       1
 
+extern unsigned int deagg_copybreak;
+
 uint8_t rmnet_map_demultiplex(struct sk_buff *skb);
 struct sk_buff *rmnet_map_deaggregate(struct sk_buff *skb,
 				      struct rmnet_phys_ep_conf_s *config);
+struct sk_buff *__rmnet_map_deaggregate(struct sk_buff *skb,
+					struct rmnet_phys_ep_conf_s *config,
+					unsigned int copybreak);
 
 struct rmnet_map_header_s *rmnet_map_add_map_header(struct sk_buff *skb,
 						    int hdrlen, int pad);
@@ -141,6 +146,8 @@ rx_handler_result_t rmnet_map_command(struct sk_buff *skb,
 				      struct rmnet_phys_ep_conf_s *config);
 void rmnet_map_aggregate(struct sk_buff *skb,
 			 struct rmnet_phys_ep_conf_s *config);
+void rmnet_map_agg_init(struct rmnet_phys_ep_conf_s *config);
+void rmnet_map_agg_cleanup(struct rmnet_phys_ep_conf_s *config);
 
 int rmnet_map_checksum_downlink_packet(struct sk_buff *skb);
 int rmnet_map_checksum_uplink_packet(struct sk_buff *skb,
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * RMNET Data MAP de-aggregation benchmark
+ *
+ * Writing a frame count to the deagg_bench parameter injects that many
+ * synthetic aggregated MAP frames, received on a dummy net_device, into
+ * __rmnet_map_deaggregate() for each way a packet can be taken out of a
+ * frame, and reading the parameter back shows the cost per packet:
+ *
+ *   echo 10000 > /sys/module/rmnet_data/parameters/deagg_bench
+ *   cat /sys/module/rmnet_data/parameters/deagg_bench
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/rmnet_data.h>
+#include <linux/net_map.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <linux/in.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include "rmnet_data_config.h"
+#include "rmnet_map.h"
+
+#define RMNET_MAP_BENCH_PKTS	32
+#define RMNET_MAP_BENCH_PKTLEN	1500
+
+enum rmnet_map_bench_mode_e {
+	RMNET_MAP_BENCH_COPY,	/* copybreak above the packet size */
+	RMNET_MAP_BENCH_FRAG,	/* frame head is a page fragment */
+	RMNET_MAP_BENCH_CLONE,	/* frame head is kmalloc'ed */
+	RMNET_MAP_BENCH_MAX
+};
+
+static const char * const rmnet_map_bench_names[RMNET_MAP_BENCH_MAX] = {
+	"copy", "frag", "clone"
+};
+
+static DEFINE_MUTEX(rmnet_map_bench_lock);
+static u64 rmnet_map_bench_ns[RMNET_MAP_BENCH_MAX];
+static unsigned long rmnet_map_bench_pkts;
+
+static struct sk_buff *rmnet_map_bench_alloc(int mode, unsigned int size)
+{
+	struct sk_buff *skb;
+	struct page *page;
+	unsigned int truesize;
+
+	if (mode != RMNET_MAP_BENCH_FRAG)
+		return alloc_skb(size, GFP_KERNEL);
+
+	/* What a driver receiving into pages builds with build_skb() */
+	truesize = SKB_DATA_ALIGN(size) +
+		   SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	page = alloc_pages(GFP_KERNEL | __GFP_COMP, get_order(truesize));
+	if (!page)
+		return 0;
+
+	skb = build_skb(page_address(page), PAGE_SIZE << compound_order(page));
+	if (!skb)
+		__free_pages(page, compound_order(page));
+	return skb;
+}
+
+/**
+ * rmnet_map_bench_frame() - Builds a synthetic aggregated MAP frame
+ * @dev:        Device the frame is received on
+ * @mode:       Kind of buffer to build the frame in
+ *
+ * The frame holds RMNET_MAP_BENCH_PKTS UDP/IPv4 packets of
+ * RMNET_MAP_BENCH_PKTLEN bytes each, behind MAP headers for mux id 1.
+ *
+ * Return:
+ *     - Pointer to the frame
+ *     - 0 (null) if allocation failed
+ */
+static struct sk_buff *rmnet_map_bench_frame(struct net_device *dev, int mode)
+{
+	struct rmnet_map_header_s *maph;
+	struct sk_buff *skb;
+	struct iphdr *iph;
+	struct udphdr *uh;
+	int i;
+
+	skb = rmnet_map_bench_alloc(mode, RMNET_MAP_BENCH_PKTS *
+			(sizeof(*maph) + RMNET_MAP_BENCH_PKTLEN));
+	if (!skb)
+		return 0;
+
+	skb->dev = dev;
+	for (i = 0; i < RMNET_MAP_BENCH_PKTS; i++) {
+		maph = (struct rmnet_map_header_s *)skb_put(skb, sizeof(*maph));
+		memset(maph, 0, sizeof(*maph));
+		maph->mux_id = 1;
+		maph->pkt_len = htons(RMNET_MAP_BENCH_PKTLEN);
+
+		iph = (struct iphdr *)skb_put(skb, RMNET_MAP_BENCH_PKTLEN);
+		memset(iph, 0, RMNET_MAP_BENCH_PKTLEN);
+		iph->version = 4;
+		iph->ihl = 5;
+		iph->ttl = 64;
+		iph->protocol = IPPROTO_UDP;
+		iph->tot_len = htons(RMNET_MAP_BENCH_PKTLEN);
+		iph->saddr = htonl(0x0a000001);
+		iph->daddr = htonl(0x0a000002);
+		iph->check = ip_fast_csum((unsigned char *)iph, iph->ihl);
+
+		uh = (struct udphdr *)(iph + 1);
+		uh->source = htons(5000 + i);
+		uh->dest = htons(5001);
+		uh->len = htons(RMNET_MAP_BENCH_PKTLEN - sizeof(*iph));
+	}
+	return skb;
+}
+
+static int rmnet_map_bench_run(unsigned long frames)
+{
+	struct rmnet_phys_ep_conf_s *config;
+	struct net_device *dev;
+	struct sk_buff *skb, *skbn;
+	unsigned int copybreak;
+	unsigned long i;
+	ktime_t start;
+	int mode, rc = 0;
+
+	config = kzalloc(sizeof(*config), GFP_KERNEL);
+	dev = alloc_netdev(0, "rmnet_bench%d", NET_NAME_UNKNOWN, ether_setup);
+	if (!config || !dev) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	config->dev = dev;
+	config->ingress_data_format = RMNET_INGRESS_FORMAT_DEAGGREGATION |
+				      RMNET_INGRESS_FORMAT_MAP;
+
+	for (mode = 0; mode < RMNET_MAP_BENCH_MAX; mode++) {
+		copybreak = mode == RMNET_MAP_BENCH_COPY ?
+			    UINT_MAX : ACCESS_ONCE(deagg_copybreak);
+		rmnet_map_bench_ns[mode] = 0;
+
+		for (i = 0; i < frames; i++) {
+			skb = rmnet_map_bench_frame(dev, mode);
+			if (!skb) {
+				rc = -ENOMEM;
+				break;
+			}
+
+			/* Deliver as _rmnet_map_ingress_handler() would */
+			start = ktime_get();
+			while ((skbn = __rmnet_map_deaggregate(skb, config,
+							       copybreak))) {
+				skb_pull(skbn, sizeof(struct rmnet_map_header_s));
+				pskb_trim(skbn, RMNET_MAP_BENCH_PKTLEN);
+				consume_skb(skbn);
+			}
+			rmnet_map_bench_ns[mode] +=
+				ktime_to_ns(ktime_sub(ktime_get(), start));
+			consume_skb(skb);
+			cond_resched();
+		}
+	}
+	rmnet_map_bench_pkts = frames * RMNET_MAP_BENCH_PKTS;
+
+out:
+	if (dev)
+		free_netdev(dev);
+	kfree(config);
+	return rc;
+}
+
+static int rmnet_map_bench_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned long frames;
+	int rc;
+
+	rc = kstrtoul(val, 0, &frames);
+	if (rc || !frames)
+		return -EINVAL;
+
+	mutex_lock(&rmnet_map_bench_lock);
+	rc = rmnet_map_bench_run(frames);
+	mutex_unlock(&rmnet_map_bench_lock);
+	return rc;
+}
+
+static int rmnet_map_bench_get(char *buffer, const struct kernel_param *kp)
+{
+	int mode, len = 0;
+
+	mutex_lock(&rmnet_map_bench_lock);
+	if (!rmnet_map_bench_pkts)
+		goto out;
+
+	for (mode = 0; mode < RMNET_MAP_BENCH_MAX; mode++)
+		len += scnprintf(buffer + len, PAGE_SIZE - len,
+				 "%-6s %llu ns/pkt\n",
+				 rmnet_map_bench_names[mode],
+				 div64_u64(rmnet_map_bench_ns[mode],
+					   rmnet_map_bench_pkts));
+out:
+	mutex_unlock(&rmnet_map_bench_lock);
+	return len;
+}
+
+static const struct kernel_param_ops rmnet_map_bench_ops = {
+	.set = rmnet_map_bench_set,
+	.get = rmnet_map_bench_get,
+};
+
+module_param_cb(deagg_bench, &rmnet_map_bench_ops, NULL, S_IRUSR | S_IWUSR);
+MODULE_PARM_DESC(deagg_bench, "Run the MAP de-aggregation benchmark");
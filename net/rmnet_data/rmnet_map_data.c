@@ -20,8 +20,10 @@
 #include <linux/netdevice.h>
 #include <linux/rmnet_data.h>
 #include <linux/spinlock.h>
-#include <linux/workqueue.h>
-#include <linux/time.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/net_map.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
@@ -49,14 +51,17 @@ long agg_bypass_time __read_mostly = 10000000L;
 module_param(agg_bypass_time, long, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(agg_bypass_time, "Skip agg when apart spaced more than this");
 
+unsigned int deagg_copybreak __read_mostly = 256;
+module_param(deagg_copybreak, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(deagg_copybreak, "Copy de-aggregated packets up to this size");
 
-struct agg_work {
-	struct delayed_work work;
-	struct rmnet_phys_ep_conf_s *config;
-};
+/* Weight of a new sample in agg_gap, as a shift */
+#define RMNET_MAP_AGG_GAP_SHIFT   2
 
 #define RMNET_MAP_DEAGGR_SPACING  64
 #define RMNET_MAP_DEAGGR_HEADROOM (RMNET_MAP_DEAGGR_SPACING/2)
+/* Copied into the linear area of a zero-copy packet: MAP, IP and L4 headers */
+#define RMNET_MAP_DEAGGR_HDRLEN   128
 /******************************************************************************/
 
 /**
@@ -117,21 +122,138 @@ done:
 }
 
 /**
- * rmnet_map_deaggregate() - Deaggregates a single packet
+ * rmnet_map_deaggregate_copy() - Copies a packet out of an aggregated frame
+ * @skb:        Source socket buffer, with the packet at skb->data
+ * @packet_len: Length of the MAP packet
+ *
+ * Used for small packets, where a copy is cheaper than referencing the
+ * frame, and for MAP commands, which are parsed in place.
+ *
+ * Return:
+ *     - Pointer to new skb
+ *     - 0 (null) if allocation failed
+ */
+static struct sk_buff *rmnet_map_deaggregate_copy(struct sk_buff *skb,
+						  uint32_t packet_len)
+{
+	struct sk_buff *skbn;
+
+	skbn = alloc_skb(packet_len + RMNET_MAP_DEAGGR_SPACING, GFP_ATOMIC);
+	if (!skbn)
+		return 0;
+
+	skb_reserve(skbn, RMNET_MAP_DEAGGR_HEADROOM);
+	skb_put(skbn, packet_len);
+	memcpy(skbn->data, skb->data, packet_len);
+	return skbn;
+}
+
+/**
+ * rmnet_map_truesize_share() - Share of the frame's memory for some bytes
+ * @skb:        Aggregated frame
+ * @len:        Bytes of the frame referenced by a de-aggregated packet
+ *
+ * Packets that reference the frame instead of copying it keep all of its
+ * memory pinned until the last of them is freed. Each is charged the part
+ * of the frame's truesize that matches its share of the frame's buffer, so
+ * that the packets of a frame are charged about what the frame costs.
+ *
+ * Return:
+ *     - Truesize to charge for @len bytes
+ */
+static unsigned int rmnet_map_truesize_share(struct sk_buff *skb,
+					     unsigned int len)
+{
+	return div_u64((u64)skb->truesize * len + skb_end_offset(skb) - 1,
+		       skb_end_offset(skb));
+}
+
+/**
+ * rmnet_map_deaggregate_frag() - References a packet in a page based frame
+ * @skb:        Source socket buffer, with the packet at skb->data
+ * @packet_len: Length of the MAP packet
+ *
+ * The source head must be a page fragment (skb->head_frag). The headers
+ * are copied so that they can be parsed and modified in the linear area;
+ * the rest of the packet becomes a page fragment pointing into the frame.
+ *
+ * Return:
+ *     - Pointer to new skb
+ *     - 0 (null) if allocation failed
+ */
+static struct sk_buff *rmnet_map_deaggregate_frag(struct sk_buff *skb,
+						  uint32_t packet_len)
+{
+	struct sk_buff *skbn;
+	struct page *page;
+	unsigned int offset, len;
+
+	skbn = alloc_skb(RMNET_MAP_DEAGGR_HDRLEN + RMNET_MAP_DEAGGR_SPACING,
+			 GFP_ATOMIC);
+	if (!skbn)
+		return 0;
+
+	skb_reserve(skbn, RMNET_MAP_DEAGGR_HEADROOM);
+	skb_put(skbn, RMNET_MAP_DEAGGR_HDRLEN);
+	memcpy(skbn->data, skb->data, RMNET_MAP_DEAGGR_HDRLEN);
+
+	page = virt_to_head_page(skb->head);
+	offset = skb->data + RMNET_MAP_DEAGGR_HDRLEN -
+		 (unsigned char *)page_address(page);
+	len = packet_len - RMNET_MAP_DEAGGR_HDRLEN;
+	get_page(page);
+	skb_add_rx_frag(skbn, 0, page, offset, len,
+			rmnet_map_truesize_share(skb, len));
+	return skbn;
+}
+
+/**
+ * rmnet_map_deaggregate_clone() - Shares the data of a kmalloc'ed frame
+ * @skb:        Source socket buffer, with the packet at skb->data
+ * @packet_len: Length of the MAP packet
+ *
+ * The frame stays allocated until the last of its packets is freed. Each
+ * clone is charged for its own sk_buff and its share of the frame.
+ *
+ * Return:
+ *     - Pointer to new skb
+ *     - 0 (null) if allocation failed
+ */
+static struct sk_buff *rmnet_map_deaggregate_clone(struct sk_buff *skb,
+						   uint32_t packet_len)
+{
+	struct sk_buff *skbn;
+
+	skbn = skb_clone(skb, GFP_ATOMIC);
+	if (!skbn)
+		return 0;
+
+	skb_trim(skbn, packet_len);
+	skbn->truesize = SKB_DATA_ALIGN(sizeof(struct sk_buff)) +
+			 rmnet_map_truesize_share(skb, packet_len);
+	return skbn;
+}
+
+/**
+ * __rmnet_map_deaggregate() - Deaggregates a single packet
  * @skb:        Source socket buffer containing multiple MAP frames
  * @config:     Physical endpoint configuration of the ingress device
+ * @copybreak:  Size up to which packets are copied
  *
- * A whole new buffer is allocated for each portion of an aggregated frame.
- * Caller should keep calling deaggregate() on the source skb until 0 is
- * returned, indicating that there are no more packets to deaggregate. Caller
- * is responsible for freeing the original skb.
+ * Packets larger than @copybreak are not copied: they reference the
+ * frame's pages if its head is a page fragment, or share its data as a
+ * clone otherwise. Smaller packets and MAP commands get a buffer of their
+ * own. Caller should keep calling deaggregate() on the source skb until 0
+ * is returned, indicating that there are no more packets to deaggregate.
+ * Caller is responsible for freeing the original skb.
  *
  * Return:
  *     - Pointer to new skb
  *     - 0 (null) if no more aggregated packets
  */
-struct sk_buff *rmnet_map_deaggregate(struct sk_buff *skb,
-				      struct rmnet_phys_ep_conf_s *config)
+struct sk_buff *__rmnet_map_deaggregate(struct sk_buff *skb,
+					struct rmnet_phys_ep_conf_s *config,
+					unsigned int copybreak)
 {
 	struct sk_buff *skbn;
 	struct rmnet_map_header_s *maph;
@@ -152,75 +274,260 @@ struct sk_buff *rmnet_map_deaggregate(struct sk_buff *skb,
 		return 0;
 	}
 
-	skbn = alloc_skb(packet_len + RMNET_MAP_DEAGGR_SPACING, GFP_ATOMIC);
-	if (!skbn)
-		return 0;
-
-	skbn->dev = skb->dev;
-	skb_reserve(skbn, RMNET_MAP_DEAGGR_HEADROOM);
-	skb_put(skbn, packet_len);
-	memcpy(skbn->data, skb->data, packet_len);
-	skb_pull(skb, packet_len);
-
-
 	/* Some hardware can send us empty frames. Catch them */
 	if (ntohs(maph->pkt_len) == 0) {
 		LOGD("Dropping empty MAP frame");
-		rmnet_kfree_skb(skbn, RMNET_STATS_SKBFREE_DEAGG_DATA_LEN_0);
+		skb_pull(skb, packet_len);
+		rmnet_kfree_skb(0, RMNET_STATS_SKBFREE_DEAGG_DATA_LEN_0);
 		return 0;
 	}
 
+	if (packet_len <= max_t(uint32_t, copybreak,
+				RMNET_MAP_DEAGGR_HDRLEN) ||
+	    RMNET_MAP_GET_CD_BIT(skb))
+		skbn = rmnet_map_deaggregate_copy(skb, packet_len);
+	else if (skb->head_frag)
+		skbn = rmnet_map_deaggregate_frag(skb, packet_len);
+	else
+		skbn = rmnet_map_deaggregate_clone(skb, packet_len);
+	if (!skbn)
+		return 0;
+
+	skbn->dev = skb->dev;
+	skb_pull(skb, packet_len);
 	return skbn;
 }
 
 /**
- * rmnet_map_flush_packet_queue() - Transmits aggregeted frame on timeout
- * @work:        struct agg_work containing delayed work and skb to flush
+ * rmnet_map_deaggregate() - Deaggregates a single packet
+ * @skb:        Source socket buffer containing multiple MAP frames
+ * @config:     Physical endpoint configuration of the ingress device
+ *
+ * Same as __rmnet_map_deaggregate(), copying packets up to deagg_copybreak.
  *
- * This function is scheduled to run in a specified number of jiffies after
- * the last frame transmitted by the network stack. When run, the buffer
- * containing aggregated packets is finally transmitted on the underlying link.
+ * Return:
+ *     - Pointer to new skb
+ *     - 0 (null) if no more aggregated packets
+ */
+struct sk_buff *rmnet_map_deaggregate(struct sk_buff *skb,
+				      struct rmnet_phys_ep_conf_s *config)
+{
+	return __rmnet_map_deaggregate(skb, config,
+				       ACCESS_ONCE(deagg_copybreak));
+}
+
+/**
+ * rmnet_map_agg_take() - Detaches the current aggregate for transmission
+ * @config:     Physical endpoint configuration, with agg_lock held
+ * @now:        Current time
+ * @count:      (O) Number of packets in the aggregate
+ * @wait_ns:    (O) Sum of the time its packets were held back
+ * @max_ns:     (O) Time its first packet was held back
+ *
+ * Return:
+ *     - Aggregate to transmit
+ */
+static struct sk_buff *rmnet_map_agg_take(struct rmnet_phys_ep_conf_s *config,
+					  ktime_t now, int *count,
+					  u64 *wait_ns, u64 *max_ns)
+{
+	struct sk_buff *skb = config->agg_skb;
+
+	*count = config->agg_count;
+	*max_ns = ktime_to_ns(ktime_sub(now, config->agg_time));
+	*wait_ns = *max_ns * config->agg_count - config->agg_wait;
+
+	config->agg_skb = 0;
+	config->agg_tail = 0;
+	config->agg_count = 0;
+	config->agg_wait = 0;
+	config->agg_state = RMNET_MAP_AGG_IDLE;
+	/* The timer only schedules the tasklet, which checks the deadline */
+	hrtimer_try_to_cancel(&config->agg_timer);
+	return skb;
+}
+
+/**
+ * rmnet_map_agg_xmit() - Transmits an aggregate on the physical device
+ * @skb:        Aggregate to transmit
+ * @count:      Number of packets in the aggregate
+ * @wait_ns:    Sum of the time its packets were held back
+ * @max_ns:     Time its first packet was held back
+ * @reason:     RMNET_STATS_QUEUE_XMIT_* reason for the transmission
+ */
+static void rmnet_map_agg_xmit(struct sk_buff *skb, int count, u64 wait_ns,
+			       u64 max_ns, unsigned int reason)
+{
+	int rc;
+
+	rmnet_stats_agg_pkts(count, wait_ns, max_ns);
+	if (count > 1)
+		LOGL("Agg count: %d", count);
+	rc = dev_queue_xmit(skb);
+	rmnet_stats_queue_xmit(rc, reason);
+}
+
+/**
+ * rmnet_map_flush_packet_queue() - Transmits aggregated frame on timeout
+ * @data:        Physical endpoint configuration
  *
+ * Scheduled by agg_timer once the deadline of the aggregate it was armed
+ * for has passed. The aggregate may have been sent and replaced with a new
+ * one in the meantime, so only an aggregate past its own deadline is sent;
+ * a newer one has re-armed the timer.
  */
-static void rmnet_map_flush_packet_queue(struct work_struct *work)
+static void rmnet_map_flush_packet_queue(unsigned long data)
 {
-	struct agg_work *real_work;
 	struct rmnet_phys_ep_conf_s *config;
+	struct sk_buff *skb = 0;
 	unsigned long flags;
-	struct sk_buff *skb;
-	int rc, agg_count = 0;
+	u64 wait_ns, max_ns;
+	int agg_count;
+	ktime_t now;
 
-	skb = 0;
-	real_work = (struct agg_work *)work;
-	config = real_work->config;
-	LOGD("%s", "Entering flush thread");
+	config = (struct rmnet_phys_ep_conf_s *)data;
+	LOGD("%s", "Entering flush tasklet");
 	spin_lock_irqsave(&config->agg_lock, flags);
-	if (likely(config->agg_state == RMNET_MAP_TXFER_SCHEDULED)) {
-		/* Buffer may have already been shipped out */
-		if (likely(config->agg_skb)) {
-			rmnet_stats_agg_pkts(config->agg_count);
-			if (config->agg_count > 1)
-				LOGL("Agg count: %d", config->agg_count);
-			skb = config->agg_skb;
-			agg_count = config->agg_count;
-			config->agg_skb = 0;
-			config->agg_count = 0;
-			memset(&(config->agg_time), 0, sizeof(struct timespec));
-		}
-		config->agg_state = RMNET_MAP_AGG_IDLE;
-	} else {
-		/* How did we get here? */
-		LOGE("Ran queued command when state %s",
-			"is idle. State machine likely broken");
-	}
-
+	now = ktime_get();
+	if (config->agg_state == RMNET_MAP_TXFER_SCHEDULED &&
+	    config->agg_skb &&
+	    ktime_compare(now, config->agg_deadline) >= 0)
+		skb = rmnet_map_agg_take(config, now, &agg_count,
+					 &wait_ns, &max_ns);
 	spin_unlock_irqrestore(&config->agg_lock, flags);
+
 	if (skb) {
 		trace_rmnet_map_flush_packet_queue(skb, agg_count);
-		rc = dev_queue_xmit(skb);
-		rmnet_stats_queue_xmit(rc, RMNET_STATS_QUEUE_XMIT_AGG_TIMEOUT);
+		rmnet_map_agg_xmit(skb, agg_count, wait_ns, max_ns,
+				   RMNET_STATS_QUEUE_XMIT_AGG_TIMEOUT);
 	}
-	kfree(work);
+}
+
+/* Runs in hardirq context; transmission has to wait for the tasklet */
+static enum hrtimer_restart rmnet_map_agg_timer(struct hrtimer *timer)
+{
+	struct rmnet_phys_ep_conf_s *config;
+
+	config = container_of(timer, struct rmnet_phys_ep_conf_s, agg_timer);
+	tasklet_schedule(&config->agg_tasklet);
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * rmnet_map_agg_limits() - Sizes a new aggregate from the packet rate
+ * @config:     Physical endpoint configuration, with agg_lock held
+ * @now:        Current time
+ *
+ * A new aggregate is sent once it holds as many packets as are expected
+ * to arrive within agg_time_limit at the average rate, up to the egress
+ * aggregation count, or once the time to collect them plus a quarter has
+ * passed. Slow traffic, such as the ACKs of a download, is not held back
+ * waiting for packets which are unlikely to come in time.
+ *
+ * Return:
+ *     - 1 if the packet should start a new aggregate
+ *     - 0 if fewer than two packets are expected within agg_time_limit
+ */
+static int rmnet_map_agg_limits(struct rmnet_phys_ep_conf_s *config,
+				ktime_t now)
+{
+	uint32_t gap = max_t(uint32_t, config->agg_gap, 1);
+	uint64_t count, wait;
+
+	if (agg_time_limit <= 0)
+		return 0;
+
+	count = div_u64(agg_time_limit, gap);
+	if (count > config->egress_agg_count)
+		count = config->egress_agg_count;
+	if (count < 2)
+		return 0;
+
+	wait = count * gap;
+	wait += wait >> 2;
+	if (wait > agg_time_limit)
+		wait = agg_time_limit;
+
+	config->agg_count_limit = count;
+	config->agg_deadline = ktime_add_ns(now, wait);
+	return 1;
+}
+
+/**
+ * rmnet_map_agg_start() - Starts a new aggregate with a packet
+ * @config:     Physical endpoint configuration, with agg_lock held
+ * @skb:        First packet of the aggregate
+ * @size:       Room to leave for more packets when they are copied
+ *
+ * If the physical device takes frag lists, later packets are chained to
+ * the frag_list of the first one instead of being copied, which requires
+ * the first packet to own its skb_shared_info.
+ *
+ * Return:
+ *     - 1 if the aggregate was started; skb is owned by it
+ *     - 0 if allocation failed; skb is left to the caller
+ */
+static int rmnet_map_agg_start(struct rmnet_phys_ep_conf_s *config,
+			       struct sk_buff *skb, int size)
+{
+	struct sk_buff *agg_skb;
+
+	if ((config->dev->features & NETIF_F_FRAGLIST) &&
+	    !skb_cloned(skb) && !skb_has_frag_list(skb)) {
+		config->agg_skb = skb;
+		return 1;
+	}
+
+	agg_skb = skb_copy_expand(skb, 0, size, GFP_ATOMIC);
+	if (!agg_skb)
+		return 0;
+
+	config->agg_skb = agg_skb;
+	rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_AGG_CPY_EXPAND);
+	return 1;
+}
+
+/**
+ * rmnet_map_agg_append() - Adds a packet to the current aggregate
+ * @config:     Physical endpoint configuration, with agg_lock held
+ * @skb:        Packet to add
+ *
+ * The packet is chained to the frag list of the aggregate when the device
+ * takes frag lists, and copied into its tailroom otherwise. The aggregate
+ * is not charged for the truesize of chained packets: they keep their own
+ * socket accounting until the aggregate is freed.
+ *
+ * Return:
+ *     - 1 if the packet was added; skb is owned by the aggregate
+ *     - 0 if it does not fit; skb is left to the caller
+ */
+static int rmnet_map_agg_append(struct rmnet_phys_ep_conf_s *config,
+				struct sk_buff *skb)
+{
+	struct sk_buff *agg_skb = config->agg_skb;
+
+	if (skb->len > (config->egress_agg_size - agg_skb->len))
+		return 0;
+
+	if ((config->dev->features & NETIF_F_FRAGLIST) &&
+	    !skb_has_frag_list(skb)) {
+		if (config->agg_tail)
+			config->agg_tail->next = skb;
+		else
+			skb_shinfo(agg_skb)->frag_list = skb;
+		config->agg_tail = skb;
+		agg_skb->len += skb->len;
+		agg_skb->data_len += skb->len;
+		return 1;
+	}
+
+	if (skb_has_frag_list(agg_skb) || skb_tailroom(agg_skb) < skb->len)
+		return 0;
+
+	if (skb_copy_bits(skb, 0, skb_put(agg_skb, skb->len), skb->len))
+		BUG();
+	rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_AGG_INTO_BUFF);
+	return 1;
 }
 
 /**
@@ -229,18 +536,20 @@ static void rmnet_map_flush_packet_queue(struct work_struct *work)
  * @config:     Physical endpoint configuration of the ingress device
  *
  * Aggregates multiple SKBs into a single large SKB for transmission. MAP
- * protocol is used to separate the packets in the buffer. This funcion consumes
- * the argument SKB and should not be further processed by any other function.
+ * protocol is used to separate the packets in the buffer. This funcion
+ * consumes the argument SKB and should not be further processed by any other
+ * function. The aggregate is sent when it reaches the size and count
+ * limits set by rmnet_map_agg_limits() or, from a tasklet, when its
+ * hrtimer deadline passes.
  */
 void rmnet_map_aggregate(struct sk_buff *skb,
 			 struct rmnet_phys_ep_conf_s *config) {
-	uint8_t *dest_buff;
-	struct agg_work *work;
-	unsigned long flags;
 	struct sk_buff *agg_skb;
-	struct timespec diff, last;
-	int size, rc, agg_count = 0;
-
+	unsigned long flags;
+	u64 wait_ns, max_ns;
+	int size, agg_count, retry = 0;
+	ktime_t now;
+	s64 gap;
 
 	if (!skb || !config)
 		BUG();
@@ -254,90 +563,113 @@ void rmnet_map_aggregate(struct sk_buff *skb,
 new_packet:
 	spin_lock_irqsave(&config->agg_lock, flags);
 
-	memcpy(&last, &(config->agg_last), sizeof(struct timespec));
-	getnstimeofday(&(config->agg_last));
-
-	if (!config->agg_skb) {
-		/* Check to see if we should agg first. If the traffic is very
-		 * sparse, don't aggregate. We will need to tune this later
+	now = ktime_get();
+	gap = ktime_to_ns(ktime_sub(now, config->agg_last));
+	if (!retry) {
+		/* Moving average of the gap, spacing beyond the bypass
+		 * time counting as the bypass time.
 		 */
-		diff = timespec_sub(config->agg_last, last);
+		if (gap > agg_bypass_time)
+			gap = agg_bypass_time;
+		config->agg_gap = config->agg_gap -
+			(config->agg_gap >> RMNET_MAP_AGG_GAP_SHIFT) +
+			((uint32_t)gap >> RMNET_MAP_AGG_GAP_SHIFT);
+		config->agg_last = now;
+	}
 
-		if ((diff.tv_sec > 0) || (diff.tv_nsec > agg_bypass_time)) {
+	if (!config->agg_skb) {
+		/* If the traffic is very sparse, don't aggregate */
+		if (gap >= agg_bypass_time ||
+		    !rmnet_map_agg_limits(config, now)) {
 			spin_unlock_irqrestore(&config->agg_lock, flags);
-			LOGL("delta t: %ld.%09lu\tcount: bypass", diff.tv_sec,
-			     diff.tv_nsec);
-			rmnet_stats_agg_pkts(1);
+			LOGL("delta t: %lld ns\tcount: bypass", gap);
 			trace_rmnet_map_aggregate(skb, 0);
-			rc = dev_queue_xmit(skb);
-			rmnet_stats_queue_xmit(rc,
-					       RMNET_STATS_QUEUE_XMIT_AGG_SKIP);
+			rmnet_map_agg_xmit(skb, 1, 0, 0,
+					   RMNET_STATS_QUEUE_XMIT_AGG_SKIP);
 			return;
 		}
 
-		config->agg_skb = skb_copy_expand(skb, 0, size, GFP_ATOMIC);
-		if (!config->agg_skb) {
-			config->agg_skb = 0;
-			config->agg_count = 0;
-			memset(&(config->agg_time), 0, sizeof(struct timespec));
+		trace_rmnet_start_aggregation(skb);
+		if (!rmnet_map_agg_start(config, skb, size)) {
 			spin_unlock_irqrestore(&config->agg_lock, flags);
-			rmnet_stats_agg_pkts(1);
 			trace_rmnet_map_aggregate(skb, 0);
-			rc = dev_queue_xmit(skb);
-			rmnet_stats_queue_xmit(rc,
+			rmnet_map_agg_xmit(skb, 1, 0, 0,
 				RMNET_STATS_QUEUE_XMIT_AGG_CPY_EXP_FAIL);
 			return;
 		}
 		config->agg_count = 1;
-		getnstimeofday(&(config->agg_time));
-		trace_rmnet_start_aggregation(skb);
-		rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_AGG_CPY_EXPAND);
-		goto schedule;
+		config->agg_time = now;
+		config->agg_state = RMNET_MAP_TXFER_SCHEDULED;
+		hrtimer_start(&config->agg_timer, config->agg_deadline,
+			      HRTIMER_MODE_ABS);
+		spin_unlock_irqrestore(&config->agg_lock, flags);
+		return;
 	}
-	diff = timespec_sub(config->agg_last, config->agg_time);
-
-	if (skb->len > (config->egress_agg_size - config->agg_skb->len)
-	    || (config->agg_count >= config->egress_agg_count)
-	    ||  (diff.tv_sec > 0) || (diff.tv_nsec > agg_time_limit)) {
-		rmnet_stats_agg_pkts(config->agg_count);
-		agg_skb = config->agg_skb;
-		agg_count = config->agg_count;
-		config->agg_skb = 0;
-		config->agg_count = 0;
-		memset(&(config->agg_time), 0, sizeof(struct timespec));
+
+	if (ktime_compare(now, config->agg_deadline) >= 0 ||
+	    !rmnet_map_agg_append(config, skb)) {
+		agg_skb = rmnet_map_agg_take(config, now, &agg_count,
+					     &wait_ns, &max_ns);
 		spin_unlock_irqrestore(&config->agg_lock, flags);
-		LOGL("delta t: %ld.%09lu\tcount: %d", diff.tv_sec,
-		     diff.tv_nsec, agg_count);
+		LOGL("waited: %llu ns\tcount: %d", max_ns, agg_count);
 		trace_rmnet_map_aggregate(skb, agg_count);
-		rc = dev_queue_xmit(agg_skb);
-		rmnet_stats_queue_xmit(rc,
-					RMNET_STATS_QUEUE_XMIT_AGG_FILL_BUFFER);
+		rmnet_map_agg_xmit(agg_skb, agg_count, wait_ns, max_ns,
+				   RMNET_STATS_QUEUE_XMIT_AGG_FILL_BUFFER);
+		retry = 1;
 		goto new_packet;
 	}
 
-	dest_buff = skb_put(config->agg_skb, skb->len);
-	memcpy(dest_buff, skb->data, skb->len);
-	config->agg_count++;
-	rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_AGG_INTO_BUFF);
-
-schedule:
-	if (config->agg_state != RMNET_MAP_TXFER_SCHEDULED) {
-		work = kmalloc(sizeof(*work), GFP_ATOMIC);
-		if (!work) {
-			LOGE("Failed to allocate work item for packet %s",
-			     "transfer. DATA PATH LIKELY BROKEN!");
-			config->agg_state = RMNET_MAP_AGG_IDLE;
-			spin_unlock_irqrestore(&config->agg_lock, flags);
-			return;
-		}
-		INIT_DELAYED_WORK((struct delayed_work *)work,
-				  rmnet_map_flush_packet_queue);
-		work->config = config;
-		config->agg_state = RMNET_MAP_TXFER_SCHEDULED;
-		schedule_delayed_work((struct delayed_work *)work, 1);
+	config->agg_wait += ktime_to_ns(ktime_sub(now, config->agg_time));
+	if (++config->agg_count < config->agg_count_limit) {
+		spin_unlock_irqrestore(&config->agg_lock, flags);
+		return;
 	}
+
+	agg_skb = rmnet_map_agg_take(config, now, &agg_count, &wait_ns,
+				     &max_ns);
 	spin_unlock_irqrestore(&config->agg_lock, flags);
-	return;
+	trace_rmnet_map_aggregate(agg_skb, agg_count);
+	rmnet_map_agg_xmit(agg_skb, agg_count, wait_ns, max_ns,
+			   RMNET_STATS_QUEUE_XMIT_AGG_FILL_BUFFER);
+}
+
+/**
+ * rmnet_map_agg_init() - Initializes the aggregation state of a device
+ * @config:     Physical endpoint configuration
+ */
+void rmnet_map_agg_init(struct rmnet_phys_ep_conf_s *config)
+{
+	spin_lock_init(&config->agg_lock);
+	hrtimer_init(&config->agg_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	config->agg_timer.function = rmnet_map_agg_timer;
+	tasklet_init(&config->agg_tasklet, rmnet_map_flush_packet_queue,
+		     (unsigned long)config);
+}
+
+/**
+ * rmnet_map_agg_cleanup() - Stops aggregation before a device goes away
+ * @config:     Physical endpoint configuration
+ *
+ * Drops the packets of an aggregate which has not been sent yet.
+ */
+void rmnet_map_agg_cleanup(struct rmnet_phys_ep_conf_s *config)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	hrtimer_cancel(&config->agg_timer);
+	tasklet_kill(&config->agg_tasklet);
+
+	spin_lock_irqsave(&config->agg_lock, flags);
+	skb = config->agg_skb;
+	config->agg_skb = 0;
+	config->agg_tail = 0;
+	config->agg_count = 0;
+	config->agg_state = RMNET_MAP_AGG_IDLE;
+	spin_unlock_irqrestore(&config->agg_lock, flags);
+
+	if (skb)
+		kfree_skb(skb);
 }
 
 
@@ -573,6 +905,7 @@ static int rmnet_map_validate_ipv6_packet_checksum(unsigned char *map_payload,
  * Validates packet checksums. Function takes a pointer to
  * the beginning of a buffer which contains the entire MAP
  * frame: MAP header + IP payload + padding + checksum trailer.
+ * The IP and transport headers must be in the linear area.
  * Currently, only IPv4 and IPv6 are supported along with
  * TCP & UDP. Fragmented or tunneled packets are not supported.
  *
@@ -589,7 +922,7 @@ static int rmnet_map_validate_ipv6_packet_checksum(unsigned char *map_payload,
  */
 int rmnet_map_checksum_downlink_packet(struct sk_buff *skb)
 {
-	struct rmnet_map_dl_checksum_trailer_s *cksum_trailer;
+	struct rmnet_map_dl_checksum_trailer_s *cksum_trailer, trailer;
 	unsigned int data_len;
 	unsigned char *map_payload;
 	unsigned char ip_version;
@@ -600,9 +933,10 @@ int rmnet_map_checksum_downlink_packet(struct sk_buff *skb)
 	    sizeof(struct rmnet_map_dl_checksum_trailer_s))))
 		return RMNET_MAP_CHECKSUM_ERR_BAD_BUFFER;
 
-	cksum_trailer = (struct rmnet_map_dl_checksum_trailer_s *)
-			(skb->data + data_len
-			+ sizeof(struct rmnet_map_header_s));
+	/* The trailer is in a page fragment of zero-copy packets */
+	cksum_trailer = skb_header_pointer(skb,
+			data_len + sizeof(struct rmnet_map_header_s),
+			sizeof(trailer), &trailer);
 
 	if (unlikely(!ntohs(cksum_trailer->valid)))
 		return RMNET_MAP_CHECKSUM_VALID_FLAG_NOT_SET;
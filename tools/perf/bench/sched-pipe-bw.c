@@ -0,0 +1,181 @@
+/*
+ *
+ * sched-pipe-bw.c
+ *
+ * pipe-bw: Benchmark for pipe() throughput
+ *
+ * One process writes a buffer to a pipe over and over, another reads it
+ * out, and the bandwidth is reported.  The pipe can be given a fixed
+ * size (otherwise the kernel sizes it on its own), and writes can pass
+ * pages to the pipe instead of copying them (F_SETPIPE_GIFT).  A gifted
+ * page belongs to the pipe until it is read, so with gifting every write
+ * comes from freshly mapped pages, which the writer unmaps right after
+ * the write instead of reusing them.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE	1024
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ		(F_LINUX_SPECIFIC_BASE + 7)
+#endif
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ		(F_LINUX_SPECIFIC_BASE + 8)
+#endif
+#ifndef F_SETPIPE_GIFT
+#define F_SETPIPE_GIFT		(F_LINUX_SPECIFIC_BASE + 16)
+#endif
+
+static const char	*size_str	= "64KB";
+static const char	*total_str	= "4GB";
+static const char	*pipe_size_str	= "0";
+static bool		gift;
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &size_str, "64KB",
+		   "Specify the size of each read and write (e.g. 4KB, 1MB)"),
+	OPT_STRING('t', "total", &total_str, "4GB",
+		   "Specify the amount of data to transfer"),
+	OPT_STRING('p', "pipe-size", &pipe_size_str, "0",
+		   "Set the pipe size with F_SETPIPE_SZ, 0 lets the kernel size it"),
+	OPT_BOOLEAN('g', "gift", &gift,
+		    "Pass whole pages to the pipe instead of copying them"),
+	OPT_END()
+};
+
+static const char * const bench_sched_pipe_bw_usage[] = {
+	"perf bench sched pipe-bw <options>",
+	NULL
+};
+
+static void *alloc_buf(size_t size)
+{
+	void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+	BUG_ON(buf == MAP_FAILED);
+	memset(buf, 0x5a, size);
+	return buf;
+}
+
+static void reader(int fd, size_t size, u64 total)
+{
+	char *buf = alloc_buf(size);
+
+	while (total) {
+		ssize_t ret = read(fd, buf, size);
+
+		BUG_ON(ret <= 0);
+		total -= ret;
+	}
+}
+
+static void writer(int fd, size_t size, u64 total)
+{
+	char *buf = alloc_buf(size);
+
+	while (total) {
+		size_t len = total < size ? total : size;
+		ssize_t ret;
+
+		/* the pages of the last write may still be in the pipe */
+		if (gift) {
+			munmap(buf, size);
+			buf = alloc_buf(size);
+		}
+
+		ret = write(fd, buf, len);
+		BUG_ON(ret <= 0);
+		total -= ret;
+	}
+	munmap(buf, size);
+}
+
+int bench_sched_pipe_bw(int argc, const char **argv,
+			const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	int fds[2], wait_stat, pipe_size;
+	s64 size, total, pipe_bytes;
+	double secs;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options, bench_sched_pipe_bw_usage, 0);
+
+	size = perf_atoll((char *)size_str);
+	total = perf_atoll((char *)total_str);
+	pipe_bytes = perf_atoll((char *)pipe_size_str);
+	if (size <= 0 || total <= 0 || pipe_bytes < 0) {
+		fprintf(stderr, "Invalid size\n");
+		return 1;
+	}
+
+	BUG_ON(pipe(fds));
+	if (pipe_bytes && fcntl(fds[1], F_SETPIPE_SZ, (int)pipe_bytes) < 0) {
+		perror("F_SETPIPE_SZ");
+		return 1;
+	}
+	if (gift && fcntl(fds[1], F_SETPIPE_GIFT, 1) < 0) {
+		perror("F_SETPIPE_GIFT");
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	pid = fork();
+	assert(pid >= 0);
+	if (!pid) {
+		close(fds[1]);
+		reader(fds[0], size, total);
+		exit(0);
+	}
+	close(fds[0]);
+	writer(fds[1], size, total);
+
+	BUG_ON(waitpid(pid, &wait_stat, 0) != pid || !WIFEXITED(wait_stat));
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	/* Where the automatic sizing left the pipe */
+	pipe_size = fcntl(fds[1], F_GETPIPE_SZ);
+	close(fds[1]);
+
+	secs = diff.tv_sec + diff.tv_usec / 1e6;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Transferred %" PRId64 " bytes in %" PRId64 " byte "
+		       "writes%s\n\n", total, size, gift ? ", gifting pages" : "");
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec, (unsigned long)(diff.tv_usec / 1000));
+		printf(" %14s: %d bytes\n", "Final pipe size", pipe_size);
+		printf(" %14lf MB/sec\n", total / secs / (1 << 20));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", total / secs / (1 << 20));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * rtb_decode - decode the register trace buffer (RTB) from a RAM dump
+ *
+ * The kernel logs the events of each cpu into its own segment of the
+ * RTB region (see kernel/trace/msm_rtb.c).  This reads the region out
+ * of a dump, merges the segments by timestamp and prints the events,
+ * optionally resolving the callers against a System.map:
+ *
+ *   rtb_decode -o 0x1f000000 -s 0x100000 -m System.map DDRCS0.BIN
+ *
+ * Regions without the segment header, as written by older kernels, are
+ * decoded as a single stream.  The dump is expected to have the byte
+ * order of the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <getopt.h>
+
+/* These must match kernel/trace/msm_rtb.c */
+#define SENTINEL_BYTE_1 0xFF
+#define SENTINEL_BYTE_2 0xAA
+#define SENTINEL_BYTE_3 0xFF
+
+#define RTB_MAGIC	0x48425452	/* "RTBH" */
+
+#define LOGTYPE_NOPC	0x80
+
+struct msm_rtb_layout {
+	unsigned char sentinel[3];
+	unsigned char log_type;
+	uint32_t idx;
+	uint64_t caller;
+	uint64_t data;
+	uint64_t timestamp;
+} __attribute__ ((__packed__));
+
+struct msm_rtb_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t nr_segments;
+	uint32_t segment_entries;
+} __attribute__ ((__packed__));
+
+struct rtb_event {
+	int cpu;
+	const struct msm_rtb_layout *entry;
+};
+
+struct symbol {
+	uint64_t addr;
+	char *name;
+};
+
+static struct symbol *symbols;
+static size_t nr_symbols;
+
+static const char * const log_type_names[] = {
+	"NONE", "READL", "WRITEL", "LOGBUF", "HOTPLUG", "CTXID",
+	"TIMESTAMP", "L2CPREAD", "L2CPWRITE", "IRQ",
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-o offset] [-s size] [-m System.map] dump\n"
+		"  -o offset      offset of the RTB region in the dump\n"
+		"  -s size        size of the RTB region (default: to EOF)\n"
+		"  -m System.map  resolve callers to symbols\n",
+		prog);
+	exit(1);
+}
+
+static int cmp_symbols(const void *a, const void *b)
+{
+	const struct symbol *sa = a, *sb = b;
+
+	if (sa->addr == sb->addr)
+		return 0;
+	return sa->addr < sb->addr ? -1 : 1;
+}
+
+static void load_symbols(const char *path)
+{
+	char line[512], name[256], type;
+	size_t size = 0;
+	uint64_t addr;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%" SCNx64 " %c %255s", &addr, &type,
+			   name) != 3)
+			continue;
+		if (type != 't' && type != 'T')
+			continue;
+
+		if (nr_symbols == size) {
+			size = size ? size * 2 : 4096;
+			symbols = realloc(symbols, size * sizeof(*symbols));
+			if (!symbols) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		symbols[nr_symbols].addr = addr;
+		symbols[nr_symbols].name = strdup(name);
+		nr_symbols++;
+	}
+	fclose(f);
+
+	qsort(symbols, nr_symbols, sizeof(*symbols), cmp_symbols);
+}
+
+static const struct symbol *find_symbol(uint64_t addr)
+{
+	size_t lo = 0, hi = nr_symbols;
+
+	if (!nr_symbols || addr < symbols[0].addr)
+		return NULL;
+
+	/* last symbol at or below addr */
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (symbols[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return &symbols[lo];
+}
+
+static int valid_entry(const struct msm_rtb_layout *entry)
+{
+	return entry->sentinel[0] == SENTINEL_BYTE_1 &&
+	       entry->sentinel[1] == SENTINEL_BYTE_2 &&
+	       entry->sentinel[2] == SENTINEL_BYTE_3;
+}
+
+static int cmp_events(const void *a, const void *b)
+{
+	const struct rtb_event *ea = a, *eb = b;
+
+	if (ea->entry->timestamp != eb->entry->timestamp)
+		return ea->entry->timestamp < eb->entry->timestamp ? -1 : 1;
+	if (ea->cpu != eb->cpu)
+		return ea->cpu < eb->cpu ? -1 : 1;
+	if (ea->entry->idx != eb->entry->idx)
+		return ea->entry->idx < eb->entry->idx ? -1 : 1;
+	return 0;
+}
+
+static void print_event(const struct rtb_event *ev)
+{
+	const struct msm_rtb_layout *entry = ev->entry;
+	unsigned int type = entry->log_type & ~LOGTYPE_NOPC;
+	const struct symbol *sym = NULL;
+	char cpu[12] = "-";
+
+	if (ev->cpu >= 0)
+		snprintf(cpu, sizeof(cpu), "%d", ev->cpu);
+
+	printf("[%6" PRIu64 ".%09" PRIu64 "] cpu %-3s idx %-10u ",
+	       entry->timestamp / 1000000000,
+	       entry->timestamp % 1000000000, cpu, entry->idx);
+
+	if (type < sizeof(log_type_names) / sizeof(log_type_names[0]))
+		printf("%-9s ", log_type_names[type]);
+	else
+		printf("TYPE%-5u ", type);
+
+	printf("data 0x%016" PRIx64, entry->data);
+
+	if (entry->log_type & LOGTYPE_NOPC) {
+		printf(" 0x%016" PRIx64 "\n", entry->caller);
+		return;
+	}
+
+	printf(" caller 0x%016" PRIx64, entry->caller);
+	sym = find_symbol(entry->caller);
+	if (sym)
+		printf(" %s+0x%" PRIx64, sym->name, entry->caller - sym->addr);
+	printf("\n");
+}
+
+static void *read_region(const char *path, long offset, long *size)
+{
+	void *buf;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	if (*size <= 0) {
+		if (fseek(f, 0, SEEK_END) < 0) {
+			perror(path);
+			exit(1);
+		}
+		*size = ftell(f) - offset;
+	}
+	if (*size <= 0 || fseek(f, offset, SEEK_SET) < 0) {
+		fprintf(stderr, "%s: no RTB region at offset 0x%lx\n",
+			path, offset);
+		exit(1);
+	}
+
+	buf = malloc(*size);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	*size = fread(buf, 1, *size, f);
+	fclose(f);
+
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	const struct msm_rtb_header *hdr;
+	const struct msm_rtb_layout *entries;
+	struct rtb_event *events;
+	size_t nr_entries, nr_events = 0, i;
+	long offset = 0, size = 0;
+	unsigned int cpu, seg_entries = 0;
+	void *buf;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:s:m:h")) != -1) {
+		switch (opt) {
+		case 'o':
+			offset = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtol(optarg, NULL, 0);
+			break;
+		case 'm':
+			load_symbols(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	buf = read_region(argv[optind], offset, &size);
+	hdr = buf;
+	entries = buf;
+	nr_entries = size / sizeof(*entries);
+
+	if (size >= (long)sizeof(*hdr) && hdr->magic == RTB_MAGIC) {
+		if (hdr->entry_size != sizeof(*entries) ||
+		    hdr->header_size % sizeof(*entries)) {
+			fprintf(stderr, "unsupported RTB layout version %u\n",
+				hdr->version);
+			return 1;
+		}
+		seg_entries = hdr->segment_entries;
+		nr_entries = (size_t)hdr->nr_segments * seg_entries;
+		if (hdr->header_size > (size_t)size ||
+		    nr_entries > (size - hdr->header_size) / sizeof(*entries)) {
+			fprintf(stderr, "RTB region is truncated\n");
+			return 1;
+		}
+		entries += hdr->header_size / sizeof(*entries);
+	}
+
+	events = calloc(nr_entries ? nr_entries : 1, sizeof(*events));
+	if (!events) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < nr_entries; i++) {
+		if (!valid_entry(&entries[i]))
+			continue;
+		cpu = seg_entries ? i / seg_entries : (unsigned int)-1;
+		events[nr_events].cpu = (int)cpu;
+		events[nr_events].entry = &entries[i];
+		nr_events++;
+	}
+
+	/* merge the per-cpu segments by timestamp */
+	qsort(events, nr_events, sizeof(*events), cmp_events);
+
+	for (i = 0; i < nr_events; i++)
+		print_event(&events[i]);
+
+	free(events);
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * aio_ring_bench: compare the cost of issuing small O_DIRECT reads with
+ * io_submit()/io_getevents(), with the io_setup2() submission ring driven
+ * by io_ring_enter(), and with the kernel polling the submission ring.
+ *
+ * usage: aio_ring_bench [file [nr_ios [depth]]]
+ *
+ * Without a file argument a 64MB scratch file is created in the current
+ * directory.  The SQPOLL run is skipped without CAP_SYS_ADMIN.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/aio_abi.h>
+#include <linux/aio_ring.h>
+
+/* Only wired up in asm-generic/unistd.h so far */
+#ifdef __aarch64__
+#ifndef __NR_io_setup2
+#define __NR_io_setup2		281
+#endif
+#ifndef __NR_io_ring_enter
+#define __NR_io_ring_enter	282
+#endif
+#endif
+
+/* Elsewhere the ring runs are skipped with ENOSYS */
+#ifndef __NR_io_setup2
+#define __NR_io_setup2		-1
+#endif
+#ifndef __NR_io_ring_enter
+#define __NR_io_ring_enter	-1
+#endif
+
+#define BS		4096
+#define FILE_SIZE	(64 << 20)
+
+#define barrier()	__asm__ __volatile__("" : : : "memory")
+#define smp_mb()	__sync_synchronize()
+#define READ_ONCE(x)	(*(volatile typeof(x) *)&(x))
+
+/* Mirrors the completion ring header in fs/aio.c */
+struct aio_ring {
+	unsigned	id;
+	unsigned	nr;
+	unsigned	head;
+	unsigned	tail;
+	unsigned	magic;
+	unsigned	compat_features;
+	unsigned	incompat_features;
+	unsigned	header_length;
+	struct io_event	io_events[0];
+};
+
+static int fd;
+static void *buf;
+static long nr_ios = 200000;
+static unsigned depth = 32;
+static unsigned nr_blocks;
+
+static int sys_io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int sys_io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static int sys_io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static int sys_io_getevents(aio_context_t ctx, long min, long nr,
+			    struct io_event *ev)
+{
+	return syscall(__NR_io_getevents, ctx, min, nr, ev, NULL);
+}
+
+static int sys_io_setup2(unsigned nr, struct aio_setup_params *p,
+			 aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup2, nr, p, ctx);
+}
+
+static int sys_io_ring_enter(aio_context_t ctx, unsigned to_submit,
+			     unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_ring_enter, ctx, to_submit, min_complete,
+		       flags);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long next_offset(void)
+{
+	return (unsigned long long)(random() % nr_blocks) * BS;
+}
+
+static void prep_read(struct iocb *iocb, unsigned slot, int fixed)
+{
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_buf = (unsigned long)buf + slot * BS;
+	iocb->aio_nbytes = BS;
+	iocb->aio_offset = next_offset();
+	iocb->aio_data = slot;
+	if (fixed) {
+		iocb->aio_fildes = 0;
+		iocb->aio_flags = IOCB_FLAG_FIXED_FILE | IOCB_FLAG_FIXED_BUF;
+		iocb->aio_reserved2 = 0;
+	} else {
+		iocb->aio_fildes = fd;
+	}
+}
+
+/* Reap completions straight from the mapped ring, no system call */
+static unsigned reap_ring(struct aio_ring *ring)
+{
+	unsigned head = ring->head, tail = READ_ONCE(ring->tail), n = 0;
+
+	smp_mb();
+	while (head != tail) {
+		struct io_event *ev = &ring->io_events[head];
+
+		if ((long)ev->res != BS) {
+			fprintf(stderr, "read failed: %lld\n", (long long)ev->res);
+			exit(1);
+		}
+		head = (head + 1) % ring->nr;
+		n++;
+	}
+	smp_mb();
+	ring->head = head;
+	return n;
+}
+
+static double run_io_submit(void)
+{
+	struct iocb *iocbs = calloc(depth, sizeof(*iocbs));
+	struct iocb **ptrs = calloc(depth, sizeof(*ptrs));
+	struct io_event *events = calloc(depth, sizeof(*events));
+	unsigned long long start;
+	aio_context_t ctx = 0;
+	long done = 0, queued = 0;
+	unsigned i;
+
+	if (sys_io_setup(depth, &ctx)) {
+		perror("io_setup");
+		exit(1);
+	}
+
+	start = now_ns();
+	for (i = 0; i < depth; i++) {
+		prep_read(&iocbs[i], i, 0);
+		ptrs[i] = &iocbs[i];
+	}
+	if (sys_io_submit(ctx, depth, ptrs) != depth) {
+		perror("io_submit");
+		exit(1);
+	}
+	queued = depth;
+
+	while (done < nr_ios) {
+		int n = sys_io_getevents(ctx, 1, depth, events);
+
+		if (n < 0) {
+			perror("io_getevents");
+			exit(1);
+		}
+		done += n;
+		for (i = 0; i < n && queued < nr_ios; i++, queued++) {
+			struct iocb *iocb = (struct iocb *)(long)events[i].obj;
+
+			prep_read(iocb, iocb->aio_data, 0);
+			ptrs[i] = iocb;
+		}
+		if (i && sys_io_submit(ctx, i, ptrs) != i) {
+			perror("io_submit");
+			exit(1);
+		}
+	}
+
+	sys_io_destroy(ctx);
+	free(iocbs);
+	free(ptrs);
+	free(events);
+	return (now_ns() - start) / (double)nr_ios;
+}
+
+static double run_ring(int sqpoll)
+{
+	struct aio_setup_params p;
+	struct iovec iov = { buf, depth * BS };
+	struct aio_sq_ring *sq;
+	struct aio_ring *ring;
+	unsigned long long start;
+	aio_context_t ctx = 0;
+	long done = 0, queued = 0;
+	unsigned i, mask;
+	int fds[1] = { fd };
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IOCTX_FLAG_SQRING | (sqpoll ? IOCTX_FLAG_SQPOLL : 0);
+	p.sq_entries = depth;
+	p.sq_thread_cpu = -1;
+	p.files = (unsigned long)fds;
+	p.nr_files = 1;
+	p.iovecs = (unsigned long)&iov;
+	p.nr_iovecs = 1;
+
+	if (sys_io_setup2(depth, &p, &ctx)) {
+		if (errno == EPERM || errno == ENOSYS)
+			return -1;
+		perror("io_setup2");
+		exit(1);
+	}
+	ring = (struct aio_ring *)ctx;
+	sq = (struct aio_sq_ring *)(ctx + p.sq_off);
+	mask = sq->nr - 1;
+
+	start = now_ns();
+	for (i = 0; i < depth; i++)
+		prep_read(&sq->iocbs[(sq->tail + i) & mask], i, 1);
+	smp_mb();
+	sq->tail += depth;
+	queued = depth;
+
+	while (done < nr_ios) {
+		unsigned n, to_submit = 0;
+
+		if (!sqpoll)
+			to_submit = sq->tail - READ_ONCE(sq->head);
+		else if (READ_ONCE(sq->flags) & AIO_SQ_NEED_WAKEUP)
+			sys_io_ring_enter(ctx, 0, 0, IORING_ENTER_SQ_WAKEUP);
+
+		n = reap_ring(ring);
+		if (!n) {
+			if (sys_io_ring_enter(ctx, to_submit, 1,
+					      IORING_ENTER_GETEVENTS) < 0) {
+				perror("io_ring_enter");
+				exit(1);
+			}
+			continue;
+		}
+		done += n;
+
+		/* Slots are recycled in order, the reads are all the same */
+		for (i = 0; i < n && queued < nr_ios; i++, queued++)
+			prep_read(&sq->iocbs[(sq->tail + i) & mask],
+				  (sq->tail + i) % depth, 1);
+		smp_mb();
+		sq->tail += i;
+	}
+
+	sys_io_destroy(ctx);
+	return (now_ns() - start) / (double)nr_ios;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "aio_ring_bench.dat";
+	struct stat st;
+	double ns;
+
+	if (argc > 2)
+		nr_ios = atol(argv[2]);
+	if (argc > 3)
+		depth = atoi(argv[3]);
+
+	if (argc < 2) {
+		int wfd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		char *zero = calloc(1, 1 << 20);
+		int i;
+
+		for (i = 0; wfd >= 0 && i < FILE_SIZE >> 20; i++)
+			if (write(wfd, zero, 1 << 20) != 1 << 20)
+				break;
+		fsync(wfd);
+		close(wfd);
+		free(zero);
+	}
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0 || fstat(fd, &st) || st.st_size < BS) {
+		perror(path);
+		return 1;
+	}
+	nr_blocks = st.st_size / BS;
+
+	if (posix_memalign(&buf, BS, depth * BS))
+		return 1;
+
+	printf("%ld reads of %d bytes, queue depth %u\n", nr_ios, BS, depth);
+	printf("io_submit:     %8.0f ns/io\n", run_io_submit());
+
+	ns = run_ring(0);
+	if (ns < 0) {
+		printf("io_setup2 not supported\n");
+		goto out;
+	}
+	printf("io_ring_enter: %8.0f ns/io\n", ns);
+
+	ns = run_ring(1);
+	if (ns < 0)
+		printf("sq polling:    skipped (needs CAP_SYS_ADMIN)\n");
+	else
+		printf("sq polling:    %8.0f ns/io\n", ns);
+out:
+	close(fd);
+	if (argc < 2)
+		unlink(path);
+	return 0;
+}
@@ -0,0 +1,337 @@
+/*
+ * TCP MSG_ZEROCOPY throughput and CPU benchmark
+ *
+ * Receiver:	msg_zerocopy -r [-p port] [-l secs]
+ * Sender:	msg_zerocopy -t -D addr [-z] [-s size] [-p port] [-l secs]
+ *
+ * The sender writes <size> byte buffers with send(), with -z passing
+ * MSG_ZEROCOPY on a socket with SO_ZEROCOPY enabled. Completions are read
+ * from the error queue as they arrive and all of them are waited for
+ * before exiting. At the end the sender reports its throughput and the
+ * CPU time it used per GB, and how many completions reported that the
+ * kernel fell back to copying.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+static bool cfg_rx;
+static bool cfg_tx;
+static bool cfg_zerocopy;
+static int cfg_port = 8000;
+static int cfg_runtime_s = 4;
+static int cfg_size = 64 * 1024;
+static const char *cfg_daddr;
+
+static char *buf;
+
+static uint32_t next_completion;
+static unsigned long completions;
+static unsigned long completions_copied;
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static unsigned long tv_to_ms(const struct timeval *tv)
+{
+	return (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+}
+
+static void setup_sockaddr(struct sockaddr_in *addr, const char *str)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(cfg_port);
+	if (str && inet_pton(AF_INET, str, &addr->sin_addr) != 1)
+		error(1, 0, "bad address: %s", str);
+}
+
+static void do_rx(void)
+{
+	unsigned long tnow, treport, tstop, bytes = 0, total = 0;
+	struct sockaddr_in addr;
+	int fd, cfd, val, ret;
+
+	fd = socket(PF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	val = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)))
+		error(1, errno, "setsockopt reuseaddr");
+
+	setup_sockaddr(&addr, NULL);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+	if (listen(fd, 1))
+		error(1, errno, "listen");
+
+	cfd = accept(fd, NULL, NULL);
+	if (cfd == -1)
+		error(1, errno, "accept");
+
+	treport = gettimeofday_ms() + 1000;
+	tstop = gettimeofday_ms() + cfg_runtime_s * 1000;
+	do {
+		ret = recv(cfd, buf, cfg_size, 0);
+		if (ret == -1)
+			error(1, errno, "recv");
+		if (ret == 0)
+			break;
+		bytes += ret;
+		total += ret;
+
+		tnow = gettimeofday_ms();
+		if (tnow > treport) {
+			fprintf(stderr, "tcp rx: %6lu MB/s\n", bytes >> 20);
+			bytes = 0;
+			treport = tnow + 1000;
+		}
+	} while (tnow < tstop);
+
+	if (close(cfd) || close(fd))
+		error(1, errno, "close");
+
+	if (!total)
+		error(1, 0, "no data received");
+}
+
+/* returns false if the error queue is empty */
+static bool do_recv_completion(int fd)
+{
+	char control[128];
+	struct sock_extended_err *serr;
+	struct msghdr msg = {0};
+	struct cmsghdr *cmsg;
+	uint32_t hi, lo;
+
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+		if (errno == EAGAIN)
+			return false;
+		error(1, errno, "recvmsg errqueue");
+	}
+	if (msg.msg_flags & MSG_CTRUNC)
+		error(1, 0, "recvmsg errqueue: truncated");
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg)
+		error(1, 0, "recvmsg errqueue: no cmsg");
+
+	serr = (void *)CMSG_DATA(cmsg);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		error(1, 0, "unexpected error origin %u", serr->ee_origin);
+	if (serr->ee_errno != 0)
+		error(1, 0, "completion with error %u", serr->ee_errno);
+
+	lo = serr->ee_info;
+	hi = serr->ee_data;
+	if (lo != next_completion)
+		error(1, 0, "completion out of order: %u, expected %u",
+		      lo, next_completion);
+
+	completions += hi - lo + 1;
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		completions_copied += hi - lo + 1;
+	next_completion = hi + 1;
+	return true;
+}
+
+static void do_recv_completions(int fd)
+{
+	while (do_recv_completion(fd))
+		;
+}
+
+/* wait for the notifications of all sends, up to two seconds */
+static void do_recv_remaining_completions(int fd, uint32_t num_sends)
+{
+	unsigned long tstop = gettimeofday_ms() + 2000;
+	struct pollfd pfd = { .fd = fd, .events = 0 };
+
+	while (next_completion != num_sends && gettimeofday_ms() < tstop) {
+		if (poll(&pfd, 1, 100) == -1)
+			error(1, errno, "poll");
+		if (pfd.revents & POLLERR)
+			do_recv_completions(fd);
+	}
+
+	if (next_completion != num_sends)
+		error(1, 0, "missing completions: %u of %u",
+		      next_completion, num_sends);
+}
+
+static void do_tx(void)
+{
+	unsigned long bytes = 0, total_bytes = 0, num_sends = 0;
+	unsigned long tnow, tstart, treport, tstop, cpu_ms;
+	struct sockaddr_in addr;
+	struct rusage ru;
+	int fd, val, ret;
+
+	fd = socket(PF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	if (cfg_zerocopy) {
+		val = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)))
+			error(1, errno, "setsockopt SO_ZEROCOPY");
+	}
+
+	setup_sockaddr(&addr, cfg_daddr);
+	if (connect(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+
+	tstart = gettimeofday_ms();
+	tnow = tstart;
+	treport = tstart + 1000;
+	tstop = tstart + cfg_runtime_s * 1000;
+	do {
+		ret = send(fd, buf, cfg_size,
+			   cfg_zerocopy ? MSG_ZEROCOPY : 0);
+		if (ret == -1 && errno == ENOBUFS && cfg_zerocopy) {
+			/* pinned page limit reached: reap and retry */
+			do_recv_completions(fd);
+			tnow = gettimeofday_ms();
+			continue;
+		}
+		if (ret == -1)
+			error(1, errno, "send");
+		bytes += ret;
+		total_bytes += ret;
+		num_sends++;
+
+		if (cfg_zerocopy)
+			do_recv_completions(fd);
+
+		tnow = gettimeofday_ms();
+		if (tnow > treport) {
+			fprintf(stderr, "tcp tx: %6lu MB/s %8lu calls/s\n",
+				bytes >> 20, num_sends);
+			bytes = 0;
+			treport = tnow + 1000;
+		}
+	} while (tnow < tstop);
+
+	if (cfg_zerocopy)
+		do_recv_remaining_completions(fd, num_sends);
+
+	if (getrusage(RUSAGE_SELF, &ru))
+		error(1, errno, "getrusage");
+	cpu_ms = tv_to_ms(&ru.ru_utime) + tv_to_ms(&ru.ru_stime);
+
+	fprintf(stderr, "tcp tx: %lu MB in %lu ms, cpu usr %lu ms sys %lu ms, %lu cpu ms/GB\n",
+		total_bytes >> 20, tnow - tstart,
+		tv_to_ms(&ru.ru_utime), tv_to_ms(&ru.ru_stime),
+		total_bytes >> 30 ? cpu_ms / (total_bytes >> 30) : cpu_ms);
+	if (cfg_zerocopy)
+		fprintf(stderr, "tcp tx: %lu completions, %lu copied\n",
+			completions, completions_copied);
+
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s (-r | -t -D addr [-z] [-s size]) [-l secs] [-p port]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "D:l:p:rs:tz")) != -1) {
+		switch (c) {
+		case 'D':
+			cfg_daddr = optarg;
+			break;
+		case 'l':
+			cfg_runtime_s = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			cfg_rx = true;
+			break;
+		case 's':
+			cfg_size = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			cfg_tx = true;
+			break;
+		case 'z':
+			cfg_zerocopy = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_rx == cfg_tx || (cfg_tx && !cfg_daddr))
+		usage(argv[0]);
+	if (cfg_size <= 0)
+		error(1, 0, "size must be positive");
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	buf = malloc(cfg_size);
+	if (!buf)
+		error(1, errno, "malloc");
+	memset(buf, 'a', cfg_size);
+
+	if (cfg_rx)
+		do_rx();
+	else
+		do_tx();
+
+	return 0;
+}
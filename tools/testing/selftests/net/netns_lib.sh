@@ -0,0 +1,96 @@
+# Helpers shared by the net benchmark scripts: network namespaces that are
+# deleted again on exit, veth pairs between them, and the pass/fail report.
+# Source it after setting NAME to the name of the benchmark.
+
+VETH_TX_ADDR=192.168.1.1
+VETH_RX_ADDR=192.168.1.2
+NETNS=
+ret=0
+
+# skip <reason>: a benchmark that could not run does not count as a pass
+skip()
+{
+	echo "$NAME: $1 [SKIP]"
+	exit 1
+}
+
+require_root()
+{
+	[ $(id -u) = 0 ] || skip "must be run as root"
+}
+
+netns_cleanup()
+{
+	for ns in $NETNS; do
+		ip netns del $ns 2>/dev/null
+	done
+}
+
+# netns_setup <netns>...: create the namespaces, deleted again on exit
+netns_setup()
+{
+	NETNS="$*"
+	trap netns_cleanup EXIT
+	netns_cleanup
+	for ns in $NETNS; do
+		ip netns add $ns || return 1
+	done
+}
+
+# veth_setup <netns> <dev> <peer netns> <peer dev> [<addr> [<peer addr>]]:
+# connect the namespaces with a veth pair, give the ends a /24 address
+# when one is set and bring them up
+veth_setup()
+{
+	ip link add $2 netns $1 type veth peer name $4 netns $3 || return 1
+	if [ -n "$5" ]; then
+		ip -netns $1 addr add $5/24 dev $2 || return 1
+	fi
+	if [ -n "$6" ]; then
+		ip -netns $3 addr add $6/24 dev $4 || return 1
+	fi
+	ip -netns $1 link set $2 up && ip -netns $3 link set $4 up
+}
+
+# veth_pair <tx netns> <rx netns>: VETH_TX_ADDR on veth_tx in the first
+# namespace, connected to VETH_RX_ADDR on veth_rx in the second
+veth_pair()
+{
+	netns_setup $1 $2 &&
+	veth_setup $1 veth_tx $2 veth_rx $VETH_TX_ADDR $VETH_RX_ADDR
+}
+
+# in_netns <netns> <cmd>...: run cmd in netns, or here if netns is empty
+in_netns()
+{
+	ns=$1
+	shift
+	if [ -n "$ns" ]; then
+		ip netns exec $ns "$@"
+	else
+		"$@"
+	fi
+}
+
+# run_bench <label> <rx netns> <tx netns> <rx args> <tx args>: run $BENCH
+# as receiver and sender; the run fails unless both exit 0, which the
+# receiver only does if it got data
+run_bench()
+{
+	echo "--- $1"
+	in_netns "$2" $BENCH -r $4 &
+	rx_pid=$!
+	sleep 0.2
+	in_netns "$3" $BENCH -t $5 || ret=1
+	wait $rx_pid || ret=1
+}
+
+report()
+{
+	if [ $ret -ne 0 ]; then
+		echo "$NAME: [FAIL]"
+		exit 1
+	fi
+	echo "$NAME: [PASS]"
+	exit 0
+}
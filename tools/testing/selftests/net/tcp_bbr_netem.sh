@@ -0,0 +1,67 @@
+#!/bin/sh
+# Compares TCP throughput and RTT of cubic and bbr between two network
+# namespaces bridged through a third one, where netem emulates a cellular
+# bottleneck (rate limit, 40ms delay with jitter, random loss, deep buffer).
+# The sender uses fq as its root qdisc, which BBR relies on for pacing.
+# Both flows must complete and reach the receiver at a nonzero rate.
+
+NAME=tcp_bbr_netem
+. $(dirname $0)/netns_lib.sh
+
+require_root
+
+if ! which iperf3 > /dev/null 2>&1; then
+	skip "iperf3 not found"
+fi
+
+NS_TX=bbr-tx
+NS_RX=bbr-rx
+NS_LINK=bbr-link
+
+# run_one <congestion control>: one 10s flow from NS_TX to NS_RX
+run_one()
+{
+	if ! ip netns exec $NS_TX sysctl -q -w \
+			net.ipv4.tcp_congestion_control=$1 2>/dev/null; then
+		echo "--- $1: not available"
+		ret=1
+		return
+	fi
+	echo "--- $1"
+	ip netns exec $NS_RX iperf3 -s -1 -D
+	sleep 0.5
+	out=$(ip netns exec $NS_TX iperf3 -c $VETH_RX_ADDR -t 10 -C $1) ||
+		ret=1
+	echo "$out" | grep -E "sender|receiver"
+	case "$(echo "$out" | grep receiver)" in
+	""|*" 0.00 bits/sec"*)
+		echo "--- $1: no data received"
+		ret=1
+		;;
+	esac
+	ip netns exec $NS_TX ss -ti dst $VETH_RX_ADDR | grep -o "rtt:[^ ]*"
+}
+
+if ! netns_setup $NS_TX $NS_RX $NS_LINK ||
+   ! veth_setup $NS_TX veth_tx $NS_LINK veth_l0 $VETH_TX_ADDR ||
+   ! veth_setup $NS_RX veth_rx $NS_LINK veth_l1 $VETH_RX_ADDR; then
+	skip "cannot set up veth pairs"
+fi
+
+ip -netns $NS_LINK link add br0 type bridge
+ip -netns $NS_LINK link set veth_l0 master br0
+ip -netns $NS_LINK link set veth_l1 master br0
+ip -netns $NS_LINK link set br0 up
+
+# sender paces with fq; the link namespace emulates the cellular bottleneck
+ip netns exec $NS_TX tc qdisc add dev veth_tx root fq || ret=1
+if ! ip netns exec $NS_LINK tc qdisc add dev veth_l1 root netem \
+		rate 20mbit delay 40ms 10ms distribution normal \
+		loss 0.5% limit 2000; then
+	skip "netem not available"
+fi
+
+run_one cubic
+run_one bbr
+
+report
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Runs the lib/test_bpf.c corpus once with the interpreter and once with
+# the JIT, and compares the average run time of every test case.
+
+if [ $(id -u) != 0 ]; then
+	echo "test_bpf: must be run as root" >&2
+	exit 1
+fi
+
+JIT=/proc/sys/net/core/bpf_jit_enable
+if [ ! -w $JIT ]; then
+	echo "test_bpf: no BPF JIT on this kernel, skipping comparison"
+	/sbin/modprobe test_bpf && /sbin/rmmod test_bpf
+	exit $?
+fi
+
+old_jit=$(cat $JIT)
+tmp=$(mktemp -d)
+trap 'echo $old_jit > $JIT; rm -rf $tmp' EXIT
+
+# new_log <lines>: the kernel log after its first <lines> lines
+new_log()
+{
+	dmesg | tail -n +$(($1 + 1))
+}
+
+# run_corpus <jit_enable> <output>: load test_bpf and keep its log lines
+run_corpus()
+{
+	echo $1 > $JIT
+	log_lines=$(dmesg | wc -l)
+	if ! /sbin/modprobe test_bpf; then
+		new_log $log_lines | grep test_bpf: | grep -v PASS
+		echo "test_bpf: [FAIL] with bpf_jit_enable=$1"
+		exit 1
+	fi
+	/sbin/rmmod test_bpf
+	# "#<n> <descr> jited:<0|1> <ns> [<ns> ...] PASS" -> "<n> <jited> <ns>"
+	new_log $log_lines | sed -n 's/.*test_bpf: #\([0-9]*\) .* jited:\([01]\) \(.*\) PASS$/\1 \2 \3/p' |
+	awk '{ sum = 0; for (i = 3; i <= NF; i++) sum += $i;
+	       print $1, $2, sum / (NF - 2) }' | sort -k1,1 > $2
+	new_log $log_lines | grep "test_bpf: Summary"
+}
+
+echo "--------------------"
+echo "running test_bpf with the interpreter"
+echo "--------------------"
+run_corpus 0 $tmp/interp
+
+echo "--------------------"
+echo "running test_bpf with the JIT"
+echo "--------------------"
+run_corpus 1 $tmp/jit
+
+# join on the test number; only tests the JIT compiled are compared
+join $tmp/interp $tmp/jit | awk '
+	$4 == 1 && $5 > 0 {
+		n++; ti += $3; tj += $5
+		printf "#%-4d interp %8.0f ns  jit %8.0f ns  speedup %5.2fx\n",
+		       $1, $3, $5, $3 / $5
+	}
+	END {
+		if (!n) {
+			print "test_bpf: no test was JIT compiled"
+			exit 1
+		}
+		printf "test_bpf: %d JIT compiled tests, interp %.0f ns, jit %.0f ns, speedup %.2fx\n",
+		       n, ti, tj, ti / tj
+	}'
+if [ $? -ne 0 ]; then
+	echo "[FAIL]"
+	exit 1
+fi
+echo "[PASS]"
@@ -0,0 +1,312 @@
+/*
+ * UDP GSO/GRO throughput benchmark
+ *
+ * Receiver:	udpgso_bench -r [-G] [-p port] [-l secs]
+ * Sender:	udpgso_bench -t -D addr [-S] [-s size] [-p port] [-l secs]
+ *
+ * The sender writes datagrams of <size> bytes, either one per sendmsg()
+ * or, with -S, up to UDP_MAX_SEGMENTS of them per sendmsg() using the
+ * UDP_SEGMENT cmsg. The receiver counts datagrams and bytes; with -G it
+ * enables UDP_GRO and receives coalesced trains of datagrams at once.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <error.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#define UDP_MAX_SEGMENTS	64
+#define ETH_MAX_MTU		0xFFFFU
+
+static bool cfg_rx;
+static bool cfg_tx;
+static bool cfg_gro;
+static bool cfg_segment;
+static int cfg_port = 8000;
+static int cfg_runtime_s = 4;
+static int cfg_size = 1472;
+static const char *cfg_daddr;
+
+static char buf[ETH_MAX_MTU];
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static void setup_sockaddr(struct sockaddr_in *addr, const char *str)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(cfg_port);
+	if (str && inet_pton(AF_INET, str, &addr->sin_addr) != 1)
+		error(1, 0, "bad address: %s", str);
+}
+
+/* returns the number of datagrams in the received skb */
+static int do_recv(int fd, int *bytes)
+{
+	char control[CMSG_SPACE(sizeof(int))] = {0};
+	struct msghdr msg = {0};
+	struct iovec iov = {0};
+	struct cmsghdr *cmsg;
+	int gso_size = 0;
+	int ret;
+
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (ret == -1) {
+		if (errno == EAGAIN)
+			return 0;
+		error(1, errno, "recvmsg");
+	}
+	if (msg.msg_flags & MSG_TRUNC)
+		error(1, 0, "recvmsg: truncated");
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+			gso_size = *(int *)CMSG_DATA(cmsg);
+	}
+
+	*bytes = ret;
+	if (!gso_size)
+		return 1;
+	return (ret + gso_size - 1) / gso_size;
+}
+
+static void do_rx(void)
+{
+	unsigned long tnow, treport, tstop;
+	unsigned long packets = 0, bytes = 0, total = 0;
+	struct sockaddr_in addr;
+	int fd, val, ret, len;
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	val = 1 << 21;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)))
+		error(1, errno, "setsockopt rcvbuf");
+
+	if (cfg_gro) {
+		val = 1;
+		if (setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)))
+			error(1, errno, "setsockopt UDP_GRO");
+	}
+
+	setup_sockaddr(&addr, NULL);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "bind");
+
+	treport = gettimeofday_ms() + 1000;
+	tstop = gettimeofday_ms() + cfg_runtime_s * 1000;
+	do {
+		ret = do_recv(fd, &len);
+		if (ret) {
+			packets += ret;
+			bytes += len;
+			total += len;
+		}
+
+		tnow = gettimeofday_ms();
+		if (tnow > treport) {
+			if (packets)
+				fprintf(stderr,
+					"udp rx: %6lu MB/s %8lu msg/s\n",
+					bytes >> 20, packets);
+			packets = 0;
+			bytes = 0;
+			treport = tnow + 1000;
+		}
+	} while (tnow < tstop);
+
+	if (close(fd))
+		error(1, errno, "close");
+
+	if (!total)
+		error(1, 0, "no data received");
+}
+
+static int send_udp(int fd)
+{
+	int ret;
+
+	ret = send(fd, buf, cfg_size, 0);
+	if (ret == -1)
+		error(1, errno, "send");
+	if (ret != cfg_size)
+		error(1, 0, "send: %d != %d", ret, cfg_size);
+	return 1;
+}
+
+static int send_udp_segment(int fd)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct msghdr msg = {0};
+	struct iovec iov = {0};
+	struct cmsghdr *cmsg;
+	int len, ret;
+
+	/* as many segments as fit into one 64K IP datagram */
+	len = (ETH_MAX_MTU - 28) / cfg_size * cfg_size;
+	if (len > cfg_size * UDP_MAX_SEGMENTS)
+		len = cfg_size * UDP_MAX_SEGMENTS;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*((uint16_t *)CMSG_DATA(cmsg)) = cfg_size;
+
+	ret = sendmsg(fd, &msg, 0);
+	if (ret == -1)
+		error(1, errno, "sendmsg");
+	if (ret != len)
+		error(1, 0, "sendmsg: %d != %d", ret, len);
+	return len / cfg_size;
+}
+
+static void do_tx(void)
+{
+	unsigned long num_msgs = 0, num_sends = 0;
+	unsigned long tnow, treport, tstop;
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	setup_sockaddr(&addr, cfg_daddr);
+	if (connect(fd, (void *)&addr, sizeof(addr)))
+		error(1, errno, "connect");
+
+	memset(buf, 'a', sizeof(buf));
+
+	treport = gettimeofday_ms() + 1000;
+	tstop = gettimeofday_ms() + cfg_runtime_s * 1000;
+	do {
+		if (cfg_segment)
+			num_msgs += send_udp_segment(fd);
+		else
+			num_msgs += send_udp(fd);
+		num_sends++;
+
+		tnow = gettimeofday_ms();
+		if (tnow > treport) {
+			fprintf(stderr,
+				"udp tx: %6lu MB/s %8lu calls/s %6lu msg/s\n",
+				(num_msgs * cfg_size) >> 20, num_sends,
+				num_msgs);
+			num_msgs = 0;
+			num_sends = 0;
+			treport = tnow + 1000;
+		}
+	} while (tnow < tstop);
+
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s (-r [-G] | -t -D addr [-S] [-s size]) [-l secs] [-p port]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "D:Gl:p:rSs:t")) != -1) {
+		switch (c) {
+		case 'D':
+			cfg_daddr = optarg;
+			break;
+		case 'G':
+			cfg_gro = true;
+			break;
+		case 'l':
+			cfg_runtime_s = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			cfg_rx = true;
+			break;
+		case 'S':
+			cfg_segment = true;
+			break;
+		case 's':
+			cfg_size = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			cfg_tx = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_rx == cfg_tx || (cfg_tx && !cfg_daddr))
+		usage(argv[0]);
+	if (cfg_size <= 0 || cfg_size > ETH_MAX_MTU - 28)
+		error(1, 0, "size must be in [1, %d]", ETH_MAX_MTU - 28);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_rx)
+		do_rx();
+	else
+		do_tx();
+
+	return 0;
+}
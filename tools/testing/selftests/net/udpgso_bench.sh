@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compares UDP throughput with one datagram per sendmsg() against UDP_SEGMENT
+# (GSO) sends, without and with UDP_GRO on the receiver, over loopback and
+# over a veth pair between two network namespaces. Every run must deliver
+# data to the receiver.
+
+NAME=udpgso_bench
+. $(dirname $0)/netns_lib.sh
+
+require_root
+
+BENCH=./udpgso_bench
+NS_TX=udpgso-tx
+NS_RX=udpgso-rx
+
+# run_all <label> <rx netns> <tx netns> <daddr>
+run_all()
+{
+	run_bench "$1: udp" "$2" "$3" "-l 4" "-l 3 -D $4"
+	run_bench "$1: udp gso" "$2" "$3" "-l 4" "-l 3 -D $4 -S"
+	run_bench "$1: udp gso + gro" "$2" "$3" "-l 4 -G" "-l 3 -D $4 -S"
+}
+
+echo "--------------------"
+echo "udpgso_bench over loopback"
+echo "--------------------"
+run_all "lo" "" "" 127.0.0.1
+
+echo "--------------------"
+echo "udpgso_bench over veth"
+echo "--------------------"
+if veth_pair $NS_TX $NS_RX; then
+	run_all "veth" $NS_RX $NS_TX $VETH_RX_ADDR
+else
+	echo "$NAME: cannot set up veth pair"
+	ret=1
+fi
+
+report
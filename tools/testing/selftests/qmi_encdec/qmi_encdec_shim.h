@@ -0,0 +1,45 @@
+/*
+ * User space definitions for building lib/qmi_encdec.c in the selftest
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#ifndef _QMI_ENCDEC_SHIM_H
+#define _QMI_ENCDEC_SHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define U8_MAX		((u8)~0U)
+#define ETOOSMALL	525
+
+#define GFP_KERNEL	0
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(ptr)		free(ptr)
+
+#define min(x, y)		((x) < (y) ? (x) : (y))
+#define min_t(type, x, y)	((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+
+extern int qmi_encdec_verbose;
+
+#define pr_err(fmt, ...) do { \
+	if (qmi_encdec_verbose) \
+		fprintf(stderr, fmt, ##__VA_ARGS__); \
+} while (0)
+#define pr_debug(fmt, ...) do { } while (0)
+
+#define EXPORT_SYMBOL(sym)
+#define MODULE_DESCRIPTION(desc)	extern int qmi_encdec_shim_unused
+#define MODULE_LICENSE(license)		extern int qmi_encdec_shim_unused
+
+#endif
@@ -0,0 +1,512 @@
+/*
+ * QMI encode/decode plan test
+ *
+ * Usage:	qmi_encdec_test [-s seed] [-d descs] [-m msgs] [-b iters] [-v]
+ *
+ * Random message descriptors are generated with the element layouts QMI
+ * IDL generated code uses: optional TLVs, static and variable length
+ * arrays, strings and nested structures. Each descriptor is compiled into
+ * a plan, and random C structures are encoded and decoded both by the
+ * interpreter and by the plan. The encoded messages and the decoded
+ * structures must be identical, and re-encoding a decoded structure must
+ * give back the same message. Encoding into a buffer one byte too small
+ * must fail with both. Finally the per message cost of both is timed on a
+ * fixed descriptor.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#include <error.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/qmi_encdec.h>
+
+#define MAX_MSG_LEN	65535
+#define MAX_ELEMS	12
+#define MAX_LEVEL	4
+#define POOL_ELEMS	4096
+#define C_STRUCT_SIZE	(256 * 1024)
+
+int qmi_encdec_verbose;
+
+static unsigned int cfg_seed;
+static int cfg_descs = 2000;
+static int cfg_msgs = 50;
+static int cfg_bench_iters = 200000;
+
+static struct elem_info pool[POOL_ELEMS];
+static int pool_used;
+
+static uint8_t c_in[C_STRUCT_SIZE];
+static uint8_t c_out_interp[C_STRUCT_SIZE];
+static uint8_t c_out_plan[C_STRUCT_SIZE];
+static uint8_t msg_interp[MAX_MSG_LEN];
+static uint8_t msg_plan[MAX_MSG_LEN];
+static uint8_t msg_again[MAX_MSG_LEN];
+
+static int descs_compiled;
+static int descs_interpreted;
+static int msgs_checked;
+
+static uint32_t rnd(uint32_t n)
+{
+	return n ? (uint32_t)random() % n : 0;
+}
+
+static uint32_t place(uint32_t *size, uint32_t *max_align, uint32_t len,
+		      uint32_t align)
+{
+	uint32_t offset = (*size + align - 1) & ~(align - 1);
+
+	*size = offset + len;
+	if (align > *max_align)
+		*max_align = align;
+	return offset;
+}
+
+static struct elem_info *pool_copy(struct elem_info *ei, int n)
+{
+	struct elem_info *dst;
+
+	if (pool_used + n > POOL_ELEMS)
+		error(1, 0, "element pool exhausted");
+	dst = &pool[pool_used];
+	memcpy(dst, ei, n * sizeof(*ei));
+	pool_used += n;
+	return dst;
+}
+
+static struct elem_info *gen_struct(int level, uint32_t *struct_size,
+				    uint32_t *struct_align, int flat);
+
+/*
+ * Generate the data element of a TLV or of a nested structure member,
+ * preceded by its array length element for variable length arrays.
+ */
+static int gen_data_elem(struct elem_info *ei, int level, uint8_t tlv_type,
+			 uint32_t *size, uint32_t *max_align, int flat)
+{
+	static const enum elem_type basic_types[] = {
+		QMI_UNSIGNED_1_BYTE, QMI_UNSIGNED_2_BYTE,
+		QMI_UNSIGNED_4_BYTE, QMI_UNSIGNED_8_BYTE,
+		QMI_SIGNED_2_BYTE_ENUM, QMI_SIGNED_4_BYTE_ENUM,
+	};
+	static const uint32_t basic_sizes[] = { 1, 2, 4, 8, 2, 4 };
+	uint32_t kind, nested_size, nested_align, t;
+	int n = 0;
+
+	memset(ei, 0, 2 * sizeof(*ei));
+	kind = rnd(10);
+	if (flat || kind < 6) {
+		t = rnd(6);
+		ei[n].data_type = basic_types[t];
+		ei[n].elem_size = basic_sizes[t];
+	} else if (kind < 8 && level < MAX_LEVEL) {
+		ei[n].data_type = QMI_STRUCT;
+		ei[n].ei_array = gen_struct(level + 1, &nested_size,
+					    &nested_align, rnd(2));
+		ei[n].elem_size = nested_size;
+	} else {
+		ei[n].data_type = QMI_STRING;
+		ei[n].elem_size = 1;
+		ei[n].elem_len = rnd(8) ? 1 + rnd(40) : 256 + rnd(64);
+		ei[n].is_array = NO_ARRAY;
+		ei[n].tlv_type = tlv_type;
+		ei[n].offset = place(size, max_align, ei[n].elem_len + 1, 1);
+		return 1;
+	}
+
+	ei[n].is_array = flat ? rnd(2) : rnd(3);
+	if (ei[n].is_array == NO_ARRAY)
+		ei[n].elem_len = 1;
+	else if (ei[n].data_type == QMI_STRUCT)
+		ei[n].elem_len = 1 + rnd(ei[n].is_array == STATIC_ARRAY ? 3 : 4);
+	else if (ei[n].is_array == STATIC_ARRAY)
+		ei[n].elem_len = 1 + rnd(8);
+	else if (ei[n].elem_size == 1 && !rnd(8))
+		ei[n].elem_len = 256 + rnd(64);
+	else
+		ei[n].elem_len = 1 + rnd(16);
+
+	if (ei[n].is_array == VAR_LEN_ARRAY) {
+		ei[n + 1] = ei[n];
+		ei[n].data_type = QMI_DATA_LEN;
+		ei[n].elem_size = ei[n + 1].elem_len > U8_MAX ?
+				  sizeof(uint16_t) : sizeof(uint8_t);
+		ei[n].elem_len = 1;
+		ei[n].is_array = NO_ARRAY;
+		ei[n].ei_array = NULL;
+		ei[n].tlv_type = tlv_type;
+		ei[n].offset = place(size, max_align, sizeof(uint32_t),
+				     sizeof(uint32_t));
+		n++;
+	}
+
+	if (ei[n].data_type == QMI_STRUCT)
+		t = nested_align;
+	else
+		t = ei[n].elem_size;
+	ei[n].tlv_type = tlv_type;
+	ei[n].offset = place(size, max_align,
+			     ei[n].elem_len * ei[n].elem_size, t);
+	return n + 1;
+}
+
+/*
+ * Generate a nested structure. Flat structures only have basic members
+ * and static arrays, which the plan copies as blocks.
+ */
+static struct elem_info *gen_struct(int level, uint32_t *struct_size,
+				    uint32_t *struct_align, int flat)
+{
+	struct elem_info ei[2 * MAX_ELEMS + 1];
+	uint32_t size = 0, max_align = 1;
+	int i, n = 0, nr_members = 1 + rnd(5);
+
+	for (i = 0; i < nr_members; i++)
+		n += gen_data_elem(&ei[n], level, 0, &size, &max_align, flat);
+
+	memset(&ei[n], 0, sizeof(ei[n]));
+	ei[n].data_type = QMI_EOTI;
+	ei[n].is_array = NO_ARRAY;
+	n++;
+
+	*struct_align = max_align;
+	*struct_size = (size + max_align - 1) & ~(max_align - 1);
+	if (!*struct_size)
+		*struct_size = 1;
+	return pool_copy(ei, n);
+}
+
+static struct elem_info *gen_msg(uint32_t *msg_size)
+{
+	struct elem_info ei[3 * MAX_ELEMS + 1];
+	uint32_t size = 0, max_align = 1;
+	int i, n = 0, nr_mand, nr_opt;
+	uint8_t tlv_type;
+
+	nr_mand = rnd(4);
+	nr_opt = rnd(MAX_ELEMS - nr_mand);
+	for (i = 0; i < nr_mand + nr_opt; i++) {
+		if (i < nr_mand) {
+			tlv_type = 0x01 + i;
+		} else {
+			tlv_type = 0x10 + i - nr_mand;
+			memset(&ei[n], 0, sizeof(ei[n]));
+			ei[n].data_type = QMI_OPT_FLAG;
+			ei[n].elem_len = 1;
+			ei[n].elem_size = sizeof(uint8_t);
+			ei[n].is_array = NO_ARRAY;
+			ei[n].tlv_type = tlv_type;
+			ei[n].offset = place(&size, &max_align, 1, 1);
+			n++;
+		}
+		n += gen_data_elem(&ei[n], 1, tlv_type, &size, &max_align, 0);
+	}
+
+	memset(&ei[n], 0, sizeof(ei[n]));
+	ei[n].data_type = QMI_EOTI;
+	ei[n].is_array = NO_ARRAY;
+	n++;
+
+	*msg_size = size;
+	return pool_copy(ei, n);
+}
+
+static void fill_struct(struct elem_info *ei, uint8_t *base)
+{
+	uint32_t i, count, len;
+
+	for (; ei->data_type != QMI_EOTI; ei++) {
+		uint8_t *p = base + ei->offset;
+
+		switch (ei->data_type) {
+		case QMI_OPT_FLAG:
+			*p = rnd(2);
+			break;
+		case QMI_DATA_LEN:
+			count = rnd(ei[1].elem_len + 1);
+			memcpy(p, &count, sizeof(count));
+			break;
+		case QMI_STRING:
+			len = rnd(ei->elem_len + 1);
+			for (i = 0; i < len; i++)
+				p[i] = 'a' + rnd(26);
+			p[len] = '\0';
+			break;
+		case QMI_STRUCT:
+			count = ei->is_array == NO_ARRAY ? 1 : ei->elem_len;
+			for (i = 0; i < count; i++)
+				fill_struct(ei->ei_array,
+					    p + i * ei->elem_size);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void fill_random(uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = random();
+}
+
+static void check_msg(struct msg_desc *interp, struct msg_desc *plan,
+		      uint32_t c_size, int desc_nr, int msg_nr)
+{
+	int len_interp, len_plan, len_again, rc_interp, rc_plan;
+
+	fill_random(c_in, c_size);
+	fill_struct(interp->ei_array, c_in);
+
+	len_interp = qmi_kernel_encode(interp, msg_interp, MAX_MSG_LEN, c_in);
+	len_plan = qmi_kernel_encode(plan, msg_plan, MAX_MSG_LEN, c_in);
+	if (len_interp < 0)
+		error(1, 0, "desc %d msg %d: interpreter encode failed %d",
+		      desc_nr, msg_nr, len_interp);
+	if (len_plan != len_interp ||
+	    memcmp(msg_interp, msg_plan, len_interp))
+		error(1, 0, "desc %d msg %d: encode mismatch, len %d != %d",
+		      desc_nr, msg_nr, len_plan, len_interp);
+
+	memset(c_out_interp, 0, c_size);
+	memset(c_out_plan, 0, c_size);
+	rc_interp = len_interp ? qmi_kernel_decode(interp, c_out_interp,
+						   msg_interp, len_interp) : 0;
+	rc_plan = len_interp ? qmi_kernel_decode(plan, c_out_plan,
+						 msg_interp, len_interp) : 0;
+	if (rc_interp || rc_plan)
+		error(1, 0, "desc %d msg %d: decode failed %d %d",
+		      desc_nr, msg_nr, rc_interp, rc_plan);
+	if (memcmp(c_out_interp, c_out_plan, c_size))
+		error(1, 0, "desc %d msg %d: decode mismatch",
+		      desc_nr, msg_nr);
+
+	len_again = qmi_kernel_encode(plan, msg_again, MAX_MSG_LEN,
+				      c_out_plan);
+	if (len_again != len_interp ||
+	    memcmp(msg_again, msg_interp, len_interp))
+		error(1, 0, "desc %d msg %d: round trip mismatch",
+		      desc_nr, msg_nr);
+
+	if (len_interp) {
+		rc_interp = qmi_kernel_encode(interp, msg_interp,
+					      len_interp - 1, c_in);
+		rc_plan = qmi_kernel_encode(plan, msg_plan,
+					    len_interp - 1, c_in);
+		if (rc_interp >= 0 || rc_plan >= 0)
+			error(1, 0, "desc %d msg %d: short buffer accepted %d %d",
+			      desc_nr, msg_nr, rc_interp, rc_plan);
+	}
+	msgs_checked++;
+}
+
+static void run_random(void)
+{
+	struct msg_desc interp, plan;
+	uint32_t c_size;
+	int i, j, rc;
+
+	for (i = 0; i < cfg_descs; i++) {
+		pool_used = 0;
+		memset(&interp, 0, sizeof(interp));
+		interp.msg_id = i;
+		interp.max_msg_len = MAX_MSG_LEN;
+		interp.ei_array = gen_msg(&c_size);
+		if (c_size > C_STRUCT_SIZE)
+			error(1, 0, "desc %d: C structure too large", i);
+
+		plan = interp;
+		rc = qmi_kernel_compile_desc(&plan);
+		if (rc == -EOPNOTSUPP) {
+			descs_interpreted++;
+			continue;
+		}
+		if (rc)
+			error(1, 0, "desc %d: compile failed %d", i, rc);
+		descs_compiled++;
+
+		for (j = 0; j < cfg_msgs; j++)
+			check_msg(&interp, &plan, c_size, i, j);
+		qmi_kernel_free_desc_plan(&plan);
+	}
+}
+
+/* A response with a result code and a few optional arrays of structures */
+struct bench_rule {
+	uint32_t id;
+	uint8_t ip_type;
+	uint16_t port;
+	uint32_t addr[4];
+};
+
+struct bench_resp {
+	struct {
+		uint16_t result;
+		uint16_t error;
+	} resp;
+	uint8_t rules_valid;
+	uint32_t rules_len;
+	struct bench_rule rules[16];
+	uint8_t ids_valid;
+	uint32_t ids_len;
+	uint32_t ids[32];
+	uint8_t name_valid;
+	char name[33];
+};
+
+static struct elem_info bench_resp_type_ei[] = {
+	{ QMI_SIGNED_2_BYTE_ENUM, 1, 2, NO_ARRAY, 0, 0, NULL },
+	{ QMI_SIGNED_2_BYTE_ENUM, 1, 2, NO_ARRAY, 0, 2, NULL },
+	{ QMI_EOTI, 0, 0, NO_ARRAY, 0, 0, NULL },
+};
+
+static struct elem_info bench_rule_ei[] = {
+	{ QMI_UNSIGNED_4_BYTE, 1, 4, NO_ARRAY, 0,
+	  offsetof(struct bench_rule, id), NULL },
+	{ QMI_UNSIGNED_1_BYTE, 1, 1, NO_ARRAY, 0,
+	  offsetof(struct bench_rule, ip_type), NULL },
+	{ QMI_UNSIGNED_2_BYTE, 1, 2, NO_ARRAY, 0,
+	  offsetof(struct bench_rule, port), NULL },
+	{ QMI_UNSIGNED_4_BYTE, 4, 4, STATIC_ARRAY, 0,
+	  offsetof(struct bench_rule, addr), NULL },
+	{ QMI_EOTI, 0, 0, NO_ARRAY, 0, 0, NULL },
+};
+
+static struct elem_info bench_resp_ei[] = {
+	{ QMI_STRUCT, 1, sizeof(((struct bench_resp *)0)->resp), NO_ARRAY,
+	  0x02, offsetof(struct bench_resp, resp), bench_resp_type_ei },
+	{ QMI_OPT_FLAG, 1, 1, NO_ARRAY, 0x10,
+	  offsetof(struct bench_resp, rules_valid), NULL },
+	{ QMI_DATA_LEN, 1, 1, NO_ARRAY, 0x10,
+	  offsetof(struct bench_resp, rules_len), NULL },
+	{ QMI_STRUCT, 16, sizeof(struct bench_rule), VAR_LEN_ARRAY, 0x10,
+	  offsetof(struct bench_resp, rules), bench_rule_ei },
+	{ QMI_OPT_FLAG, 1, 1, NO_ARRAY, 0x11,
+	  offsetof(struct bench_resp, ids_valid), NULL },
+	{ QMI_DATA_LEN, 1, 1, NO_ARRAY, 0x11,
+	  offsetof(struct bench_resp, ids_len), NULL },
+	{ QMI_UNSIGNED_4_BYTE, 32, 4, VAR_LEN_ARRAY, 0x11,
+	  offsetof(struct bench_resp, ids), NULL },
+	{ QMI_OPT_FLAG, 1, 1, NO_ARRAY, 0x12,
+	  offsetof(struct bench_resp, name_valid), NULL },
+	{ QMI_STRING, 32, 1, NO_ARRAY, 0x12,
+	  offsetof(struct bench_resp, name), NULL },
+	{ QMI_EOTI, 0, 0, NO_ARRAY, 0, 0, NULL },
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_one(struct msg_desc *desc, struct bench_resp *in,
+		      const char *name)
+{
+	struct bench_resp out;
+	uint64_t start, enc_ns, dec_ns;
+	int i, len = 0;
+
+	start = now_ns();
+	for (i = 0; i < cfg_bench_iters; i++)
+		len = qmi_kernel_encode(desc, msg_plan, MAX_MSG_LEN, in);
+	enc_ns = now_ns() - start;
+	if (len <= 0)
+		error(1, 0, "bench encode failed %d", len);
+
+	start = now_ns();
+	for (i = 0; i < cfg_bench_iters; i++)
+		if (qmi_kernel_decode(desc, &out, msg_plan, len))
+			error(1, 0, "bench decode failed");
+	dec_ns = now_ns() - start;
+
+	fprintf(stderr, "%-12s %4d bytes: encode %6llu ns/msg, decode %6llu ns/msg\n",
+		name, len,
+		(unsigned long long)(enc_ns / cfg_bench_iters),
+		(unsigned long long)(dec_ns / cfg_bench_iters));
+}
+
+static void run_bench(void)
+{
+	struct msg_desc interp = {
+		.max_msg_len = MAX_MSG_LEN,
+		.ei_array = bench_resp_ei,
+	};
+	struct msg_desc plan = interp;
+	struct bench_resp in;
+	int i;
+
+	if (qmi_kernel_compile_desc(&plan))
+		error(1, 0, "bench descriptor did not compile");
+
+	memset(&in, 0, sizeof(in));
+	in.rules_valid = 1;
+	in.rules_len = 8;
+	for (i = 0; i < 8; i++) {
+		in.rules[i].id = i;
+		in.rules[i].ip_type = i & 1;
+		in.rules[i].port = 1000 + i;
+		in.rules[i].addr[0] = 0x0a000000 + i;
+	}
+	in.ids_valid = 1;
+	in.ids_len = 32;
+	for (i = 0; i < 32; i++)
+		in.ids[i] = i;
+	in.name_valid = 1;
+	strcpy(in.name, "qmi_encdec_test");
+
+	bench_one(&interp, &in, "interpreter");
+	bench_one(&plan, &in, "plan");
+	qmi_kernel_free_desc_plan(&plan);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	cfg_seed = time(NULL);
+	while ((c = getopt(argc, argv, "b:d:m:s:v")) != -1) {
+		switch (c) {
+		case 'b':
+			cfg_bench_iters = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			cfg_descs = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			cfg_msgs = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			cfg_seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			qmi_encdec_verbose = 1;
+			break;
+		default:
+			error(1, 0, "Usage: %s [-s seed] [-d descs] [-m msgs] [-b iters] [-v]",
+			      argv[0]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+	srandom(cfg_seed);
+
+	run_random();
+	fprintf(stderr, "seed %u: %d descriptors compiled, %d interpreted, %d messages checked\n",
+		cfg_seed, descs_compiled, descs_interpreted, msgs_checked);
+
+	if (cfg_bench_iters)
+		run_bench();
+	return 0;
+}